@@ -0,0 +1,217 @@
+/**
+ * Local Alarms
+ *
+ * High level, low level, high water and high temperature alarms used to be
+ * raised by the dashboard once a reading reached it, which could be minutes
+ * after the fact behind the periodic publish and the queued telemetry. Each
+ * probe may now carry its own limits in its [probe] section:
+ *
+ *   high_level = 2800   ; product mm
+ *   low_level = 300     ; product mm
+ *   high_water = 50     ; water mm
+ *   high_temp = 45      ; degrees Celsius
+ *
+ * The bus worker checks them against the raw reading right after the frame
+ * is parsed, before filtering, volumes and change detection. An alarm is
+ * raised after `confirm` consecutive readings past its limit and cleared
+ * after as many readings back inside it by the hysteresis, so a level
+ * hovering at the limit does not toggle it. Each change goes out on
+ * <topic>/alarm through the publisher's priority lane (see publisher.c):
+ *
+ *   {"Address":"83731","Alarm":"HIGH_LEVEL","Severity":"critical",
+ *    "Active":true,"Value":2801.40,"Limit":2800.00,
+ *    "Timestamp":"...","LatencyMs":0.8}
+ *
+ * LatencyMs is the time from the frame's arrival to its hand-over to the
+ * MQTT client. Removing a limit, or disabling the [alarms] section, clears
+ * an alarm that is raised.
+ */
+
+#include "alarm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "config.h"
+#include "main_linux.h"
+
+// [probe] key of each kind's limit
+static const char *const aachRuleKeys[ALARM_KINDS] = {"high_level", "low_level", "high_water", "high_temp"};
+
+void fnAlarmConfigDefaults(AlarmConfig *pstConfig)
+{
+    pstConfig->bEnabled = true;
+    pstConfig->wConfirm = ALARM_CONFIRM;
+    pstConfig->fLevelHysteresis = ALARM_LEVEL_HYSTERESIS;
+    pstConfig->fTempHysteresis = ALARM_TEMP_HYSTERESIS;
+}
+
+static int fnAlarmConfigHandler(void *pvContext, const char *achSection, const char *achName,
+                                const char *achKey, const char *achValue, int wLine)
+{
+    AlarmConfig *pstConfig = (AlarmConfig *)pvContext;
+    (void)achName;
+
+    if (strcmp(achSection, "alarms") != 0 || achKey[0] == '\0')
+    {
+        return 0;
+    }
+
+    if (strcmp(achKey, "enabled") == 0)
+    {
+        pstConfig->bEnabled = fnConfigParseBool(achValue);
+    }
+    else if (strcmp(achKey, "confirm") == 0)
+    {
+        int wValue = atoi(achValue);
+        if (wValue < 1 || wValue > 10)
+        {
+            printf("Config line %d: confirm must be 1 to 10 readings\n", wLine);
+            return -1;
+        }
+        pstConfig->wConfirm = wValue;
+    }
+    else if (strcmp(achKey, "level_hysteresis") == 0 || strcmp(achKey, "temp_hysteresis") == 0)
+    {
+        float fValue = strtof(achValue, NULL);
+        if (fValue < 0)
+        {
+            printf("Config line %d: %s must not be negative\n", wLine, achKey);
+            return -1;
+        }
+        if (achKey[0] == 'l')
+            pstConfig->fLevelHysteresis = fValue;
+        else
+            pstConfig->fTempHysteresis = fValue;
+    }
+    else
+    {
+        printf("Config line %d: unknown alarms key '%s' ignored\n", wLine, achKey);
+    }
+    return 0;
+}
+
+/**
+ * Read the [alarms] section on top of the defaults
+ * @return 0 on success (or missing file), >0 on parse error
+ */
+int fnAlarmLoadConfig(AlarmConfig *pstConfig, const char *achPath)
+{
+    fnAlarmConfigDefaults(pstConfig);
+    int rc = fnConfigParse(achPath, fnAlarmConfigHandler, pstConfig);
+    return (rc == -1) ? 0 : rc;
+}
+
+/**
+ * Take an alarm limit from a [probe] key
+ * @return 0 if the key is an alarm limit, -1 if it is not
+ */
+int fnAlarmParseRule(AlarmRules *pstRules, const char *achKey, const char *achValue)
+{
+    for (int i = 0; i < ALARM_KINDS; i++)
+    {
+        if (strcmp(achKey, aachRuleKeys[i]) == 0)
+        {
+            pstRules->afLimit[i] = strtof(achValue, NULL);
+            pstRules->u8Set |= (uint8_t)(1u << i);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *fnAlarmKindName(AlarmKind eKind)
+{
+    switch (eKind)
+    {
+    case ALARM_HIGH_LEVEL:
+        return "HIGH_LEVEL";
+    case ALARM_LOW_LEVEL:
+        return "LOW_LEVEL";
+    case ALARM_HIGH_WATER:
+        return "HIGH_WATER";
+    default:
+        return "HIGH_TEMP";
+    }
+}
+
+/**
+ * Check one raw reading against a probe's limits, handing every alarm it
+ * raises or clears to fnHandler
+ * @param dbFrameAt When the frame completed (ms, CLOCK_MONOTONIC)
+ */
+void fnAlarmEvaluate(ProbeAlarms *pstAlarms, const AlarmRules *pstRules, const AlarmConfig *pstConfig,
+                     const AtgData *pstData, double dbFrameAt, AlarmHandler fnHandler, void *pvContext)
+{
+    const float afValue[ALARM_KINDS] = {pstData->product, pstData->product, (float)pstData->water,
+                                        pstData->temperature};
+
+    for (int i = 0; i < ALARM_KINDS; i++)
+    {
+        uint8_t u8Bit = (uint8_t)(1u << i);
+        bool bActive = (pstAlarms->u8Active & u8Bit) != 0;
+        bool bSet = pstConfig->bEnabled && (pstRules->u8Set & u8Bit);
+        float fLimit = pstRules->afLimit[i];
+        float fHysteresis = (i == ALARM_HIGH_TEMP) ? pstConfig->fTempHysteresis : pstConfig->fLevelHysteresis;
+        bool bChange;
+
+        if (!bSet)
+        {
+            // A removed limit clears its alarm at once
+            bChange = bActive;
+            fLimit = 0;
+        }
+        else if (i == ALARM_LOW_LEVEL)
+        {
+            bChange = bActive ? (afValue[i] > fLimit + fHysteresis) : (afValue[i] < fLimit);
+        }
+        else
+        {
+            bChange = bActive ? (afValue[i] < fLimit - fHysteresis) : (afValue[i] > fLimit);
+        }
+
+        if (!bChange)
+        {
+            pstAlarms->au8Pending[i] = 0;
+            continue;
+        }
+        if (bSet && ++pstAlarms->au8Pending[i] < pstConfig->wConfirm)
+        {
+            continue;
+        }
+
+        pstAlarms->au8Pending[i] = 0;
+        pstAlarms->u8Active ^= u8Bit;
+
+        AlarmChange stChange;
+        stChange.eKind = (AlarmKind)i;
+        stChange.bActive = !bActive;
+        stChange.fValue = afValue[i];
+        stChange.fLimit = fLimit;
+        stChange.timestamp = pstData->timestamp;
+        stChange.dbFrameAt = dbFrameAt;
+        fnHandler(&stChange, pvContext);
+    }
+}
+
+/**
+ * Format an alarm change as the JSON alarm payload
+ * @param dbLatencyMs Time from the frame's arrival until now
+ * @return Payload length, or -1 if it did not fit
+ */
+int fnAlarmFormat(char *achPayload, size_t szSize, int address, const AlarmChange *pstChange, double dbLatencyMs)
+{
+    time_t seconds = (time_t)(pstChange->timestamp / 1000);
+    struct tm utc;
+    gmtime_r(&seconds, &utc);
+
+    int wLength = snprintf(achPayload, szSize,
+                           "{\"Address\":\"%d\",\"Alarm\":\"%s\",\"Severity\":\"%s\",\"Active\":%s,\"Value\":%.2f,"
+                           "\"Limit\":%.2f,\"Timestamp\":\"%04d-%02d-%02dT%02d:%02d:%02d.%03dZ\",\"LatencyMs\":%.1f}",
+                           address, fnAlarmKindName(pstChange->eKind),
+                           (pstChange->eKind == ALARM_HIGH_LEVEL) ? "critical" : "warning",
+                           pstChange->bActive ? "true" : "false", pstChange->fValue, pstChange->fLimit,
+                           utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec,
+                           (int)(pstChange->timestamp % 1000), dbLatencyMs);
+    return (wLength > 0 && (size_t)wLength < szSize) ? wLength : -1;
+}
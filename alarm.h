@@ -0,0 +1,65 @@
+/**
+ * Local Alarms
+ * Per-probe limits with hysteresis, checked as each frame is parsed
+ */
+
+#ifndef ALARM_H
+#define ALARM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "atg.h"
+
+#define ALARM_PAYLOAD_MAX 256 // Largest formatted alarm
+
+// Same names as the dashboard's alarm types
+typedef enum {
+    ALARM_HIGH_LEVEL = 0,
+    ALARM_LOW_LEVEL,
+    ALARM_HIGH_WATER,
+    ALARM_HIGH_TEMP,
+    ALARM_KINDS
+} AlarmKind;
+
+// Limits of one probe, from its [probe] section
+typedef struct {
+    uint8_t u8Set;              // Bit per AlarmKind that has a limit
+    float afLimit[ALARM_KINDS]; // mm, or degrees Celsius for ALARM_HIGH_TEMP
+} AlarmRules;
+
+typedef struct {
+    bool bEnabled;
+    int wConfirm;           // Consecutive readings before an alarm is raised or cleared
+    float fLevelHysteresis; // mm back inside a product or water limit to clear
+    float fTempHysteresis;  // degrees Celsius back below the temperature limit to clear
+} AlarmConfig;
+
+// Runtime state of one probe
+typedef struct {
+    uint8_t u8Active;                // Bit per raised AlarmKind
+    uint8_t au8Pending[ALARM_KINDS]; // Consecutive readings towards a change
+} ProbeAlarms;
+
+// An alarm raised or cleared by one reading
+typedef struct {
+    AlarmKind eKind;
+    bool bActive;      // Raised, or cleared
+    float fValue;      // Reading that changed it
+    float fLimit;      // Limit in force, 0 if it was removed
+    int64_t timestamp; // Wall clock of the reading (ms since epoch)
+    double dbFrameAt;  // When the frame completed (ms, CLOCK_MONOTONIC)
+} AlarmChange;
+
+// Called with each alarm that is raised or cleared
+typedef void (*AlarmHandler)(const AlarmChange *pstChange, void *pvContext);
+
+void fnAlarmConfigDefaults(AlarmConfig *pstConfig);
+int fnAlarmLoadConfig(AlarmConfig *pstConfig, const char *achPath);
+int fnAlarmParseRule(AlarmRules *pstRules, const char *achKey, const char *achValue);
+void fnAlarmEvaluate(ProbeAlarms *pstAlarms, const AlarmRules *pstRules, const AlarmConfig *pstConfig,
+                     const AtgData *pstData, double dbFrameAt, AlarmHandler fnHandler, void *pvContext);
+const char *fnAlarmKindName(AlarmKind eKind);
+int fnAlarmFormat(char *achPayload, size_t szSize, int address, const AlarmChange *pstChange, double dbLatencyMs);
+
+#endif
@@ -25,37 +25,173 @@ uint8_t fnPacketAtgPacket(uint8_t *au8Buffer, char *achAddress)
     return u8Pointer;
 }
 
+// Longest digit runs accepted per field; anything longer is a corrupt frame
+#define ATG_MAX_ADDRESS_DIGITS 6
+#define ATG_MAX_INTEGER_DIGITS 6 // Keeps the fixed-point value within int32_t
+#define ATG_MAX_FRACTION_DIGITS 3
+
+// Scan position plus the running checksum of every byte consumed so far
+typedef struct {
+    const char *pch;
+    uint32_t u32Sum;
+} AtgScanner;
+
+static bool fnScanChar(AtgScanner *pstScan, char ch)
+{
+    if (*pstScan->pch != ch)
+    {
+        return false;
+    }
+    pstScan->u32Sum += (uint8_t)ch;
+    pstScan->pch++;
+    return true;
+}
+
+// Unsigned decimal of 1..wMaxDigits digits
+static bool fnScanDigits(AtgScanner *pstScan, int wMaxDigits, int32_t *pi32Value, int *pwDigits)
+{
+    int32_t i32Value = 0;
+    int wDigits = 0;
+    while (*pstScan->pch >= '0' && *pstScan->pch <= '9')
+    {
+        if (++wDigits > wMaxDigits)
+        {
+            return false;
+        }
+        pstScan->u32Sum += (uint8_t)*pstScan->pch;
+        i32Value = i32Value * 10 + (*pstScan->pch - '0');
+        pstScan->pch++;
+    }
+    *pi32Value = i32Value;
+    if (pwDigits != NULL)
+        *pwDigits = wDigits;
+    return wDigits > 0;
+}
+
+// Fixed-point decimal "123" or "123.4": value scaled by 10^ATG_MAX_FRACTION_DIGITS
+static bool fnScanFixed(AtgScanner *pstScan, int32_t *pi32Milli)
+{
+    int32_t i32Integer;
+    int32_t i32Fraction = 0;
+    int wDigits = 0;
+
+    if (!fnScanDigits(pstScan, ATG_MAX_INTEGER_DIGITS, &i32Integer, NULL))
+    {
+        return false;
+    }
+    if (fnScanChar(pstScan, '.') && !fnScanDigits(pstScan, ATG_MAX_FRACTION_DIGITS, &i32Fraction, &wDigits))
+    {
+        return false;
+    }
+    for (; wDigits < ATG_MAX_FRACTION_DIGITS; wDigits++)
+    {
+        i32Fraction *= 10;
+    }
+    *pi32Milli = i32Integer * 1000 + i32Fraction;
+    return true;
+}
+
+/**
+ * Parse a probe response in one pass, without sscanf or the C locale:
+ *
+ *   [R:]<address>N<status>=[+|-]<temperature x10>=<product>=<water>=<checksum>[\r][\n]
+ *
+ * e.g. "83731N0=+253=1500.0=12.0=1314". The checksum is taken to be the
+ * sum of the bytes from the address up to and including the last '=',
+ * modulo 65536. That is not yet confirmed against a real probe, so a
+ * mismatch is only flagged in data->checksum_mismatch and the caller
+ * decides whether to reject the frame (see verify_checksum in [bus]).
+ * data is only written when the whole frame is valid.
+ * @return ATG_PARSE_OK, or the AtgParseResult naming the first problem
+ */
 int fnParseAtgResponse(const char *achBuffer, AtgData *data)
 {
-    if (!achBuffer || !data)
-        return 1;
+    if (!achBuffer || !data || achBuffer[0] == '\0')
+        return ATG_PARSE_E_EMPTY;
 
-    const char *start = strstr(achBuffer, "R:");
-    if (start)
-        start += 2;
-    else
-        start = achBuffer;
+    // Some probes echo a "R:" prefix; it is not covered by the checksum
+    AtgScanner stScan;
+    stScan.pch = (achBuffer[0] == 'R' && achBuffer[1] == ':') ? achBuffer + 2 : achBuffer;
+    stScan.u32Sum = 0;
+
+    int32_t i32Address, i32Status, i32Temperature, i32Product, i32Water, i32Checksum;
+    bool bNegative;
+
+    if (!fnScanDigits(&stScan, ATG_MAX_ADDRESS_DIGITS, &i32Address, NULL))
+        return ATG_PARSE_E_ADDRESS;
+    if (!fnScanChar(&stScan, 'N') || !fnScanDigits(&stScan, 4, &i32Status, NULL))
+        return ATG_PARSE_E_STATUS;
+    if (!fnScanChar(&stScan, '='))
+        return ATG_PARSE_E_SEPARATOR;
+
+    bNegative = fnScanChar(&stScan, '-');
+    if (!bNegative)
+        fnScanChar(&stScan, '+');
+    if (!fnScanDigits(&stScan, 5, &i32Temperature, NULL))
+        return ATG_PARSE_E_TEMPERATURE;
+    if (!fnScanChar(&stScan, '='))
+        return ATG_PARSE_E_SEPARATOR;
+
+    if (!fnScanFixed(&stScan, &i32Product))
+        return ATG_PARSE_E_PRODUCT;
+    if (!fnScanChar(&stScan, '='))
+        return ATG_PARSE_E_SEPARATOR;
 
-    char waterStr[16];
-    int tempRaw;
+    if (!fnScanFixed(&stScan, &i32Water))
+        return ATG_PARSE_E_WATER;
+    if (!fnScanChar(&stScan, '='))
+        return ATG_PARSE_E_SEPARATOR;
 
-    int parsed = sscanf(start, "%5dN%d=+%d=%f=%[^=]=%d",
-                        &data->address,
-                        &data->status,
-                        &tempRaw, // store as int first
-                        &data->product,
-                        waterStr,
-                        &data->checksum);
+    // Everything up to here is covered by the checksum
+    uint32_t u32Sum = stScan.u32Sum % 65536u;
+    if (!fnScanDigits(&stScan, 5, &i32Checksum, NULL))
+        return ATG_PARSE_E_CHECKSUM;
+    bool bMismatch = ((uint32_t)i32Checksum != u32Sum);
 
-    if (parsed == 6)
+    fnScanChar(&stScan, '\r');
+    fnScanChar(&stScan, '\n');
+    if (*stScan.pch != '\0')
+        return ATG_PARSE_E_TRAILING;
+
+    data->address = i32Address;
+    data->status = i32Status;
+    data->temperature = (bNegative ? -i32Temperature : i32Temperature) / 10.0f;
+    data->product = i32Product / 1000.0f;
+    data->water = i32Water / 1000; // Whole millimetres, truncated
+    data->checksum = i32Checksum;
+    data->checksum_mismatch = bMismatch;
+    return ATG_PARSE_OK;
+}
+
+const char *fnAtgParseResultName(int wResult)
+{
+    switch (wResult)
     {
-        data->temperature = tempRaw / 10.0f;
-        float waterFloat = strtof(waterStr, NULL);
-        data->water = (int)waterFloat;
-        return 0;
+    case ATG_PARSE_OK:
+        return "ok";
+    case ATG_PARSE_E_EMPTY:
+        return "empty frame";
+    case ATG_PARSE_E_ADDRESS:
+        return "bad address";
+    case ATG_PARSE_E_STATUS:
+        return "bad status";
+    case ATG_PARSE_E_TEMPERATURE:
+        return "bad temperature";
+    case ATG_PARSE_E_PRODUCT:
+        return "bad product level";
+    case ATG_PARSE_E_WATER:
+        return "bad water level";
+    case ATG_PARSE_E_SEPARATOR:
+        return "missing '='";
+    case ATG_PARSE_E_CHECKSUM:
+        return "bad checksum field";
+    case ATG_PARSE_E_MISMATCH:
+        return "checksum mismatch";
+    case ATG_PARSE_E_TRAILING:
+        return "trailing bytes";
+    default:
+        return "unknown error";
     }
-
-    return 1;
 }
 
 uint8_t fnGetLastAddressSent()
@@ -102,6 +238,11 @@ void fnInitAtgData(AtgData *stAtgData)
     stAtgData->product = 0.0f;
     stAtgData->water = 0;
     stAtgData->checksum = 0;
+    stAtgData->checksum_mismatch = false;
+    stAtgData->timestamp = 0;
+    stAtgData->volume = -1.0;
+    stAtgData->ullage = -1.0;
+    stAtgData->std_volume = -1.0;
 }
 
 void fnPrintPacket(const char chLabel, const uint8_t *chPacket, int wLength)
@@ -131,7 +272,13 @@ void fnPrintPacket(const char chLabel, const uint8_t *chPacket, int wLength)
 
 bool fnCheckStopFlag(uint8_t *au8Buffer, uint8_t u8LastIndex)
 {
-    if ((au8Buffer[u8LastIndex - 1] == '\r') || (au8Buffer[u8LastIndex - 2] == '\n'))
+    // Need at least the \r\n pair; never look before the start of the buffer
+    if (u8LastIndex < 2)
+    {
+        return false;
+    }
+
+    if ((au8Buffer[u8LastIndex - 2] == '\r') && (au8Buffer[u8LastIndex - 1] == '\n'))
     {
         return true;
     }
@@ -7,7 +7,9 @@
 // ========================================
 // USER CONFIGURATION
 // ========================================
-// Set the number of ATG devices connected (1 to 10)
+// Number of entries in the compiled-in address list (achAtgAddress in atg.c).
+// The Linux poller only uses this list when no configuration file exists;
+// probes are normally listed in atg_poller.conf (see registry.c).
 #define NUMBER_OF_ATGS 1
 
 // Delay between polling packets in milliseconds
@@ -15,8 +17,24 @@
 
 // Command header for ATG protocol
 #define COMMAND_HEADER "M"
+
 // ========================================
 
+// fnParseAtgResponse results
+typedef enum {
+    ATG_PARSE_OK = 0,
+    ATG_PARSE_E_EMPTY,       // No buffer, or nothing in it
+    ATG_PARSE_E_ADDRESS,     // Missing or over-long address
+    ATG_PARSE_E_STATUS,      // Missing 'N' or status digits
+    ATG_PARSE_E_TEMPERATURE,
+    ATG_PARSE_E_PRODUCT,
+    ATG_PARSE_E_WATER,
+    ATG_PARSE_E_SEPARATOR,   // A field not followed by '='
+    ATG_PARSE_E_CHECKSUM,    // Missing or malformed checksum field
+    ATG_PARSE_E_MISMATCH,    // Checksum does not match the frame
+    ATG_PARSE_E_TRAILING     // Unexpected bytes after the checksum
+} AtgParseResult;
+
 extern char achAtgAddress[NUMBER_OF_ATGS][7];
 
 // Structure to hold the parsed sensor data
@@ -27,6 +45,11 @@ typedef struct {
     float product;     // in mm
     int water;         // in mm
     int checksum;
+    bool checksum_mismatch; // Checksum field did not match; the bus's verify_checksum decides what that costs
+    int64_t timestamp; // Unix time in ms when the response arrived, 0 if not recorded
+    double volume;     // Litres from the tank's dip chart, negative if it has none
+    double ullage;     // Litres of free space below the top of the chart
+    double std_volume; // Volume corrected to 15 C, negative if the probe has no density
 } AtgData;
 
 uint8_t fnPacketAtgPacket(uint8_t *au8Buffer, char *achAddress);
@@ -35,6 +58,7 @@ void fnInitAtgData(AtgData *data);
 void fnPrintPacket(const char chLabel, const uint8_t *chPacket, int wLength);
 bool fnCheckStopFlag(uint8_t *au8Buffer, uint8_t u8LastIndex);
 int fnParseAtgResponse(const char *achBuffer, AtgData *data);
+const char *fnAtgParseResultName(int wResult);
 
 uint8_t fnGetLastAddressSent();
 void fnUpdateLastAddressSentIndex(uint8_t u8Index);
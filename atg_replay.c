@@ -0,0 +1,226 @@
+/**
+ * Serial Trace Replay
+ * Feeds a capture of the [capture] section (layout in trace.c) through the
+ * poller's own framer, parser, filters, volumes, event detection and
+ * publisher, then reports the frame rate and the latency of every stage.
+ * Use it to reproduce field behaviour offline and as the regression
+ * benchmark for changes to the hot path.
+ *
+ * Usage: atg_replay [--fast] [--broker] <trace> [config file]
+ *   --fast    Feed the trace as fast as possible instead of at recorded speed
+ *   --broker  Publish to the [mqtt] broker; without it every message is
+ *             refused as offline, so the publisher still formats it
+ *
+ * Each port in the trace is matched to the [bus] section with the same
+ * port, and its bytes go through that bus's probes; a port with no section
+ * uses the first bus. Polls and responses are replayed as recorded, so the
+ * poll scheduler does not run. Readings are stamped with the wall clock of
+ * the capture, so Timestamps, rollup windows, event windows and quiet hours
+ * come out the same on every replay, --fast or not. Heartbeats and stage
+ * latencies run on the replay's own monotonic clock, which --fast
+ * compresses. The journal is never opened. The pipeline's own output goes to stdout and the report
+ * to stderr:  atg_replay --fast field.atgt atg_poller.conf > /dev/null
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "main_linux.h"
+#include "settings.h"
+#include "bus_linux.h"
+#include "publisher.h"
+#include "journal.h"
+#include "stats.h"
+#include "trace.h"
+#include "mqtt.h"
+
+static AtgBus astBuses[BUS_MAX];
+static TraceReader stReader;
+static TraceRecord stRecord; // 64 KB of data
+static StatsSnapshot stStats;
+
+double getCurrentTimeMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000.0) + (ts.tv_nsec / 1000000.0);
+}
+
+// The capture's wall clock at the record being replayed, not the time of the replay
+int64_t getWallClockMs()
+{
+    return stReader.i64StartMs + (int64_t)stReader.dbAtMs;
+}
+
+// Print count and percentiles of every stage that recorded anything
+static void fnPrintStages(const StatsSnapshot *pstStats)
+{
+    fprintf(stderr, "  %-10s %9s %9s %9s %9s %9s\n", "Stage", "Count", "Mean us", "P50 us", "P90 us", "P99 us");
+    for (int s = 0; s < STAT_STAGES; s++)
+    {
+        uint64_t u64Count = 0;
+        for (int i = 0; i < STATS_BUCKETS; i++)
+            u64Count += pstStats->aau64Buckets[s][i];
+        if (u64Count == 0)
+            continue;
+        fprintf(stderr, "  %-10s %9llu %9.1f %9.0f %9.0f %9.0f\n", fnStatsStageName((StatStage)s),
+                (unsigned long long)u64Count, (double)pstStats->au64SumUs[s] / u64Count,
+                fnStatsPercentileUs(pstStats->aau64Buckets[s], u64Count, 0.50),
+                fnStatsPercentileUs(pstStats->aau64Buckets[s], u64Count, 0.90),
+                fnStatsPercentileUs(pstStats->aau64Buckets[s], u64Count, 0.99));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    bool bFast = false;
+    bool bBroker = false;
+    int wArg = 1;
+
+    for (; wArg < argc && argv[wArg][0] == '-'; wArg++)
+    {
+        if (strcmp(argv[wArg], "--fast") == 0)
+            bFast = true;
+        else if (strcmp(argv[wArg], "--broker") == 0)
+            bBroker = true;
+        else
+            break;
+    }
+    if (wArg >= argc || wArg + 2 < argc)
+    {
+        printf("Usage: %s [--fast] [--broker] <trace> [config file]\n", argv[0]);
+        return 2;
+    }
+    const char *achTrace = argv[wArg];
+    const char *configPath = (wArg + 1 < argc) ? argv[wArg + 1] : ATG_CONFIG_FILE;
+
+    if (fnTraceReaderOpen(&stReader, achTrace) != 0)
+    {
+        return 1;
+    }
+
+    Settings *pstSettings = fnSettingsLoad(configPath, true);
+    if (pstSettings == NULL)
+    {
+        fnTraceReaderClose(&stReader);
+        return 1;
+    }
+    fnSettingsPublish(pstSettings);
+
+    BusConfig astBusConfig[BUS_MAX];
+    PublisherConfig stPublisherConfig;
+    JournalConfig stJournalConfig;
+    int wBuses = fnBusLoadConfig(astBusConfig, BUS_MAX, configPath);
+    if (wBuses < 0 || fnMqttLoadConfig(configPath) != 0 ||
+        fnPublisherLoadConfig(&stPublisherConfig, configPath) != 0 ||
+        fnJournalLoadConfig(&stJournalConfig, configPath) != 0)
+    {
+        printf("ERROR: Invalid configuration in %s\n", configPath);
+        fnSettingsFree(pstSettings);
+        fnTraceReaderClose(&stReader);
+        return 1;
+    }
+    stJournalConfig.bEnabled = false;
+
+    if (bBroker && fnMqttInit("ATGReplay") != 0)
+    {
+        printf("Warning: MQTT broker not reachable, messages will be refused\n");
+    }
+    int rc = fnPublisherInit(wBuses, PUBLISH_QUEUE_DEPTH, &stPublisherConfig, &stJournalConfig);
+    if (rc == 0)
+    {
+        rc = fnPublisherStart();
+    }
+
+    // The buses keep their names and probes but open no port
+    int wBusCount = 0;
+    for (int b = 0; b < wBuses && rc == 0; b++)
+    {
+        BusConfig stReplayConfig = astBusConfig[b];
+        stReplayConfig.achPort[0] = '\0';
+        rc = fnBusInit(&astBuses[b], b, &stReplayConfig, pstSettings, b == 0);
+        wBusCount = b + 1;
+    }
+
+    int awChannelBus[256];
+    for (int i = 0; i < 256; i++)
+        awChannelBus[i] = 0;
+
+    uint32_t u32Records = 0;
+    uint64_t u64RxBytes = 0;
+    double dbStart = getCurrentTimeMs();
+    double dbSpanMs = 0;
+
+    while (rc == 0 && fnTraceReaderNext(&stReader, &stRecord))
+    {
+        if (!bFast)
+        {
+            double dbWaitMs = dbStart + stRecord.dbAtMs - getCurrentTimeMs();
+            if (dbWaitMs > 0)
+                usleep((useconds_t)(dbWaitMs * 1000.0));
+        }
+        AtgBus *pstBus = &astBuses[awChannelBus[stRecord.u8Channel]];
+        double dbNow = getCurrentTimeMs();
+
+        if (stRecord.eKind == TRACE_OPEN)
+        {
+            for (int b = 0; b < wBusCount; b++)
+            {
+                if (strlen(astBusConfig[b].achPort) == stRecord.u16Length &&
+                    memcmp(astBusConfig[b].achPort, stRecord.au8Data, stRecord.u16Length) == 0)
+                {
+                    awChannelBus[stRecord.u8Channel] = b;
+                }
+            }
+            printf("Port %.*s replays on bus %s\n", stRecord.u16Length, (const char *)stRecord.au8Data,
+                   astBusConfig[awChannelBus[stRecord.u8Channel]].achName);
+        }
+        else if (stRecord.eKind == TRACE_TX)
+        {
+            fnBusReplayPoll(pstBus, dbNow);
+        }
+        else if (stRecord.eKind == TRACE_RX)
+        {
+            fnBusReplayReceive(pstBus, stRecord.au8Data, stRecord.u16Length, dbNow);
+            u64RxBytes += stRecord.u16Length;
+        }
+        u32Records++;
+        dbSpanMs = stRecord.dbAtMs;
+    }
+    double dbFedMs = getCurrentTimeMs() - dbStart;
+
+    // Everything queued is published (or refused) before the clock stops
+    fnPublisherStop();
+    double dbElapsedMs = getCurrentTimeMs() - dbStart;
+    fnMqttCleanup();
+    fnPublisherFree();
+
+    fnStatsCollect(&stStats);
+    time_t captured = (time_t)(stReader.i64StartMs / 1000);
+    struct tm local;
+    localtime_r(&captured, &local);
+    uint64_t u64Frames = stStats.au64Counters[STAT_FRAMES];
+
+    fprintf(stderr, "\nReplayed %s, captured %04d-%02d-%02d %02d:%02d:%02d, %.1f s of traffic\n", achTrace,
+            local.tm_year + 1900, local.tm_mon + 1, local.tm_mday, local.tm_hour, local.tm_min, local.tm_sec,
+            dbSpanMs / 1000.0);
+    fprintf(stderr, "  %u record(s), %llu byte(s) received, %llu poll(s)\n", u32Records,
+            (unsigned long long)u64RxBytes, (unsigned long long)stStats.au64Counters[STAT_POLLS]);
+    fprintf(stderr, "  %llu frame(s), %llu rejected; %llu reading(s) queued, %llu deferred (queue full)\n",
+            (unsigned long long)u64Frames, (unsigned long long)stStats.au64Counters[STAT_REJECTED],
+            (unsigned long long)stStats.au64Counters[STAT_QUEUED],
+            (unsigned long long)stStats.au64Counters[STAT_QUEUE_FULL]);
+    fprintf(stderr, "  %s: fed in %.1f ms, published in %.1f ms, %.0f frames/s\n", bFast ? "fast" : "recorded speed",
+            dbFedMs, dbElapsedMs, (dbElapsedMs > 0) ? u64Frames * 1000.0 / dbElapsedMs : 0.0);
+    fnPrintStages(&stStats);
+
+    for (int b = 0; b < wBusCount; b++)
+    {
+        fnBusFree(&astBuses[b]);
+    }
+    fnSettingsFree(pstSettings);
+    fnTraceReaderClose(&stReader);
+    return rc == 0 ? 0 : 1;
+}
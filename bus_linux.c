@@ -0,0 +1,819 @@
+/**
+ * ATG Bus Worker - Linux
+ *
+ * Each serial port gets its own thread running the response-driven poll
+ * loop: an epoll set over the port, a one-shot poll timer and stop and
+ * reload eventfds. Probes are split between buses by their "bus" key, so a
+ * slow or dead segment never delays the others. Readings leave the worker
+ * through the shared publish stage.
+ *
+ * After a configuration reload the worker switches to the new Settings on
+ * its own thread, between polls, so the scheduler never sees its probes
+ * change under it (see settings.c).
+ *
+ * An unplugged USB adapter leaves the port hung up: epoll reports it ready
+ * for good and every read fails. The worker closes it, sends no polls and
+ * tries to open it again from the poll timer, backing off from
+ * BUS_REOPEN_MIN_MS to BUS_REOPEN_MAX_MS. A port that failed to open at
+ * startup is retried the same way.
+ */
+
+#include "bus_linux.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+#include "main_linux.h"
+#include "uart_linux.h"
+#include "config.h"
+#include "publisher.h"
+#include "dipchart.h"
+#include "vcf.h"
+#include "filter.h"
+#include "rollup.h"
+#include "events.h"
+#include "alarm.h"
+#include "stats.h"
+
+typedef struct {
+    BusConfig *pstBuses;
+    int wMaxBuses;
+    int wCount;
+} BusConfigLoader;
+
+static int fnBusConfigHandler(void *pvContext, const char *achSection, const char *achName, const char *achKey,
+                              const char *achValue, int wLine)
+{
+    BusConfigLoader *pstLoader = (BusConfigLoader *)pvContext;
+
+    if (strcmp(achSection, "bus") != 0)
+    {
+        return 0;
+    }
+
+    // Section header: start a new bus
+    if (achKey[0] == '\0')
+    {
+        if (achName[0] == '\0' || strlen(achName) >= PROBE_BUS_LEN)
+        {
+            printf("Config line %d: [bus] needs a name shorter than %d characters\n", wLine, PROBE_BUS_LEN);
+            return -1;
+        }
+        for (int i = 0; i < pstLoader->wCount; i++)
+        {
+            if (strcmp(pstLoader->pstBuses[i].achName, achName) == 0)
+            {
+                printf("Config line %d: bus %s defined twice\n", wLine, achName);
+                return -1;
+            }
+        }
+        if (pstLoader->wCount >= pstLoader->wMaxBuses)
+        {
+            printf("Config line %d: more than %d buses\n", wLine, pstLoader->wMaxBuses);
+            return -1;
+        }
+
+        BusConfig *pstBus = &pstLoader->pstBuses[pstLoader->wCount++];
+        memset(pstBus, 0, sizeof(BusConfig));
+        strcpy(pstBus->achName, achName);
+        strcpy(pstBus->achPort, SERIAL_PORT);
+        pstBus->u32Baud = BAUDRATE;
+        return 0;
+    }
+
+    BusConfig *pstBus = &pstLoader->pstBuses[pstLoader->wCount - 1];
+    if (strcmp(achKey, "port") == 0)
+    {
+        if (strlen(achValue) >= sizeof(pstBus->achPort))
+        {
+            printf("Config line %d: port name too long\n", wLine);
+            return -1;
+        }
+        strcpy(pstBus->achPort, achValue);
+    }
+    else if (strcmp(achKey, "baud") == 0)
+    {
+        pstBus->u32Baud = strtoul(achValue, NULL, 10);
+    }
+    else if (strcmp(achKey, "verify_checksum") == 0)
+    {
+        pstBus->bVerifyChecksum = fnConfigParseBool(achValue);
+    }
+    else
+    {
+        printf("Config line %d: unknown bus key '%s' ignored\n", wLine, achKey);
+    }
+    return 0;
+}
+
+/**
+ * Read the [bus <name>] sections of the configuration file
+ * Without any, a single bus named "default" on SERIAL_PORT/BAUDRATE is used.
+ * @param pstBuses Output array
+ * @param wMaxBuses Capacity of pstBuses
+ * @param achPath Configuration file
+ * @return Number of buses, or -1 on a configuration error
+ */
+int fnBusLoadConfig(BusConfig *pstBuses, int wMaxBuses, const char *achPath)
+{
+    BusConfigLoader stLoader;
+    stLoader.pstBuses = pstBuses;
+    stLoader.wMaxBuses = wMaxBuses;
+    stLoader.wCount = 0;
+
+    int rc = fnConfigParse(achPath, fnBusConfigHandler, &stLoader);
+    if (rc > 0)
+    {
+        return -1;
+    }
+
+    if (stLoader.wCount == 0)
+    {
+        memset(&pstBuses[0], 0, sizeof(BusConfig));
+        strcpy(pstBuses[0].achName, "default");
+        strcpy(pstBuses[0].achPort, SERIAL_PORT);
+        pstBuses[0].u32Baud = BAUDRATE;
+        stLoader.wCount = 1;
+    }
+    return stLoader.wCount;
+}
+
+// Function to check if ATG data has changed significantly for this probe
+static int fnHasDataChanged(const AtgData *current, const AtgData *previous, const AtgProbe *probe)
+{
+    if (fabs(current->temperature - previous->temperature) >= probe->fTempThreshold)
+        return 1;
+    if (fabs(current->product - previous->product) >= probe->fProductThreshold)
+        return 1;
+    if (abs(current->water - previous->water) >= (int)probe->fWaterThreshold)
+        return 1;
+    if (current->status != previous->status)
+        return 1;
+    return 0;
+}
+
+static void fnOnProbeStatus(AtgProbe *probe, void *context)
+{
+    AtgBus *pstBus = (AtgBus *)context;
+    if (fnPublisherPublishStatus(pstBus->wLane, probe) == 0)
+    {
+        probe->u32SuppressedReported = probe->u32Suppressed;
+    }
+    else
+    {
+        printf("[%s] Publish queue full, status of %s dropped\n", pstBus->stConfig.achName, probe->achAddress);
+    }
+}
+
+// Context of the rollup and event handlers for one reading
+typedef struct {
+    AtgBus *pstBus;
+    AtgProbe *pstProbe;
+} ProbeContext;
+
+static void fnOnRollup(const RollupWindow *pstWindow, void *pvContext)
+{
+    ProbeContext *pstContext = (ProbeContext *)pvContext;
+    AtgBus *pstBus = pstContext->pstBus;
+    AtgProbe *probe = pstContext->pstProbe;
+
+    if (fnPublisherPublishRollup(pstBus->wLane, probe, pstWindow) != 0)
+    {
+        printf("[%s] Publish queue full, summary of %s dropped\n", pstBus->stConfig.achName, probe->achAddress);
+    }
+    else if (probe->u32Suppressed != probe->u32SuppressedReported)
+    {
+        fnOnProbeStatus(probe, pstBus);
+    }
+}
+
+// A full lane leaves the event held in ProbeEvents for the next reading to retry
+static bool fnOnTankEvent(const TankEvent *pstEvent, void *pvContext)
+{
+    ProbeContext *pstContext = (ProbeContext *)pvContext;
+    AtgBus *pstBus = pstContext->pstBus;
+    AtgProbe *probe = pstContext->pstProbe;
+
+    if (fnPublisherPublishEvent(pstBus->wLane, probe, pstEvent) != 0)
+    {
+        return false;
+    }
+    printf("[%s] %s on %s: %.1f mm\n", pstBus->stConfig.achName, fnEventKindName(pstEvent->eKind),
+           probe->achAddress, (pstEvent->stEnd.i64Ms != 0) ? pstEvent->stEnd.dbLevel : pstEvent->stStart.dbLevel);
+    return true;
+}
+
+static void fnOnAlarm(const AlarmChange *pstChange, void *pvContext)
+{
+    ProbeContext *pstContext = (ProbeContext *)pvContext;
+    AtgBus *pstBus = pstContext->pstBus;
+    AtgProbe *probe = pstContext->pstProbe;
+
+    if (fnPublisherPublishAlarm(pstBus->wLane, probe, pstChange) != 0)
+    {
+        printf("[%s] Alarm queue full, %s of %s dropped\n", pstBus->stConfig.achName,
+               fnAlarmKindName(pstChange->eKind), probe->achAddress);
+    }
+    printf("[%s] %s %s on %s: %.1f (limit %.1f)\n", pstBus->stConfig.achName, fnAlarmKindName(pstChange->eKind),
+           pstChange->bActive ? "raised" : "cleared", probe->achAddress, pstChange->fValue, pstChange->fLimit);
+}
+
+// Process a complete response frame from the ATG bus
+// Returns the probe that answered, or NULL if the frame could not be attributed
+static AtgProbe *fnHandleAtgFrame(AtgBus *pstBus, uint8_t *chPacketRec, uint16_t u16Length, double dbCurrentTime)
+{
+    AtgData stAtgData;
+    fnInitAtgData(&stAtgData);
+
+#ifdef PRINT_PACKET
+    fnPrintPacket('R', chPacketRec, u16Length);
+#else
+    (void)u16Length;
+#endif
+    double dbParseStart = getCurrentTimeMs();
+    int wResult = fnParseAtgResponse((char *)chPacketRec, &stAtgData);
+    fnStatsRecord(STAT_PARSE, getCurrentTimeMs() - dbParseStart);
+    if (wResult != ATG_PARSE_OK)
+    {
+        fnStatsCount(STAT_REJECTED);
+        // Nothing from a corrupt frame is trusted, not even its address
+        printf("[%s] Rejected response (%s): %s\n", pstBus->stConfig.achName, fnAtgParseResultName(wResult),
+               (char *)chPacketRec);
+        return NULL;
+    }
+    stAtgData.timestamp = getWallClockMs();
+    fnStatsCount(STAT_FRAMES);
+
+    // Until the probes' checksum algorithm is confirmed a mismatch is only logged unless verify_checksum is set
+    if (stAtgData.checksum_mismatch)
+    {
+        fnStatsCount(STAT_MISMATCHED);
+        if (pstBus->stConfig.bVerifyChecksum)
+        {
+            fnStatsCount(STAT_REJECTED);
+            printf("[%s] Rejected response (%s): %s\n", pstBus->stConfig.achName,
+                   fnAtgParseResultName(ATG_PARSE_E_MISMATCH), (char *)chPacketRec);
+            return NULL;
+        }
+        if (pstBus->u32ChecksumMismatches++ % 100 == 0)
+        {
+            printf("[%s] Checksum mismatch from %d (%u so far), reading kept: %s\n", pstBus->stConfig.achName,
+                   stAtgData.address, pstBus->u32ChecksumMismatches, (char *)chPacketRec);
+        }
+    }
+
+    // Alarms go out first, on the raw reading, ahead of everything below.
+    // A reading that failed its checksum is kept but never raises or clears one.
+    AtgProbe *probe = fnRegistryFind(&pstBus->stRegistry, stAtgData.address);
+    if (probe != NULL && !stAtgData.checksum_mismatch)
+    {
+        ProbeContext stAlarmContext = {pstBus, probe};
+        fnAlarmEvaluate(&probe->stAlarms, &probe->stAlarmRules, &pstBus->stAlarms, &stAtgData, dbCurrentTime,
+                        fnOnAlarm, &stAlarmContext);
+    }
+    fnPrintAtgData(&stAtgData);
+
+    // Update latest data and check for changes
+    if (probe == NULL)
+    {
+        printf("[%s] Response from unconfigured address %d ignored\n", pstBus->stConfig.achName, stAtgData.address);
+        return NULL;
+    }
+
+    // Adapt the poll rate to the raw reading, before the previous one is overwritten
+    fnSchedulerOnReading(&pstBus->stScheduler, probe, &stAtgData, dbCurrentTime);
+    memcpy(&probe->stRaw, &stAtgData, sizeof(AtgData));
+
+    // Condition the signal; a probe back from offline starts a fresh history
+    int rawChanged = fnHasDataChanged(&stAtgData, &probe->stPrevious, probe);
+    if (probe->eCommState == PROBE_COMM_OFFLINE)
+    {
+        fnFilterReset(&probe->stFilter);
+    }
+    fnFilterApply(&probe->stFilter, &pstBus->stFilter, &stAtgData);
+
+    if (probe->pstChart != NULL)
+    {
+        stAtgData.volume = fnDipChartVolume(probe->pstChart, stAtgData.product);
+        stAtgData.ullage = probe->pstChart->dbCapacity - stAtgData.volume;
+
+        double dbVcf = fnVcfFactor(&probe->stVcf, stAtgData.temperature);
+        if (dbVcf > 0)
+        {
+            stAtgData.std_volume = stAtgData.volume * dbVcf;
+        }
+    }
+
+    memcpy(&probe->stLatest, &stAtgData, sizeof(AtgData));
+
+    ProbeContext stProbeContext = {pstBus, probe};
+    fnRollupAdd(&probe->stRollup, &pstBus->stRollup, &probe->stLatest, fnOnRollup, &stProbeContext);
+    fnEventUpdate(&probe->stEvents, &pstBus->stEvents, &probe->stLatest, fnOnTankEvent, &stProbeContext);
+
+    // Summaries already carry the last value of a quiet tank when thin_raw is set
+    double timeSinceLastPublish = dbCurrentTime - probe->dbLastPublishTime;
+    int dataChanged = fnHasDataChanged(&probe->stLatest, &probe->stPrevious, probe);
+    bool bHeartbeatDue = (timeSinceLastPublish >= MQTT_PERIODIC_INTERVAL) &&
+                         !(pstBus->stRollup.bEnabled && pstBus->stRollup.bThinRaw);
+
+    if (rawChanged && !dataChanged && !bHeartbeatDue)
+    {
+        probe->u32Suppressed++;
+    }
+
+    if (dataChanged || bHeartbeatDue)
+    {
+        // A full queue leaves stPrevious alone so the next reading is queued instead
+        if (fnPublisherPublishReading(pstBus->wLane, probe, &probe->stLatest) == 0)
+        {
+            fnStatsRecord(STAT_ENQUEUE, getCurrentTimeMs() - dbCurrentTime);
+            fnStatsCount(STAT_QUEUED);
+            memcpy(&probe->stPrevious, &probe->stLatest, sizeof(AtgData));
+            probe->dbLastPublishTime = dbCurrentTime;
+            pstBus->bSweepOpen = true;
+
+            if (dataChanged)
+            {
+                printf("[MQTT] Queued due to data change\n");
+            }
+            else
+            {
+                printf("[MQTT] Queued due to periodic interval (2 min)\n");
+
+                // Refresh the retained status with the filter's count
+                if (probe->u32Suppressed != probe->u32SuppressedReported)
+                {
+                    fnOnProbeStatus(probe, pstBus);
+                }
+            }
+        }
+        else
+        {
+            fnStatsCount(STAT_QUEUE_FULL);
+            printf("[%s] Publish queue full, reading of %s deferred\n", pstBus->stConfig.achName, probe->achAddress);
+        }
+    }
+    return probe;
+}
+
+// Arm the one-shot poll timer for an absolute CLOCK_MONOTONIC time in ms
+static void fnArmPollTimer(AtgBus *pstBus, double dbDeadlineMs)
+{
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+
+    // Nothing to poll: a zero it_value disarms the timer until a reload adds probes
+    if (isinf(dbDeadlineMs))
+    {
+        timerfd_settime(pstBus->timerFd, TFD_TIMER_ABSTIME, &its, NULL);
+        return;
+    }
+
+    // Anything in the past fires at once, but must not be zero
+    if (dbDeadlineMs < 0.001)
+        dbDeadlineMs = 0.001;
+    its.it_value.tv_sec = (time_t)(dbDeadlineMs / 1000.0);
+    its.it_value.tv_nsec = (long)((dbDeadlineMs - its.it_value.tv_sec * 1000.0) * 1000000.0);
+
+    if (timerfd_settime(pstBus->timerFd, TFD_TIMER_ABSTIME, &its, NULL) != 0)
+    {
+        printf("[%s] Error arming poll timer: %s\n", pstBus->stConfig.achName, strerror(errno));
+    }
+}
+
+/**
+ * Move to the current Settings if they are newer than the ones in use and no
+ * poll is outstanding. Probes that remain keep their readings and schedule;
+ * added probes are polled at once; removed ones are dropped.
+ */
+static void fnBusApplySettings(AtgBus *pstBus)
+{
+    const Settings *pstSettings = fnSettingsCurrent();
+    uint32_t u32InUse = atomic_load_explicit(&pstBus->u32Generation, memory_order_relaxed);
+    if (pstSettings->u32Generation == u32InUse || fnSchedulerInFlight(&pstBus->stScheduler))
+    {
+        return;
+    }
+
+    ProbeRegistry stOld = pstBus->stRegistry;
+    ProbeRegistry stNew;
+    int rc = fnRegistrySelect(&stNew, &pstSettings->stRegistry, pstBus->stConfig.achName, pstBus->bDefaultBus);
+    if (rc == 0)
+    {
+        for (int i = 0; i < stNew.wCount; i++)
+        {
+            const AtgProbe *pstOldProbe = fnRegistryFind(&stOld, stNew.pstProbes[i].address);
+            if (pstOldProbe != NULL)
+            {
+                fnRegistryCarryState(&stNew.pstProbes[i], pstOldProbe);
+            }
+        }
+
+        pstBus->stRegistry = stNew;
+        pstBus->stFilter = pstSettings->stFilter;
+        pstBus->stRollup = pstSettings->stRollup;
+        pstBus->stEvents = pstSettings->stEvents;
+        pstBus->stAlarms = pstSettings->stAlarms;
+        rc = fnSchedulerRebuild(&pstBus->stScheduler, &pstSettings->stScheduler, &pstBus->stRegistry);
+        if (rc != 0)
+        {
+            pstBus->stRegistry = stOld;
+            fnRegistryFree(&stNew);
+        }
+    }
+
+    if (rc == 0)
+    {
+        fnRegistryFree(&stOld);
+        printf("[%s] Configuration %u applied: %d probe(s)\n", pstBus->stConfig.achName, pstSettings->u32Generation,
+               pstBus->stRegistry.wCount);
+    }
+    else
+    {
+        // Keep polling the old list, but drop its charts: they go with the old Settings
+        for (int i = 0; i < pstBus->stRegistry.wCount; i++)
+        {
+            pstBus->stRegistry.pstProbes[i].pstChart = NULL;
+        }
+        printf("[%s] ERROR: Out of memory applying configuration %u, probe list unchanged\n",
+               pstBus->stConfig.achName, pstSettings->u32Generation);
+    }
+
+    // The old Settings may be freed from here on
+    atomic_store_explicit(&pstBus->u32Generation, pstSettings->u32Generation, memory_order_release);
+}
+
+// Handle every complete frame in the framer, including back-to-back responses
+static void fnBusHandleFrames(AtgBus *pstBus, double dbNow)
+{
+    uint8_t chPacketRec[FRAMER_MAX_FRAME + 1] = {0};
+    uint16_t u16FrameLength;
+
+    if (pstBus->bAwaitingFirstByte)
+    {
+        fnStatsRecord(STAT_FIRST_BYTE, dbNow - pstBus->dbPollSentAt);
+        pstBus->bAwaitingFirstByte = false;
+    }
+    while ((u16FrameLength = fnFramerNext(&pstBus->stFramer, chPacketRec, sizeof(chPacketRec))) > 0)
+    {
+        if (pstBus->bAwaitingFrame)
+        {
+            fnStatsRecord(STAT_FRAME, dbNow - pstBus->dbPollSentAt);
+            pstBus->bAwaitingFrame = false;
+        }
+        AtgProbe *probe = fnHandleAtgFrame(pstBus, chPacketRec, u16FrameLength, dbNow);
+        fnSchedulerOnFrame(&pstBus->stScheduler, probe, dbNow);
+    }
+}
+
+// Close a hung-up port and drop the poll that went out on it; the poll timer reopens it
+static void fnBusPortLost(AtgBus *pstBus, double dbNow)
+{
+    epoll_ctl(pstBus->epollFd, EPOLL_CTL_DEL, pstBus->hPort, NULL);
+    fnCloseComPort(pstBus->hPort);
+    pstBus->hPort = -1;
+    fnFramerDropPartial(&pstBus->stFramer);
+    fnSchedulerAbort(&pstBus->stScheduler);
+    pstBus->bAwaitingFirstByte = pstBus->bAwaitingFrame = false;
+
+    pstBus->dbReopenBackoffMs = BUS_REOPEN_MIN_MS;
+    pstBus->dbReopenAt = dbNow + pstBus->dbReopenBackoffMs;
+    printf("[%s] Serial port %s lost, polling stopped until it reopens\n", pstBus->stConfig.achName,
+           pstBus->stConfig.achPort);
+}
+
+// Try to open a closed port again; on failure wait twice as long before the next attempt
+static void fnBusReopenPort(AtgBus *pstBus, double dbNow)
+{
+    if (fnInitComPort(&pstBus->hPort, pstBus->stConfig.achPort, pstBus->stConfig.u32Baud))
+    {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = pstBus->hPort;
+        if (epoll_ctl(pstBus->epollFd, EPOLL_CTL_ADD, pstBus->hPort, &ev) == 0)
+        {
+            printf("[%s] Serial port %s reopened, polling resumed\n", pstBus->stConfig.achName,
+                   pstBus->stConfig.achPort);
+            return;
+        }
+        printf("[%s] Error registering serial port: %s\n", pstBus->stConfig.achName, strerror(errno));
+        fnCloseComPort(pstBus->hPort);
+        pstBus->hPort = -1;
+    }
+
+    pstBus->dbReopenBackoffMs *= 2.0;
+    if (pstBus->dbReopenBackoffMs > BUS_REOPEN_MAX_MS)
+        pstBus->dbReopenBackoffMs = BUS_REOPEN_MAX_MS;
+    pstBus->dbReopenAt = dbNow + pstBus->dbReopenBackoffMs;
+    printf("[%s] Serial port %s still closed, next attempt in %.0f s\n", pstBus->stConfig.achName,
+           pstBus->stConfig.achPort, pstBus->dbReopenBackoffMs / 1000.0);
+}
+
+// Worker thread: sleep in epoll_wait until the port, poll timer or stop request needs attention
+static void *fnBusThread(void *pvArg)
+{
+    AtgBus *pstBus = (AtgBus *)pvArg;
+    uint8_t chPacketSend[10] = {0};
+    uint8_t chBurst[256];
+    bool bRunning = true;
+
+    // First poll goes out immediately
+    fnArmPollTimer(pstBus, 0);
+
+    while (bRunning)
+    {
+        struct epoll_event events[4];
+        int nEvents = epoll_wait(pstBus->epollFd, events, 4, -1);
+        if (nEvents < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            printf("[%s] Error waiting for events: %s\n", pstBus->stConfig.achName, strerror(errno));
+            break;
+        }
+
+        for (int e = 0; e < nEvents; e++)
+        {
+            int fd = events[e].data.fd;
+
+            if (fd == pstBus->stopFd)
+            {
+                bRunning = false;
+            }
+            else if (fd == pstBus->reloadFd)
+            {
+                uint64_t u64Requests;
+                if (read(pstBus->reloadFd, &u64Requests, sizeof(u64Requests)) != sizeof(u64Requests))
+                    continue;
+            }
+            else if (fd == pstBus->timerFd)
+            {
+                uint64_t u64Expirations;
+                if (read(pstBus->timerFd, &u64Expirations, sizeof(u64Expirations)) != sizeof(u64Expirations))
+                    continue;
+
+                // No polls while the port is closed, only the attempts to reopen it
+                if (pstBus->hPort < 0)
+                {
+                    double dbNow = getCurrentTimeMs();
+                    if (dbNow >= pstBus->dbReopenAt)
+                        fnBusReopenPort(pstBus, dbNow);
+                    if (pstBus->hPort < 0)
+                        continue;
+                }
+
+                // Send the next ATG polling request if the bus is free (or the last poll timed out)
+                AtgProbe *probe = fnSchedulerPoll(&pstBus->stScheduler, getCurrentTimeMs());
+                if (probe != NULL)
+                {
+                    // Leftovers of an unanswered poll must not prefix the next response
+                    fnFramerDropPartial(&pstBus->stFramer);
+
+                    uint8_t u8Length = fnPacketAtgPacket(chPacketSend, probe->achAddress);
+                    double dbSendStart = getCurrentTimeMs();
+                    fnUartTransmit(&pstBus->hPort, (uint8_t *)chPacketSend, u8Length);
+                    pstBus->dbPollSentAt = getCurrentTimeMs();
+                    pstBus->bAwaitingFirstByte = pstBus->bAwaitingFrame = true;
+                    fnStatsRecord(STAT_TX, pstBus->dbPollSentAt - dbSendStart);
+                    fnStatsCount(STAT_POLLS);
+                    fnSchedulerOnSent(&pstBus->stScheduler, pstBus->dbPollSentAt);
+                }
+            }
+            else if (fd == pstBus->hPort)
+            {
+                // One read per burst; a short read means the driver queue is empty
+                int wReceived;
+                do
+                {
+                    wReceived = fnUartReceiveBulk(&pstBus->hPort, chBurst, sizeof(chBurst));
+                    if (wReceived > 0)
+                        fnFramerPush(&pstBus->stFramer, chBurst, (uint16_t)wReceived);
+                } while (wReceived == (int)sizeof(chBurst));
+
+                double dbNow = getCurrentTimeMs();
+                fnBusHandleFrames(pstBus, dbNow);
+
+                // A hung-up port stays ready forever; reading it again would spin
+                if (wReceived < 0 || (events[e].events & (EPOLLHUP | EPOLLERR)))
+                {
+                    fnBusPortLost(pstBus, dbNow);
+                }
+            }
+        }
+
+        // Switch to reloaded settings between polls; new probes may be due at once
+        fnBusApplySettings(pstBus);
+
+        // A completed frame or a sent poll moves the next deadline; a closed port waits for its reopen
+        double dbDeadline = fnSchedulerNextDeadline(&pstBus->stScheduler);
+        fnArmPollTimer(pstBus, (pstBus->hPort < 0) ? pstBus->dbReopenAt : dbDeadline);
+
+        // End of a sweep: let a sweep batch go out (retried next pass if the lane is full)
+        if (pstBus->bSweepOpen && fnSchedulerIdle(&pstBus->stScheduler) && fnPublisherEndSweep(pstBus->wLane) == 0)
+        {
+            pstBus->bSweepOpen = false;
+        }
+    }
+
+    // Never hold up a reload waiting for this worker
+    atomic_store_explicit(&pstBus->u32Generation, UINT_MAX, memory_order_release);
+    return NULL;
+}
+
+/**
+ * Prepare a bus: take its probes from the settings, open the serial port
+ * and build the worker's event loop
+ * @param pstBus Bus to initialize
+ * @param wLane Publisher lane for this bus's readings
+ * @param pstConfig Port settings
+ * @param pstSettings Current settings (every configured probe, scheduler settings)
+ * @param bDefaultBus Also take the probes without a "bus" key
+ * @return 0 on success, -1 on failure (fnBusFree must still be called)
+ */
+int fnBusInit(AtgBus *pstBus, int wLane, const BusConfig *pstConfig, const Settings *pstSettings, bool bDefaultBus)
+{
+    struct epoll_event ev;
+
+    memset(pstBus, 0, sizeof(AtgBus));
+    pstBus->stConfig = *pstConfig;
+    pstBus->wLane = wLane;
+    pstBus->hPort = -1;
+    pstBus->bDefaultBus = bDefaultBus;
+    pstBus->epollFd = pstBus->timerFd = pstBus->stopFd = pstBus->reloadFd = -1;
+    atomic_init(&pstBus->u32Generation, pstSettings->u32Generation);
+    fnFramerInit(&pstBus->stFramer);
+
+    if (fnRegistrySelect(&pstBus->stRegistry, &pstSettings->stRegistry, pstConfig->achName, bDefaultBus) != 0 ||
+        fnSchedulerInit(&pstBus->stScheduler, &pstSettings->stScheduler, &pstBus->stRegistry) != 0)
+    {
+        printf("[%s] ERROR: Out of memory initializing the bus\n", pstConfig->achName);
+        return -1;
+    }
+    fnSchedulerSetStatusHandler(&pstBus->stScheduler, fnOnProbeStatus, pstBus);
+    pstBus->stFilter = pstSettings->stFilter;
+    pstBus->stRollup = pstSettings->stRollup;
+    pstBus->stEvents = pstSettings->stEvents;
+    pstBus->stAlarms = pstSettings->stAlarms;
+
+    printf("[%s] %d probe(s) on %s at %lu baud\n", pstConfig->achName, pstBus->stRegistry.wCount,
+           pstConfig->achPort, pstConfig->u32Baud);
+
+    if (pstConfig->achPort[0] == '\0')
+    {
+        // Replay (atg_replay.c): the bytes come from a trace instead
+    }
+    else if (fnInitComPort(&pstBus->hPort, pstConfig->achPort, pstConfig->u32Baud))
+    {
+        printf("[%s] Serial port connected successfully\n", pstConfig->achName);
+    }
+    else
+    {
+        printf("[%s] ERROR: Serial port connection failed!\n", pstConfig->achName);
+        printf("Please check:\n");
+        printf("  1. Port %s exists (ls -la %s)\n", pstConfig->achPort, pstConfig->achPort);
+        printf("  2. You have permission (sudo usermod -a -G dialout $USER)\n");
+        printf("  3. The device is connected\n");
+        pstBus->dbReopenBackoffMs = BUS_REOPEN_MIN_MS;
+        pstBus->dbReopenAt = getCurrentTimeMs() + pstBus->dbReopenBackoffMs;
+    }
+
+    pstBus->stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    pstBus->reloadFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    pstBus->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    pstBus->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (pstBus->stopFd < 0 || pstBus->reloadFd < 0 || pstBus->timerFd < 0 || pstBus->epollFd < 0)
+    {
+        printf("[%s] Error creating event loop: %s\n", pstConfig->achName, strerror(errno));
+        return -1;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = pstBus->stopFd;
+    epoll_ctl(pstBus->epollFd, EPOLL_CTL_ADD, pstBus->stopFd, &ev);
+
+    ev.data.fd = pstBus->reloadFd;
+    epoll_ctl(pstBus->epollFd, EPOLL_CTL_ADD, pstBus->reloadFd, &ev);
+
+    ev.data.fd = pstBus->timerFd;
+    epoll_ctl(pstBus->epollFd, EPOLL_CTL_ADD, pstBus->timerFd, &ev);
+
+    // Without a serial port the timer still runs to reopen it
+    if (pstBus->hPort >= 0)
+    {
+        ev.data.fd = pstBus->hPort;
+        if (epoll_ctl(pstBus->epollFd, EPOLL_CTL_ADD, pstBus->hPort, &ev) != 0)
+        {
+            printf("[%s] Error registering serial port: %s\n", pstConfig->achName, strerror(errno));
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Replay a poll the trace recorded on this bus (instead of the worker thread)
+ */
+void fnBusReplayPoll(AtgBus *pstBus, double dbNow)
+{
+    fnFramerDropPartial(&pstBus->stFramer);
+    pstBus->dbPollSentAt = dbNow;
+    pstBus->bAwaitingFirstByte = pstBus->bAwaitingFrame = true;
+    fnStatsCount(STAT_POLLS);
+}
+
+/**
+ * Replay bytes the trace recorded from this bus's port: frame, parse, filter
+ * and queue them exactly as the worker does
+ */
+void fnBusReplayReceive(AtgBus *pstBus, const uint8_t *pu8Data, uint16_t u16Length, double dbNow)
+{
+    fnFramerPush(&pstBus->stFramer, pu8Data, u16Length);
+    fnBusHandleFrames(pstBus, dbNow);
+}
+
+/**
+ * Start the bus worker thread
+ * @return 0 on success
+ */
+int fnBusStart(AtgBus *pstBus)
+{
+    int rc = pthread_create(&pstBus->thread, NULL, fnBusThread, pstBus);
+    if (rc != 0)
+    {
+        printf("[%s] Error starting worker thread: %s\n", pstBus->stConfig.achName, strerror(rc));
+        return -1;
+    }
+    pstBus->bThreadStarted = true;
+    return 0;
+}
+
+/**
+ * Wake the worker to pick up newly published Settings
+ */
+void fnBusReload(AtgBus *pstBus)
+{
+    uint64_t u64One = 1;
+    if (pstBus->bThreadStarted && write(pstBus->reloadFd, &u64One, sizeof(u64One)) != sizeof(u64One))
+    {
+        printf("[%s] Error signalling worker: %s\n", pstBus->stConfig.achName, strerror(errno));
+    }
+}
+
+/**
+ * Settings generation the worker has switched to (UINT_MAX once it exited)
+ */
+uint32_t fnBusGeneration(AtgBus *pstBus)
+{
+    return atomic_load_explicit(&pstBus->u32Generation, memory_order_acquire);
+}
+
+/**
+ * Ask the worker to stop and wait for it to finish its current wake-up
+ */
+void fnBusStop(AtgBus *pstBus)
+{
+    if (!pstBus->bThreadStarted)
+    {
+        return;
+    }
+
+    uint64_t u64One = 1;
+    if (write(pstBus->stopFd, &u64One, sizeof(u64One)) != sizeof(u64One))
+    {
+        printf("[%s] Error signalling worker: %s\n", pstBus->stConfig.achName, strerror(errno));
+    }
+    pthread_join(pstBus->thread, NULL);
+    pstBus->bThreadStarted = false;
+}
+
+/**
+ * Release the bus's port, descriptors and probe state (after fnBusStop)
+ */
+void fnBusFree(AtgBus *pstBus)
+{
+    if (pstBus->epollFd >= 0)
+        close(pstBus->epollFd);
+    if (pstBus->timerFd >= 0)
+        close(pstBus->timerFd);
+    if (pstBus->stopFd >= 0)
+        close(pstBus->stopFd);
+    if (pstBus->reloadFd >= 0)
+        close(pstBus->reloadFd);
+    pstBus->epollFd = pstBus->timerFd = pstBus->stopFd = pstBus->reloadFd = -1;
+
+    fnCloseComPort(pstBus->hPort);
+    pstBus->hPort = -1;
+    fnSchedulerFree(&pstBus->stScheduler);
+    fnRegistryFree(&pstBus->stRegistry);
+}
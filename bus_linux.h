@@ -0,0 +1,81 @@
+/**
+ * ATG Bus Worker - Linux
+ * One polling thread per serial port (RS-485 segment)
+ */
+
+#ifndef BUS_LINUX_H
+#define BUS_LINUX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "framer.h"
+#include "registry.h"
+#include "scheduler.h"
+#include "filter.h"
+#include "rollup.h"
+#include "events.h"
+#include "alarm.h"
+#include "settings.h"
+
+// Maximum number of serial ports one poller drives
+#define BUS_MAX 8
+
+// Reopening a lost serial port: first retry, then doubling up to the cap
+#define BUS_REOPEN_MIN_MS 1000.0
+#define BUS_REOPEN_MAX_MS 60000.0
+
+typedef struct {
+    char achName[PROBE_BUS_LEN]; // Name used by the probes' "bus" key
+    char achPort[64];            // Serial device, e.g. /dev/ttyS1
+    unsigned long u32Baud;
+    bool bVerifyChecksum; // Reject responses whose checksum does not match, instead of only logging them
+} BusConfig;
+
+typedef struct {
+    BusConfig stConfig;
+    int wLane; // Publisher lane this worker produces into
+    int hPort; // Serial port file descriptor, -1 while it is closed
+    double dbReopenAt;        // When to try a closed port again
+    double dbReopenBackoffMs; // Wait after the last failed reopen
+    bool bSweepOpen; // Readings queued since the publisher was last told the bus went idle
+    bool bDefaultBus; // Also polls the probes that do not name a bus
+
+    ProbeRegistry stRegistry;  // Probes wired to this bus, built from the current Settings
+    atomic_uint u32Generation; // Settings generation in use, UINT_MAX once the worker exited
+    PollScheduler stScheduler;
+    FilterConfig stFilter;     // From the current Settings
+    RollupConfig stRollup;     // From the current Settings
+    EventConfig stEvents;      // From the current Settings
+    AlarmConfig stAlarms;      // From the current Settings
+    Framer stFramer;
+    uint32_t u32ChecksumMismatches; // Frames accepted with a checksum that did not match
+
+    // Latency of the last poll, for the runtime statistics
+    double dbPollSentAt;
+    bool bAwaitingFirstByte;
+    bool bAwaitingFrame;
+
+    // Worker event loop
+    int epollFd;
+    int timerFd;
+    int stopFd;   // eventfd written by fnBusStop
+    int reloadFd; // eventfd written by fnBusReload
+    pthread_t thread;
+    bool bThreadStarted;
+} AtgBus;
+
+int fnBusLoadConfig(BusConfig *pstBuses, int wMaxBuses, const char *achPath);
+int fnBusInit(AtgBus *pstBus, int wLane, const BusConfig *pstConfig, const Settings *pstSettings, bool bDefaultBus);
+int fnBusStart(AtgBus *pstBus);
+void fnBusReload(AtgBus *pstBus);
+uint32_t fnBusGeneration(AtgBus *pstBus);
+void fnBusStop(AtgBus *pstBus);
+void fnBusFree(AtgBus *pstBus);
+
+// Feed a recorded trace through the bus without a port or worker thread
+void fnBusReplayPoll(AtgBus *pstBus, double dbNow);
+void fnBusReplayReceive(AtgBus *pstBus, const uint8_t *pu8Data, uint16_t u16Length, double dbNow);
+
+#endif
@@ -0,0 +1,131 @@
+/**
+ * Configuration File Reader
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+/**
+ * Trim leading and trailing whitespace in place
+ */
+static char *fnTrim(char *achText)
+{
+    while (isspace((unsigned char)*achText))
+    {
+        achText++;
+    }
+
+    char *end = achText + strlen(achText);
+    while (end > achText && isspace((unsigned char)end[-1]))
+    {
+        end--;
+    }
+    *end = '\0';
+    return achText;
+}
+
+/**
+ * Parse a configuration file
+ * @param achPath File to read
+ * @param fnHandler Callback for each key/value pair
+ * @param pvContext Passed through to the callback
+ * @return 0 on success, -1 if the file cannot be opened, otherwise the
+ *         line number of the first error
+ */
+int fnConfigParse(const char *achPath, ConfigHandler fnHandler, void *pvContext)
+{
+    FILE *file = fopen(achPath, "r");
+    if (file == NULL)
+    {
+        return -1;
+    }
+
+    char achLine[CONFIG_MAX_LINE];
+    char achSection[64] = "";
+    char achName[64] = "";
+    int wLine = 0;
+    int rc = 0;
+
+    while (fgets(achLine, sizeof(achLine), file) != NULL)
+    {
+        wLine++;
+        char *line = fnTrim(achLine);
+
+        if (*line == '\0' || *line == '#' || *line == ';')
+        {
+            continue;
+        }
+
+        if (*line == '[')
+        {
+            char *end = strchr(line, ']');
+            if (end == NULL)
+            {
+                printf("Config %s:%d: missing ']'\n", achPath, wLine);
+                rc = wLine;
+                break;
+            }
+            *end = '\0';
+            line = fnTrim(line + 1);
+
+            // "[probe 83731]" -> section "probe", name "83731"
+            char *space = strpbrk(line, " \t");
+            achName[0] = '\0';
+            if (space != NULL)
+            {
+                *space = '\0';
+                snprintf(achName, sizeof(achName), "%s", fnTrim(space + 1));
+            }
+            snprintf(achSection, sizeof(achSection), "%s", line);
+
+            // Report the section itself with an empty key
+            if (fnHandler(pvContext, achSection, achName, "", "", wLine) != 0)
+            {
+                rc = wLine;
+                break;
+            }
+            continue;
+        }
+
+        char *equals = strchr(line, '=');
+        if (equals == NULL)
+        {
+            printf("Config %s:%d: expected key = value\n", achPath, wLine);
+            rc = wLine;
+            break;
+        }
+        *equals = '\0';
+
+        char *key = fnTrim(line);
+        char *value = fnTrim(equals + 1);
+
+        // Allow trailing comments after values
+        char *comment = strchr(value, '#');
+        if (comment != NULL)
+        {
+            *comment = '\0';
+            value = fnTrim(value);
+        }
+
+        if (fnHandler(pvContext, achSection, achName, key, value, wLine) != 0)
+        {
+            rc = wLine;
+            break;
+        }
+    }
+
+    fclose(file);
+    return rc;
+}
+
+/**
+ * Interpret yes/no style values
+ */
+bool fnConfigParseBool(const char *achValue)
+{
+    return (strcasecmp(achValue, "1") == 0) || (strcasecmp(achValue, "yes") == 0) ||
+           (strcasecmp(achValue, "true") == 0) || (strcasecmp(achValue, "on") == 0);
+}
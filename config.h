@@ -0,0 +1,27 @@
+/**
+ * Configuration File Reader
+ * Minimal INI-style parser used for the poller's runtime configuration
+ *
+ * Format:
+ *   # comment
+ *   [section optional-name]
+ *   key = value
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdbool.h>
+
+#define CONFIG_MAX_LINE 256
+
+// Called for every key/value pair, and once per section header with an empty
+// key; return 0 to continue, non-zero to abort
+typedef int (*ConfigHandler)(void *pvContext, const char *achSection, const char *achName,
+                             const char *achKey, const char *achValue, int wLine);
+
+int fnConfigParse(const char *achPath, ConfigHandler fnHandler, void *pvContext);
+
+bool fnConfigParseBool(const char *achValue);
+
+#endif
@@ -0,0 +1,683 @@
+/**
+ * Dip Charts
+ *
+ * A tank's strapping table is a JSON array of {"depth": mm, "volume": litres}
+ * points sorted by depth, the same files server.js reads from dip_charts/.
+ * Each file is loaded once at startup and resampled into a direct-indexed
+ * table holding the volume at every whole millimetre from 0 to the top of
+ * the chart. A reading then costs one index and one linear interpolation
+ * between neighbouring millimetres, whatever the number of chart points.
+ *
+ * Between two chart points the table is filled by linear interpolation, so
+ * for charts with whole-millimetre depths (all charts in use) the result
+ * matches server.js's getVolume exactly. Depths below the first point read
+ * as its volume and depths above the last as the tank's capacity.
+ *
+ * A chart is found by the probe's "chart" key, or else by its topic. The
+ * server applies per-tank calibration offsets from its database before the
+ * lookup; the device uses the published product level without offsets,
+ * filtered while [filter] is enabled.
+ *
+ * Parsing thousands of JSON lines per tank is slow on the board, so the
+ * tables are normally compiled ahead of time by dipchart_compile into one
+ * file that is mapped read-only. The tables are used in place from the page
+ * cache, shared by every process mapping the file, and only the pages of
+ * charts actually read become resident. Every field is little-endian:
+ *
+ *   Header (32 bytes)
+ *     char magic[4]   "ATGD"
+ *     u16  version    1
+ *     u16  entry size 96
+ *     u32  charts
+ *     u32  index CRC  CRC-32 of the index
+ *     u64  file size
+ *     u64  reserved
+ *   Index, one entry per chart sorted by name (96 bytes)
+ *     char name[64]   NUL-terminated
+ *     u32  max depth  mm
+ *     u32  table CRC  CRC-32 of the table
+ *     u64  offset     Start of the table in the file, 8-byte aligned
+ *     f64  capacity   litres
+ *     u64  reserved
+ *   Tables: f64 litres for every mm from 0 to max depth
+ *
+ * The header and index are validated when the file is mapped. A table's
+ * CRC is checked the first time a probe is attached to it, so the startup
+ * cost follows the configured probes, not the number of charts in the file.
+ * Any failure falls back to the JSON directory.
+ */
+
+#include "dipchart.h"
+#include "config.h"
+#include "main_linux.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Tables are used in place, so the host must share the file's byte order
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "dipchart.c maps little-endian tables in place"
+#endif
+
+typedef struct {
+    double dbDepth;
+    double dbLitres;
+} ChartPoint;
+
+// Compiled file layout; both structures are free of padding
+typedef struct {
+    char achMagic[4];
+    uint16_t u16Version;
+    uint16_t u16EntrySize;
+    uint32_t u32Charts;
+    uint32_t u32IndexCrc;
+    uint64_t u64FileSize;
+    uint64_t u64Reserved;
+} ChartFileHeader;
+
+typedef struct {
+    char achName[PROBE_TOPIC_LEN];
+    uint32_t u32MaxDepthMm;
+    uint32_t u32TableCrc;
+    uint64_t u64Offset;
+    double dbCapacity;
+    uint64_t u64Reserved;
+} ChartFileEntry;
+
+static uint32_t fnChartCrc32(const void *pvData, size_t szLength)
+{
+    const uint8_t *pu8Data = (const uint8_t *)pvData;
+    uint32_t u32Crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < szLength; i++)
+    {
+        u32Crc ^= pu8Data[i];
+        for (int k = 0; k < 8; k++)
+        {
+            u32Crc = (u32Crc >> 1) ^ (0xEDB88320u & (0u - (u32Crc & 1u)));
+        }
+    }
+    return ~u32Crc;
+}
+
+void fnDipChartConfigDefaults(DipChartConfig *pstConfig)
+{
+    pstConfig->bEnabled = true;
+    snprintf(pstConfig->achFile, sizeof(pstConfig->achFile), "%s", DIP_CHART_FILE);
+    snprintf(pstConfig->achDir, sizeof(pstConfig->achDir), "%s", DIP_CHART_DIR);
+}
+
+static int fnDipChartConfigHandler(void *pvContext, const char *achSection, const char *achName, const char *achKey,
+                                   const char *achValue, int wLine)
+{
+    DipChartConfig *pstConfig = (DipChartConfig *)pvContext;
+    (void)achName;
+
+    if (strcmp(achSection, "charts") != 0 || achKey[0] == '\0')
+    {
+        return 0;
+    }
+
+    if (strcmp(achKey, "enabled") == 0)
+    {
+        pstConfig->bEnabled = fnConfigParseBool(achValue);
+    }
+    else if (strcmp(achKey, "dir") == 0)
+    {
+        if (strlen(achValue) >= sizeof(pstConfig->achDir) - PROBE_TOPIC_LEN)
+        {
+            printf("Config line %d: charts dir too long\n", wLine);
+            return -1;
+        }
+        strcpy(pstConfig->achDir, achValue);
+    }
+    else if (strcmp(achKey, "file") == 0)
+    {
+        if (strlen(achValue) >= sizeof(pstConfig->achFile) - 8)
+        {
+            printf("Config line %d: charts file too long\n", wLine);
+            return -1;
+        }
+        strcpy(pstConfig->achFile, achValue);
+    }
+    else
+    {
+        printf("Config line %d: unknown charts key '%s' ignored\n", wLine, achKey);
+    }
+    return 0;
+}
+
+/**
+ * Read the [charts] section of the configuration file
+ * @return 0 on success or if the file does not exist, non-zero on a bad value
+ */
+int fnDipChartLoadConfig(DipChartConfig *pstConfig, const char *achPath)
+{
+    fnDipChartConfigDefaults(pstConfig);
+    int rc = fnConfigParse(achPath, fnDipChartConfigHandler, pstConfig);
+    return (rc == -1) ? 0 : rc;
+}
+
+// Read a whole file into a NUL-terminated buffer; the caller frees it
+static char *fnReadFile(const char *achPath)
+{
+    FILE *pFile = fopen(achPath, "rb");
+    if (pFile == NULL)
+    {
+        return NULL;
+    }
+
+    char *achText = NULL;
+    long lSize = (fseek(pFile, 0, SEEK_END) == 0) ? ftell(pFile) : -1;
+    if (lSize >= 0 && fseek(pFile, 0, SEEK_SET) == 0)
+    {
+        achText = (char *)malloc((size_t)lSize + 1);
+        if (achText != NULL)
+        {
+            size_t szRead = fread(achText, 1, (size_t)lSize, pFile);
+            achText[szRead] = '\0';
+        }
+    }
+    fclose(pFile);
+    return achText;
+}
+
+/**
+ * Collect the depth/volume pairs of a chart file. Only the shape the charts
+ * use is understood: objects with numeric "depth" and "volume" members;
+ * other members are skipped.
+ * @return Number of points, or -1 on a malformed file or out of memory
+ */
+static int fnParseChart(const char *achText, ChartPoint **ppstPoints)
+{
+    ChartPoint *pstPoints = NULL;
+    int wCount = 0;
+    int wCapacity = 0;
+    bool bInObject = false;
+    bool bError = false;
+    bool bHaveDepth = false;
+    bool bHaveLitres = false;
+    ChartPoint stPoint = {0, 0};
+
+    for (const char *pch = achText; *pch != '\0' && !bError; pch++)
+    {
+        if (*pch == '{')
+        {
+            bInObject = true;
+            bHaveDepth = bHaveLitres = false;
+        }
+        else if (*pch == '}' && bInObject)
+        {
+            bInObject = false;
+            if (!bHaveDepth || !bHaveLitres)
+            {
+                bError = true;
+                continue;
+            }
+            if (wCount == wCapacity)
+            {
+                wCapacity = wCapacity ? wCapacity * 2 : 256;
+                ChartPoint *pstGrown = (ChartPoint *)realloc(pstPoints, wCapacity * sizeof(ChartPoint));
+                if (pstGrown == NULL)
+                {
+                    bError = true;
+                    continue;
+                }
+                pstPoints = pstGrown;
+            }
+            pstPoints[wCount++] = stPoint;
+        }
+        else if (*pch == '"' && bInObject)
+        {
+            const char *pchKey = ++pch;
+            while (*pch != '\0' && *pch != '"')
+                pch++;
+            if (*pch == '\0')
+            {
+                bError = true;
+                continue;
+            }
+            size_t szKey = (size_t)(pch - pchKey);
+
+            const char *pchValue = pch + 1;
+            while (*pchValue == ' ' || *pchValue == '\t' || *pchValue == '\r' || *pchValue == '\n')
+                pchValue++;
+            if (*pchValue != ':')
+            {
+                continue;
+            }
+
+            double *pdbTarget = NULL;
+            if (szKey == 5 && strncmp(pchKey, "depth", 5) == 0)
+            {
+                pdbTarget = &stPoint.dbDepth;
+                bHaveDepth = true;
+            }
+            else if (szKey == 6 && strncmp(pchKey, "volume", 6) == 0)
+            {
+                pdbTarget = &stPoint.dbLitres;
+                bHaveLitres = true;
+            }
+            if (pdbTarget != NULL)
+            {
+                char *pchEnd = NULL;
+                *pdbTarget = strtod(pchValue + 1, &pchEnd);
+                bError = (pchEnd == pchValue + 1);
+                pch = pchEnd - 1;
+            }
+        }
+    }
+
+    // Unterminated object, missing member, bad number or out of memory
+    if (bError || bInObject)
+    {
+        free(pstPoints);
+        return -1;
+    }
+    *ppstPoints = pstPoints;
+    return wCount;
+}
+
+/**
+ * Resample a parsed chart to one volume per millimetre
+ * @return 0 on success, -1 if the points are unusable
+ */
+static int fnBuildTable(DipChart *pstChart, const ChartPoint *pstPoints, int wCount)
+{
+    if (wCount < 1 || pstPoints[0].dbDepth < 0 ||
+        pstPoints[wCount - 1].dbDepth > DIPCHART_MAX_DEPTH_MM)
+    {
+        return -1;
+    }
+    for (int i = 1; i < wCount; i++)
+    {
+        if (pstPoints[i].dbDepth <= pstPoints[i - 1].dbDepth)
+        {
+            return -1;
+        }
+    }
+
+    uint32_t u32MaxDepthMm = (uint32_t)ceil(pstPoints[wCount - 1].dbDepth);
+    double *pdbLitres = (double *)malloc((u32MaxDepthMm + 1) * sizeof(double));
+    if (pdbLitres == NULL)
+    {
+        return -1;
+    }
+
+    // Walk the points once; every millimetre lies in the segment ending at iUpper
+    int iUpper = 0;
+    for (uint32_t u32Mm = 0; u32Mm <= u32MaxDepthMm; u32Mm++)
+    {
+        while (iUpper < wCount - 1 && pstPoints[iUpper].dbDepth < u32Mm)
+            iUpper++;
+
+        const ChartPoint *pstHigh = &pstPoints[iUpper];
+        if (iUpper == 0 || u32Mm >= pstHigh->dbDepth)
+        {
+            pdbLitres[u32Mm] = pstHigh->dbLitres;
+            continue;
+        }
+        const ChartPoint *pstLow = &pstPoints[iUpper - 1];
+        pdbLitres[u32Mm] = pstLow->dbLitres + (u32Mm - pstLow->dbDepth) * (pstHigh->dbLitres - pstLow->dbLitres) /
+                                                  (pstHigh->dbDepth - pstLow->dbDepth);
+    }
+
+    pstChart->u32MaxDepthMm = u32MaxDepthMm;
+    pstChart->pdbLitres = pdbLitres;
+    pstChart->dbCapacity = pstPoints[wCount - 1].dbLitres;
+    pstChart->bVerified = true;
+    return 0;
+}
+
+static int fnLoadChart(DipChart *pstChart, const char *achPath)
+{
+    char *achText = fnReadFile(achPath);
+    if (achText == NULL)
+    {
+        return -1;
+    }
+
+    ChartPoint *pstPoints = NULL;
+    int wCount = fnParseChart(achText, &pstPoints);
+    free(achText);
+
+    int rc = (wCount > 0) ? fnBuildTable(pstChart, pstPoints, wCount) : -1;
+    free(pstPoints);
+    return rc;
+}
+
+static int fnCompareCharts(const void *pvA, const void *pvB)
+{
+    return strcmp(((const DipChart *)pvA)->achName, ((const DipChart *)pvB)->achName);
+}
+
+/**
+ * Parse every <name>.json chart in a directory
+ * @return Number of charts loaded, sorted by name; a missing directory or
+ *         unreadable chart is reported and skipped, since volume is optional
+ */
+int fnDipChartLoadDir(DipChartSet *pstSet, const char *achDir)
+{
+    memset(pstSet, 0, sizeof(DipChartSet));
+
+    DIR *pDir = opendir(achDir);
+    if (pDir == NULL)
+    {
+        printf("Dip charts: no directory %s\n", achDir);
+        return 0;
+    }
+
+    int wCapacity = 0;
+    struct dirent *pstEntry;
+    while ((pstEntry = readdir(pDir)) != NULL)
+    {
+        size_t szName = strlen(pstEntry->d_name);
+        if (szName <= 5 || szName - 5 >= PROBE_TOPIC_LEN || strcmp(pstEntry->d_name + szName - 5, ".json") != 0)
+        {
+            continue;
+        }
+
+        if (pstSet->wCount == wCapacity)
+        {
+            wCapacity = wCapacity ? wCapacity * 2 : 16;
+            DipChart *pstGrown = (DipChart *)realloc(pstSet->pstCharts, wCapacity * sizeof(DipChart));
+            if (pstGrown == NULL)
+            {
+                break;
+            }
+            pstSet->pstCharts = pstGrown;
+        }
+
+        char achPath[DIPCHART_PATH_LEN + PROBE_TOPIC_LEN + 8];
+        snprintf(achPath, sizeof(achPath), "%s/%s", achDir, pstEntry->d_name);
+
+        DipChart *pstChart = &pstSet->pstCharts[pstSet->wCount];
+        memset(pstChart, 0, sizeof(DipChart));
+        snprintf(pstChart->achName, sizeof(pstChart->achName), "%.*s", (int)(szName - 5), pstEntry->d_name);
+        if (fnLoadChart(pstChart, achPath) != 0)
+        {
+            printf("Dip charts: %s is not a usable chart, ignored\n", achPath);
+            continue;
+        }
+        pstSet->wCount++;
+    }
+    closedir(pDir);
+
+    if (pstSet->wCount > 1)
+    {
+        qsort(pstSet->pstCharts, pstSet->wCount, sizeof(DipChart), fnCompareCharts);
+    }
+    return pstSet->wCount;
+}
+
+// Check the mapped header and index and describe each chart; returns why the file is unusable, or NULL
+static const char *fnDipChartIndex(DipChartSet *pstSet)
+{
+    const ChartFileHeader *pstHeader = (const ChartFileHeader *)pstSet->pu8Map;
+    if (pstSet->szMap < sizeof(ChartFileHeader) || memcmp(pstHeader->achMagic, DIPCHART_MAGIC, 4) != 0)
+        return "not a compiled chart file";
+    if (pstHeader->u16Version != DIPCHART_VERSION || pstHeader->u16EntrySize != sizeof(ChartFileEntry))
+        return "unsupported version";
+    if (pstHeader->u64FileSize != pstSet->szMap)
+        return "truncated";
+
+    uint32_t u32Charts = pstHeader->u32Charts;
+    size_t szIndex = (size_t)u32Charts * sizeof(ChartFileEntry);
+    if (u32Charts > (pstSet->szMap - sizeof(ChartFileHeader)) / sizeof(ChartFileEntry))
+        return "truncated index";
+
+    const ChartFileEntry *pstEntries = (const ChartFileEntry *)(pstSet->pu8Map + sizeof(ChartFileHeader));
+    if (fnChartCrc32(pstEntries, szIndex) != pstHeader->u32IndexCrc)
+        return "index checksum mismatch";
+
+    pstSet->pstCharts = (DipChart *)calloc(u32Charts ? u32Charts : 1, sizeof(DipChart));
+    if (pstSet->pstCharts == NULL)
+        return "out of memory";
+
+    for (uint32_t i = 0; i < u32Charts; i++)
+    {
+        const ChartFileEntry *pstEntry = &pstEntries[i];
+        uint64_t u64Length = ((uint64_t)pstEntry->u32MaxDepthMm + 1) * sizeof(double);
+        if (memchr(pstEntry->achName, '\0', sizeof(pstEntry->achName)) == NULL ||
+            pstEntry->u32MaxDepthMm > DIPCHART_MAX_DEPTH_MM || (pstEntry->u64Offset % sizeof(double)) != 0 ||
+            pstEntry->u64Offset < sizeof(ChartFileHeader) + szIndex || pstEntry->u64Offset > pstSet->szMap ||
+            u64Length > pstSet->szMap - pstEntry->u64Offset)
+        {
+            return "bad index entry";
+        }
+
+        DipChart *pstChart = &pstSet->pstCharts[i];
+        memcpy(pstChart->achName, pstEntry->achName, sizeof(pstChart->achName));
+        pstChart->u32MaxDepthMm = pstEntry->u32MaxDepthMm;
+        pstChart->pdbLitres = (const double *)(pstSet->pu8Map + pstEntry->u64Offset);
+        pstChart->dbCapacity = pstEntry->dbCapacity;
+        pstChart->u32Crc = pstEntry->u32TableCrc;
+        pstSet->wCount++;
+    }
+    return NULL;
+}
+
+/**
+ * Map a file written by fnDipChartWrite
+ * @return Number of charts, or -1 if the file is missing or invalid (reported)
+ */
+int fnDipChartMap(DipChartSet *pstSet, const char *achPath)
+{
+    memset(pstSet, 0, sizeof(DipChartSet));
+
+    int fd = open(achPath, O_RDONLY);
+    if (fd < 0)
+    {
+        if (errno != ENOENT)
+            printf("Dip charts: cannot open %s: %s\n", achPath, strerror(errno));
+        return -1;
+    }
+
+    struct stat stInfo;
+    void *pvMap = MAP_FAILED;
+    if (fstat(fd, &stInfo) == 0 && stInfo.st_size > 0)
+    {
+        pvMap = mmap(NULL, (size_t)stInfo.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (pvMap == MAP_FAILED)
+    {
+        printf("Dip charts: cannot map %s\n", achPath);
+        return -1;
+    }
+
+    pstSet->pu8Map = (const uint8_t *)pvMap;
+    pstSet->szMap = (size_t)stInfo.st_size;
+    const char *achError = fnDipChartIndex(pstSet);
+    if (achError != NULL)
+    {
+        printf("Dip charts: %s rejected: %s\n", achPath, achError);
+        fnDipChartFree(pstSet);
+        return -1;
+    }
+    return pstSet->wCount;
+}
+
+/**
+ * Load the charts for the poller: the compiled file when it is present and
+ * valid, otherwise the JSON directory
+ * @return Number of charts loaded
+ */
+int fnDipChartLoad(DipChartSet *pstSet, const DipChartConfig *pstConfig)
+{
+    memset(pstSet, 0, sizeof(DipChartSet));
+    if (!pstConfig->bEnabled)
+    {
+        return 0;
+    }
+
+    const char *achSource = pstConfig->achFile;
+    if (achSource[0] == '\0' || fnDipChartMap(pstSet, achSource) < 0)
+    {
+        achSource = pstConfig->achDir;
+        fnDipChartLoadDir(pstSet, achSource);
+    }
+    if (pstSet->wCount > 0)
+    {
+        printf("Dip charts: %d loaded from %s\n", pstSet->wCount, achSource);
+    }
+    return pstSet->wCount;
+}
+
+/**
+ * Write a chart set as a compiled file. The file is written beside the
+ * target and renamed over it, so a running poller never maps a partial file.
+ * @return 0 on success, -1 on error (reported)
+ */
+int fnDipChartWrite(const DipChartSet *pstSet, const char *achPath)
+{
+    if (strlen(achPath) >= DIPCHART_PATH_LEN)
+    {
+        printf("Dip charts: output path too long\n");
+        return -1;
+    }
+
+    size_t szIndex = (size_t)pstSet->wCount * sizeof(ChartFileEntry);
+    ChartFileEntry *pstEntries = (ChartFileEntry *)calloc(pstSet->wCount ? pstSet->wCount : 1, sizeof(ChartFileEntry));
+    if (pstEntries == NULL)
+    {
+        return -1;
+    }
+
+    // Tables follow the index; both sizes are multiples of 8, keeping the tables aligned
+    uint64_t u64Offset = sizeof(ChartFileHeader) + szIndex;
+    for (int i = 0; i < pstSet->wCount; i++)
+    {
+        const DipChart *pstChart = &pstSet->pstCharts[i];
+        size_t szTable = ((size_t)pstChart->u32MaxDepthMm + 1) * sizeof(double);
+        snprintf(pstEntries[i].achName, sizeof(pstEntries[i].achName), "%s", pstChart->achName);
+        pstEntries[i].u32MaxDepthMm = pstChart->u32MaxDepthMm;
+        pstEntries[i].u32TableCrc = fnChartCrc32(pstChart->pdbLitres, szTable);
+        pstEntries[i].u64Offset = u64Offset;
+        pstEntries[i].dbCapacity = pstChart->dbCapacity;
+        u64Offset += szTable;
+    }
+
+    ChartFileHeader stHeader;
+    memset(&stHeader, 0, sizeof(stHeader));
+    memcpy(stHeader.achMagic, DIPCHART_MAGIC, 4);
+    stHeader.u16Version = DIPCHART_VERSION;
+    stHeader.u16EntrySize = sizeof(ChartFileEntry);
+    stHeader.u32Charts = (uint32_t)pstSet->wCount;
+    stHeader.u32IndexCrc = fnChartCrc32(pstEntries, szIndex);
+    stHeader.u64FileSize = u64Offset;
+
+    char achTemp[DIPCHART_PATH_LEN + 8];
+    snprintf(achTemp, sizeof(achTemp), "%s.tmp", achPath);
+    FILE *pFile = fopen(achTemp, "wb");
+    bool bOk = (pFile != NULL);
+    if (bOk)
+    {
+        bOk = fwrite(&stHeader, sizeof(stHeader), 1, pFile) == 1 &&
+              (szIndex == 0 || fwrite(pstEntries, szIndex, 1, pFile) == 1);
+        for (int i = 0; i < pstSet->wCount && bOk; i++)
+        {
+            const DipChart *pstChart = &pstSet->pstCharts[i];
+            bOk = fwrite(pstChart->pdbLitres, sizeof(double), pstChart->u32MaxDepthMm + 1, pFile) ==
+                  pstChart->u32MaxDepthMm + 1;
+        }
+        bOk = (fflush(pFile) == 0) && bOk && fsync(fileno(pFile)) == 0;
+        bOk = (fclose(pFile) == 0) && bOk;
+    }
+    free(pstEntries);
+
+    if (!bOk || rename(achTemp, achPath) != 0)
+    {
+        printf("Dip charts: cannot write %s: %s\n", achPath, strerror(errno));
+        unlink(achTemp);
+        return -1;
+    }
+    return 0;
+}
+
+void fnDipChartFree(DipChartSet *pstSet)
+{
+    if (pstSet->pu8Map != NULL)
+    {
+        munmap((void *)pstSet->pu8Map, pstSet->szMap);
+    }
+    else
+    {
+        for (int i = 0; i < pstSet->wCount; i++)
+        {
+            free((void *)pstSet->pstCharts[i].pdbLitres);
+        }
+    }
+    free(pstSet->pstCharts);
+    memset(pstSet, 0, sizeof(DipChartSet));
+}
+
+const DipChart *fnDipChartFind(const DipChartSet *pstSet, const char *achName)
+{
+    for (int i = 0; i < pstSet->wCount; i++)
+    {
+        if (strcmp(pstSet->pstCharts[i].achName, achName) == 0)
+        {
+            return &pstSet->pstCharts[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Point every probe at its chart, by its "chart" key or else its topic,
+ * checking a mapped table the first time it is used. Done before the buses
+ * copy their probes, so each copy shares the tables.
+ */
+void fnDipChartAttach(DipChartSet *pstSet, ProbeRegistry *pstRegistry)
+{
+    for (int i = 0; i < pstRegistry->wCount; i++)
+    {
+        AtgProbe *pstProbe = &pstRegistry->pstProbes[i];
+        const char *achName = pstProbe->achChart[0] ? pstProbe->achChart : pstProbe->achTopic;
+        DipChart *pstChart = (DipChart *)fnDipChartFind(pstSet, achName);
+        if (pstChart != NULL && !pstChart->bVerified)
+        {
+            size_t szTable = ((size_t)pstChart->u32MaxDepthMm + 1) * sizeof(double);
+            pstChart->bVerified = (fnChartCrc32(pstChart->pdbLitres, szTable) == pstChart->u32Crc);
+        }
+
+        pstProbe->pstChart = (pstChart != NULL && pstChart->bVerified) ? pstChart : NULL;
+        if (pstChart != NULL && pstProbe->pstChart == NULL)
+        {
+            printf("Dip charts: chart %s fails its checksum, probe %s has no volume\n", achName,
+                   pstProbe->achAddress);
+        }
+        else if (pstChart == NULL && pstSet->wCount > 0)
+        {
+            printf("Dip charts: no chart %s for probe %s\n", achName, pstProbe->achAddress);
+        }
+    }
+}
+
+/**
+ * Litres held at a product level
+ * @param dbDepthMm Product level in mm
+ */
+double fnDipChartVolume(const DipChart *pstChart, double dbDepthMm)
+{
+    if (!(dbDepthMm > 0))
+    {
+        return pstChart->pdbLitres[0];
+    }
+    if (dbDepthMm >= pstChart->u32MaxDepthMm)
+    {
+        return pstChart->dbCapacity;
+    }
+
+    uint32_t u32Mm = (uint32_t)dbDepthMm;
+    double dbFraction = dbDepthMm - u32Mm;
+    const double *pdbAt = &pstChart->pdbLitres[u32Mm];
+    return pdbAt[0] + dbFraction * (pdbAt[1] - pdbAt[0]);
+}
@@ -0,0 +1,58 @@
+/**
+ * Dip Charts
+ * Per-tank strapping tables turning a product level into litres
+ */
+
+#ifndef DIPCHART_H
+#define DIPCHART_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "registry.h"
+
+#define DIPCHART_PATH_LEN 128
+#define DIPCHART_MAX_DEPTH_MM 100000 // Deepest table accepted (100 m)
+
+// Compiled chart file, layout in dipchart.c
+#define DIPCHART_MAGIC "ATGD"
+#define DIPCHART_VERSION 1
+
+typedef struct {
+    bool bEnabled;
+    char achFile[DIPCHART_PATH_LEN]; // Compiled charts, used when present
+    char achDir[DIPCHART_PATH_LEN];  // Directory of <name>.json charts otherwise
+} DipChartConfig;
+
+// One tank's chart, resampled to every whole millimetre
+typedef struct DipChart {
+    char achName[PROBE_TOPIC_LEN]; // File stem, e.g. ATG83731
+    uint32_t u32MaxDepthMm;        // Top of the chart
+    const double *pdbLitres;       // Volume at 0..u32MaxDepthMm mm
+    double dbCapacity;             // Volume at the top of the chart
+    uint32_t u32Crc;               // CRC-32 of the table in the compiled file
+    bool bVerified;                // Table checked against u32Crc, or built from JSON
+} DipChart;
+
+typedef struct {
+    DipChart *pstCharts;
+    int wCount;
+
+    // Read-only mapping of the compiled file, NULL when parsed from JSON
+    const uint8_t *pu8Map;
+    size_t szMap;
+} DipChartSet;
+
+void fnDipChartConfigDefaults(DipChartConfig *pstConfig);
+int fnDipChartLoadConfig(DipChartConfig *pstConfig, const char *achPath);
+int fnDipChartLoad(DipChartSet *pstSet, const DipChartConfig *pstConfig);
+int fnDipChartLoadDir(DipChartSet *pstSet, const char *achDir);
+int fnDipChartMap(DipChartSet *pstSet, const char *achPath);
+int fnDipChartWrite(const DipChartSet *pstSet, const char *achPath);
+void fnDipChartFree(DipChartSet *pstSet);
+const DipChart *fnDipChartFind(const DipChartSet *pstSet, const char *achName);
+void fnDipChartAttach(DipChartSet *pstSet, ProbeRegistry *pstRegistry);
+
+double fnDipChartVolume(const DipChart *pstChart, double dbDepthMm);
+
+#endif
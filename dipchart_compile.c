@@ -0,0 +1,69 @@
+/**
+ * Dip Chart Compiler
+ * Turns a directory of <name>.json strapping tables into the file the
+ * poller maps at startup (layout in dipchart.c)
+ *
+ * Usage: dipchart_compile <chart dir> <output file>
+ *   e.g. dipchart_compile dip_charts /etc/atg_poller/dip_charts.bin
+ */
+
+#include "dipchart.h"
+#include <stdio.h>
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        printf("Usage: %s <chart dir> <output file>\n", argv[0]);
+        return 2;
+    }
+
+    DipChartSet stCharts;
+    if (fnDipChartLoadDir(&stCharts, argv[1]) == 0)
+    {
+        printf("No usable charts in %s\n", argv[1]);
+        fnDipChartFree(&stCharts);
+        return 1;
+    }
+
+    for (int i = 0; i < stCharts.wCount; i++)
+    {
+        const DipChart *pstChart = &stCharts.pstCharts[i];
+        printf("  %-24s %5u mm %10.0f L\n", pstChart->achName, pstChart->u32MaxDepthMm, pstChart->dbCapacity);
+    }
+
+    int rc = fnDipChartWrite(&stCharts, argv[2]);
+
+    // Read the result back the way the poller will, and compare every table
+    DipChartSet stCompiled;
+    if (rc == 0 && fnDipChartMap(&stCompiled, argv[2]) != stCharts.wCount)
+    {
+        rc = -1;
+    }
+    else if (rc == 0)
+    {
+        for (int i = 0; i < stCharts.wCount && rc == 0; i++)
+        {
+            const DipChart *pstSource = &stCharts.pstCharts[i];
+            const DipChart *pstChart = fnDipChartFind(&stCompiled, pstSource->achName);
+            for (uint32_t u32Mm = 0; pstChart != NULL && u32Mm <= pstSource->u32MaxDepthMm; u32Mm++)
+            {
+                if (pstChart->pdbLitres[u32Mm] != pstSource->pdbLitres[u32Mm])
+                    pstChart = NULL;
+            }
+            if (pstChart == NULL)
+            {
+                printf("Chart %s did not read back intact\n", pstSource->achName);
+                rc = -1;
+            }
+        }
+        fnDipChartFree(&stCompiled);
+    }
+
+    if (rc == 0)
+    {
+        printf("Compiled %d chart(s) into %s\n", stCharts.wCount, argv[2]);
+    }
+    fnDipChartFree(&stCharts);
+    return rc == 0 ? 0 : 1;
+}
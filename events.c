@@ -0,0 +1,445 @@
+/**
+ * Tank Events
+ *
+ * Deliveries, thefts and leaks used to be inferred by the server from the
+ * readings that happen to be published, minutes apart. Here every reading
+ * of a probe, at its full poll rate, drives a small state machine:
+ *
+ *   IDLE     -> DELIVERY  product rose delivery_mm above its lowest level of
+ *                         the last delivery_window_s (DeliveryStart)
+ *   IDLE     -> LOSS      in quiet hours, product fell loss_mm below its
+ *                         highest quiet-hours level of the last
+ *                         loss_window_s (LossStart)
+ *   DELIVERY -> IDLE      product moved less than settle_mm for settle_s,
+ *                         or for as long as the rise took to detect if
+ *                         that is longer (DeliveryEnd)
+ *   LOSS     -> IDLE      the same, or quiet hours ended (LossEnd)
+ *
+ * Independently, water rising water_rise_mm above its lowest level since
+ * the last such event raises WaterRise. Each event carries the start and
+ * end level, and the volume when the probe has a dip chart, and goes out on
+ * <topic>/event through the publish lane, journaled like readings. An event
+ * the lane has no room for is held on the probe and offered again, ahead
+ * of anything newer, with each following reading:
+ *
+ *   {"Address":"83731","Event":"DeliveryEnd","Timestamp":"...",
+ *    "Start":"...","StartLevel":812.40,"StartVolume":10211.52,
+ *    "End":"...","EndLevel":1630.10,"EndVolume":20433.18,"Volume":10221.66}
+ *
+ * The lowest and highest levels are tracked in two window-long buckets, so
+ * the reference always covers between one and two windows of history in
+ * constant memory. A slow drift such as thermal expansion is absorbed as
+ * the buckets roll over; a delivery or a draining tank is not. Detection
+ * runs on the filtered readings (see filter.c), which is what the volumes
+ * in the published readings are computed from too.
+ */
+
+#include "events.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "config.h"
+#include "main_linux.h"
+
+void fnEventConfigDefaults(EventConfig *pstConfig)
+{
+    pstConfig->bEnabled = true;
+    pstConfig->fDeliveryMm = EVENT_DELIVERY_MM;
+    pstConfig->u32DeliveryWindowS = EVENT_DELIVERY_WINDOW_S;
+    pstConfig->fLossMm = EVENT_LOSS_MM;
+    pstConfig->u32LossWindowS = EVENT_LOSS_WINDOW_S;
+    pstConfig->fSettleMm = EVENT_SETTLE_MM;
+    pstConfig->u32SettleS = EVENT_SETTLE_S;
+    pstConfig->fWaterRiseMm = EVENT_WATER_RISE_MM;
+    pstConfig->wQuietStartHour = EVENT_QUIET_START_HOUR;
+    pstConfig->wQuietEndHour = EVENT_QUIET_END_HOUR;
+}
+
+static int fnEventConfigHandler(void *pvContext, const char *achSection, const char *achName,
+                                const char *achKey, const char *achValue, int wLine)
+{
+    EventConfig *pstConfig = (EventConfig *)pvContext;
+    (void)achName;
+
+    if (strcmp(achSection, "events") != 0 || achKey[0] == '\0')
+    {
+        return 0;
+    }
+
+    if (strcmp(achKey, "enabled") == 0)
+    {
+        pstConfig->bEnabled = fnConfigParseBool(achValue);
+        return 0;
+    }
+    if (strcmp(achKey, "quiet_hours") == 0)
+    {
+        // <start>-<end> in local hours, e.g. 22-6
+        int wStart, wEnd;
+        if (sscanf(achValue, "%d-%d", &wStart, &wEnd) != 2 || wStart < 0 || wStart > 23 || wEnd < 0 ||
+            wEnd > 23)
+        {
+            printf("Config line %d: quiet_hours must be <start>-<end> with hours 0-23\n", wLine);
+            return -1;
+        }
+        pstConfig->wQuietStartHour = wStart;
+        pstConfig->wQuietEndHour = wEnd;
+        return 0;
+    }
+
+    double dbValue = strtod(achValue, NULL);
+    if (strcmp(achKey, "delivery_mm") == 0 || strcmp(achKey, "loss_mm") == 0 || strcmp(achKey, "settle_mm") == 0 ||
+        strcmp(achKey, "water_rise_mm") == 0)
+    {
+        if (dbValue < 0 || (dbValue == 0 && strcmp(achKey, "water_rise_mm") != 0))
+        {
+            printf("Config line %d: %s must be above 0\n", wLine, achKey);
+            return -1;
+        }
+        if (achKey[0] == 'd')
+            pstConfig->fDeliveryMm = (float)dbValue;
+        else if (achKey[0] == 'l')
+            pstConfig->fLossMm = (float)dbValue;
+        else if (achKey[0] == 's')
+            pstConfig->fSettleMm = (float)dbValue;
+        else
+            pstConfig->fWaterRiseMm = (float)dbValue;
+    }
+    else if (strcmp(achKey, "delivery_window_s") == 0 || strcmp(achKey, "loss_window_s") == 0 ||
+             strcmp(achKey, "settle_s") == 0)
+    {
+        if (dbValue < 10 || dbValue > 86400)
+        {
+            printf("Config line %d: %s must be 10 to 86400 s\n", wLine, achKey);
+            return -1;
+        }
+        if (achKey[0] == 'd')
+            pstConfig->u32DeliveryWindowS = (uint32_t)dbValue;
+        else if (achKey[0] == 'l')
+            pstConfig->u32LossWindowS = (uint32_t)dbValue;
+        else
+            pstConfig->u32SettleS = (uint32_t)dbValue;
+    }
+    else
+    {
+        printf("Config line %d: unknown events key '%s' ignored\n", wLine, achKey);
+    }
+    return 0;
+}
+
+/**
+ * Read the [events] section on top of the defaults
+ * @return 0 on success (or missing file), >0 on parse error
+ */
+int fnEventLoadConfig(EventConfig *pstConfig, const char *achPath)
+{
+    fnEventConfigDefaults(pstConfig);
+    int rc = fnConfigParse(achPath, fnEventConfigHandler, pstConfig);
+    return (rc == -1) ? 0 : rc;
+}
+
+/**
+ * Forget a probe's history and any open event
+ */
+void fnEventReset(ProbeEvents *pstEvents)
+{
+    memset(pstEvents, 0, sizeof(ProbeEvents));
+}
+
+const char *fnEventKindName(TankEventKind eKind)
+{
+    switch (eKind)
+    {
+    case EVENT_DELIVERY_START:
+        return "DeliveryStart";
+    case EVENT_DELIVERY_END:
+        return "DeliveryEnd";
+    case EVENT_LOSS_START:
+        return "LossStart";
+    case EVENT_LOSS_END:
+        return "LossEnd";
+    default:
+        return "WaterRise";
+    }
+}
+
+// Roll the buckets over when the current one is a window old, then keep the
+// lowest (bLow) or highest level of the current one
+static void fnEventReferenceAdd(EventReference *pstReference, const EventPoint *pstPoint, int64_t i64WindowMs,
+                                bool bLow)
+{
+    EventPoint *pstCurrent = &pstReference->astExtreme[1];
+
+    if (pstPoint->i64Ms - pstReference->i64BucketMs >= i64WindowMs)
+    {
+        // After a gap of more than a window the previous bucket is too old as well
+        if (pstPoint->i64Ms - pstReference->i64BucketMs < 2 * i64WindowMs)
+            pstReference->astExtreme[0] = *pstCurrent;
+        else
+            pstReference->astExtreme[0].i64Ms = 0;
+        pstCurrent->i64Ms = 0;
+        pstReference->i64BucketMs = pstPoint->i64Ms;
+    }
+    if (pstCurrent->i64Ms == 0 || (bLow ? pstPoint->dbLevel < pstCurrent->dbLevel
+                                        : pstPoint->dbLevel > pstCurrent->dbLevel))
+    {
+        *pstCurrent = *pstPoint;
+    }
+}
+
+static const EventPoint *fnEventReferenceGet(const EventReference *pstReference, bool bLow)
+{
+    const EventPoint *pstPrevious = &pstReference->astExtreme[0];
+    const EventPoint *pstCurrent = &pstReference->astExtreme[1];
+
+    if (pstPrevious->i64Ms == 0)
+        return pstCurrent;
+    if (bLow ? pstPrevious->dbLevel < pstCurrent->dbLevel : pstPrevious->dbLevel > pstCurrent->dbLevel)
+        return pstPrevious;
+    return pstCurrent;
+}
+
+static bool fnEventQuietHours(const EventConfig *pstConfig, int64_t i64Ms)
+{
+    time_t seconds = (time_t)(i64Ms / 1000);
+    struct tm local;
+    localtime_r(&seconds, &local);
+
+    int wStart = pstConfig->wQuietStartHour;
+    int wEnd = pstConfig->wQuietEndHour;
+    if (wStart == wEnd)
+        return true;
+    if (wStart < wEnd)
+        return local.tm_hour >= wStart && local.tm_hour < wEnd;
+    return local.tm_hour >= wStart || local.tm_hour < wEnd;
+}
+
+// Offer the held events to fnHandler in order, stopping at the first it refuses
+static void fnEventFlushPending(ProbeEvents *pstEvents, EventHandler fnHandler, void *pvContext)
+{
+    int wTaken = 0;
+    while (wTaken < pstEvents->wPending && fnHandler(&pstEvents->astPending[wTaken], pvContext))
+    {
+        wTaken++;
+    }
+    if (wTaken > 0)
+    {
+        pstEvents->wPending -= wTaken;
+        memmove(pstEvents->astPending, &pstEvents->astPending[wTaken], pstEvents->wPending * sizeof(TankEvent));
+    }
+}
+
+static void fnEventRaise(ProbeEvents *pstEvents, TankEventKind eKind, const EventPoint *pstStart,
+                         const EventPoint *pstEnd, int64_t i64DetectedMs, EventHandler fnHandler, void *pvContext)
+{
+    TankEvent stEvent;
+    memset(&stEvent, 0, sizeof(stEvent));
+    stEvent.eKind = eKind;
+    stEvent.i64DetectedMs = i64DetectedMs;
+    stEvent.stStart = *pstStart;
+    if (pstEnd != NULL)
+    {
+        stEvent.stEnd = *pstEnd;
+    }
+
+    // Behind any held event, so they go out in the order they happened
+    if (pstEvents->wPending == 0 && fnHandler(&stEvent, pvContext))
+    {
+        return;
+    }
+    if (pstEvents->wPending == EVENT_PENDING_MAX)
+    {
+        printf("%s at %.1f mm dropped, %d events already waiting\n", fnEventKindName(eKind), pstStart->dbLevel,
+               EVENT_PENDING_MAX);
+        return;
+    }
+    pstEvents->astPending[pstEvents->wPending++] = stEvent;
+}
+
+// Start tracking a delivery or loss detected at pstNow. A leak that took
+// twenty minutes to show must also stay still longer than a pump stop
+// before it counts as over.
+static void fnEventOpen(ProbeEvents *pstEvents, const EventConfig *pstConfig, const EventPoint *pstNow)
+{
+    pstEvents->stMoved = *pstNow;
+    pstEvents->i64SettleMs = pstNow->i64Ms - pstEvents->stOpenStart.i64Ms;
+    if (pstEvents->i64SettleMs < (int64_t)pstConfig->u32SettleS * 1000)
+    {
+        pstEvents->i64SettleMs = (int64_t)pstConfig->u32SettleS * 1000;
+    }
+}
+
+/**
+ * Feed one (filtered) reading to a probe's detector, handing each event it
+ * raises to fnHandler after any still held from earlier readings. A
+ * disabled detector forgets its state.
+ */
+void fnEventUpdate(ProbeEvents *pstEvents, const EventConfig *pstConfig, const AtgData *pstData,
+                   EventHandler fnHandler, void *pvContext)
+{
+    if (!pstConfig->bEnabled)
+    {
+        // Start from scratch if it is enabled again by a reload
+        fnEventReset(pstEvents);
+        return;
+    }
+    fnEventFlushPending(pstEvents, fnHandler, pvContext);
+    if (pstData->timestamp <= 0)
+    {
+        return;
+    }
+
+    int64_t i64Now = pstData->timestamp;
+    EventPoint stNow = {i64Now, pstData->product, pstData->volume};
+
+    // Water ingress, measured from the lowest water since the last report
+    if (pstConfig->fWaterRiseMm > 0)
+    {
+        EventPoint stWater = {i64Now, pstData->water, -1.0};
+        if (pstEvents->stWater.i64Ms == 0 || stWater.dbLevel <= pstEvents->stWater.dbLevel)
+        {
+            pstEvents->stWater = stWater;
+        }
+        else if (stWater.dbLevel - pstEvents->stWater.dbLevel >= pstConfig->fWaterRiseMm)
+        {
+            fnEventRaise(pstEvents, EVENT_WATER_RISE, &pstEvents->stWater, &stWater, i64Now, fnHandler,
+                         pvContext);
+            pstEvents->stWater = stWater;
+        }
+    }
+
+    bool bQuiet = fnEventQuietHours(pstConfig, i64Now);
+
+    if (pstEvents->eState == EVENT_STATE_IDLE)
+    {
+        fnEventReferenceAdd(&pstEvents->stLow, &stNow, (int64_t)pstConfig->u32DeliveryWindowS * 1000, true);
+        if (bQuiet)
+        {
+            fnEventReferenceAdd(&pstEvents->stHigh, &stNow, (int64_t)pstConfig->u32LossWindowS * 1000, false);
+        }
+        else
+        {
+            // Daytime sales must not count against the first quiet window
+            memset(&pstEvents->stHigh, 0, sizeof(EventReference));
+            pstEvents->stNearHigh.i64Ms = 0;
+        }
+
+        // The movement started at the last reading still close to the reference
+        const EventPoint *pstLow = fnEventReferenceGet(&pstEvents->stLow, true);
+        const EventPoint *pstHigh = fnEventReferenceGet(&pstEvents->stHigh, false);
+        if (stNow.dbLevel - pstLow->dbLevel <= pstConfig->fSettleMm)
+        {
+            pstEvents->stNearLow = stNow;
+        }
+        if (pstHigh->i64Ms != 0 && pstHigh->dbLevel - stNow.dbLevel <= pstConfig->fSettleMm)
+        {
+            pstEvents->stNearHigh = stNow;
+        }
+
+        if (stNow.dbLevel - pstLow->dbLevel >= pstConfig->fDeliveryMm)
+        {
+            pstEvents->eState = EVENT_STATE_DELIVERY;
+            pstEvents->stOpenStart = (pstEvents->stNearLow.i64Ms != 0) ? pstEvents->stNearLow : *pstLow;
+            fnEventOpen(pstEvents, pstConfig, &stNow);
+            fnEventRaise(pstEvents, EVENT_DELIVERY_START, &pstEvents->stOpenStart, NULL, i64Now, fnHandler,
+                         pvContext);
+        }
+        else if (bQuiet && pstHigh->i64Ms != 0 && pstHigh->dbLevel - stNow.dbLevel >= pstConfig->fLossMm)
+        {
+            pstEvents->eState = EVENT_STATE_LOSS;
+            pstEvents->stOpenStart = (pstEvents->stNearHigh.i64Ms != 0) ? pstEvents->stNearHigh : *pstHigh;
+            fnEventOpen(pstEvents, pstConfig, &stNow);
+            fnEventRaise(pstEvents, EVENT_LOSS_START, &pstEvents->stOpenStart, NULL, i64Now, fnHandler, pvContext);
+        }
+        return;
+    }
+
+    // An open delivery or loss ends once the product has settled; a loss
+    // also ends with the quiet hours
+    bool bLoss = (pstEvents->eState == EVENT_STATE_LOSS);
+    bool bMoving = fabs(stNow.dbLevel - pstEvents->stMoved.dbLevel) > pstConfig->fSettleMm;
+    if (bMoving)
+    {
+        pstEvents->stMoved = stNow;
+    }
+    bool bSettled = !bMoving && i64Now - pstEvents->stMoved.i64Ms >= pstEvents->i64SettleMs;
+    if (!bSettled && !(bLoss && !bQuiet))
+    {
+        return;
+    }
+
+    // A settled event ended when it stopped moving, at the level it settled on
+    EventPoint stEnd = stNow;
+    if (bSettled)
+    {
+        stEnd.i64Ms = pstEvents->stMoved.i64Ms;
+    }
+
+    fnEventRaise(pstEvents, bLoss ? EVENT_LOSS_END : EVENT_DELIVERY_END, &pstEvents->stOpenStart, &stEnd, i64Now,
+                 fnHandler, pvContext);
+
+    // Measure the next event from here
+    ProbeEvents stNext;
+    memset(&stNext, 0, sizeof(stNext));
+    stNext.stWater = pstEvents->stWater;
+    *pstEvents = stNext;
+    fnEventReferenceAdd(&pstEvents->stLow, &stNow, (int64_t)pstConfig->u32DeliveryWindowS * 1000, true);
+    if (bQuiet)
+    {
+        fnEventReferenceAdd(&pstEvents->stHigh, &stNow, (int64_t)pstConfig->u32LossWindowS * 1000, false);
+    }
+}
+
+// ISO 8601 UTC with milliseconds, as in the reading payload
+static void fnEventFormatTime(char *achTime, size_t szSize, int64_t i64Ms)
+{
+    time_t seconds = (time_t)(i64Ms / 1000);
+    struct tm utc;
+    gmtime_r(&seconds, &utc);
+    snprintf(achTime, szSize, "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ", utc.tm_year + 1900, utc.tm_mon + 1,
+             utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec, (int)(i64Ms % 1000));
+}
+
+/**
+ * Format an event as the JSON event payload
+ * @return Payload length, or -1 if it did not fit
+ */
+int fnEventFormat(char *achPayload, size_t szSize, int address, const TankEvent *pstEvent)
+{
+    char achDetected[48], achStart[48], achEnd[48];
+    fnEventFormatTime(achDetected, sizeof(achDetected), pstEvent->i64DetectedMs);
+    fnEventFormatTime(achStart, sizeof(achStart), pstEvent->stStart.i64Ms);
+
+    int wLength = snprintf(achPayload, szSize,
+                           "{\"Address\":\"%d\",\"Event\":\"%s\",\"Timestamp\":\"%s\",\"Start\":\"%s\","
+                           "\"StartLevel\":%.2f",
+                           address, fnEventKindName(pstEvent->eKind), achDetected, achStart,
+                           pstEvent->stStart.dbLevel);
+    if (pstEvent->stStart.dbVolume >= 0 && wLength > 0 && (size_t)wLength < szSize)
+    {
+        wLength += snprintf(achPayload + wLength, szSize - wLength, ",\"StartVolume\":%.2f",
+                            pstEvent->stStart.dbVolume);
+    }
+
+    if (pstEvent->stEnd.i64Ms != 0 && wLength > 0 && (size_t)wLength < szSize)
+    {
+        fnEventFormatTime(achEnd, sizeof(achEnd), pstEvent->stEnd.i64Ms);
+        wLength += snprintf(achPayload + wLength, szSize - wLength, ",\"End\":\"%s\",\"EndLevel\":%.2f", achEnd,
+                            pstEvent->stEnd.dbLevel);
+        if (pstEvent->stStart.dbVolume >= 0 && pstEvent->stEnd.dbVolume >= 0 && wLength > 0 &&
+            (size_t)wLength < szSize)
+        {
+            wLength += snprintf(achPayload + wLength, szSize - wLength, ",\"EndVolume\":%.2f,\"Volume\":%.2f",
+                                pstEvent->stEnd.dbVolume, pstEvent->stEnd.dbVolume - pstEvent->stStart.dbVolume);
+        }
+    }
+
+    if (wLength > 0 && (size_t)wLength + 1 < szSize)
+    {
+        achPayload[wLength++] = '}';
+        achPayload[wLength] = '\0';
+        return wLength;
+    }
+    return -1;
+}
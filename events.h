@@ -0,0 +1,91 @@
+/**
+ * Tank Events
+ * Delivery, loss and water ingress detection per probe, published as events
+ */
+
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "atg.h"
+
+#define EVENT_PAYLOAD_MAX 384 // Largest formatted event
+#define EVENT_PENDING_MAX 4   // Events held per probe while the publish lane is full
+
+typedef struct {
+    bool bEnabled;
+    float fDeliveryMm;           // Product rise that starts a delivery
+    uint32_t u32DeliveryWindowS; // ...measured over this long
+    float fLossMm;               // Product drop in quiet hours that starts a loss
+    uint32_t u32LossWindowS;     // ...measured over this long
+    float fSettleMm;             // An open event ends once the product moves less
+    uint32_t u32SettleS;         // ...for this long, or as long as it took to detect
+    float fWaterRiseMm;          // Water rise reported as ingress, 0 = off
+    int wQuietStartHour;         // Local hours [start, end) in which losses are
+    int wQuietEndHour;           // detected; start == end means all day
+} EventConfig;
+
+typedef enum {
+    EVENT_DELIVERY_START = 0,
+    EVENT_DELIVERY_END,
+    EVENT_LOSS_START,
+    EVENT_LOSS_END,
+    EVENT_WATER_RISE
+} TankEventKind;
+
+// A level at a point in time
+typedef struct {
+    int64_t i64Ms;   // Unix time in ms; 0 = none
+    double dbLevel;  // mm
+    double dbVolume; // Litres, -1 without a dip chart
+} EventPoint;
+
+typedef struct {
+    TankEventKind eKind;
+    int64_t i64DetectedMs; // Reading that raised the event
+    EventPoint stStart;    // Product level before the movement (water for WATER_RISE)
+    EventPoint stEnd;      // Where it settled; i64Ms 0 for *_START
+} TankEvent;
+
+// Lowest or highest level over the last one to two windows: the extreme of
+// the previous and of the current window-long bucket
+typedef struct {
+    int64_t i64BucketMs;       // Start of the current bucket
+    EventPoint astExtreme[2];  // Previous and current bucket
+} EventReference;
+
+typedef enum {
+    EVENT_STATE_IDLE = 0,
+    EVENT_STATE_DELIVERY,
+    EVENT_STATE_LOSS
+} EventState;
+
+typedef struct {
+    EventState eState;
+    EventReference stLow;   // What a delivery is measured from
+    EventReference stHigh;  // What a loss is measured from (quiet hours only)
+    EventPoint stNearLow;   // Last reading within settle_mm of stLow
+    EventPoint stNearHigh;  // Last reading within settle_mm of stHigh
+    EventPoint stOpenStart; // Start of the open delivery or loss
+    EventPoint stMoved;     // Where the product last moved more than settle_mm
+    int64_t i64SettleMs;    // Stillness that ends the open event
+    EventPoint stWater;     // Lowest water since the last ingress event
+    TankEvent astPending[EVENT_PENDING_MAX]; // Raised but not yet taken by the handler, oldest first
+    int wPending;
+} ProbeEvents;
+
+// Called with each event as it is detected; returns false if it could not
+// take the event, which is then offered again with the next reading
+typedef bool (*EventHandler)(const TankEvent *pstEvent, void *pvContext);
+
+void fnEventConfigDefaults(EventConfig *pstConfig);
+int fnEventLoadConfig(EventConfig *pstConfig, const char *achPath);
+void fnEventReset(ProbeEvents *pstEvents);
+void fnEventUpdate(ProbeEvents *pstEvents, const EventConfig *pstConfig, const AtgData *pstData,
+                   EventHandler fnHandler, void *pvContext);
+const char *fnEventKindName(TankEventKind eKind);
+int fnEventFormat(char *achPayload, size_t szSize, int address, const TankEvent *pstEvent);
+
+#endif
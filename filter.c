@@ -0,0 +1,195 @@
+/**
+ * Signal Conditioning
+ *
+ * Probe readings jitter by a fraction of a millimetre, and the product
+ * surface ripples while a tank is filled. Fed straight to the change
+ * detector, both publish readings that carry no information. Each channel
+ * (product, water, temperature) therefore passes three stages before
+ * fnHasDataChanged sees it:
+ *
+ *   1. Rolling median over the last `median` samples: drops single-sample
+ *      spikes and ripple peaks without smearing a real step.
+ *   2. Exponential smoothing, new = old + ema * (sample - old): averages out
+ *      the remaining noise.
+ *   3. Hysteresis deadband: the output holds its value until the smoothed
+ *      value moves more than `deadband` away, then jumps to it. Noise that
+ *      stays inside the band never reaches the output.
+ *
+ * The last FILTER_MEDIAN_MAX samples and two values per channel are kept in
+ * the probe's slot, so memory is fixed however the filter is configured and
+ * a reload that changes the window takes effect on the next reading. The
+ * scheduler still sees the raw readings, so a moving tank is polled fast
+ * and the window refills within seconds.
+ */
+
+#include "filter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "config.h"
+#include "main_linux.h"
+
+// [filter] key prefix of each channel
+static const char *const aachChannelNames[FILTER_CHANNELS] = {"product", "water", "temp"};
+
+void fnFilterConfigDefaults(FilterConfig *pstConfig)
+{
+    pstConfig->bEnabled = false; // Opt-in, so an upgrade publishes what it did before
+    for (int i = 0; i < FILTER_CHANNELS; i++)
+    {
+        pstConfig->astChannels[i].wMedian = FILTER_MEDIAN_WINDOW;
+    }
+    pstConfig->astChannels[FILTER_PRODUCT].fEma = FILTER_LEVEL_EMA;
+    pstConfig->astChannels[FILTER_PRODUCT].fDeadband = FILTER_LEVEL_DEADBAND;
+    pstConfig->astChannels[FILTER_WATER].fEma = FILTER_LEVEL_EMA;
+    pstConfig->astChannels[FILTER_WATER].fDeadband = FILTER_LEVEL_DEADBAND;
+    pstConfig->astChannels[FILTER_TEMP].fEma = FILTER_TEMP_EMA;
+    pstConfig->astChannels[FILTER_TEMP].fDeadband = FILTER_TEMP_DEADBAND;
+}
+
+static int fnFilterConfigHandler(void *pvContext, const char *achSection, const char *achName,
+                                 const char *achKey, const char *achValue, int wLine)
+{
+    FilterConfig *pstConfig = (FilterConfig *)pvContext;
+    (void)achName;
+
+    if (strcmp(achSection, "filter") != 0 || achKey[0] == '\0')
+    {
+        return 0;
+    }
+
+    if (strcmp(achKey, "enabled") == 0)
+    {
+        pstConfig->bEnabled = fnConfigParseBool(achValue);
+        return 0;
+    }
+
+    // <channel>_median, <channel>_ema, <channel>_deadband
+    const char *achParam = strchr(achKey, '_');
+    FilterChannelConfig *pstChannel = NULL;
+    for (int i = 0; achParam != NULL && i < FILTER_CHANNELS; i++)
+    {
+        if (strncmp(achKey, aachChannelNames[i], achParam - achKey) == 0 &&
+            aachChannelNames[i][achParam - achKey] == '\0')
+        {
+            pstChannel = &pstConfig->astChannels[i];
+        }
+    }
+
+    double dbValue = strtod(achValue, NULL);
+    if (pstChannel != NULL && strcmp(achParam, "_median") == 0)
+    {
+        if (dbValue < 1 || dbValue > FILTER_MEDIAN_MAX)
+        {
+            printf("Config line %d: %s must be 1 to %d samples\n", wLine, achKey, FILTER_MEDIAN_MAX);
+            return -1;
+        }
+        pstChannel->wMedian = (int)dbValue;
+    }
+    else if (pstChannel != NULL && strcmp(achParam, "_ema") == 0)
+    {
+        if (dbValue <= 0 || dbValue > 1)
+        {
+            printf("Config line %d: %s must be above 0 and at most 1\n", wLine, achKey);
+            return -1;
+        }
+        pstChannel->fEma = (float)dbValue;
+    }
+    else if (pstChannel != NULL && strcmp(achParam, "_deadband") == 0)
+    {
+        if (dbValue < 0)
+        {
+            printf("Config line %d: %s must not be negative\n", wLine, achKey);
+            return -1;
+        }
+        pstChannel->fDeadband = (float)dbValue;
+    }
+    else
+    {
+        printf("Config line %d: unknown filter key '%s' ignored\n", wLine, achKey);
+    }
+    return 0;
+}
+
+/**
+ * Read the [filter] section on top of the defaults
+ * @return 0 on success (or missing file), >0 on parse error
+ */
+int fnFilterLoadConfig(FilterConfig *pstConfig, const char *achPath)
+{
+    fnFilterConfigDefaults(pstConfig);
+    int rc = fnConfigParse(achPath, fnFilterConfigHandler, pstConfig);
+    return (rc == -1) ? 0 : rc;
+}
+
+/**
+ * Forget a probe's history, e.g. after it was offline
+ */
+void fnFilterReset(ProbeFilter *pstFilter)
+{
+    memset(pstFilter, 0, sizeof(ProbeFilter));
+}
+
+static double fnFilterChannel(FilterChannel *pstChannel, const FilterChannelConfig *pstConfig, double dbSample)
+{
+    pstChannel->afSamples[pstChannel->u8Next] = (float)dbSample;
+    pstChannel->u8Next = (uint8_t)((pstChannel->u8Next + 1) % FILTER_MEDIAN_MAX);
+    if (pstChannel->u8Count < FILTER_MEDIAN_MAX)
+    {
+        pstChannel->u8Count++;
+    }
+
+    // Median of the newest samples, insertion-sorted (at most 9)
+    int wWindow = (pstConfig->wMedian < pstChannel->u8Count) ? pstConfig->wMedian : pstChannel->u8Count;
+    float afSorted[FILTER_MEDIAN_MAX];
+    for (int i = 0; i < wWindow; i++)
+    {
+        float fSample = pstChannel->afSamples[(pstChannel->u8Next + FILTER_MEDIAN_MAX - 1 - i) % FILTER_MEDIAN_MAX];
+        int j = i;
+        while (j > 0 && afSorted[j - 1] > fSample)
+        {
+            afSorted[j] = afSorted[j - 1];
+            j--;
+        }
+        afSorted[j] = fSample;
+    }
+    double dbMedian = (wWindow % 2) ? afSorted[wWindow / 2]
+                                    : (afSorted[wWindow / 2 - 1] + (double)afSorted[wWindow / 2]) / 2.0;
+
+    if (!pstChannel->bPrimed)
+    {
+        pstChannel->dbSmooth = pstChannel->dbOutput = dbMedian;
+        pstChannel->bPrimed = true;
+        return dbMedian;
+    }
+
+    pstChannel->dbSmooth += pstConfig->fEma * (dbMedian - pstChannel->dbSmooth);
+    if (fabs(pstChannel->dbSmooth - pstChannel->dbOutput) > pstConfig->fDeadband)
+    {
+        pstChannel->dbOutput = pstChannel->dbSmooth;
+    }
+    return pstChannel->dbOutput;
+}
+
+/**
+ * Replace a reading's product, water and temperature with their
+ * conditioned values; status and everything else pass through
+ */
+void fnFilterApply(ProbeFilter *pstFilter, const FilterConfig *pstConfig, AtgData *pstData)
+{
+    if (!pstConfig->bEnabled)
+    {
+        // Start from scratch if it is enabled again by a reload
+        fnFilterReset(pstFilter);
+        return;
+    }
+
+    const FilterChannelConfig *pstChannels = pstConfig->astChannels;
+    pstData->product = (float)fnFilterChannel(&pstFilter->astChannels[FILTER_PRODUCT], &pstChannels[FILTER_PRODUCT],
+                                              pstData->product);
+    pstData->water = (int)lround(
+        fnFilterChannel(&pstFilter->astChannels[FILTER_WATER], &pstChannels[FILTER_WATER], pstData->water));
+    pstData->temperature = (float)fnFilterChannel(&pstFilter->astChannels[FILTER_TEMP], &pstChannels[FILTER_TEMP],
+                                                  pstData->temperature);
+}
@@ -0,0 +1,52 @@
+/**
+ * Signal Conditioning
+ * Per-channel median, smoothing and hysteresis applied to probe readings
+ */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "atg.h"
+
+#define FILTER_MEDIAN_MAX 9 // Longest median window (samples kept per channel)
+
+typedef enum {
+    FILTER_PRODUCT = 0,
+    FILTER_WATER,
+    FILTER_TEMP,
+    FILTER_CHANNELS
+} FilterChannelId;
+
+typedef struct {
+    int wMedian;     // Rolling median window in samples, 1 = off
+    float fEma;      // Weight of a new sample, 1 = no smoothing
+    float fDeadband; // Hysteresis half-width in the channel's unit, 0 = off
+} FilterChannelConfig;
+
+typedef struct {
+    bool bEnabled;
+    FilterChannelConfig astChannels[FILTER_CHANNELS];
+} FilterConfig;
+
+// State of one channel, fixed size whatever the configuration
+typedef struct {
+    float afSamples[FILTER_MEDIAN_MAX]; // Last raw samples, circular
+    uint8_t u8Count;                    // Samples held, up to FILTER_MEDIAN_MAX
+    uint8_t u8Next;                     // Slot of the next sample
+    bool bPrimed;                       // dbSmooth and dbOutput hold a value
+    double dbSmooth;                    // Smoothed value
+    double dbOutput;                    // Value after the deadband
+} FilterChannel;
+
+typedef struct {
+    FilterChannel astChannels[FILTER_CHANNELS];
+} ProbeFilter;
+
+void fnFilterConfigDefaults(FilterConfig *pstConfig);
+int fnFilterLoadConfig(FilterConfig *pstConfig, const char *achPath);
+void fnFilterReset(ProbeFilter *pstFilter);
+void fnFilterApply(ProbeFilter *pstFilter, const FilterConfig *pstConfig, AtgData *pstData);
+
+#endif
@@ -0,0 +1,179 @@
+/**
+ * Streaming Serial Framer
+ *
+ * Bytes from a serial burst are pushed into a ring buffer. Complete frames
+ * (terminated by \n, with an optional \r before it) are handed out one at a
+ * time by fnFramerNext. Control characters or an over-long line mark the
+ * current frame as corrupt; everything up to the next terminator is dropped
+ * so the framer resynchronizes on the following response.
+ *
+ * Noise between frames is different: the RS-485 driver turning the line
+ * around often leaves a 0x00 or 0xFF just ahead of the response. With
+ * nothing of a frame received yet such bytes are dropped one by one, so the
+ * response that follows still arrives instead of timing out.
+ */
+
+#include "framer.h"
+#include <string.h>
+
+#define FRAMER_MASK (FRAMER_RING_SIZE - 1)
+
+/**
+ * Reset the framer to an empty state and clear its counters
+ */
+void fnFramerInit(Framer *pstFramer)
+{
+    memset(pstFramer, 0, sizeof(Framer));
+}
+
+/**
+ * Discard the frame currently being received (e.g. before a new poll)
+ */
+void fnFramerDropPartial(Framer *pstFramer)
+{
+    if (pstFramer->u32Head != pstFramer->u32FrameStart || pstFramer->bDiscarding)
+    {
+        pstFramer->u32Resyncs++;
+    }
+    pstFramer->u32Head = pstFramer->u32FrameStart;
+    pstFramer->bDiscarding = false;
+}
+
+/**
+ * Drop the oldest complete frame to make room in a full ring
+ */
+static void fnFramerDropOldest(Framer *pstFramer)
+{
+    while (pstFramer->u32Tail != pstFramer->u32FrameStart)
+    {
+        uint8_t u8Byte = pstFramer->au8Ring[pstFramer->u32Tail & FRAMER_MASK];
+        pstFramer->u32Tail++;
+        pstFramer->u32Overflows++;
+        if (u8Byte == '\n')
+        {
+            return;
+        }
+    }
+}
+
+/**
+ * Append a burst of received bytes
+ * @param au8Data Bytes read from the serial port
+ * @param u16Length Number of bytes
+ */
+void fnFramerPush(Framer *pstFramer, const uint8_t *au8Data, uint16_t u16Length)
+{
+    for (uint16_t i = 0; i < u16Length; i++)
+    {
+        uint8_t u8Byte = au8Data[i];
+
+        if (pstFramer->bDiscarding)
+        {
+            if (u8Byte == '\n')
+            {
+                pstFramer->bDiscarding = false;
+            }
+            continue;
+        }
+
+        // Line noise: anything outside printable ASCII apart from \r and \n.
+        // Only a frame it lands in is lost; between frames the byte alone is.
+        if ((u8Byte < 0x20 && u8Byte != '\r' && u8Byte != '\n') || u8Byte >= 0x7F)
+        {
+            pstFramer->bDiscarding = (pstFramer->u32Head != pstFramer->u32FrameStart);
+            pstFramer->u32Head = pstFramer->u32FrameStart;
+            pstFramer->u32Resyncs++;
+            continue;
+        }
+
+        // Longer than any valid response (+1 for the \r)
+        if (u8Byte != '\n' && (pstFramer->u32Head - pstFramer->u32FrameStart) > FRAMER_MAX_FRAME)
+        {
+            pstFramer->u32Head = pstFramer->u32FrameStart;
+            pstFramer->bDiscarding = true;
+            pstFramer->u32Oversize++;
+            continue;
+        }
+
+        // Complete frames nobody has collected yet make way for new data
+        if ((pstFramer->u32Head - pstFramer->u32Tail) == FRAMER_RING_SIZE)
+        {
+            fnFramerDropOldest(pstFramer);
+        }
+
+        pstFramer->au8Ring[pstFramer->u32Head & FRAMER_MASK] = u8Byte;
+        pstFramer->u32Head++;
+
+        if (u8Byte == '\n')
+        {
+            pstFramer->u32FrameStart = pstFramer->u32Head;
+        }
+    }
+}
+
+/**
+ * Extract the next complete frame
+ * @param au8Frame Output buffer, NUL-terminated on return
+ * @param u16FrameSize Size of the output buffer
+ * @return Frame length without terminator, 0 if no complete frame is pending
+ */
+uint16_t fnFramerNext(Framer *pstFramer, uint8_t *au8Frame, uint16_t u16FrameSize)
+{
+    while (pstFramer->u32Tail != pstFramer->u32FrameStart)
+    {
+        uint32_t u32Start = pstFramer->u32Tail;
+        uint32_t u32End = u32Start;
+
+        while (pstFramer->au8Ring[u32End & FRAMER_MASK] != '\n')
+        {
+            u32End++;
+        }
+        pstFramer->u32Tail = u32End + 1;
+
+        // A stray \r inside the line means the start was garbage: keep what follows it
+        for (uint32_t u32Pos = u32Start; u32Pos < u32End; u32Pos++)
+        {
+            if (pstFramer->au8Ring[u32Pos & FRAMER_MASK] == '\r' && (u32Pos + 1) != u32End)
+            {
+                u32Start = u32Pos + 1;
+                pstFramer->u32Resyncs++;
+            }
+        }
+
+        uint32_t u32Length = u32End - u32Start;
+        if (u32Length > 0 && pstFramer->au8Ring[(u32End - 1) & FRAMER_MASK] == '\r')
+        {
+            u32Length--;
+        }
+
+        // Empty lines carry nothing
+        if (u32Length == 0)
+        {
+            continue;
+        }
+
+        if (u32Length >= u16FrameSize)
+        {
+            pstFramer->u32Oversize++;
+            continue;
+        }
+
+        for (uint32_t i = 0; i < u32Length; i++)
+        {
+            au8Frame[i] = pstFramer->au8Ring[(u32Start + i) & FRAMER_MASK];
+        }
+        au8Frame[u32Length] = '\0';
+        pstFramer->u32Frames++;
+        return (uint16_t)u32Length;
+    }
+
+    return 0;
+}
+
+/**
+ * Number of bytes of the frame currently being received
+ */
+uint16_t fnFramerPending(const Framer *pstFramer)
+{
+    return (uint16_t)(pstFramer->u32Head - pstFramer->u32FrameStart);
+}
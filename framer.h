@@ -0,0 +1,38 @@
+/**
+ * Streaming Serial Framer
+ * Reassembles \r\n-terminated ATG responses from raw serial bursts
+ */
+
+#ifndef FRAMER_H
+#define FRAMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Ring capacity in bytes (must be a power of two)
+#define FRAMER_RING_SIZE 512
+
+// Longest frame accepted, terminator excluded
+#define FRAMER_MAX_FRAME 96
+
+typedef struct {
+    uint8_t au8Ring[FRAMER_RING_SIZE];
+    uint32_t u32Tail;       // Oldest unread byte (free running)
+    uint32_t u32FrameStart; // Start of the frame being received
+    uint32_t u32Head;       // Next write position
+    bool bDiscarding;       // Dropping bytes until the next terminator
+
+    // Counters
+    uint32_t u32Frames;    // Complete frames extracted
+    uint32_t u32Resyncs;   // Partial frames and stray noise bytes dropped
+    uint32_t u32Oversize;  // Frames longer than FRAMER_MAX_FRAME
+    uint32_t u32Overflows; // Bytes lost because the ring was full
+} Framer;
+
+void fnFramerInit(Framer *pstFramer);
+void fnFramerDropPartial(Framer *pstFramer);
+void fnFramerPush(Framer *pstFramer, const uint8_t *au8Data, uint16_t u16Length);
+uint16_t fnFramerNext(Framer *pstFramer, uint8_t *au8Frame, uint16_t u16FrameSize);
+uint16_t fnFramerPending(const Framer *pstFramer);
+
+#endif
@@ -0,0 +1,657 @@
+/**
+ * Store-and-Forward Journal
+ *
+ * Messages the broker did not acknowledge are appended to fixed-size
+ * segment files named <sequence>.jnl, each mapped MAP_SHARED so an append
+ * is a memcpy into the page cache. A record is written body first and its
+ * magic last, and carries a CRC-32 of the body. After a crash, recovery
+ * stops at the first record without a valid magic and CRC, so a torn
+ * append is dropped and everything before it is kept.
+ *
+ * Replay reads from the oldest segment. The cursor (segment, offset) is
+ * kept in a small mapped file and advanced once a record has been handed to
+ * the MQTT client. A fully replayed segment is deleted. Delivery is
+ * at-least-once: a crash between a publish and the cursor update replays
+ * that record again. The server stores readings by their Timestamp, so a
+ * duplicate overwrites nothing.
+ *
+ * Disk usage is capped at max_mb. When a new segment would exceed the cap,
+ * the oldest segment is evicted with whatever it still holds. During a
+ * very long outage the newest readings are kept and the oldest are lost.
+ */
+
+#include "journal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "main_linux.h"
+#include "config.h"
+
+#define JOURNAL_SEGMENT_MAGIC 0x4A475441 // "ATGJ"
+#define JOURNAL_RECORD_MAGIC 0x52475441  // "ATGR"
+#define JOURNAL_CURSOR_MAGIC 0x43475441  // "ATGC"
+#define JOURNAL_VERSION 1
+#define JOURNAL_HEADER_SIZE 32 // Segment header, records start after it
+#define JOURNAL_ALIGN(n) (((n) + 7u) & ~7u)
+
+typedef struct {
+    uint32_t u32Magic;
+    uint16_t u16Version;
+    uint16_t u16HeaderSize;
+    uint32_t u32Seq;
+    uint32_t u32SegmentSize;
+} SegmentHeader;
+
+typedef struct {
+    uint32_t u32Magic;  // Written last
+    uint32_t u32Length; // Body bytes: topic, NUL, payload, NUL
+    uint32_t u32Crc;    // CRC-32 of the body
+    uint32_t u32Flags;
+} RecordHeader;
+
+// Cursor file: sequence, offset, check word
+enum { CURSOR_SEQ, CURSOR_OFFSET, CURSOR_CHECK, CURSOR_WORDS };
+
+static uint32_t fnJournalCrc32(const uint8_t *pu8Data, uint32_t u32Length)
+{
+    uint32_t u32Crc = 0xFFFFFFFFu;
+    for (uint32_t i = 0; i < u32Length; i++)
+    {
+        u32Crc ^= pu8Data[i];
+        for (int b = 0; b < 8; b++)
+        {
+            u32Crc = (u32Crc >> 1) ^ (0xEDB88320u & (0u - (u32Crc & 1u)));
+        }
+    }
+    return ~u32Crc;
+}
+
+static void fnSegmentPath(const Journal *pstJournal, uint32_t u32Seq, char *achPath, size_t szPath)
+{
+    snprintf(achPath, szPath, "%s/%08u.jnl", pstJournal->stConfig.achDir, u32Seq);
+}
+
+// Map an existing segment, or create it when bCreate is set; *pu32Size receives its size
+static uint8_t *fnMapSegment(Journal *pstJournal, uint32_t u32Seq, bool bCreate, uint32_t *pu32Size)
+{
+    char achPath[JOURNAL_PATH_LEN + 16];
+    fnSegmentPath(pstJournal, u32Seq, achPath, sizeof(achPath));
+
+    int fd = open(achPath, O_RDWR | O_CLOEXEC | (bCreate ? O_CREAT | O_TRUNC : 0), 0644);
+    if (fd < 0)
+    {
+        if (bCreate || errno != ENOENT)
+            printf("[Journal] Cannot open %s: %s\n", achPath, strerror(errno));
+        return NULL;
+    }
+
+    struct stat st;
+    uint32_t u32Size = pstJournal->u32SegmentSize;
+    if (bCreate)
+    {
+        // Sparse file: only the pages actually written take disk space
+        if (ftruncate(fd, u32Size) != 0)
+        {
+            printf("[Journal] Cannot size %s: %s\n", achPath, strerror(errno));
+            close(fd);
+            return NULL;
+        }
+    }
+    else if (fstat(fd, &st) != 0 || st.st_size < JOURNAL_HEADER_SIZE || st.st_size > 0x7FFFFFFF)
+    {
+        close(fd);
+        return NULL;
+    }
+    else
+    {
+        u32Size = (uint32_t)st.st_size;
+    }
+
+    void *pvMap = mmap(NULL, u32Size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pvMap == MAP_FAILED)
+    {
+        printf("[Journal] Cannot map %s: %s\n", achPath, strerror(errno));
+        return NULL;
+    }
+
+    SegmentHeader *pstHeader = (SegmentHeader *)pvMap;
+    if (bCreate)
+    {
+        pstHeader->u16Version = JOURNAL_VERSION;
+        pstHeader->u16HeaderSize = JOURNAL_HEADER_SIZE;
+        pstHeader->u32Seq = u32Seq;
+        pstHeader->u32SegmentSize = u32Size;
+        pstHeader->u32Magic = JOURNAL_SEGMENT_MAGIC;
+    }
+    else if (pstHeader->u32Magic != JOURNAL_SEGMENT_MAGIC || pstHeader->u16Version != JOURNAL_VERSION ||
+             pstHeader->u32Seq != u32Seq || pstHeader->u32SegmentSize != u32Size)
+    {
+        printf("[Journal] %s is not a valid segment, skipped\n", achPath);
+        munmap(pvMap, u32Size);
+        return NULL;
+    }
+
+    *pu32Size = u32Size;
+    return (uint8_t *)pvMap;
+}
+
+static void fnUnmap(uint8_t **ppu8Map, uint32_t *pu32Size)
+{
+    if (*ppu8Map != NULL)
+    {
+        munmap(*ppu8Map, *pu32Size);
+    }
+    *ppu8Map = NULL;
+    *pu32Size = 0;
+}
+
+// Offset just past the valid record at u32Offset, or 0 if there is none
+static uint32_t fnRecordNext(const uint8_t *pu8Segment, uint32_t u32Size, uint32_t u32Offset)
+{
+    if (pu8Segment == NULL || u32Offset < JOURNAL_HEADER_SIZE || u32Offset + sizeof(RecordHeader) > u32Size)
+    {
+        return 0;
+    }
+    const RecordHeader *pstRecord = (const RecordHeader *)(pu8Segment + u32Offset);
+    if (pstRecord->u32Magic != JOURNAL_RECORD_MAGIC || pstRecord->u32Length < 2 ||
+        pstRecord->u32Length > u32Size - u32Offset - sizeof(RecordHeader))
+    {
+        return 0;
+    }
+    const uint8_t *pu8Body = (const uint8_t *)(pstRecord + 1);
+    if (fnJournalCrc32(pu8Body, pstRecord->u32Length) != pstRecord->u32Crc)
+    {
+        return 0;
+    }
+    return u32Offset + sizeof(RecordHeader) + JOURNAL_ALIGN(pstRecord->u32Length);
+}
+
+// Walk the valid records from u32Offset; returns how many, and the end offset in *pu32End
+static uint32_t fnCountRecords(const uint8_t *pu8Segment, uint32_t u32Size, uint32_t u32Offset, uint32_t *pu32End)
+{
+    uint32_t u32Count = 0;
+    uint32_t u32Next;
+    while ((u32Next = fnRecordNext(pu8Segment, u32Size, u32Offset)) != 0)
+    {
+        u32Offset = u32Next;
+        u32Count++;
+    }
+    if (pu32End != NULL)
+        *pu32End = u32Offset;
+    return u32Count;
+}
+
+static void fnSaveCursor(Journal *pstJournal)
+{
+    pstJournal->pu32Cursor[CURSOR_SEQ] = pstJournal->u32ReadSeq;
+    pstJournal->pu32Cursor[CURSOR_OFFSET] = pstJournal->u32ReadOffset;
+    pstJournal->pu32Cursor[CURSOR_CHECK] =
+        (pstJournal->u32ReadSeq * 2654435761u) ^ pstJournal->u32ReadOffset ^ JOURNAL_CURSOR_MAGIC;
+}
+
+// Drop the oldest segment and move the cursor to the start of the next one
+static void fnDropReadSegment(Journal *pstJournal)
+{
+    char achPath[JOURNAL_PATH_LEN + 16];
+
+    fnUnmap(&pstJournal->pu8Read, &pstJournal->u32ReadSize);
+    fnSegmentPath(pstJournal, pstJournal->u32ReadSeq, achPath, sizeof(achPath));
+    unlink(achPath);
+
+    pstJournal->u32ReadSeq++;
+    pstJournal->u32ReadOffset = JOURNAL_HEADER_SIZE;
+    pstJournal->bPeeked = false;
+    pstJournal->pu8Read = fnMapSegment(pstJournal, pstJournal->u32ReadSeq, false, &pstJournal->u32ReadSize);
+    fnSaveCursor(pstJournal);
+}
+
+// Start a new write segment, evicting the oldest one if the disk cap requires it
+static int fnJournalRoll(Journal *pstJournal)
+{
+    while (pstJournal->u32WriteSeq + 2 - pstJournal->u32ReadSeq > pstJournal->u32MaxSegments)
+    {
+        uint32_t u32Lost = fnCountRecords(pstJournal->pu8Read, pstJournal->u32ReadSize, pstJournal->u32ReadOffset, NULL);
+        pstJournal->u32Pending -= u32Lost;
+        pstJournal->u32Evicted += u32Lost;
+        printf("[Journal] Disk cap reached, evicted segment %u (%u unsent message(s))\n", pstJournal->u32ReadSeq,
+               u32Lost);
+        fnDropReadSegment(pstJournal);
+    }
+
+    // The finished segment is made durable before it is let go
+    if (pstJournal->pu8Write != NULL)
+    {
+        msync(pstJournal->pu8Write, pstJournal->u32WriteSize, MS_SYNC);
+    }
+    fnUnmap(&pstJournal->pu8Write, &pstJournal->u32WriteSize);
+
+    pstJournal->u32WriteSeq++;
+    pstJournal->u32WriteOffset = JOURNAL_HEADER_SIZE;
+    pstJournal->pu8Write = fnMapSegment(pstJournal, pstJournal->u32WriteSeq, true, &pstJournal->u32WriteSize);
+    if (pstJournal->pu8Write == NULL)
+    {
+        return -1;
+    }
+    if (pstJournal->pu8Read == NULL && pstJournal->u32ReadSeq == pstJournal->u32WriteSeq)
+    {
+        pstJournal->pu8Read = fnMapSegment(pstJournal, pstJournal->u32ReadSeq, false, &pstJournal->u32ReadSize);
+    }
+    return 0;
+}
+
+static bool fnMakeDirs(const char *achDir)
+{
+    char achPath[JOURNAL_PATH_LEN];
+    snprintf(achPath, sizeof(achPath), "%s", achDir);
+    for (char *p = achPath + 1; *p != '\0'; p++)
+    {
+        if (*p == '/')
+        {
+            *p = '\0';
+            mkdir(achPath, 0755);
+            *p = '/';
+        }
+    }
+    return mkdir(achPath, 0755) == 0 || errno == EEXIST;
+}
+
+void fnJournalConfigDefaults(JournalConfig *pstConfig)
+{
+    pstConfig->bEnabled = true;
+    snprintf(pstConfig->achDir, sizeof(pstConfig->achDir), "%s", JOURNAL_DIR);
+    pstConfig->u32SegmentKb = JOURNAL_SEGMENT_KB;
+    pstConfig->u32MaxMb = JOURNAL_MAX_MB;
+    pstConfig->dbReplayRate = JOURNAL_REPLAY_RATE;
+}
+
+static int fnJournalConfigHandler(void *pvContext, const char *achSection, const char *achName, const char *achKey,
+                                  const char *achValue, int wLine)
+{
+    JournalConfig *pstConfig = (JournalConfig *)pvContext;
+    (void)achName;
+
+    if (strcmp(achSection, "journal") != 0 || achKey[0] == '\0')
+    {
+        return 0;
+    }
+
+    if (strcmp(achKey, "enabled") == 0)
+    {
+        pstConfig->bEnabled = fnConfigParseBool(achValue);
+    }
+    else if (strcmp(achKey, "dir") == 0)
+    {
+        if (strlen(achValue) >= sizeof(pstConfig->achDir) - 16)
+        {
+            printf("Config line %d: journal dir too long\n", wLine);
+            return -1;
+        }
+        strcpy(pstConfig->achDir, achValue);
+    }
+    else if (strcmp(achKey, "segment_kb") == 0)
+    {
+        pstConfig->u32SegmentKb = (uint32_t)strtoul(achValue, NULL, 10);
+    }
+    else if (strcmp(achKey, "max_mb") == 0)
+    {
+        pstConfig->u32MaxMb = (uint32_t)strtoul(achValue, NULL, 10);
+    }
+    else if (strcmp(achKey, "replay_rate") == 0)
+    {
+        pstConfig->dbReplayRate = strtod(achValue, NULL);
+    }
+    else
+    {
+        printf("Config line %d: unknown journal key '%s' ignored\n", wLine, achKey);
+    }
+    return 0;
+}
+
+/**
+ * Read the [journal] section of the configuration file
+ * @return 0 on success or if the file does not exist, non-zero on a bad value
+ */
+int fnJournalLoadConfig(JournalConfig *pstConfig, const char *achPath)
+{
+    fnJournalConfigDefaults(pstConfig);
+    int rc = fnConfigParse(achPath, fnJournalConfigHandler, pstConfig);
+
+    if (pstConfig->u32SegmentKb < 16)
+        pstConfig->u32SegmentKb = 16;
+    if (pstConfig->u32SegmentKb > 65536)
+        pstConfig->u32SegmentKb = 65536;
+    if (pstConfig->dbReplayRate < 1)
+        pstConfig->dbReplayRate = 1;
+    return (rc == -1) ? 0 : rc;
+}
+
+/**
+ * Open the journal directory, recovering segments and the replay cursor
+ * left by a previous run
+ * @return 0 on success or when disabled, -1 if the journal cannot be used
+ *         (fnJournalClose must still be called)
+ */
+int fnJournalOpen(Journal *pstJournal, const JournalConfig *pstConfig)
+{
+    memset(pstJournal, 0, sizeof(Journal));
+    pstJournal->stConfig = *pstConfig;
+    pstJournal->hCursor = -1;
+    pthread_mutex_init(&pstJournal->mutex, NULL);
+    if (!pstConfig->bEnabled)
+    {
+        return 0;
+    }
+
+    pstJournal->u32SegmentSize = pstConfig->u32SegmentKb * 1024;
+    pstJournal->u32MaxSegments = (uint32_t)(((uint64_t)pstConfig->u32MaxMb * 1024) / pstConfig->u32SegmentKb);
+    if (pstJournal->u32MaxSegments < 2)
+        pstJournal->u32MaxSegments = 2;
+
+    if (!fnMakeDirs(pstConfig->achDir))
+    {
+        printf("[Journal] Cannot create %s: %s\n", pstConfig->achDir, strerror(errno));
+        return -1;
+    }
+
+    // Find the range of segment sequence numbers on disk
+    uint32_t u32MinSeq = 0, u32MaxSeq = 0;
+    DIR *pDir = opendir(pstConfig->achDir);
+    if (pDir == NULL)
+    {
+        printf("[Journal] Cannot read %s: %s\n", pstConfig->achDir, strerror(errno));
+        return -1;
+    }
+    struct dirent *pstEntry;
+    while ((pstEntry = readdir(pDir)) != NULL)
+    {
+        unsigned u32Seq;
+        int wEnd = 0;
+        if (sscanf(pstEntry->d_name, "%8u.jnl%n", &u32Seq, &wEnd) == 1 && wEnd == 12 &&
+            pstEntry->d_name[12] == '\0' && u32Seq > 0)
+        {
+            if (u32MinSeq == 0 || u32Seq < u32MinSeq)
+                u32MinSeq = u32Seq;
+            if (u32Seq > u32MaxSeq)
+                u32MaxSeq = u32Seq;
+        }
+    }
+    closedir(pDir);
+
+    // Replay cursor
+    char achPath[JOURNAL_PATH_LEN + 16];
+    snprintf(achPath, sizeof(achPath), "%s/cursor", pstConfig->achDir);
+    pstJournal->hCursor = open(achPath, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (pstJournal->hCursor < 0 || ftruncate(pstJournal->hCursor, CURSOR_WORDS * sizeof(uint32_t)) != 0)
+    {
+        printf("[Journal] Cannot open %s: %s\n", achPath, strerror(errno));
+        return -1;
+    }
+    void *pvCursor = mmap(NULL, CURSOR_WORDS * sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_SHARED,
+                          pstJournal->hCursor, 0);
+    if (pvCursor == MAP_FAILED)
+    {
+        printf("[Journal] Cannot map %s: %s\n", achPath, strerror(errno));
+        return -1;
+    }
+    pstJournal->pu32Cursor = (uint32_t *)pvCursor;
+
+    uint32_t u32CursorSeq = pstJournal->pu32Cursor[CURSOR_SEQ];
+    uint32_t u32CursorOffset = pstJournal->pu32Cursor[CURSOR_OFFSET];
+    bool bCursorValid = pstJournal->pu32Cursor[CURSOR_CHECK] ==
+                        ((u32CursorSeq * 2654435761u) ^ u32CursorOffset ^ JOURNAL_CURSOR_MAGIC);
+
+    if (u32MaxSeq == 0)
+    {
+        u32MinSeq = u32MaxSeq = 1;
+        pstJournal->pu8Write = fnMapSegment(pstJournal, 1, true, &pstJournal->u32WriteSize);
+    }
+    else
+    {
+        pstJournal->pu8Write = fnMapSegment(pstJournal, u32MaxSeq, false, &pstJournal->u32WriteSize);
+    }
+    pstJournal->u32ReadSeq = u32MinSeq;
+    pstJournal->u32ReadOffset = JOURNAL_HEADER_SIZE;
+    pstJournal->u32WriteSeq = u32MaxSeq;
+
+    // Segments before a valid cursor were replayed; their deletion was interrupted
+    if (bCursorValid && u32CursorSeq >= u32MinSeq && u32CursorSeq <= u32MaxSeq)
+    {
+        while (pstJournal->u32ReadSeq < u32CursorSeq)
+        {
+            fnSegmentPath(pstJournal, pstJournal->u32ReadSeq, achPath, sizeof(achPath));
+            unlink(achPath);
+            pstJournal->u32ReadSeq++;
+        }
+        pstJournal->u32ReadOffset = u32CursorOffset;
+    }
+    pstJournal->pu8Read = fnMapSegment(pstJournal, pstJournal->u32ReadSeq, false, &pstJournal->u32ReadSize);
+    if (pstJournal->u32ReadOffset < JOURNAL_HEADER_SIZE || pstJournal->u32ReadOffset > pstJournal->u32ReadSize)
+    {
+        pstJournal->u32ReadOffset = JOURNAL_HEADER_SIZE;
+    }
+
+    // Count what is left to replay and find the append position after the last intact record
+    for (uint32_t u32Seq = pstJournal->u32ReadSeq; u32Seq <= u32MaxSeq; u32Seq++)
+    {
+        uint8_t *pu8Segment;
+        uint32_t u32Size = 0;
+        uint32_t u32Start = JOURNAL_HEADER_SIZE;
+        bool bTemporary = false;
+
+        if (u32Seq == pstJournal->u32ReadSeq)
+        {
+            pu8Segment = pstJournal->pu8Read;
+            u32Size = pstJournal->u32ReadSize;
+            u32Start = pstJournal->u32ReadOffset;
+        }
+        else if (u32Seq == u32MaxSeq)
+        {
+            pu8Segment = pstJournal->pu8Write;
+            u32Size = pstJournal->u32WriteSize;
+        }
+        else
+        {
+            pu8Segment = fnMapSegment(pstJournal, u32Seq, false, &u32Size);
+            bTemporary = true;
+        }
+
+        uint32_t u32End = u32Start;
+        pstJournal->u32Pending += fnCountRecords(pu8Segment, u32Size, u32Start, &u32End);
+        if (u32Seq == u32MaxSeq)
+        {
+            pstJournal->u32WriteOffset = u32End;
+        }
+        if (bTemporary)
+        {
+            fnUnmap(&pu8Segment, &u32Size);
+        }
+    }
+
+    // A damaged or resized newest segment is not appended to
+    if (pstJournal->pu8Write == NULL || pstJournal->u32WriteSize != pstJournal->u32SegmentSize)
+    {
+        if (fnJournalRoll(pstJournal) != 0)
+        {
+            return -1;
+        }
+    }
+    fnSaveCursor(pstJournal);
+
+    pstJournal->bOpen = true;
+    printf("[Journal] %s: %u message(s) awaiting replay, cap %u MB\n", pstConfig->achDir, pstJournal->u32Pending,
+           pstConfig->u32MaxMb);
+    return 0;
+}
+
+void fnJournalClose(Journal *pstJournal)
+{
+    if (pstJournal->bOpen)
+    {
+        fnJournalSync(pstJournal);
+        printf("[Journal] %u appended, %u replayed, %u evicted, %u rejected, %u still pending\n",
+               pstJournal->u32Appended, pstJournal->u32Replayed, pstJournal->u32Evicted, pstJournal->u32Rejected,
+               pstJournal->u32Pending);
+    }
+
+    pthread_mutex_lock(&pstJournal->mutex);
+    pstJournal->bOpen = false;
+    fnUnmap(&pstJournal->pu8Read, &pstJournal->u32ReadSize);
+    fnUnmap(&pstJournal->pu8Write, &pstJournal->u32WriteSize);
+    if (pstJournal->pu32Cursor != NULL)
+    {
+        munmap(pstJournal->pu32Cursor, CURSOR_WORDS * sizeof(uint32_t));
+        pstJournal->pu32Cursor = NULL;
+    }
+    if (pstJournal->hCursor >= 0)
+    {
+        close(pstJournal->hCursor);
+        pstJournal->hCursor = -1;
+    }
+    pthread_mutex_unlock(&pstJournal->mutex);
+    pthread_mutex_destroy(&pstJournal->mutex);
+}
+
+/**
+ * Append one message; the payload may be binary
+ * @return 0 on success, -1 if the journal is closed, full of errors or the message is too large
+ */
+int fnJournalAppend(Journal *pstJournal, const char *achTopic, const void *pvPayload, size_t szPayload)
+{
+    size_t szTopic = strlen(achTopic) + 1;
+    uint32_t u32Length = (uint32_t)(szTopic + szPayload + 1);
+    uint32_t u32Needed = sizeof(RecordHeader) + JOURNAL_ALIGN(u32Length);
+
+    pthread_mutex_lock(&pstJournal->mutex);
+    if (!pstJournal->bOpen)
+    {
+        pthread_mutex_unlock(&pstJournal->mutex);
+        return -1;
+    }
+    if (u32Needed > pstJournal->u32SegmentSize - JOURNAL_HEADER_SIZE)
+    {
+        pstJournal->u32Rejected++;
+        pthread_mutex_unlock(&pstJournal->mutex);
+        return -1;
+    }
+    if (pstJournal->pu8Write == NULL || pstJournal->u32WriteOffset + u32Needed > pstJournal->u32WriteSize)
+    {
+        if (fnJournalRoll(pstJournal) != 0)
+        {
+            pstJournal->u32Rejected++;
+            pthread_mutex_unlock(&pstJournal->mutex);
+            return -1;
+        }
+    }
+
+    RecordHeader *pstRecord = (RecordHeader *)(pstJournal->pu8Write + pstJournal->u32WriteOffset);
+    uint8_t *pu8Body = (uint8_t *)(pstRecord + 1);
+    memcpy(pu8Body, achTopic, szTopic);
+    memcpy(pu8Body + szTopic, pvPayload, szPayload);
+    pu8Body[szTopic + szPayload] = '\0';
+    pstRecord->u32Length = u32Length;
+    pstRecord->u32Crc = fnJournalCrc32(pu8Body, u32Length);
+    pstRecord->u32Flags = 0;
+    __atomic_store_n(&pstRecord->u32Magic, JOURNAL_RECORD_MAGIC, __ATOMIC_RELEASE);
+
+    pstJournal->u32WriteOffset += u32Needed;
+    pstJournal->u32Pending++;
+    pstJournal->u32Appended++;
+    pstJournal->bDirty = true;
+    pthread_mutex_unlock(&pstJournal->mutex);
+    return 0;
+}
+
+/**
+ * Copy out the oldest unreplayed message without consuming it
+ * @param pszLength Receives the payload length (clipped to szPayload)
+ * @return true if a message was returned
+ */
+bool fnJournalPeek(Journal *pstJournal, char *achTopic, size_t szTopic, void *pvPayload, size_t szPayload,
+                   size_t *pszLength)
+{
+    bool bFound = false;
+
+    pthread_mutex_lock(&pstJournal->mutex);
+    while (pstJournal->bOpen)
+    {
+        uint32_t u32Next = fnRecordNext(pstJournal->pu8Read, pstJournal->u32ReadSize, pstJournal->u32ReadOffset);
+        if (u32Next == 0)
+        {
+            // End of a finished segment: it has been replayed in full
+            if (pstJournal->u32ReadSeq < pstJournal->u32WriteSeq)
+            {
+                fnDropReadSegment(pstJournal);
+                continue;
+            }
+            break;
+        }
+
+        // Body: topic NUL payload NUL, the payload possibly binary
+        const RecordHeader *pstRecord = (const RecordHeader *)(pstJournal->pu8Read + pstJournal->u32ReadOffset);
+        const char *achBody = (const char *)(pstRecord + 1);
+        size_t szBodyTopic = strnlen(achBody, pstRecord->u32Length - 2);
+        size_t szLength = pstRecord->u32Length - szBodyTopic - 2;
+        snprintf(achTopic, szTopic, "%.*s", (int)szBodyTopic, achBody);
+        if (szLength > szPayload)
+            szLength = szPayload;
+        memcpy(pvPayload, achBody + szBodyTopic + 1, szLength);
+        *pszLength = szLength;
+        pstJournal->bPeeked = true;
+        pstJournal->u32PeekNext = u32Next;
+        bFound = true;
+        break;
+    }
+    pthread_mutex_unlock(&pstJournal->mutex);
+    return bFound;
+}
+
+/**
+ * Advance the replay cursor past the message returned by the last fnJournalPeek
+ */
+void fnJournalConsume(Journal *pstJournal)
+{
+    pthread_mutex_lock(&pstJournal->mutex);
+    // An eviction since the peek already moved the cursor past the record
+    if (pstJournal->bOpen && pstJournal->bPeeked)
+    {
+        pstJournal->u32ReadOffset = pstJournal->u32PeekNext;
+        pstJournal->bPeeked = false;
+        pstJournal->u32Pending--;
+        pstJournal->u32Replayed++;
+        fnSaveCursor(pstJournal);
+    }
+    pthread_mutex_unlock(&pstJournal->mutex);
+}
+
+uint32_t fnJournalPending(Journal *pstJournal)
+{
+    pthread_mutex_lock(&pstJournal->mutex);
+    uint32_t u32Pending = pstJournal->bOpen ? pstJournal->u32Pending : 0;
+    pthread_mutex_unlock(&pstJournal->mutex);
+    return u32Pending;
+}
+
+/**
+ * Flush appended records and the cursor to disk; bounds what a power cut can lose
+ */
+void fnJournalSync(Journal *pstJournal)
+{
+    pthread_mutex_lock(&pstJournal->mutex);
+    if (pstJournal->bOpen && pstJournal->bDirty && pstJournal->pu8Write != NULL)
+    {
+        msync(pstJournal->pu8Write, pstJournal->u32WriteSize, MS_SYNC);
+        pstJournal->bDirty = false;
+    }
+    if (pstJournal->bOpen)
+    {
+        msync(pstJournal->pu32Cursor, CURSOR_WORDS * sizeof(uint32_t), MS_ASYNC);
+    }
+    pthread_mutex_unlock(&pstJournal->mutex);
+}
@@ -0,0 +1,72 @@
+/**
+ * Store-and-Forward Journal
+ * Append-only, memory-mapped segment files holding messages the broker
+ * has not acknowledged, replayed in order once it is reachable again
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define JOURNAL_PATH_LEN 128
+
+typedef struct {
+    bool bEnabled;
+    char achDir[JOURNAL_PATH_LEN]; // Directory holding the segment files
+    uint32_t u32SegmentKb;         // Size of one segment file
+    uint32_t u32MaxMb;             // Disk cap; the oldest segment is evicted beyond it
+    double dbReplayRate;           // Replayed messages per second
+} JournalConfig;
+
+typedef struct {
+    JournalConfig stConfig;
+    bool bOpen;
+    pthread_mutex_t mutex; // Appends come from the publish thread and Paho's callback thread
+
+    uint32_t u32SegmentSize;
+    uint32_t u32MaxSegments;
+
+    // Oldest segment; the replay cursor always points into it
+    uint32_t u32ReadSeq;
+    uint32_t u32ReadOffset;
+    uint8_t *pu8Read;
+    uint32_t u32ReadSize;
+    bool bPeeked;
+    uint32_t u32PeekNext; // Offset after the record returned by fnJournalPeek
+
+    // Newest segment, appended to
+    uint32_t u32WriteSeq;
+    uint32_t u32WriteOffset;
+    uint8_t *pu8Write;
+    uint32_t u32WriteSize;
+    bool bDirty; // Appended since the last fnJournalSync
+
+    // Persisted replay cursor
+    int hCursor;
+    uint32_t *pu32Cursor;
+
+    // Counters
+    uint32_t u32Pending;  // Records not yet replayed
+    uint32_t u32Appended;
+    uint32_t u32Replayed;
+    uint32_t u32Evicted;  // Records lost to the disk cap
+    uint32_t u32Rejected; // Records too large for a segment
+} Journal;
+
+void fnJournalConfigDefaults(JournalConfig *pstConfig);
+int fnJournalLoadConfig(JournalConfig *pstConfig, const char *achPath);
+int fnJournalOpen(Journal *pstJournal, const JournalConfig *pstConfig);
+void fnJournalClose(Journal *pstJournal);
+
+int fnJournalAppend(Journal *pstJournal, const char *achTopic, const void *pvPayload, size_t szPayload);
+bool fnJournalPeek(Journal *pstJournal, char *achTopic, size_t szTopic, void *pvPayload, size_t szPayload,
+                   size_t *pszLength);
+void fnJournalConsume(Journal *pstJournal);
+uint32_t fnJournalPending(Journal *pstJournal);
+void fnJournalSync(Journal *pstJournal);
+
+#endif
@@ -76,11 +76,18 @@ int main()
 #ifdef PRINT_PACKET
                 fnPrintPacket('R', chPacketRec, u8PacketPointer);
 #endif
-                fnParseAtgResponse((char *)chPacketRec, &stAtgData);
-                fnPrintAtgData(&stAtgData);
+                int wResult = fnParseAtgResponse((char *)chPacketRec, &stAtgData);
+                if (wResult == ATG_PARSE_OK)
+                {
+                    fnPrintAtgData(&stAtgData);
+                }
+                else
+                {
+                    printf("Rejected response (%s)\n", fnAtgParseResultName(wResult));
+                }
 
-                // Update latest data and check for changes
-                for (int i = 0; i < NUMBER_OF_ATGS; i++)
+                // Update latest data and check for changes (a rejected frame updates nothing)
+                for (int i = 0; i < NUMBER_OF_ATGS && wResult == ATG_PARSE_OK; i++)
                 {
                     if (stLatestAtgData[i].address == stAtgData.address)
                     {
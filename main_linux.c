@@ -10,30 +10,27 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <time.h>
-#include <math.h>
 #include <unistd.h>
 #include <signal.h>
+#include <errno.h>
 
 #include "main_linux.h"
-#include "uart_linux.h"
+#include "registry.h"
+#include "scheduler.h"
+#include "bus_linux.h"
+#include "publisher.h"
+#include "journal.h"
+#include "stats.h"
+#include "metrics.h"
+#include "trace.h"
+#include "settings.h"
 #include "atg.h"
 #include "mqtt.h"
 
 // Global variables
-int hPortDart = -1;  // File descriptor for serial port (replaces Windows HANDLE)
-AtgData stLatestAtgData[NUMBER_OF_ATGS];
-AtgData stPreviousAtgData[NUMBER_OF_ATGS];
-double dbLastMqttPublishTime[NUMBER_OF_ATGS];
-
-// Flag for graceful shutdown
-static volatile int keepRunning = 1;
-
-// Signal handler for graceful shutdown (Ctrl+C)
-void signalHandler(int signum)
-{
-    printf("\nReceived signal %d, shutting down...\n", signum);
-    keepRunning = 0;
-}
+static Settings *pstSettings; // Probes, scheduler settings and dip charts; each bus polls its own copy
+static AtgBus astBuses[BUS_MAX];
+static int wBusCount = 0;
 
 // Get current time in milliseconds
 double getCurrentTimeMs()
@@ -43,164 +40,236 @@ double getCurrentTimeMs()
     return (ts.tv_sec * 1000.0) + (ts.tv_nsec / 1000000.0);
 }
 
-// Function to check if ATG data has changed significantly
-int fnHasDataChanged(const AtgData *current, const AtgData *previous)
+// Get wall-clock time in milliseconds since the Unix epoch
+int64_t getWallClockMs()
 {
-    if (fabs(current->temperature - previous->temperature) >= TEMP_CHANGE_THRESHOLD)
-        return 1;
-    if (fabs(current->product - previous->product) >= PRODUCT_CHANGE_THRESHOLD)
-        return 1;
-    if (abs(current->water - previous->water) >= (int)WATER_CHANGE_THRESHOLD)
-        return 1;
-    if (current->status != previous->status)
-        return 1;
-    return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Warn about probes whose "bus" key names no [bus] section; they are never polled
+static void fnCheckProbeBuses(const ProbeRegistry *pstRegistry, const BusConfig *pstBuses, int wCount)
+{
+    for (int i = 0; i < pstRegistry->wCount; i++)
+    {
+        const AtgProbe *probe = &pstRegistry->pstProbes[i];
+        if (probe->achBus[0] == '\0')
+            continue;
+
+        bool bFound = false;
+        for (int b = 0; b < wCount && !bFound; b++)
+        {
+            bFound = (strcmp(pstBuses[b].achName, probe->achBus) == 0);
+        }
+        if (!bFound)
+        {
+            printf("Warning: probe %s is on unknown bus '%s' and will not be polled\n", probe->achAddress,
+                   probe->achBus);
+        }
+    }
 }
 
-int main()
+static void fnStopBuses()
 {
-    // Setup signal handlers for graceful shutdown
-    signal(SIGINT, signalHandler);
-    signal(SIGTERM, signalHandler);
+    for (int b = 0; b < wBusCount; b++)
+    {
+        fnBusStop(&astBuses[b]);
+    }
+    for (int b = 0; b < wBusCount; b++)
+    {
+        fnBusFree(&astBuses[b]);
+    }
+    wBusCount = 0;
+}
 
+// SIGHUP: swap in a freshly loaded configuration while the buses keep polling (see settings.c)
+static void fnReloadSettings(const char *configPath, const BusConfig *pstBuses, int wBuses)
+{
+    printf("\nReloading configuration from %s...\n", configPath);
+    Settings *pstNew = fnSettingsLoad(configPath, false);
+    if (pstNew == NULL)
+    {
+        printf("Reload failed, keeping the running configuration\n");
+        return;
+    }
+    fnCheckProbeBuses(&pstNew->stRegistry, pstBuses, wBuses);
+
+    Settings *pstOld = fnSettingsPublish(pstNew);
+    pstSettings = pstNew;
+    for (int b = 0; b < wBusCount; b++)
+    {
+        fnBusReload(&astBuses[b]);
+    }
+
+    // Each bus switches after its outstanding poll; only then is the old snapshot unused
+    for (int b = 0; b < wBusCount; b++)
+    {
+        while (fnBusGeneration(&astBuses[b]) < pstNew->u32Generation)
+        {
+            usleep(10000);
+        }
+    }
+    fnSettingsFree(pstOld);
+    printf("Configuration %u active on %d bus(es)\n", pstNew->u32Generation, wBusCount);
+}
+
+int main(int argc, char *argv[])
+{
     printf("==============================================\n");
     printf("  ATG Poller - Linux/Orange Pi Version\n");
     printf("  Stingray Technologies\n");
     printf("==============================================\n\n");
 
-    fnInitMachine();
+    // Load the probe registry, scheduler settings and dip charts before touching any hardware
+    const char *configPath = (argc > 1) ? argv[1] : ATG_CONFIG_FILE;
+    pstSettings = fnSettingsLoad(configPath, true);
+    if (pstSettings == NULL)
+    {
+        return 1;
+    }
+    fnSettingsPublish(pstSettings);
+
+    BusConfig astBusConfig[BUS_MAX];
+    int wBusConfigs = fnBusLoadConfig(astBusConfig, BUS_MAX, configPath);
+    if (wBusConfigs < 0)
+    {
+        printf("ERROR: Invalid [bus] section in %s\n", configPath);
+        fnSettingsFree(pstSettings);
+        return 1;
+    }
+    fnCheckProbeBuses(&pstSettings->stRegistry, astBusConfig, wBusConfigs);
+
+    if (fnMqttLoadConfig(configPath) != 0)
+    {
+        printf("ERROR: Invalid [mqtt] section in %s\n", configPath);
+        fnSettingsFree(pstSettings);
+        return 1;
+    }
 
-    double dbCurrentTime = 0;
-    double dbLastSendMicros = -(DELAY_BW_PACKET);
-    uint8_t chPacketSend[10] = {0};
-    uint8_t chPacketRec[50] = {0};
-    uint8_t u8PacketPointer = 0;
-    AtgData stAtgData;
+    PublisherConfig stPublisherConfig;
+    if (fnPublisherLoadConfig(&stPublisherConfig, configPath) != 0)
+    {
+        printf("ERROR: Invalid [batch] section in %s\n", configPath);
+        fnSettingsFree(pstSettings);
+        return 1;
+    }
 
-    // Initialize ATG data structures
-    fnInitAtgData(&stAtgData);
-    for (int i = 0; i < NUMBER_OF_ATGS; i++)
+    JournalConfig stJournalConfig;
+    if (fnJournalLoadConfig(&stJournalConfig, configPath) != 0)
     {
-        fnInitAtgData(&stLatestAtgData[i]);
-        fnInitAtgData(&stPreviousAtgData[i]);
-        stLatestAtgData[i].address = atoi(achAtgAddress[i]);
-        stPreviousAtgData[i].address = atoi(achAtgAddress[i]);
-        dbLastMqttPublishTime[i] = -(MQTT_PERIODIC_INTERVAL);
+        printf("ERROR: Invalid [journal] section in %s\n", configPath);
+        fnSettingsFree(pstSettings);
+        return 1;
     }
 
-    fnUpdateLastAddressSentIndex((NUMBER_OF_ATGS - 1));
+    if (fnStatsLoadConfig(configPath) != 0)
+    {
+        printf("ERROR: Invalid [stats] section in %s\n", configPath);
+        fnSettingsFree(pstSettings);
+        return 1;
+    }
 
-    printf("Starting ATG polling loop...\n");
-    printf("Press Ctrl+C to stop\n\n");
+    if (fnMetricsLoadConfig(configPath) != 0)
+    {
+        printf("ERROR: Invalid [metrics] section in %s\n", configPath);
+        fnSettingsFree(pstSettings);
+        return 1;
+    }
 
-    while (keepRunning)
+    TraceConfig stTraceConfig;
+    if (fnTraceLoadConfig(&stTraceConfig, configPath) != 0)
     {
-        dbCurrentTime = getCurrentTimeMs();
+        printf("ERROR: Invalid [capture] section in %s\n", configPath);
+        fnSettingsFree(pstSettings);
+        return 1;
+    }
 
-        // Send ATG polling requests
-        if ((dbCurrentTime - dbLastSendMicros) > DELAY_BW_PACKET)
-        {
-            uint8_t u8AddIndex = fnGetNextAddress();
-            uint8_t u8Length = fnPacketAtgPacket(chPacketSend, &achAtgAddress[u8AddIndex][0]);
-            fnUartTransmit(&hPortDart, (uint8_t *)chPacketSend, u8Length);
-            fnUpdateLastAddressSentIndex(u8AddIndex);
-            dbLastSendMicros = getCurrentTimeMs();
-        }
+    // Block SIGINT/SIGTERM/SIGHUP before any worker starts so only sigwait below sees them
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) != 0)
+    {
+        printf("Error blocking signals: %s\n", strerror(errno));
+        fnSettingsFree(pstSettings);
+        return 1;
+    }
 
-        // Receive and process ATG responses
-        uint8_t u8LengReceived = fnUartReceive(&hPortDart, &chPacketRec[u8PacketPointer]);
-        u8PacketPointer += u8LengReceived;
+    fnInitMachine();
 
-        if (u8PacketPointer > 0)
+    // One publisher lane per bus; the publish thread starts before any producer
+    int rc = fnPublisherInit(wBusConfigs, PUBLISH_QUEUE_DEPTH, &stPublisherConfig, &stJournalConfig);
+    if (rc != 0)
+    {
+        printf("ERROR: Out of memory initializing the publish queues\n");
+    }
+    else
+    {
+        rc = fnPublisherStart();
+    }
+
+    // Monitoring is optional: a port in use is reported, not fatal
+    fnMetricsStart();
+
+    // Capture starts before the ports open so the trace records which is which
+    fnTraceStart(&stTraceConfig);
+
+    // The first bus also polls the probes that do not name one
+    for (int b = 0; b < wBusConfigs && rc == 0; b++)
+    {
+        rc = fnBusInit(&astBuses[b], b, &astBusConfig[b], pstSettings, b == 0);
+        wBusCount = b + 1;
+    }
+    printf("\n");
+
+    if (rc == 0)
+    {
+        printf("Starting ATG polling on %d bus(es)...\n", wBusCount);
+        printf("Press Ctrl+C to stop\n\n");
+
+        for (int b = 0; b < wBusCount && rc == 0; b++)
         {
-            if (fnCheckStopFlag(chPacketRec, u8PacketPointer))
-            {
-#ifdef PRINT_PACKET
-                fnPrintPacket('R', chPacketRec, u8PacketPointer);
-#endif
-                fnParseAtgResponse((char *)chPacketRec, &stAtgData);
-                fnPrintAtgData(&stAtgData);
-
-                // Update latest data and check for changes
-                for (int i = 0; i < NUMBER_OF_ATGS; i++)
-                {
-                    if (stLatestAtgData[i].address == stAtgData.address)
-                    {
-                        memcpy(&stLatestAtgData[i], &stAtgData, sizeof(AtgData));
-
-                        double timeSinceLastPublish = dbCurrentTime - dbLastMqttPublishTime[i];
-                        int dataChanged = fnHasDataChanged(&stLatestAtgData[i], &stPreviousAtgData[i]);
-
-                        if (dataChanged || (timeSinceLastPublish >= MQTT_PERIODIC_INTERVAL))
-                        {
-                            char topic[32];
-                            sprintf(topic, "ATG%d", stLatestAtgData[i].address);
-
-                            if (fnMqttPublishAtgData(topic, &stLatestAtgData[i]) == 0)
-                            {
-                                memcpy(&stPreviousAtgData[i], &stLatestAtgData[i], sizeof(AtgData));
-                                dbLastMqttPublishTime[i] = dbCurrentTime;
-
-                                if (dataChanged)
-                                {
-                                    printf("[MQTT] Published due to data change\n");
-                                }
-                                else
-                                {
-                                    printf("[MQTT] Published due to periodic interval (2 min)\n");
-                                }
-                            }
-                        }
-                        break;
-                    }
-                }
-
-                fnInitAtgData(&stAtgData);
-                u8PacketPointer = 0;
-                memset(chPacketRec, 0x00, sizeof(chPacketRec));
-            }
+            rc = fnBusStart(&astBuses[b]);
         }
+    }
 
-        // Small delay to prevent CPU spinning (1ms)
-        usleep(1000);
+    // The main thread only waits for reload and shutdown requests; the buses poll on their own
+    while (rc == 0)
+    {
+        int signo = 0;
+        sigwait(&mask, &signo);
+        if (signo != SIGHUP)
+        {
+            printf("\nReceived signal %d, shutting down...\n", signo);
+            break;
+        }
+        fnReloadSettings(configPath, astBusConfig, wBusConfigs);
     }
 
     // Cleanup
     printf("\nCleaning up...\n");
+    fnMetricsStop();
+    fnStopBuses();
+    fnTraceStop();
+    fnPublisherStop();
     fnMqttCleanup();
-    fnCloseComPort(hPortDart);
+    fnPublisherFree();
+    fnSettingsFree(pstSettings);
     printf("Shutdown complete.\n");
 
-    return 0;
+    return rc == 0 ? 0 : 1;
 }
 
 void fnInitMachine()
 {
-    // Set serial port - common Orange Pi serial ports:
-    // /dev/ttyS0 - UART0 (debug console, may not be available)
+    // Serial ports are opened per bus; see the [bus] sections of the configuration file.
+    // Common Orange Pi serial ports:
     // /dev/ttyS1 - UART1
     // /dev/ttyS2 - UART2
     // /dev/ttyUSB0 - USB to Serial adapter
-    setComPort(SERIAL_PORT);
-    setBaudRate(BAUDRATE);
-
-    char comPort[64] = {0};
-    getComPort(comPort);
-
-    printf("Connecting to serial port: %s at %d baud\n", comPort, (int)getBaudRate());
-
-    if (fnInitComPort(&hPortDart, comPort, getBaudRate()))
-    {
-        printf("Serial port connected successfully\n");
-    }
-    else
-    {
-        printf("ERROR: Serial port connection failed!\n");
-        printf("Please check:\n");
-        printf("  1. Port %s exists (ls -la %s)\n", comPort, comPort);
-        printf("  2. You have permission (sudo usermod -a -G dialout $USER)\n");
-        printf("  3. The device is connected\n");
-    }
 
     // Initialize MQTT connection
     printf("\nInitializing MQTT connection to %s:%d...\n", MQTT_BROKER, MQTT_PORT);
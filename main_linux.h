@@ -6,6 +6,8 @@
 #ifndef MAIN_LINUX_H
 #define MAIN_LINUX_H
 
+#include <stdint.h>
+
 // ========================================
 // SERIAL PORT CONFIGURATION
 // ========================================
@@ -19,17 +21,146 @@
 #define SERIAL_PORT "/dev/ttyS1"
 #define BAUDRATE 9600
 
+// ========================================
+// PROBE CONFIGURATION
+// ========================================
+// Probe list, topics and per-probe thresholds are read at startup from this
+// file (or the path given as the first command line argument). When it does
+// not exist the compiled-in list in atg.c is used with the thresholds below.
+#define ATG_CONFIG_FILE "/etc/atg_poller/atg_poller.conf"
+
+// ========================================
+// POLL SCHEDULER DEFAULTS
+// ========================================
+// The next poll is sent as soon as the previous response completes or times
+// out. Override in the [scheduler] section of the configuration file.
+#define POLL_TURNAROUND_MS 20               // Bus idle gap before the next poll
+#define POLL_MIN_TIMEOUT_MS 100             // Floor for learned response timeouts
+#define POLL_MAX_TIMEOUT_MS DELAY_BW_PACKET // Timeout until a probe has answered once
+#define POLL_MIN_INTERVAL_MS 1000           // Fastest poll rate for a changing tank
+#define POLL_MAX_INTERVAL_MS 60000          // Slowest poll rate for a static tank
+#define POLL_INTERVAL_GROWTH 1.5            // Interval growth per unchanged reading
+#define POLL_RETRIES 2                      // Immediate retries after a missed response
+#define POLL_BACKOFF_MIN_MS 5000            // First re-probe interval for an offline probe
+#define POLL_BACKOFF_MAX_MS 300000          // Re-probe interval cap (5 minutes)
+
 // ========================================
 // MQTT PUBLISHING CONFIGURATION
 // ========================================
 // Publish data after every X minutes regardless of change (in milliseconds)
 #define MQTT_PERIODIC_INTERVAL 120000  // 2 minutes = 120000 ms
 
-// Minimum change threshold to trigger publish
+// Messages each serial bus can queue for the publish thread while the
+// broker is slow; further readings wait for the next poll
+#define PUBLISH_QUEUE_DEPTH 64
+
+// ========================================
+// BATCHED PUBLISHING
+// ========================================
+// Off by default: every reading is its own message on the probe's topic.
+// Enable with mode = sweep or window in the [batch] section to send one
+// payload per station instead.
+#define BATCH_TOPIC "ATGSTATION"  // Station topic carrying the batches
+#define BATCH_WINDOW_MS 5000      // Longest a reading waits in a batch
+#define BATCH_MAX_READINGS 32     // Readings per batch (at most BATCH_READINGS_LIMIT)
+
+// ========================================
+// STORE-AND-FORWARD JOURNAL
+// ========================================
+// Readings the broker did not acknowledge are kept on disk and replayed
+// once it is reachable again. Override in the [journal] section.
+#define JOURNAL_DIR "/var/lib/atg_poller/journal"
+#define JOURNAL_SEGMENT_KB 1024  // Size of one segment file
+#define JOURNAL_MAX_MB 64        // Disk cap before the oldest segment is evicted
+#define JOURNAL_REPLAY_RATE 20   // Replayed messages per second
+#define JOURNAL_SYNC_MS 1000     // Flush interval for appended messages
+
+// ========================================
+// DIP CHARTS
+// ========================================
+// Strapping tables (<topic>.json, as in the server's dip_charts/) used to
+// publish Volume and Ullage with each reading. The compiled file made by
+// dipchart_compile is preferred; the JSON directory is parsed when it is
+// missing. Override in the [charts] section.
+#define DIP_CHART_FILE "/etc/atg_poller/dip_charts.bin"
+#define DIP_CHART_DIR "/etc/atg_poller/dip_charts"
+
+// Default minimum change threshold to trigger publish
 #define TEMP_CHANGE_THRESHOLD 0.1     // 0.1 degree Celsius
 #define PRODUCT_CHANGE_THRESHOLD 1.0  // 1 mm
 #define WATER_CHANGE_THRESHOLD 1.0    // 1 mm
 
+// ========================================
+// SIGNAL CONDITIONING
+// ========================================
+// Each channel passes a rolling median, exponential smoothing and a
+// hysteresis deadband before the change thresholds above are applied.
+// Override per channel in the [filter] section.
+#define FILTER_MEDIAN_WINDOW 5        // Samples in the rolling median
+#define FILTER_LEVEL_EMA 0.5          // Weight of a new product or water sample
+#define FILTER_TEMP_EMA 0.3           // Weight of a new temperature sample
+#define FILTER_LEVEL_DEADBAND 0.5     // mm
+#define FILTER_TEMP_DEADBAND 0.05     // degree Celsius
+
+// ========================================
+// ROLLUPS
+// ========================================
+// Off by default. With enabled = true in the [rollup] section each probe
+// also publishes min/max/mean/last/rate summaries per window on
+// <topic>/summary.
+#define ROLLUP_WINDOW_S 60  // Default window length in seconds
+
+// ========================================
+// TANK EVENTS
+// ========================================
+// Deliveries, losses in quiet hours and water ingress detected on the
+// device and published on <topic>/event. Override in the [events] section.
+#define EVENT_DELIVERY_MM 20.0        // Product rise that starts a delivery
+#define EVENT_DELIVERY_WINDOW_S 300   // ...within this many seconds
+#define EVENT_LOSS_MM 10.0            // Product drop that starts a loss
+#define EVENT_LOSS_WINDOW_S 1800      // ...within this many seconds
+#define EVENT_SETTLE_MM 2.0           // Movement below which an event ends
+#define EVENT_SETTLE_S 120            // ...for this many seconds
+#define EVENT_WATER_RISE_MM 5.0       // Water rise reported as ingress
+#define EVENT_QUIET_START_HOUR 22     // Local hour quiet hours begin
+#define EVENT_QUIET_END_HOUR 6        // Local hour quiet hours end
+
+// ========================================
+// LOCAL ALARMS
+// ========================================
+// Limits are set per probe (high_level, low_level, high_water, high_temp);
+// override these in the [alarms] section.
+#define ALARM_CONFIRM 2               // Readings past a limit before it changes
+#define ALARM_LEVEL_HYSTERESIS 5.0    // mm
+#define ALARM_TEMP_HYSTERESIS 1.0     // degree Celsius
+#define ALARM_LANE_DEPTH 64           // Alarms queued per bus ahead of telemetry
+
+// ========================================
+// RUNTIME STATISTICS
+// ========================================
+// Counters and per-stage latency percentiles, published retained on
+// STATS_TOPIC every STATS_INTERVAL_S seconds. Override in [stats].
+#define STATS_INTERVAL_S 60
+#define STATS_TOPIC "ATGSTATION/stats"
+
+// ========================================
+// METRICS ENDPOINT
+// ========================================
+// Off by default. With enabled = true in the [metrics] section the
+// statistics are also served in the Prometheus text format over HTTP.
+#define METRICS_BIND "127.0.0.1"
+#define METRICS_PORT 9464
+#define METRICS_CACHE_MS 1000      // Scrapes within this reuse one render
+#define METRICS_IO_TIMEOUT_MS 1000 // For a scraper to send its whole request and take the reply
+
+// ========================================
+// SERIAL CAPTURE
+// ========================================
+// Off by default. With enabled = true in the [capture] section all serial
+// traffic is recorded for atg_replay.
+#define TRACE_FILE "/var/lib/atg_poller/serial.atgt"
+#define TRACE_MAX_MB 64 // Capture stops at this size
+
 // ========================================
 // DEBUG OPTIONS
 // ========================================
@@ -42,5 +173,7 @@
 // ========================================
 void fnInitMachine();
 void fnDelay(int milliseconds);
+double getCurrentTimeMs();
+int64_t getWallClockMs();
 
 #endif
@@ -0,0 +1,486 @@
+/**
+ * Metrics Endpoint
+ *
+ * A minimal HTTP listener for monitoring stacks that scrape rather than
+ * subscribe. With enabled = true in the [metrics] section, GET /metrics on
+ * bind:port returns the runtime statistics (stats.c) in the Prometheus text
+ * format:
+ *
+ *   atg_polls_total, atg_timeouts_total, ...    counters of stats.c
+ *   atg_probe_polls_total{address="83731"}      per-probe polls, responses,
+ *   atg_probe_up{address="83731"}               timeouts, response time, online
+ *   atg_stage_latency_seconds_bucket{stage="frame",le="0.065536"}
+ *                                               histograms of every stage
+ *   atg_journal_pending_messages, atg_mqtt_connected
+ *   process_resident_memory_bytes
+ *
+ * The histogram boundaries are powers of two microseconds (16 us to 8.4 s),
+ * which are exact bucket edges of the stats histograms. The frame stage is
+ * the poll round trip and the puback stage the publish latency.
+ *
+ * The listener runs on a thread of its own and only reads counters the
+ * other threads update atomically, so a scrape never takes a lock a bus
+ * worker or the publish thread waits on. The cost of a scrape is bounded:
+ * one connection is served at a time and gets METRICS_IO_TIMEOUT_MS in all
+ * to send its request and take the reply, however slowly it trickles bytes;
+ * the page is rendered into a buffer allocated once, and a render is reused
+ * for every scrape within METRICS_CACHE_MS.
+ * Anything but GET /metrics (or /) gets a 404.
+ *
+ * Binds to 127.0.0.1 by default; set bind to the gateway's management
+ * interface, or 0.0.0.0 for all, to scrape it from elsewhere.
+ */
+
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include "stats.h"
+#include "config.h"
+#include "main_linux.h"
+
+#define METRICS_PAGE_MAX (512 * 1024) // Rendered page, sized for STATS_MAX_PROBES probes
+#define METRICS_REQUEST_MAX 1024      // Request head kept; the rest is ignored
+#define METRICS_LE_FIRST 4            // First histogram boundary, 2^4 us
+#define METRICS_LE_COUNT 20           // Boundaries up to 2^23 us
+
+static MetricsConfig stConfig = {false, METRICS_BIND, METRICS_PORT};
+static int listenFd = -1;
+static int stopFd = -1; // eventfd written by fnMetricsStop
+static pthread_t metricsThread;
+static bool bThreadStarted = false;
+
+static char *pchPage = NULL;
+static size_t szPage = 0;
+static bool bTruncated = false;
+static double dbStartedAt = 0;
+static double dbRenderedAt = -1e9;
+static double dbRenderMs = 0;
+static uint32_t u32Scrapes = 0;
+
+// Scratch space for a render, too large for the thread's stack
+static StatsSnapshot stSnapshot;
+static StatsProbeCounts astProbeCounts[STATS_MAX_PROBES];
+
+// Metric name and help of each StatCounter
+static const char *const aachCounterMetrics[STAT_COUNTERS][2] = {
+    {"atg_polls_total", "Poll commands sent"},
+    {"atg_frames_total", "Responses parsed"},
+    {"atg_rejected_total", "Responses that failed to parse"},
+    {"atg_checksum_mismatches_total", "Responses whose checksum did not match"},
+    {"atg_timeouts_total", "Polls left unanswered"},
+    {"atg_queued_total", "Readings queued for publishing"},
+    {"atg_queue_full_total", "Readings deferred because their publish lane was full"},
+    {"atg_mqtt_sent_total", "Messages handed to the MQTT client"},
+    {"atg_mqtt_acked_total", "PUBACKs received"},
+    {"atg_mqtt_failed_total", "Messages refused or failed"},
+    {"atg_journaled_total", "Messages written to the journal"},
+    {"atg_mqtt_connects_total", "Broker connections established"},
+    {"atg_mqtt_connections_lost_total", "Broker connections lost"}};
+static const char *const aachStageLabels[STAT_STAGES] = {"tx", "first_byte", "frame", "parse", "enqueue", "puback"};
+
+static int fnMetricsConfigHandler(void *pvContext, const char *achSection, const char *achName,
+                                  const char *achKey, const char *achValue, int wLine)
+{
+    MetricsConfig *pstConfig = (MetricsConfig *)pvContext;
+    (void)achName;
+
+    if (strcmp(achSection, "metrics") != 0 || achKey[0] == '\0')
+    {
+        return 0;
+    }
+
+    if (strcmp(achKey, "enabled") == 0)
+    {
+        pstConfig->bEnabled = fnConfigParseBool(achValue);
+    }
+    else if (strcmp(achKey, "bind") == 0)
+    {
+        struct in_addr stAddress;
+        if (strlen(achValue) >= sizeof(pstConfig->achBind) || inet_pton(AF_INET, achValue, &stAddress) != 1)
+        {
+            printf("Config line %d: bind must be an IPv4 address\n", wLine);
+            return -1;
+        }
+        strcpy(pstConfig->achBind, achValue);
+    }
+    else if (strcmp(achKey, "port") == 0)
+    {
+        long lValue = strtol(achValue, NULL, 10);
+        if (lValue < 1 || lValue > 65535)
+        {
+            printf("Config line %d: port must be 1 to 65535\n", wLine);
+            return -1;
+        }
+        pstConfig->u16Port = (uint16_t)lValue;
+    }
+    else
+    {
+        printf("Config line %d: unknown metrics key '%s' ignored\n", wLine, achKey);
+    }
+    return 0;
+}
+
+/**
+ * Read the [metrics] section of the configuration file
+ * @return 0 on success or if the file does not exist, non-zero on a bad value
+ */
+int fnMetricsLoadConfig(const char *achPath)
+{
+    MetricsConfig stNew = {false, METRICS_BIND, METRICS_PORT};
+    int rc = fnConfigParse(achPath, fnMetricsConfigHandler, &stNew);
+    if (rc > 0)
+    {
+        return rc;
+    }
+    stConfig = stNew;
+    return 0;
+}
+
+// Append to the page; a page that runs out of room is cut at the last whole line
+static void fnMetricsAppend(const char *achFormat, ...)
+{
+    if (bTruncated)
+    {
+        return;
+    }
+    va_list args;
+    va_start(args, achFormat);
+    int wLength = vsnprintf(pchPage + szPage, METRICS_PAGE_MAX - szPage, achFormat, args);
+    va_end(args);
+    if (wLength < 0 || (size_t)wLength >= METRICS_PAGE_MAX - szPage)
+    {
+        bTruncated = true;
+        pchPage[szPage] = '\0';
+        return;
+    }
+    szPage += (size_t)wLength;
+}
+
+static void fnMetricsFamily(const char *achName, const char *achType, const char *achHelp)
+{
+    fnMetricsAppend("# HELP %s %s\n# TYPE %s %s\n", achName, achHelp, achName, achType);
+}
+
+// Resident set size from /proc/self/statm, 0 if unavailable
+static uint64_t fnMetricsRss()
+{
+    unsigned long ulSize = 0, ulResident = 0;
+    FILE *pFile = fopen("/proc/self/statm", "r");
+    if (pFile == NULL)
+    {
+        return 0;
+    }
+    if (fscanf(pFile, "%lu %lu", &ulSize, &ulResident) != 2)
+    {
+        ulResident = 0;
+    }
+    fclose(pFile);
+    return (uint64_t)ulResident * (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+// Render the whole page from the current statistics
+static void fnMetricsRender(double dbNow)
+{
+    szPage = 0;
+    bTruncated = false;
+    fnStatsCollect(&stSnapshot);
+
+    fnMetricsFamily("atg_uptime_seconds", "gauge", "Seconds since the poller started");
+    fnMetricsAppend("atg_uptime_seconds %.0f\n", (dbNow - dbStartedAt) / 1000.0);
+
+    for (int i = 0; i < STAT_COUNTERS; i++)
+    {
+        fnMetricsFamily(aachCounterMetrics[i][0], "counter", aachCounterMetrics[i][1]);
+        fnMetricsAppend("%s %llu\n", aachCounterMetrics[i][0], (unsigned long long)stSnapshot.au64Counters[i]);
+    }
+
+    fnMetricsFamily("atg_journal_pending_messages", "gauge", "Messages waiting in the store-and-forward journal");
+    fnMetricsAppend("atg_journal_pending_messages %llu\n", (unsigned long long)fnStatsGauge(STAT_JOURNAL_DEPTH));
+    fnMetricsFamily("atg_mqtt_connected", "gauge", "1 while the broker connection is up");
+    fnMetricsAppend("atg_mqtt_connected %llu\n", (unsigned long long)fnStatsGauge(STAT_MQTT_CONNECTED));
+    fnMetricsFamily("process_resident_memory_bytes", "gauge", "Resident memory size in bytes");
+    fnMetricsAppend("process_resident_memory_bytes %llu\n", (unsigned long long)fnMetricsRss());
+
+    // Latency of every stage; the buckets are cumulative
+    fnMetricsFamily("atg_stage_latency_seconds", "histogram", "Latency of each stage of the poll and publish path");
+    for (int s = 0; s < STAT_STAGES; s++)
+    {
+        const uint64_t *pu64Buckets = stSnapshot.aau64Buckets[s];
+        uint64_t u64Below = 0;
+        int wBucket = 0;
+        for (int k = 0; k < METRICS_LE_COUNT; k++)
+        {
+            double dbLeUs = (double)(1u << (METRICS_LE_FIRST + k));
+            while (wBucket < STATS_BUCKETS && fnStatsBucketUpperUs(wBucket) <= dbLeUs)
+            {
+                u64Below += pu64Buckets[wBucket++];
+            }
+            fnMetricsAppend("atg_stage_latency_seconds_bucket{stage=\"%s\",le=\"%.6f\"} %llu\n", aachStageLabels[s],
+                            dbLeUs / 1e6, (unsigned long long)u64Below);
+        }
+        while (wBucket < STATS_BUCKETS)
+        {
+            u64Below += pu64Buckets[wBucket++];
+        }
+        fnMetricsAppend("atg_stage_latency_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n", aachStageLabels[s],
+                        (unsigned long long)u64Below);
+        fnMetricsAppend("atg_stage_latency_seconds_sum{stage=\"%s\"} %.6f\n", aachStageLabels[s],
+                        stSnapshot.au64SumUs[s] / 1e6);
+        fnMetricsAppend("atg_stage_latency_seconds_count{stage=\"%s\"} %llu\n", aachStageLabels[s],
+                        (unsigned long long)u64Below);
+    }
+
+    int wProbes = fnStatsCollectProbes(astProbeCounts, STATS_MAX_PROBES);
+    fnMetricsFamily("atg_probe_up", "gauge", "1 while the probe answers its polls");
+    for (int i = 0; i < wProbes; i++)
+        fnMetricsAppend("atg_probe_up{address=\"%d\"} %d\n", astProbeCounts[i].address, astProbeCounts[i].bOnline);
+    fnMetricsFamily("atg_probe_polls_total", "counter", "Polls sent to the probe");
+    for (int i = 0; i < wProbes; i++)
+        fnMetricsAppend("atg_probe_polls_total{address=\"%d\"} %u\n", astProbeCounts[i].address,
+                        astProbeCounts[i].u32Polls);
+    fnMetricsFamily("atg_probe_responses_total", "counter", "Polls the probe answered");
+    for (int i = 0; i < wProbes; i++)
+        fnMetricsAppend("atg_probe_responses_total{address=\"%d\"} %u\n", astProbeCounts[i].address,
+                        astProbeCounts[i].u32Responses);
+    fnMetricsFamily("atg_probe_timeouts_total", "counter", "Polls the probe left unanswered");
+    for (int i = 0; i < wProbes; i++)
+        fnMetricsAppend("atg_probe_timeouts_total{address=\"%d\"} %u\n", astProbeCounts[i].address,
+                        astProbeCounts[i].u32Timeouts);
+    fnMetricsFamily("atg_probe_response_seconds_total", "counter", "Summed poll-to-frame time of the answered polls");
+    for (int i = 0; i < wProbes; i++)
+        fnMetricsAppend("atg_probe_response_seconds_total{address=\"%d\"} %.6f\n", astProbeCounts[i].address,
+                        astProbeCounts[i].u64RttSumUs / 1e6);
+
+    // Cost of this render, reported by the next one
+    fnMetricsFamily("atg_metrics_render_seconds", "gauge", "Time taken to render the previous scrape");
+    fnMetricsAppend("atg_metrics_render_seconds %.6f\n", dbRenderMs / 1000.0);
+    if (bTruncated)
+    {
+        printf("[Metrics] Page truncated at %zu bytes\n", szPage);
+    }
+}
+
+// Wait until the connection is ready for wEvents; false once its deadline has passed
+static bool fnMetricsWait(int fd, short wEvents, double dbDeadline)
+{
+    while (true)
+    {
+        double dbRemainingMs = dbDeadline - getCurrentTimeMs();
+        if (dbRemainingMs <= 0)
+        {
+            return false;
+        }
+        struct pollfd stPoll = {fd, wEvents, 0};
+        int rc = poll(&stPoll, 1, (int)dbRemainingMs + 1);
+        if (rc > 0)
+        {
+            return true;
+        }
+        if (rc == 0 || errno != EINTR)
+        {
+            return false;
+        }
+    }
+}
+
+// Send the whole buffer, giving up on error or at the connection's deadline
+static int fnMetricsSend(int fd, const char *pchData, size_t szLength, double dbDeadline)
+{
+    while (szLength > 0)
+    {
+        if (!fnMetricsWait(fd, POLLOUT, dbDeadline))
+        {
+            return -1;
+        }
+        ssize_t wSent = send(fd, pchData, szLength, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (wSent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        {
+            continue;
+        }
+        if (wSent <= 0)
+        {
+            return -1;
+        }
+        pchData += wSent;
+        szLength -= (size_t)wSent;
+    }
+    return 0;
+}
+
+// Answer one connection within METRICS_IO_TIMEOUT_MS of accepting it
+static void fnMetricsServe(int fd)
+{
+    double dbDeadline = getCurrentTimeMs() + METRICS_IO_TIMEOUT_MS;
+
+    // Only the request line matters; read until the end of the head or the deadline
+    char achRequest[METRICS_REQUEST_MAX];
+    size_t szRead = 0;
+    while (szRead < sizeof(achRequest) - 1 && fnMetricsWait(fd, POLLIN, dbDeadline))
+    {
+        ssize_t wRead = recv(fd, achRequest + szRead, sizeof(achRequest) - 1 - szRead, MSG_DONTWAIT);
+        if (wRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        {
+            continue;
+        }
+        if (wRead <= 0)
+        {
+            break;
+        }
+        szRead += (size_t)wRead;
+        achRequest[szRead] = '\0';
+        if (strstr(achRequest, "\r\n\r\n") != NULL || strstr(achRequest, "\n\n") != NULL)
+        {
+            break;
+        }
+    }
+    achRequest[szRead] = '\0';
+
+    char achHead[192];
+    if (strncmp(achRequest, "GET /metrics ", 13) != 0 && strncmp(achRequest, "GET /metrics?", 13) != 0 &&
+        strncmp(achRequest, "GET / ", 6) != 0)
+    {
+        int wLength = snprintf(achHead, sizeof(achHead),
+                               "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 10\r\n"
+                               "Connection: close\r\n\r\nNot found\n");
+        fnMetricsSend(fd, achHead, (size_t)wLength, dbDeadline);
+        return;
+    }
+
+    double dbNow = getCurrentTimeMs();
+    if (dbNow - dbRenderedAt >= METRICS_CACHE_MS)
+    {
+        fnMetricsRender(dbNow);
+        dbRenderedAt = dbNow;
+        dbRenderMs = getCurrentTimeMs() - dbNow;
+    }
+    u32Scrapes++;
+
+    int wLength = snprintf(achHead, sizeof(achHead),
+                           "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                           "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                           szPage);
+    if (fnMetricsSend(fd, achHead, (size_t)wLength, dbDeadline) == 0)
+    {
+        fnMetricsSend(fd, pchPage, szPage, dbDeadline);
+    }
+}
+
+static void *fnMetricsThread(void *pvArg)
+{
+    (void)pvArg;
+    while (true)
+    {
+        struct pollfd astPoll[2] = {{listenFd, POLLIN, 0}, {stopFd, POLLIN, 0}};
+        int rc = poll(astPoll, 2, -1);
+        if (rc < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            printf("[Metrics] Error waiting for connections: %s\n", strerror(errno));
+            break;
+        }
+        if (astPoll[1].revents != 0)
+        {
+            break;
+        }
+        if (astPoll[0].revents & POLLIN)
+        {
+            int fd = accept(listenFd, NULL, NULL);
+            if (fd >= 0)
+            {
+                fnMetricsServe(fd);
+                close(fd);
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Open the listening socket and start serving, if enabled
+ * @return 0 on success or when disabled, -1 if the endpoint could not start
+ */
+int fnMetricsStart(void)
+{
+    if (!stConfig.bEnabled)
+    {
+        return 0;
+    }
+
+    struct sockaddr_in stAddress;
+    memset(&stAddress, 0, sizeof(stAddress));
+    stAddress.sin_family = AF_INET;
+    stAddress.sin_port = htons(stConfig.u16Port);
+    inet_pton(AF_INET, stConfig.achBind, &stAddress.sin_addr);
+
+    int wReuse = 1;
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0 || setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &wReuse, sizeof(wReuse)) != 0 ||
+        bind(listenFd, (struct sockaddr *)&stAddress, sizeof(stAddress)) != 0 || listen(listenFd, 4) != 0)
+    {
+        printf("[Metrics] Error listening on %s:%u: %s\n", stConfig.achBind, stConfig.u16Port, strerror(errno));
+        fnMetricsStop();
+        return -1;
+    }
+
+    pchPage = malloc(METRICS_PAGE_MAX);
+    stopFd = eventfd(0, EFD_CLOEXEC);
+    if (pchPage == NULL || stopFd < 0)
+    {
+        printf("[Metrics] Error allocating the endpoint\n");
+        fnMetricsStop();
+        return -1;
+    }
+
+    dbStartedAt = getCurrentTimeMs();
+    int rc = pthread_create(&metricsThread, NULL, fnMetricsThread, NULL);
+    if (rc != 0)
+    {
+        printf("[Metrics] Error starting metrics thread: %s\n", strerror(rc));
+        fnMetricsStop();
+        return -1;
+    }
+    bThreadStarted = true;
+    printf("[Metrics] Serving http://%s:%u/metrics\n", stConfig.achBind, stConfig.u16Port);
+    return 0;
+}
+
+/**
+ * Stop serving and release the socket
+ */
+void fnMetricsStop(void)
+{
+    if (bThreadStarted)
+    {
+        uint64_t u64Stop = 1;
+        if (write(stopFd, &u64Stop, sizeof(u64Stop)) != sizeof(u64Stop))
+        {
+            printf("[Metrics] Error stopping metrics thread: %s\n", strerror(errno));
+        }
+        pthread_join(metricsThread, NULL);
+        bThreadStarted = false;
+        printf("[Metrics] %u scrape(s), last render %.2f ms, %zu bytes\n", u32Scrapes, dbRenderMs, szPage);
+    }
+    if (listenFd >= 0)
+    {
+        close(listenFd);
+        listenFd = -1;
+    }
+    if (stopFd >= 0)
+    {
+        close(stopFd);
+        stopFd = -1;
+    }
+    free(pchPage);
+    pchPage = NULL;
+}
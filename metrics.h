@@ -0,0 +1,22 @@
+/**
+ * Metrics Endpoint
+ * Prometheus text exposition of the runtime statistics over HTTP
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    bool bEnabled;
+    char achBind[64]; // IPv4 address to listen on
+    uint16_t u16Port;
+} MetricsConfig;
+
+int fnMetricsLoadConfig(const char *achPath);
+int fnMetricsStart(void);
+void fnMetricsStop(void);
+
+#endif
@@ -3,7 +3,9 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include "atg.h"
+#include "payload.h"
 
 #define MQTT_BROKER "127.0.0.1"
 #define MQTT_PORT 1883
@@ -12,6 +14,26 @@
 #define MQTT_KEEPALIVE 60
 #define MQTT_QOS 1
 
+// Unacknowledged QoS 1 messages allowed at once (mqtt_async.c only);
+// override with max_inflight in the [mqtt] section of the configuration file
+#define MQTT_MAX_INFLIGHT 32
+#define MQTT_INFLIGHT_LIMIT 1024
+// Slots of the window only priority messages (alarms) may use
+#define MQTT_PRIORITY_SLOTS 4
+// Routine publish refused because the rest of the window is in flight
+// (mqtt_async.c only; outside the range of Paho's return codes)
+#define MQTT_WINDOW_FULL (-100)
+
+// Background reconnect delay bounds (mqtt_async.c only); the delay doubles
+// per failed attempt and is jittered. Override with reconnect_min_ms and
+// reconnect_max_ms in the [mqtt] section
+#define MQTT_RECONNECT_MIN_MS 1000
+#define MQTT_RECONNECT_MAX_MS 60000
+
+// Reading payload encoding (mqtt_async.c only): PAYLOAD_JSON for existing
+// consumers or PAYLOAD_PACKED. Override with encoding in the [mqtt] section
+#define MQTT_ENCODING PAYLOAD_JSON
+
 // MQTT connection and publishing functions
 int fnMqttInit(const char *clientId);
 void fnMqttCleanup();
@@ -19,4 +41,22 @@ bool fnMqttIsConnected();
 int fnMqttPublishAtgData(const char *topic, const AtgData *data);
 int fnMqttReconnect();
 
+// Asynchronous client only (mqtt_async.c)
+// Called for a message the broker never acknowledged: its publish failed, or
+// it was still in flight when the connection dropped
+typedef void (*MqttUndeliveredHandler)(const char *topic, const void *payload, size_t length, int retained);
+// Called on Paho's thread when a slot frees after a publish was refused with MQTT_WINDOW_FULL
+typedef void (*MqttWindowHandler)(void);
+
+int fnMqttLoadConfig(const char *achPath);
+PayloadEncoding fnMqttPayloadEncoding();
+int fnMqttFormatAtgData(char *payload, size_t size, const AtgData *data);
+int fnMqttPublishPayload(const char *topic, const char *payload, int retained);
+int fnMqttPublishProbeStatus(const char *topic, int address, const char *commState, unsigned failures,
+                             unsigned pollIntervalMs, unsigned suppressed);
+int fnMqttPublishMessage(const char *topic, const void *payload, size_t length, int retained);
+int fnMqttPublishPriority(const char *topic, const void *payload, size_t length, double dbOriginAt);
+void fnMqttSetUndeliveredHandler(MqttUndeliveredHandler fnHandler);
+void fnMqttSetWindowHandler(MqttWindowHandler fnHandler);
+
 #endif
@@ -0,0 +1,851 @@
+/**
+ * MQTT Client - Asynchronous (Paho MQTTAsync)
+ *
+ * Implements mqtt.h for the Linux poller. A publish hands the message to
+ * the Paho client and returns at once; the PUBACK arrives later on Paho's
+ * callback thread. Up to wMaxInflight QoS 1 messages may be unacknowledged
+ * at a time, so throughput is bounded by the link instead of one broker
+ * round trip per reading. When the window is full a routine publish is
+ * refused at once with MQTT_WINDOW_FULL, and the window handler is called
+ * as soon as a completion frees a slot, so the single publish thread is
+ * never stuck behind a PUBACK while an alarm waits to go out.
+ *
+ * A supervisor thread owns the connection. It walks a small state machine
+ * (disconnected -> connecting -> connected, and backoff after a failure or
+ * a lost connection) and retries with exponential backoff plus jitter, so a
+ * fleet of pollers does not reconnect in lockstep after a broker restart.
+ * Publishing never connects: while the link is down it fails immediately.
+ *
+ * Each in-flight message occupies a slot; its index and the slot's
+ * generation travel as the Paho callback context. A connection loss frees
+ * every slot and bumps the generations, so late callbacks for messages the
+ * client has already written off are ignored instead of corrupting the
+ * window.
+ *
+ * Each slot also keeps a copy of its message. A message that fails, or is
+ * still unacknowledged when the connection drops, goes to the undelivered
+ * handler (the store-and-forward journal) instead of being lost.
+ *
+ * The last MQTT_PRIORITY_SLOTS slots of the window are kept for priority
+ * messages (alarms), so a window full of routine telemetry never makes an
+ * alarm wait for a PUBACK. Their time from frame arrival to PUBACK is
+ * accounted separately.
+ */
+
+#include "mqtt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "MQTTAsync.h"
+#include "config.h"
+#include "stats.h"
+
+// How long fnMqttInit and fnMqttCleanup wait for the broker
+#define MQTT_CONNECT_WAIT_MS 5000
+// TCP connect plus CONNACK limit for one attempt, in seconds
+#define MQTT_CONNECT_TIMEOUT_S 10
+// How long an alarm waits for a free priority slot before giving up
+#define MQTT_WINDOW_WAIT_MS 1000
+
+typedef struct {
+    bool bInUse;
+    uint16_t u16Generation;
+    double dbSentAt;
+    double dbOriginAt; // Priority messages: when their data arrived (ms, monotonic), else 0
+    char *pchTopic; // Copies kept until the broker acknowledges
+    void *pvPayload;
+    size_t szPayload;
+    int retained;
+} InflightSlot;
+
+typedef enum {
+    MQTT_STATE_DISCONNECTED, // Next step: start a connect
+    MQTT_STATE_CONNECTING,   // Waiting for the connect callback
+    MQTT_STATE_CONNECTED,
+    MQTT_STATE_BACKOFF       // Waiting out the retry delay
+} MqttState;
+
+static MQTTAsync client;
+static bool clientCreated = false;
+
+// Guards everything below; Paho callbacks run on their own thread
+static pthread_mutex_t mqttMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mqttCond = PTHREAD_COND_INITIALIZER;
+
+static MqttState eState = MQTT_STATE_DISCONNECTED;
+static bool isConnected = false; // eState == MQTT_STATE_CONNECTED, for the fast path
+static double dbRetryAt = 0;     // End of the current backoff
+static double dbBackoffMs = 0;   // Un-jittered delay before the next retry, doubles per failure
+static bool bRetryNow = false;   // fnMqttReconnect skips the rest of a backoff
+static bool bSupervisorStop = false;
+static pthread_t supervisorThread;
+static bool bSupervisorStarted = false;
+static unsigned int u32JitterSeed = 0;
+
+static int wMaxInflight = MQTT_MAX_INFLIGHT;
+static PayloadEncoding eEncoding = MQTT_ENCODING;
+static double dbReconnectMinMs = MQTT_RECONNECT_MIN_MS;
+static double dbReconnectMaxMs = MQTT_RECONNECT_MAX_MS;
+static InflightSlot astInflight[MQTT_INFLIGHT_LIMIT];
+static int wInflight = 0;
+static MqttUndeliveredHandler fnOnUndelivered = NULL;
+static MqttWindowHandler fnOnWindowOpen = NULL;
+static bool bWindowWaiter = false; // A routine publish was refused since the last slot freed
+
+// Completion accounting
+static uint32_t u32Sent = 0;
+static uint32_t u32Delivered = 0;
+static uint32_t u32Failed = 0;
+static uint32_t u32Abandoned = 0;  // In flight when the connection dropped
+static uint32_t u32WindowFull = 0; // Publishes refused because the window was full
+static uint32_t u32Offline = 0;    // Publishes refused because the broker was unreachable
+static uint32_t u32ConnectAttempts = 0;
+static uint32_t u32ConnectionsLost = 0;
+static int wPeakInflight = 0;
+static double dbAckTotalMs = 0;
+static double dbAckMaxMs = 0;
+static uint32_t u32PriorityDelivered = 0;
+static double dbPriorityTotalMs = 0; // Origin to PUBACK
+static double dbPriorityMaxMs = 0;
+
+static double fnMqttNowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000.0) + (ts.tv_nsec / 1000000.0);
+}
+
+// Absolute CLOCK_REALTIME deadline for pthread_cond_timedwait
+static struct timespec fnMqttDeadline(int wTimeoutMs)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += wTimeoutMs / 1000;
+    ts.tv_nsec += (long)(wTimeoutMs % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+static void *fnSlotContext(int wSlot)
+{
+    return (void *)(uintptr_t)(((uint32_t)astInflight[wSlot].u16Generation << 16) | (uint32_t)wSlot);
+}
+
+// Caller holds mqttMutex; tell a publisher refused for a full window that a slot is free
+static void fnWindowOpened()
+{
+    if (bWindowWaiter && fnOnWindowOpen != NULL)
+    {
+        bWindowWaiter = false;
+        fnOnWindowOpen();
+    }
+}
+
+// Caller holds mqttMutex; hands the message to the undelivered handler if asked, then frees it
+static void fnFreeSlot(InflightSlot *pstSlot, bool bUndelivered)
+{
+    if (bUndelivered && fnOnUndelivered != NULL)
+    {
+        fnOnUndelivered(pstSlot->pchTopic, pstSlot->pvPayload, pstSlot->szPayload, pstSlot->retained);
+    }
+    free(pstSlot->pchTopic);
+    free(pstSlot->pvPayload);
+    pstSlot->pchTopic = NULL;
+    pstSlot->pvPayload = NULL;
+    pstSlot->bInUse = false;
+    pstSlot->u16Generation++;
+}
+
+// Release the slot named by a callback context; returns its send time, or -1 if stale.
+// pdbOriginAt, if given, receives the slot's origin time
+static double fnReleaseSlot(void *context, bool bUndelivered, double *pdbOriginAt)
+{
+    uint32_t u32Context = (uint32_t)(uintptr_t)context;
+    int wSlot = (int)(u32Context & 0xFFFF);
+    uint16_t u16Generation = (uint16_t)(u32Context >> 16);
+
+    if (wSlot >= MQTT_INFLIGHT_LIMIT || !astInflight[wSlot].bInUse ||
+        astInflight[wSlot].u16Generation != u16Generation)
+    {
+        return -1;
+    }
+    double dbSentAt = astInflight[wSlot].dbSentAt;
+    if (pdbOriginAt != NULL)
+    {
+        *pdbOriginAt = astInflight[wSlot].dbOriginAt;
+    }
+    fnFreeSlot(&astInflight[wSlot], bUndelivered);
+    wInflight--;
+    pthread_cond_broadcast(&mqttCond);
+    fnWindowOpened();
+    return dbSentAt;
+}
+
+// Caller holds mqttMutex; every outstanding message is written off
+static void fnAbandonInflight()
+{
+    for (int i = 0; i < MQTT_INFLIGHT_LIMIT; i++)
+    {
+        if (astInflight[i].bInUse)
+        {
+            fnFreeSlot(&astInflight[i], true);
+            u32Abandoned++;
+        }
+    }
+    wInflight = 0;
+    pthread_cond_broadcast(&mqttCond);
+    fnWindowOpened();
+}
+
+static const char *fnMqttStateName(MqttState eValue)
+{
+    switch (eValue)
+    {
+    case MQTT_STATE_DISCONNECTED:
+        return "disconnected";
+    case MQTT_STATE_CONNECTING:
+        return "connecting";
+    case MQTT_STATE_CONNECTED:
+        return "connected";
+    case MQTT_STATE_BACKOFF:
+        return "backoff";
+    }
+    return "unknown";
+}
+
+// Caller holds mqttMutex
+static void fnMqttSetState(MqttState eNew)
+{
+    if (eNew != eState)
+    {
+        printf("[MQTT] %s -> %s\n", fnMqttStateName(eState), fnMqttStateName(eNew));
+    }
+    eState = eNew;
+    isConnected = (eNew == MQTT_STATE_CONNECTED);
+    pthread_cond_broadcast(&mqttCond);
+}
+
+// Caller holds mqttMutex; schedule the next connect attempt
+static void fnMqttEnterBackoff()
+{
+    // Equal jitter: wait between half and all of the current delay
+    double dbDelayMs = dbBackoffMs / 2 + (dbBackoffMs / 2) * ((double)rand_r(&u32JitterSeed) / RAND_MAX);
+    dbRetryAt = fnMqttNowMs() + dbDelayMs;
+    printf("[MQTT] Next connect attempt in %.0f ms\n", dbDelayMs);
+
+    dbBackoffMs *= 2;
+    if (dbBackoffMs > dbReconnectMaxMs)
+        dbBackoffMs = dbReconnectMaxMs;
+    fnMqttSetState(MQTT_STATE_BACKOFF);
+}
+
+static void fnOnConnectionLost(void *context, char *cause)
+{
+    (void)context;
+    printf("MQTT connection lost: %s\n", cause != NULL ? cause : "unknown cause");
+
+    pthread_mutex_lock(&mqttMutex);
+    u32ConnectionsLost++;
+    fnStatsCount(STAT_CONNECTIONS_LOST);
+    fnStatsSetGauge(STAT_MQTT_CONNECTED, 0);
+    fnAbandonInflight();
+    if (eState == MQTT_STATE_CONNECTED)
+    {
+        // The broker was fine until now, so start again from the shortest delay
+        dbBackoffMs = dbReconnectMinMs;
+        fnMqttEnterBackoff();
+    }
+    pthread_mutex_unlock(&mqttMutex);
+}
+
+// Nothing is subscribed, but Paho requires a message handler
+static int fnOnMessageArrived(void *context, char *topicName, int topicLen, MQTTAsync_message *message)
+{
+    (void)context;
+    (void)topicLen;
+    MQTTAsync_freeMessage(&message);
+    MQTTAsync_free(topicName);
+    return 1;
+}
+
+static void fnOnConnectSuccess(void *context, MQTTAsync_successData *response)
+{
+    (void)context;
+    (void)response;
+    pthread_mutex_lock(&mqttMutex);
+    dbBackoffMs = dbReconnectMinMs;
+    fnMqttSetState(MQTT_STATE_CONNECTED);
+    pthread_mutex_unlock(&mqttMutex);
+    fnStatsCount(STAT_CONNECTS);
+    fnStatsSetGauge(STAT_MQTT_CONNECTED, 1);
+}
+
+static void fnOnConnectFailure(void *context, MQTTAsync_failureData *response)
+{
+    (void)context;
+    printf("Failed to connect to MQTT broker, return code %d\n", response != NULL ? response->code : 0);
+    pthread_mutex_lock(&mqttMutex);
+    if (eState == MQTT_STATE_CONNECTING)
+    {
+        fnMqttEnterBackoff();
+    }
+    pthread_mutex_unlock(&mqttMutex);
+}
+
+static void fnOnPublishSuccess(void *context, MQTTAsync_successData *response)
+{
+    pthread_mutex_lock(&mqttMutex);
+    double dbOriginAt = 0;
+    double dbSentAt = fnReleaseSlot(context, false, &dbOriginAt);
+    if (dbSentAt >= 0)
+    {
+        double dbNow = fnMqttNowMs();
+        double dbAckMs = dbNow - dbSentAt;
+        u32Delivered++;
+        dbAckTotalMs += dbAckMs;
+        if (dbAckMs > dbAckMaxMs)
+            dbAckMaxMs = dbAckMs;
+        fnStatsCount(STAT_ACKED);
+        fnStatsRecord(STAT_PUBACK, dbAckMs);
+        if (dbOriginAt > 0)
+        {
+            u32PriorityDelivered++;
+            dbPriorityTotalMs += dbNow - dbOriginAt;
+            if (dbNow - dbOriginAt > dbPriorityMaxMs)
+                dbPriorityMaxMs = dbNow - dbOriginAt;
+        }
+    }
+    pthread_mutex_unlock(&mqttMutex);
+
+    if (dbSentAt >= 0 && response != NULL && response->alt.pub.destinationName != NULL)
+    {
+        const char *pchPayload = (const char *)response->alt.pub.message.payload;
+        int wLength = response->alt.pub.message.payloadlen;
+        if (wLength > 0 && (uint8_t)pchPayload[0] == PAYLOAD_MAGIC)
+            printf("Published to %s: %d bytes packed\n", response->alt.pub.destinationName, wLength);
+        else
+            printf("Published to %s: %.*s\n", response->alt.pub.destinationName, wLength, pchPayload);
+    }
+}
+
+static void fnOnPublishFailure(void *context, MQTTAsync_failureData *response)
+{
+    pthread_mutex_lock(&mqttMutex);
+    bool bCounted = fnReleaseSlot(context, true, NULL) >= 0;
+    if (bCounted)
+    {
+        u32Failed++;
+        fnStatsCount(STAT_PUBLISH_FAILED);
+    }
+    pthread_mutex_unlock(&mqttMutex);
+
+    if (bCounted)
+    {
+        printf("Failed to publish message, return code %d\n", response != NULL ? response->code : 0);
+    }
+}
+
+// Start one asynchronous connect; the callbacks move the state machine on
+static void fnMqttStartConnect()
+{
+    MQTTAsync_connectOptions conn_opts = MQTTAsync_connectOptions_initializer;
+    conn_opts.keepAliveInterval = MQTT_KEEPALIVE;
+    conn_opts.cleansession = 1;
+    conn_opts.username = MQTT_USERNAME;
+    conn_opts.password = MQTT_PASSWORD;
+    conn_opts.maxInflight = wMaxInflight;
+    conn_opts.connectTimeout = MQTT_CONNECT_TIMEOUT_S;
+    conn_opts.onSuccess = fnOnConnectSuccess;
+    conn_opts.onFailure = fnOnConnectFailure;
+    conn_opts.context = NULL;
+
+    int rc = MQTTAsync_connect(client, &conn_opts);
+    if (rc != MQTTASYNC_SUCCESS)
+    {
+        printf("Failed to start MQTT connect, return code %d\n", rc);
+        pthread_mutex_lock(&mqttMutex);
+        if (eState == MQTT_STATE_CONNECTING)
+        {
+            fnMqttEnterBackoff();
+        }
+        pthread_mutex_unlock(&mqttMutex);
+    }
+}
+
+// Supervisor thread: the only place a connect is started
+static void *fnMqttSupervisor(void *pvArg)
+{
+    (void)pvArg;
+
+    pthread_mutex_lock(&mqttMutex);
+    while (!bSupervisorStop)
+    {
+        if (eState == MQTT_STATE_DISCONNECTED)
+        {
+            u32ConnectAttempts++;
+            fnMqttSetState(MQTT_STATE_CONNECTING);
+            pthread_mutex_unlock(&mqttMutex);
+            fnMqttStartConnect();
+            pthread_mutex_lock(&mqttMutex);
+        }
+        else if (eState == MQTT_STATE_BACKOFF)
+        {
+            double dbWaitMs = dbRetryAt - fnMqttNowMs();
+            if (dbWaitMs <= 0 || bRetryNow)
+            {
+                bRetryNow = false;
+                fnMqttSetState(MQTT_STATE_DISCONNECTED);
+                continue;
+            }
+            struct timespec deadline = fnMqttDeadline((int)dbWaitMs + 1);
+            pthread_cond_timedwait(&mqttCond, &mqttMutex, &deadline);
+        }
+        else
+        {
+            // Connecting or connected: sleep until a callback changes the state
+            pthread_cond_wait(&mqttCond, &mqttMutex);
+        }
+    }
+    pthread_mutex_unlock(&mqttMutex);
+    return NULL;
+}
+
+// Reserve an in-flight slot holding a copy of the message. Routine messages leave the
+// priority slots free and never wait: a full window refuses them at once and the window
+// handler fires on the next completion. Priority messages wait for a completion.
+// Returns the slot index, MQTT_WINDOW_FULL, or -1 if the connection dropped
+static int fnAcquireSlot(const char *topic, const void *payload, size_t length, int retained, double dbOriginAt)
+{
+    struct timespec deadline = fnMqttDeadline(MQTT_WINDOW_WAIT_MS);
+    int wSlot = -1;
+    int wLimit = wMaxInflight;
+    bool bPriority = (dbOriginAt > 0);
+    if (!bPriority && wMaxInflight > MQTT_PRIORITY_SLOTS)
+    {
+        wLimit -= MQTT_PRIORITY_SLOTS;
+    }
+
+    pthread_mutex_lock(&mqttMutex);
+    while (bPriority && isConnected && wInflight >= wLimit)
+    {
+        if (pthread_cond_timedwait(&mqttCond, &mqttMutex, &deadline) != 0)
+            break;
+    }
+
+    if (!isConnected)
+    {
+        pthread_mutex_unlock(&mqttMutex);
+        return -1;
+    }
+    if (wInflight >= wLimit)
+    {
+        u32WindowFull++;
+        bWindowWaiter = bWindowWaiter || !bPriority;
+        pthread_mutex_unlock(&mqttMutex);
+        return bPriority ? -1 : MQTT_WINDOW_FULL;
+    }
+
+    for (int i = 0; i < MQTT_INFLIGHT_LIMIT; i++)
+    {
+        if (!astInflight[i].bInUse)
+        {
+            wSlot = i;
+            break;
+        }
+    }
+    astInflight[wSlot].pchTopic = strdup(topic);
+    astInflight[wSlot].pvPayload = malloc(length > 0 ? length : 1);
+    if (astInflight[wSlot].pchTopic == NULL || astInflight[wSlot].pvPayload == NULL)
+    {
+        fnFreeSlot(&astInflight[wSlot], false);
+        pthread_mutex_unlock(&mqttMutex);
+        return -1;
+    }
+    memcpy(astInflight[wSlot].pvPayload, payload, length);
+    astInflight[wSlot].szPayload = length;
+    astInflight[wSlot].retained = retained;
+    astInflight[wSlot].bInUse = true;
+    astInflight[wSlot].dbSentAt = fnMqttNowMs();
+    astInflight[wSlot].dbOriginAt = dbOriginAt;
+    wInflight++;
+    if (wInflight > wPeakInflight)
+        wPeakInflight = wInflight;
+    pthread_mutex_unlock(&mqttMutex);
+    return wSlot;
+}
+
+// Hand one message to Paho; dbOriginAt > 0 marks a priority message
+static int fnMqttSend(const char *topic, const void *payload, size_t length, int retained, double dbOriginAt)
+{
+    // Fast path while the broker is unreachable: the supervisor reconnects
+    if (!fnMqttIsConnected())
+    {
+        pthread_mutex_lock(&mqttMutex);
+        u32Offline++;
+        pthread_mutex_unlock(&mqttMutex);
+        return MQTTASYNC_DISCONNECTED;
+    }
+
+    int wSlot = fnAcquireSlot(topic, payload, length, retained, dbOriginAt);
+    if (wSlot < 0)
+    {
+        return wSlot;
+    }
+
+    MQTTAsync_message pubmsg = MQTTAsync_message_initializer;
+    pubmsg.payload = (void *)payload;
+    pubmsg.payloadlen = (int)length;
+    pubmsg.qos = MQTT_QOS;
+    pubmsg.retained = retained;
+
+    MQTTAsync_responseOptions opts = MQTTAsync_responseOptions_initializer;
+    opts.onSuccess = fnOnPublishSuccess;
+    opts.onFailure = fnOnPublishFailure;
+    pthread_mutex_lock(&mqttMutex);
+    opts.context = fnSlotContext(wSlot);
+    pthread_mutex_unlock(&mqttMutex);
+
+    // Paho copies the topic and payload before returning
+    int rc = MQTTAsync_sendMessage(client, topic, &pubmsg, &opts);
+
+    pthread_mutex_lock(&mqttMutex);
+    if (rc == MQTTASYNC_SUCCESS)
+    {
+        u32Sent++;
+        fnStatsCount(STAT_SENT);
+    }
+    else
+    {
+        // Refused outright: the caller still owns the message
+        fnReleaseSlot(opts.context, false, NULL);
+        u32Failed++;
+        fnStatsCount(STAT_PUBLISH_FAILED);
+    }
+    pthread_mutex_unlock(&mqttMutex);
+
+    if (rc != MQTTASYNC_SUCCESS)
+    {
+        printf("Failed to publish message, return code %d\n", rc);
+    }
+    return rc;
+}
+
+/**
+ * Hand one message to Paho; completion is accounted in the callbacks
+ * @return 0 if accepted; otherwise the message was refused and is still the caller's.
+ *         MQTT_WINDOW_FULL means it may be retried once the window handler fires
+ */
+int fnMqttPublishMessage(const char *topic, const void *payload, size_t length, int retained)
+{
+    return fnMqttSend(topic, payload, length, retained, 0);
+}
+
+/**
+ * Hand an alarm to Paho ahead of routine traffic: it may use the reserved
+ * in-flight slots, and its time from dbOriginAt to the PUBACK is measured
+ * @param dbOriginAt When the data it reports arrived (ms, CLOCK_MONOTONIC)
+ * @return 0 if accepted; otherwise the message was refused and is still the caller's
+ */
+int fnMqttPublishPriority(const char *topic, const void *payload, size_t length, double dbOriginAt)
+{
+    return fnMqttSend(topic, payload, length, 0, (dbOriginAt > 0) ? dbOriginAt : fnMqttNowMs());
+}
+
+/**
+ * Publish a text payload
+ */
+int fnMqttPublishPayload(const char *topic, const char *payload, int retained)
+{
+    return fnMqttPublishMessage(topic, payload, strlen(payload), retained);
+}
+
+static int fnMqttConfigHandler(void *pvContext, const char *achSection, const char *achName, const char *achKey,
+                               const char *achValue, int wLine)
+{
+    (void)pvContext;
+    (void)achName;
+
+    if (strcmp(achSection, "mqtt") != 0 || achKey[0] == '\0')
+    {
+        return 0;
+    }
+
+    if (strcmp(achKey, "max_inflight") == 0)
+    {
+        int wValue = atoi(achValue);
+        if (wValue < 1 || wValue > MQTT_INFLIGHT_LIMIT)
+        {
+            printf("Config line %d: max_inflight must be between 1 and %d\n", wLine, MQTT_INFLIGHT_LIMIT);
+            return -1;
+        }
+        wMaxInflight = wValue;
+    }
+    else if (strcmp(achKey, "reconnect_min_ms") == 0)
+    {
+        dbReconnectMinMs = strtod(achValue, NULL);
+    }
+    else if (strcmp(achKey, "reconnect_max_ms") == 0)
+    {
+        dbReconnectMaxMs = strtod(achValue, NULL);
+    }
+    else if (strcmp(achKey, "encoding") == 0)
+    {
+        if (fnPayloadParseEncoding(achValue, &eEncoding) != 0)
+        {
+            printf("Config line %d: encoding must be json or packed\n", wLine);
+            return -1;
+        }
+    }
+    else
+    {
+        printf("Config line %d: unknown mqtt key '%s' ignored\n", wLine, achKey);
+    }
+    return 0;
+}
+
+/**
+ * Read the [mqtt] section of the configuration file (before fnMqttInit)
+ * @return 0 on success or if the file does not exist, non-zero on a bad value
+ */
+int fnMqttLoadConfig(const char *achPath)
+{
+    int rc = fnConfigParse(achPath, fnMqttConfigHandler, NULL);
+    if (dbReconnectMinMs < 100)
+        dbReconnectMinMs = 100;
+    if (dbReconnectMaxMs < dbReconnectMinMs)
+        dbReconnectMaxMs = dbReconnectMinMs;
+    return (rc == -1) ? 0 : rc;
+}
+
+/**
+ * Encoding the publisher uses for readings
+ */
+PayloadEncoding fnMqttPayloadEncoding()
+{
+    return eEncoding;
+}
+
+int fnMqttInit(const char *clientId)
+{
+    char address[64];
+    sprintf(address, "tcp://%s:%d", MQTT_BROKER, MQTT_PORT);
+
+    int rc = MQTTAsync_create(&client, address, clientId, MQTTCLIENT_PERSISTENCE_NONE, NULL);
+    if (rc != MQTTASYNC_SUCCESS)
+    {
+        printf("Failed to create MQTT client, return code %d\n", rc);
+        return rc;
+    }
+    clientCreated = true;
+
+    rc = MQTTAsync_setCallbacks(client, NULL, fnOnConnectionLost, fnOnMessageArrived, NULL);
+    if (rc != MQTTASYNC_SUCCESS)
+    {
+        printf("Failed to set MQTT callbacks, return code %d\n", rc);
+        return rc;
+    }
+
+    u32JitterSeed = (unsigned int)time(NULL) ^ (unsigned int)getpid();
+    dbBackoffMs = dbReconnectMinMs;
+    rc = pthread_create(&supervisorThread, NULL, fnMqttSupervisor, NULL);
+    if (rc != 0)
+    {
+        printf("Failed to start MQTT supervisor: %s\n", strerror(rc));
+        return MQTTASYNC_FAILURE;
+    }
+    bSupervisorStarted = true;
+
+    // Report the first attempt's outcome; later ones are retried in the background
+    struct timespec deadline = fnMqttDeadline(MQTT_CONNECT_WAIT_MS);
+    pthread_mutex_lock(&mqttMutex);
+    while (eState == MQTT_STATE_DISCONNECTED || eState == MQTT_STATE_CONNECTING)
+    {
+        if (pthread_cond_timedwait(&mqttCond, &mqttMutex, &deadline) != 0)
+            break;
+    }
+    bool bConnected = isConnected;
+    pthread_mutex_unlock(&mqttMutex);
+    if (!bConnected)
+    {
+        return MQTTASYNC_FAILURE;
+    }
+
+    printf("Connected to MQTT broker at %s (up to %d messages in flight)\n", address, wMaxInflight);
+    return MQTTASYNC_SUCCESS;
+}
+
+void fnMqttCleanup()
+{
+    if (!clientCreated)
+    {
+        return;
+    }
+
+    if (bSupervisorStarted)
+    {
+        pthread_mutex_lock(&mqttMutex);
+        bSupervisorStop = true;
+        pthread_cond_broadcast(&mqttCond);
+        pthread_mutex_unlock(&mqttMutex);
+        pthread_join(supervisorThread, NULL);
+        bSupervisorStarted = false;
+    }
+
+    // Give outstanding messages a chance to be acknowledged
+    struct timespec deadline = fnMqttDeadline(MQTT_CONNECT_WAIT_MS);
+    pthread_mutex_lock(&mqttMutex);
+    while (isConnected && wInflight > 0)
+    {
+        if (pthread_cond_timedwait(&mqttCond, &mqttMutex, &deadline) != 0)
+            break;
+    }
+    bool bConnected = isConnected;
+    fnMqttSetState(MQTT_STATE_DISCONNECTED);
+    pthread_mutex_unlock(&mqttMutex);
+
+    if (bConnected)
+    {
+        MQTTAsync_disconnectOptions disc_opts = MQTTAsync_disconnectOptions_initializer;
+        disc_opts.timeout = 1000;
+        MQTTAsync_disconnect(client, &disc_opts);
+    }
+
+    pthread_mutex_lock(&mqttMutex);
+    fnAbandonInflight();
+    printf("[MQTT] %u sent, %u delivered, %u failed, %u abandoned, %u refused (window full), peak %d in flight\n",
+           u32Sent, u32Delivered, u32Failed, u32Abandoned, u32WindowFull, wPeakInflight);
+    printf("[MQTT] %u refused while offline, %u connect attempts, %u connections lost\n", u32Offline,
+           u32ConnectAttempts, u32ConnectionsLost);
+    if (u32Delivered > 0)
+    {
+        printf("[MQTT] PUBACK latency: mean %.1f ms, max %.1f ms\n", dbAckTotalMs / u32Delivered, dbAckMaxMs);
+    }
+    if (u32PriorityDelivered > 0)
+    {
+        printf("[MQTT] %u alarm(s), frame to PUBACK: mean %.1f ms, max %.1f ms\n", u32PriorityDelivered,
+               dbPriorityTotalMs / u32PriorityDelivered, dbPriorityMaxMs);
+    }
+    pthread_mutex_unlock(&mqttMutex);
+
+    MQTTAsync_destroy(&client);
+    clientCreated = false;
+    printf("MQTT connection closed\n");
+}
+
+bool fnMqttIsConnected()
+{
+    pthread_mutex_lock(&mqttMutex);
+    bool bConnected = isConnected;
+    pthread_mutex_unlock(&mqttMutex);
+    return bConnected && MQTTAsync_isConnected(client);
+}
+
+/**
+ * Ask the supervisor to skip the rest of its backoff and connect now
+ * Never blocks; the outcome is reported through the state machine.
+ * @return 0 if already connected, -1 otherwise
+ */
+int fnMqttReconnect()
+{
+    pthread_mutex_lock(&mqttMutex);
+    bool bConnected = isConnected;
+    if (!bConnected)
+    {
+        bRetryNow = true;
+        pthread_cond_broadcast(&mqttCond);
+    }
+    pthread_mutex_unlock(&mqttMutex);
+    return bConnected ? MQTTASYNC_SUCCESS : MQTTASYNC_FAILURE;
+}
+
+/**
+ * Format a reading as the JSON payload the server expects
+ * Timestamp (UTC, ms) is included when the reading carries one, so replayed
+ * readings are stored at the time they were taken.
+ * @return Payload length
+ */
+int fnMqttFormatAtgData(char *payload, size_t size, const AtgData *data)
+{
+    char timestamp[96] = "";
+    if (data->timestamp > 0)
+    {
+        time_t seconds = (time_t)(data->timestamp / 1000);
+        struct tm utc;
+        gmtime_r(&seconds, &utc);
+        snprintf(timestamp, sizeof(timestamp), ",\"Timestamp\":\"%04d-%02d-%02dT%02d:%02d:%02d.%03dZ\"",
+                 utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec,
+                 (int)(data->timestamp % 1000));
+    }
+
+    // Volume is present only for probes with a dip chart, StdVolume only
+    // for those that also have a density
+    char volume[96] = "";
+    if (data->volume >= 0)
+    {
+        int wLength =
+            snprintf(volume, sizeof(volume), ",\"Volume\":%.2f,\"Ullage\":%.2f", data->volume, data->ullage);
+        if (data->std_volume >= 0 && wLength > 0 && (size_t)wLength < sizeof(volume))
+        {
+            snprintf(volume + wLength, sizeof(volume) - wLength, ",\"StdVolume\":%.2f", data->std_volume);
+        }
+    }
+
+    return snprintf(payload, size,
+                    "{\"Address\":\"%d\",\"req_type\":0,\"Status\":\"%d\",\"Temp\":%.2f,\"Product\":%.2f,\"Water\":%.2f%s%s}",
+                    data->address,
+                    data->status,
+                    data->temperature,
+                    data->product,
+                    (float)data->water,
+                    volume,
+                    timestamp);
+}
+
+void fnMqttSetUndeliveredHandler(MqttUndeliveredHandler fnHandler)
+{
+    pthread_mutex_lock(&mqttMutex);
+    fnOnUndelivered = fnHandler;
+    pthread_mutex_unlock(&mqttMutex);
+}
+
+void fnMqttSetWindowHandler(MqttWindowHandler fnHandler)
+{
+    pthread_mutex_lock(&mqttMutex);
+    fnOnWindowOpen = fnHandler;
+    bWindowWaiter = false;
+    pthread_mutex_unlock(&mqttMutex);
+}
+
+int fnMqttPublishAtgData(const char *topic, const AtgData *data)
+{
+    if (eEncoding == PAYLOAD_PACKED)
+    {
+        uint8_t packed[PAYLOAD_HEADER_SIZE + PAYLOAD_READING_SIZE];
+        int length = fnPayloadPackReading(packed, sizeof(packed), data);
+        return fnMqttPublishMessage(topic, packed, (size_t)length, 0);
+    }
+
+    char payload[256];
+    fnMqttFormatAtgData(payload, sizeof(payload), data);
+    return fnMqttPublishPayload(topic, payload, 0);
+}
+
+int fnMqttPublishProbeStatus(const char *topic, int address, const char *commState, unsigned failures,
+                             unsigned pollIntervalMs, unsigned suppressed)
+{
+    char payload[160];
+    snprintf(payload, sizeof(payload),
+             "{\"Address\":\"%d\",\"Comm\":\"%s\",\"Failures\":%u,\"PollIntervalMs\":%u,\"Suppressed\":%u}",
+             address, commState, failures, pollIntervalMs, suppressed);
+
+    // Retained so a dashboard subscribing later still sees the last known state
+    return fnMqttPublishPayload(topic, payload, 1);
+}
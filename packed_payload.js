@@ -0,0 +1,72 @@
+/**
+ * Packed Payload Decoder
+ * Decodes the poller's packed binary payload (layout in payload.c) into the
+ * same shape as its JSON payload. Used by server.js; tests/payload_test.js
+ * checks it against buffers encoded by the C encoder.
+ */
+
+const PACKED_MAGIC = 0xA7;
+const PACKED_VERSION = 3;
+const PACKED_NO_VOLUME = -0x80000000;
+const PACKED_RECORD_SIZE = [0, 24, 32, 36]; // By version
+
+function decodePackedPayload(buf) {
+  if (buf.length < 4 || buf[0] !== PACKED_MAGIC) throw new Error('not a packed payload');
+  if (buf[1] < 1 || buf[1] > PACKED_VERSION) throw new Error(`unsupported packed version ${buf[1]}`);
+  const recordSize = PACKED_RECORD_SIZE[buf[1]];
+  const kind = buf[2];
+  const count = buf[3];
+  let offset = 4;
+
+  const need = (length) => {
+    if (offset + length > buf.length) throw new Error('truncated packed payload');
+  };
+  const readString = () => {
+    need(1);
+    const length = buf[offset];
+    need(1 + length);
+    const text = buf.toString('utf8', offset + 1, offset + 1 + length);
+    offset += 1 + length;
+    return text;
+  };
+  const readReading = () => {
+    need(recordSize);
+    const timestamp = Number(buf.readBigInt64LE(offset + 16));
+    const reading = {
+      Address: String(buf.readUInt32LE(offset)),
+      Status: String(buf.readUInt16LE(offset + 14)),
+      Temp: buf.readInt16LE(offset + 12) / 100,
+      Product: buf.readInt32LE(offset + 4) / 100,
+      Water: buf.readInt32LE(offset + 8) / 100
+    };
+    if (timestamp > 0) reading.Timestamp = new Date(timestamp).toISOString();
+    if (recordSize >= 32 && buf.readInt32LE(offset + 24) !== PACKED_NO_VOLUME) {
+      reading.Volume = buf.readInt32LE(offset + 24) / 100;
+      reading.Ullage = buf.readInt32LE(offset + 28) / 100;
+    }
+    if (recordSize >= 36 && buf.readInt32LE(offset + 32) !== PACKED_NO_VOLUME) {
+      reading.StdVolume = buf.readInt32LE(offset + 32) / 100;
+    }
+    offset += recordSize;
+    return reading;
+  };
+  const done = (result) => {
+    if (offset !== buf.length) throw new Error('trailing bytes after packed payload');
+    return result;
+  };
+
+  if (kind === 1) {
+    if (count !== 1) throw new Error('truncated packed payload');
+    return done(readReading());
+  }
+  if (kind !== 2) throw new Error(`unknown packed payload kind ${kind}`);
+
+  const batch = { Station: readString(), Version: PACKED_VERSION, Readings: [] };
+  for (let i = 0; i < count; i++) {
+    const topic = readString();
+    batch.Readings.push({ Topic: topic, ...readReading() });
+  }
+  return done(batch);
+}
+
+module.exports = { PACKED_MAGIC, PACKED_VERSION, decodePackedPayload };
@@ -0,0 +1,293 @@
+/**
+ * Payload Encoding
+ *
+ * The packed encoding replaces the ~160-byte JSON object of a reading with
+ * a 36-byte fixed-point record, and needs no float-to-text conversion.
+ * Every multi-byte field is little-endian.
+ *
+ *   Header (4 bytes)
+ *     u8  magic      0xA7
+ *     u8  version    3
+ *     u8  kind       1 = single reading, 2 = batch
+ *     u8  count      readings that follow
+ *   Batch only: u8 station length, station topic bytes
+ *   Per reading, batch only: u8 topic length, topic bytes
+ *   Reading (36 bytes)
+ *     u32 address
+ *     i32 product     0.01 mm
+ *     i32 water       0.01 mm
+ *     i16 temperature 0.01 C
+ *     u16 status
+ *     i64 timestamp   Unix time in ms, 0 if not recorded
+ *     i32 volume      0.01 L, INT32_MIN if the probe has no dip chart
+ *     i32 ullage      0.01 L
+ *     i32 std volume  0.01 L at 15 C, INT32_MIN if not corrected
+ *
+ * A single reading is published on its probe's topic like the JSON payload;
+ * a batch names each reading's topic. The version is bumped for any layout
+ * change, and decoders reject versions they do not know. Version 1 and 2
+ * records are the first 24 and 32 bytes of the above, and are still
+ * decoded so journaled payloads from before an upgrade replay. The server's
+ * decoder is packed_payload.js; "make test" round-trips both decoders
+ * against this encoder (tests/payload_test.c).
+ */
+
+#include "payload.h"
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+static void fnPutU16(uint8_t *pu8Out, uint16_t u16Value)
+{
+    pu8Out[0] = (uint8_t)u16Value;
+    pu8Out[1] = (uint8_t)(u16Value >> 8);
+}
+
+static void fnPutU32(uint8_t *pu8Out, uint32_t u32Value)
+{
+    for (int i = 0; i < 4; i++)
+        pu8Out[i] = (uint8_t)(u32Value >> (8 * i));
+}
+
+static void fnPutU64(uint8_t *pu8Out, uint64_t u64Value)
+{
+    for (int i = 0; i < 8; i++)
+        pu8Out[i] = (uint8_t)(u64Value >> (8 * i));
+}
+
+static uint16_t fnGetU16(const uint8_t *pu8In)
+{
+    return (uint16_t)(pu8In[0] | (pu8In[1] << 8));
+}
+
+static uint32_t fnGetU32(const uint8_t *pu8In)
+{
+    uint32_t u32Value = 0;
+    for (int i = 3; i >= 0; i--)
+        u32Value = (u32Value << 8) | pu8In[i];
+    return u32Value;
+}
+
+static uint64_t fnGetU64(const uint8_t *pu8In)
+{
+    uint64_t u64Value = 0;
+    for (int i = 7; i >= 0; i--)
+        u64Value = (u64Value << 8) | pu8In[i];
+    return u64Value;
+}
+
+// Scale to fixed point, saturating instead of wrapping
+static int32_t fnFixed(double dbValue, double dbScale, int32_t i32Min, int32_t i32Max)
+{
+    double dbScaled = round(dbValue * dbScale);
+    if (dbScaled < i32Min)
+        return i32Min;
+    if (dbScaled > i32Max)
+        return i32Max;
+    return (int32_t)dbScaled;
+}
+
+static void fnPackRecord(uint8_t *pu8Out, const AtgData *pstData)
+{
+    fnPutU32(pu8Out, (uint32_t)pstData->address);
+    fnPutU32(pu8Out + 4, (uint32_t)fnFixed(pstData->product, 100.0, INT32_MIN, INT32_MAX));
+    fnPutU32(pu8Out + 8, (uint32_t)fnFixed(pstData->water, 100.0, INT32_MIN, INT32_MAX));
+    fnPutU16(pu8Out + 12, (uint16_t)fnFixed(pstData->temperature, 100.0, INT16_MIN, INT16_MAX));
+    fnPutU16(pu8Out + 14, (uint16_t)pstData->status);
+    fnPutU64(pu8Out + 16, (uint64_t)pstData->timestamp);
+    if (pstData->volume >= 0)
+    {
+        fnPutU32(pu8Out + 24, (uint32_t)fnFixed(pstData->volume, 100.0, INT32_MIN + 1, INT32_MAX));
+        fnPutU32(pu8Out + 28, (uint32_t)fnFixed(pstData->ullage, 100.0, INT32_MIN + 1, INT32_MAX));
+    }
+    else
+    {
+        fnPutU32(pu8Out + 24, (uint32_t)PAYLOAD_NO_VOLUME);
+        fnPutU32(pu8Out + 28, (uint32_t)PAYLOAD_NO_VOLUME);
+    }
+    if (pstData->volume >= 0 && pstData->std_volume >= 0)
+        fnPutU32(pu8Out + 32, (uint32_t)fnFixed(pstData->std_volume, 100.0, INT32_MIN + 1, INT32_MAX));
+    else
+        fnPutU32(pu8Out + 32, (uint32_t)PAYLOAD_NO_VOLUME);
+}
+
+static void fnUnpackRecord(const uint8_t *pu8In, size_t szRecord, AtgData *pstData)
+{
+    fnInitAtgData(pstData);
+    pstData->address = (int)fnGetU32(pu8In);
+    pstData->product = (float)((int32_t)fnGetU32(pu8In + 4) / 100.0);
+    pstData->water = (int)lround((int32_t)fnGetU32(pu8In + 8) / 100.0);
+    pstData->temperature = (float)((int16_t)fnGetU16(pu8In + 12) / 100.0);
+    pstData->status = fnGetU16(pu8In + 14);
+    pstData->timestamp = (int64_t)fnGetU64(pu8In + 16);
+    if (szRecord >= PAYLOAD_READING_SIZE_V2 && (int32_t)fnGetU32(pu8In + 24) != PAYLOAD_NO_VOLUME)
+    {
+        pstData->volume = (int32_t)fnGetU32(pu8In + 24) / 100.0;
+        pstData->ullage = (int32_t)fnGetU32(pu8In + 28) / 100.0;
+    }
+    if (szRecord >= PAYLOAD_READING_SIZE && (int32_t)fnGetU32(pu8In + 32) != PAYLOAD_NO_VOLUME)
+    {
+        pstData->std_volume = (int32_t)fnGetU32(pu8In + 32) / 100.0;
+    }
+}
+
+static void fnPackHeader(uint8_t *pu8Out, uint8_t u8Kind, uint8_t u8Count)
+{
+    pu8Out[0] = PAYLOAD_MAGIC;
+    pu8Out[1] = PAYLOAD_VERSION;
+    pu8Out[2] = u8Kind;
+    pu8Out[3] = u8Count;
+}
+
+const char *fnPayloadEncodingName(PayloadEncoding eEncoding)
+{
+    return (eEncoding == PAYLOAD_PACKED) ? "packed" : "json";
+}
+
+/**
+ * Parse an "encoding" configuration value
+ * @return 0 on success, -1 if the value names no encoding
+ */
+int fnPayloadParseEncoding(const char *achValue, PayloadEncoding *peEncoding)
+{
+    if (strcasecmp(achValue, "json") == 0)
+        *peEncoding = PAYLOAD_JSON;
+    else if (strcasecmp(achValue, "packed") == 0)
+        *peEncoding = PAYLOAD_PACKED;
+    else
+        return -1;
+    return 0;
+}
+
+/**
+ * Encode one reading, published on its probe's topic
+ * @return Payload length, or -1 if the buffer is too small
+ */
+int fnPayloadPackReading(uint8_t *pu8Buffer, size_t szSize, const AtgData *pstData)
+{
+    if (szSize < PAYLOAD_HEADER_SIZE + PAYLOAD_READING_SIZE)
+    {
+        return -1;
+    }
+    fnPackHeader(pu8Buffer, PAYLOAD_KIND_READING, 1);
+    fnPackRecord(pu8Buffer + PAYLOAD_HEADER_SIZE, pstData);
+    return PAYLOAD_HEADER_SIZE + PAYLOAD_READING_SIZE;
+}
+
+/**
+ * Start an empty batch for the station topic
+ * @return Length so far, or -1 if the buffer is too small
+ */
+int fnPayloadPackBatchBegin(uint8_t *pu8Buffer, size_t szSize, const char *achStation)
+{
+    size_t szStation = strlen(achStation);
+    if (szStation > UINT8_MAX || szSize < PAYLOAD_HEADER_SIZE + 1 + szStation)
+    {
+        return -1;
+    }
+    fnPackHeader(pu8Buffer, PAYLOAD_KIND_BATCH, 0);
+    pu8Buffer[PAYLOAD_HEADER_SIZE] = (uint8_t)szStation;
+    memcpy(pu8Buffer + PAYLOAD_HEADER_SIZE + 1, achStation, szStation);
+    return (int)(PAYLOAD_HEADER_SIZE + 1 + szStation);
+}
+
+/**
+ * Append one reading to a batch started with fnPayloadPackBatchBegin
+ * @param szUsed Length returned by the previous call
+ * @return New length, or -1 if the reading does not fit (the batch is unchanged)
+ */
+int fnPayloadPackBatchAdd(uint8_t *pu8Buffer, size_t szSize, size_t szUsed, const char *achTopic,
+                          const AtgData *pstData)
+{
+    size_t szTopic = strlen(achTopic);
+    if (pu8Buffer[3] == UINT8_MAX || szTopic > UINT8_MAX ||
+        szUsed + 1 + szTopic + PAYLOAD_READING_SIZE > szSize)
+    {
+        return -1;
+    }
+
+    uint8_t *pu8Out = pu8Buffer + szUsed;
+    *pu8Out++ = (uint8_t)szTopic;
+    memcpy(pu8Out, achTopic, szTopic);
+    fnPackRecord(pu8Out + szTopic, pstData);
+    pu8Buffer[3]++;
+    return (int)(szUsed + 1 + szTopic + PAYLOAD_READING_SIZE);
+}
+
+// Copy a length-prefixed string; returns the bytes consumed, or 0 if truncated
+static size_t fnUnpackString(const uint8_t *pu8In, size_t szLeft, char *achOut, size_t szOut)
+{
+    if (szLeft < 1 || szLeft < 1u + pu8In[0])
+    {
+        return 0;
+    }
+    if (achOut != NULL && szOut > 0)
+    {
+        size_t szCopy = (pu8In[0] < szOut) ? pu8In[0] : szOut - 1;
+        memcpy(achOut, pu8In + 1, szCopy);
+        achOut[szCopy] = '\0';
+    }
+    return 1u + pu8In[0];
+}
+
+/**
+ * Decode a packed payload
+ * @param achStation Receives the batch's station topic ("" for a single reading); may be NULL
+ * @param fnHandler Called for every reading in order
+ * @return Number of readings, or a PAYLOAD_E_* error (readings before the error were delivered)
+ */
+int fnPayloadUnpack(const uint8_t *pu8Buffer, size_t szLength, char *achStation, size_t szStation,
+                    PayloadReadingHandler fnHandler, void *pvContext)
+{
+    char achTopic[256];
+    AtgData stData;
+
+    if (achStation != NULL && szStation > 0)
+        achStation[0] = '\0';
+    if (szLength < PAYLOAD_HEADER_SIZE)
+        return PAYLOAD_E_SHORT;
+    if (pu8Buffer[0] != PAYLOAD_MAGIC)
+        return PAYLOAD_E_MAGIC;
+    if (pu8Buffer[1] < 1 || pu8Buffer[1] > PAYLOAD_VERSION)
+        return PAYLOAD_E_VERSION;
+
+    size_t szRecord = (pu8Buffer[1] == 1)   ? PAYLOAD_READING_SIZE_V1
+                      : (pu8Buffer[1] == 2) ? PAYLOAD_READING_SIZE_V2
+                                            : PAYLOAD_READING_SIZE;
+    uint8_t u8Kind = pu8Buffer[2];
+    int wCount = pu8Buffer[3];
+    size_t szOffset = PAYLOAD_HEADER_SIZE;
+
+    if (u8Kind == PAYLOAD_KIND_READING)
+    {
+        if (wCount != 1 || szLength < szOffset + szRecord)
+            return PAYLOAD_E_SHORT;
+        fnUnpackRecord(pu8Buffer + szOffset, szRecord, &stData);
+        fnHandler("", &stData, pvContext);
+        szOffset += szRecord;
+    }
+    else if (u8Kind == PAYLOAD_KIND_BATCH)
+    {
+        size_t szUsed = fnUnpackString(pu8Buffer + szOffset, szLength - szOffset, achStation, szStation);
+        if (szUsed == 0)
+            return PAYLOAD_E_SHORT;
+        szOffset += szUsed;
+
+        for (int i = 0; i < wCount; i++)
+        {
+            szUsed = fnUnpackString(pu8Buffer + szOffset, szLength - szOffset, achTopic, sizeof(achTopic));
+            if (szUsed == 0 || szLength - szOffset - szUsed < szRecord)
+                return PAYLOAD_E_SHORT;
+            szOffset += szUsed;
+            fnUnpackRecord(pu8Buffer + szOffset, szRecord, &stData);
+            fnHandler(achTopic, &stData, pvContext);
+            szOffset += szRecord;
+        }
+    }
+    else
+    {
+        return PAYLOAD_E_KIND;
+    }
+
+    return (szOffset == szLength) ? wCount : PAYLOAD_E_TRAILING;
+}
@@ -0,0 +1,51 @@
+/**
+ * Payload Encoding
+ * Packed binary alternative to the JSON reading payload, and its decoder
+ */
+
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "atg.h"
+
+typedef enum {
+    PAYLOAD_JSON,  // Text, one object per reading (default)
+    PAYLOAD_PACKED // Fixed little-endian records, see payload.c
+} PayloadEncoding;
+
+// Packed layout, version 3; records of versions 1 (no volume) and 2 (no
+// standard volume) are still decoded
+#define PAYLOAD_MAGIC 0xA7 // Never the first byte of a JSON payload
+#define PAYLOAD_VERSION 3
+#define PAYLOAD_KIND_READING 1
+#define PAYLOAD_KIND_BATCH 2
+#define PAYLOAD_HEADER_SIZE 4
+#define PAYLOAD_READING_SIZE 36
+#define PAYLOAD_READING_SIZE_V1 24
+#define PAYLOAD_READING_SIZE_V2 32
+#define PAYLOAD_NO_VOLUME INT32_MIN // Volume field of a probe without a dip chart or density
+
+// Decoder errors
+#define PAYLOAD_E_SHORT -1    // Truncated header or record
+#define PAYLOAD_E_MAGIC -2    // Not a packed payload
+#define PAYLOAD_E_VERSION -3  // Layout this decoder does not know
+#define PAYLOAD_E_KIND -4     // Unknown payload kind
+#define PAYLOAD_E_TRAILING -5 // Bytes left after the last record
+
+// Called once per decoded reading; achTopic is "" for a single-reading payload
+typedef void (*PayloadReadingHandler)(const char *achTopic, const AtgData *pstData, void *pvContext);
+
+const char *fnPayloadEncodingName(PayloadEncoding eEncoding);
+int fnPayloadParseEncoding(const char *achValue, PayloadEncoding *peEncoding);
+
+int fnPayloadPackReading(uint8_t *pu8Buffer, size_t szSize, const AtgData *pstData);
+int fnPayloadPackBatchBegin(uint8_t *pu8Buffer, size_t szSize, const char *achStation);
+int fnPayloadPackBatchAdd(uint8_t *pu8Buffer, size_t szSize, size_t szUsed, const char *achTopic,
+                          const AtgData *pstData);
+
+int fnPayloadUnpack(const uint8_t *pu8Buffer, size_t szLength, char *achStation, size_t szStation,
+                    PayloadReadingHandler fnHandler, void *pvContext);
+
+#endif
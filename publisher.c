@@ -0,0 +1,884 @@
+/**
+ * Publish Stage
+ *
+ * Bus workers never call into MQTT themselves. Each worker owns one
+ * single-producer/single-consumer ring (its "lane") and copies ready-to-send
+ * records into it; a dedicated publish thread drains every lane in turn and
+ * talks to the broker. A slow or unreachable broker therefore only fills the
+ * rings and never delays a poll or a serial read.
+ *
+ * When a lane is full the new record is rejected and counted. For readings
+ * the worker then keeps its previous published value, so the change is
+ * detected again and re-queued with the next response.
+ *
+ * Readings the broker does not take - refused while offline, failed, or in
+ * flight when the connection dropped - are appended to the store-and-forward
+ * journal. Between live messages the thread replays the journal in order at
+ * replay_rate messages per second while the broker is connected, and so are
+ * rollup summaries and tank events. Status messages are retained and
+ * superseded by the next one, so they are not journaled.
+ *
+ * With batching enabled, readings are collected into one payload on the
+ * station topic instead of one message per probe:
+ *
+ *   {"Station":"ATGSTATION","Version":1,"Readings":[{"Topic":"ATG83731",...},...]}
+ *
+ * Each element is the single-reading payload, Timestamp included, with the
+ * probe's topic added. In sweep mode a batch goes out once every bus that
+ * contributed to it has gone idle (each worker queues a PUBLISH_SWEEP_END
+ * marker behind its readings); in window mode once its oldest reading is
+ * window_ms old. Either way a full batch, or one older than window_ms, is
+ * published at once. Status messages, summaries and events are never
+ * batched.
+ *
+ * With encoding = packed in the [mqtt] section, readings and batches use the
+ * binary layout of payload.c instead of JSON; status messages, summaries and
+ * events stay JSON.
+ *
+ * Alarms (alarm.c) take a lane of their own: a small second ring per bus
+ * worker that the thread empties before every pass over the telemetry
+ * lanes, before each journal replay and before a batch is flushed. They
+ * are never batched, may use the in-flight slots the MQTT client keeps for
+ * priority messages, and are journaled if the broker does not take them.
+ *
+ * A routine message that finds the rest of the MQTT in-flight window full
+ * is refused at once. The thread holds it (or the batch) and the lanes
+ * queue up behind it, and sleeps until the client reports a freed slot or
+ * a worker queues something, so an alarm is never stuck behind a PUBACK.
+ *
+ * Every interval_s seconds of the [stats] section the thread also collects
+ * the runtime statistics (stats.c) and publishes them retained on the stats
+ * topic. Like status messages they are superseded by the next snapshot and
+ * not journaled.
+ */
+
+#include "publisher.h"
+#include <stdio.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+#include "spsc_ring.h"
+#include "journal.h"
+#include "payload.h"
+#include "stats.h"
+#include "config.h"
+#include "main_linux.h"
+#include "mqtt.h"
+
+#define BATCH_VERSION 1 // "Version" of the batch payload layout
+
+static PublisherConfig stConfig;
+static PayloadEncoding eEncoding; // Readings and batches; chosen in the [mqtt] section
+static SpscRing *pstLanes = NULL;
+static SpscRing *pstAlarmLanes = NULL; // One per bus worker, drained first
+static int wLaneCount = 0;
+
+// Alarm lane record; kept small so a burst of alarms is cheap to copy
+typedef struct {
+    char achTopic[PROBE_TOPIC_LEN + 8];
+    int address;
+    AlarmChange stChange;
+} AlarmRecord;
+
+static int wakeFd = -1; // eventfd: records queued or stop requested
+static atomic_bool bStopRequested;
+static pthread_t publishThread;
+static bool bThreadStarted = false;
+
+static Journal stJournal;
+static double dbReplayCredit = 0; // Messages the replay may send now
+static double dbLastReplayAt = 0;
+static double dbLastSyncAt = 0;
+
+// Publish thread only: the batch being collected and the payload scratch
+// buffer shared by batches and replay
+static PublishRecord astBatch[BATCH_READINGS_LIMIT];
+static uint32_t u32BatchCount = 0;
+static double dbBatchOpenedAt = 0;
+static uint32_t u32BatchLanes = 0; // Lanes in the batch whose sweep is still running (BUS_MAX <= 32)
+static char achPayloadBuffer[PUBLISH_PAYLOAD_MAX];
+
+// Publish thread only: what met a full MQTT window, retried before anything new
+static PublishRecord stHeld;
+static int wHeldLane = -1;      // Lane stHeld came from, -1 when nothing is held
+static bool bBatchHeld = false; // The batch could not be flushed
+
+// Publish thread counters
+static uint32_t u32Published = 0;
+static uint32_t u32Failed = 0;
+static uint32_t u32Journaled = 0; // Updated from the publish and Paho threads
+static uint32_t u32Lost = 0;      // Undelivered and not journaled
+static uint32_t u32Batches = 0;
+static uint32_t u32Batched = 0; // Readings sent inside batches
+static uint32_t u32Alarms = 0;
+static double dbAlarmTotalMs = 0; // Frame arrival to hand-over to the MQTT client
+static double dbAlarmMaxMs = 0;
+
+// Runtime statistics snapshots; the previous one gives the interval's latencies
+static StatsSnapshot stStatsNow;
+static StatsSnapshot stStatsPrevious;
+static double dbStartedAt = 0;
+static double dbNextStatsAt = 0;
+
+static void fnPublisherWake()
+{
+    uint64_t u64One = 1;
+    if (write(wakeFd, &u64One, sizeof(u64One)) != sizeof(u64One) && errno != EAGAIN)
+    {
+        printf("[Publisher] Error waking publish thread: %s\n", strerror(errno));
+    }
+}
+
+static int fnPublisherEnqueue(int wLane, const PublishRecord *pstRecord)
+{
+    if (!fnRingPush(&pstLanes[wLane], pstRecord))
+    {
+        return -1;
+    }
+    fnPublisherWake();
+    return 0;
+}
+
+// Keep an undelivered reading for replay
+static void fnPublisherJournal(const char *topic, const void *payload, size_t length)
+{
+    if (fnJournalAppend(&stJournal, topic, payload, length) == 0)
+    {
+        __atomic_add_fetch(&u32Journaled, 1, __ATOMIC_RELAXED);
+        fnStatsCount(STAT_JOURNALED);
+    }
+    else
+        __atomic_add_fetch(&u32Lost, 1, __ATOMIC_RELAXED);
+}
+
+// MQTT client callback for messages the broker never acknowledged
+static void fnOnUndelivered(const char *topic, const void *payload, size_t length, int retained)
+{
+    if (!retained)
+    {
+        fnPublisherJournal(topic, payload, length);
+    }
+}
+
+// A routine message the window had no room for is held and retried; when stopping it is journaled
+static bool fnPublisherWindowFull(int rc)
+{
+    return rc == MQTT_WINDOW_FULL && !atomic_load(&bStopRequested);
+}
+
+static bool fnPublisherBlocked()
+{
+    return wHeldLane >= 0 || bBatchHeld;
+}
+
+static void fnPublisherCount(int rc)
+{
+    if (rc == 0)
+        u32Published++;
+    else
+        u32Failed++;
+}
+
+// Publish every queued alarm, ahead of anything else
+static void fnPublisherDrainAlarms()
+{
+    AlarmRecord stRecord;
+    char payload[ALARM_PAYLOAD_MAX];
+
+    for (int i = 0; i < wLaneCount; i++)
+    {
+        while (fnRingPop(&pstAlarmLanes[i], &stRecord))
+        {
+            double dbLatencyMs = getCurrentTimeMs() - stRecord.stChange.dbFrameAt;
+            int length = fnAlarmFormat(payload, sizeof(payload), stRecord.address, &stRecord.stChange, dbLatencyMs);
+            if (length < 0)
+            {
+                continue;
+            }
+
+            int rc = fnMqttPublishPriority(stRecord.achTopic, payload, (size_t)length, stRecord.stChange.dbFrameAt);
+            if (rc != 0)
+            {
+                fnPublisherJournal(stRecord.achTopic, payload, (size_t)length);
+            }
+            fnPublisherCount(rc);
+            u32Alarms++;
+            dbAlarmTotalMs += dbLatencyMs;
+            if (dbLatencyMs > dbAlarmMaxMs)
+                dbAlarmMaxMs = dbLatencyMs;
+        }
+    }
+}
+
+// Build the JSON batch in the payload buffer; *pu32Included receives the readings that fit
+static size_t fnPublisherJsonBatch(uint32_t *pu32Included)
+{
+    char achReading[256];
+    size_t szSize = sizeof(achPayloadBuffer);
+    size_t szUsed = (size_t)snprintf(achPayloadBuffer, szSize, "{\"Station\":\"%s\",\"Version\":%d,\"Readings\":[",
+                                     stConfig.achTopic, BATCH_VERSION);
+    uint32_t i;
+    for (i = 0; i < u32BatchCount; i++)
+    {
+        // Element = single-reading payload with the probe's topic in front
+        fnMqttFormatAtgData(achReading, sizeof(achReading), &astBatch[i].stData);
+        int wLength = snprintf(achPayloadBuffer + szUsed, szSize - szUsed, "%s{\"Topic\":\"%s\",%s", (i > 0) ? "," : "",
+                               astBatch[i].achTopic, achReading + 1);
+        if (wLength < 0 || szUsed + (size_t)wLength + 3 > szSize)
+        {
+            break;
+        }
+        szUsed += (size_t)wLength;
+    }
+    szUsed += (size_t)snprintf(achPayloadBuffer + szUsed, szSize - szUsed, "]}");
+    *pu32Included = i;
+    return szUsed;
+}
+
+// Build the packed batch in the payload buffer; *pu32Included receives the readings that fit
+static size_t fnPublisherPackedBatch(uint32_t *pu32Included)
+{
+    uint8_t *pu8Buffer = (uint8_t *)achPayloadBuffer;
+    int wUsed = fnPayloadPackBatchBegin(pu8Buffer, sizeof(achPayloadBuffer), stConfig.achTopic);
+    uint32_t i;
+    for (i = 0; i < u32BatchCount && wUsed >= 0; i++)
+    {
+        int wLength = fnPayloadPackBatchAdd(pu8Buffer, sizeof(achPayloadBuffer), (size_t)wUsed, astBatch[i].achTopic,
+                                            &astBatch[i].stData);
+        if (wLength < 0)
+        {
+            break;
+        }
+        wUsed = wLength;
+    }
+    *pu32Included = (wUsed >= 0) ? i : 0;
+    return (wUsed >= 0) ? (size_t)wUsed : 0;
+}
+
+// Publish the collected readings as one payload on the station topic
+// @return false if the window was full; the batch is kept for a retry
+static bool fnPublisherFlushBatch()
+{
+    if (u32BatchCount == 0)
+    {
+        return true;
+    }
+    fnPublisherDrainAlarms();
+
+    uint32_t i;
+    size_t szLength = (eEncoding == PAYLOAD_PACKED) ? fnPublisherPackedBatch(&i) : fnPublisherJsonBatch(&i);
+    int rc = fnMqttPublishMessage(stConfig.achTopic, achPayloadBuffer, szLength, 0);
+    bBatchHeld = fnPublisherWindowFull(rc);
+    if (bBatchHeld)
+    {
+        return false;
+    }
+
+    if (i < u32BatchCount)
+    {
+        printf("[Publisher] Batch payload full, %u reading(s) dropped\n", u32BatchCount - i);
+        u32Lost += u32BatchCount - i;
+    }
+    if (rc != 0)
+    {
+        fnPublisherJournal(stConfig.achTopic, achPayloadBuffer, szLength);
+    }
+    fnPublisherCount(rc);
+    u32Batches++;
+    u32Batched += i;
+    u32BatchCount = 0;
+    u32BatchLanes = 0;
+    return true;
+}
+
+// @return false if the batch is full and still waiting for the window
+static bool fnPublisherBatchReading(int wLane, const PublishRecord *pstRecord)
+{
+    if (u32BatchCount >= stConfig.u32MaxReadings && !fnPublisherFlushBatch())
+    {
+        return false;
+    }
+    if (u32BatchCount == 0)
+    {
+        dbBatchOpenedAt = getCurrentTimeMs();
+    }
+    astBatch[u32BatchCount++] = *pstRecord;
+    u32BatchLanes |= 1u << wLane;
+
+    if (u32BatchCount >= stConfig.u32MaxReadings)
+    {
+        fnPublisherFlushBatch();
+    }
+    return true;
+}
+
+// @return false if the record met a full window and must be retried
+static bool fnPublisherSend(int wLane, const PublishRecord *pstRecord)
+{
+    int rc;
+    if (pstRecord->eKind == PUBLISH_SWEEP_END)
+    {
+        // The sweep batch is complete once every contributing bus is idle
+        u32BatchLanes &= ~(1u << wLane);
+        if (u32BatchLanes == 0)
+        {
+            fnPublisherFlushBatch();
+        }
+        return true;
+    }
+    if (pstRecord->eKind == PUBLISH_READING && stConfig.eMode != BATCH_OFF)
+    {
+        return fnPublisherBatchReading(wLane, pstRecord);
+    }
+
+    if (pstRecord->eKind == PUBLISH_READING)
+    {
+        char payload[256];
+        int length;
+        if (eEncoding == PAYLOAD_PACKED)
+            length = fnPayloadPackReading((uint8_t *)payload, sizeof(payload), &pstRecord->stData);
+        else
+            length = fnMqttFormatAtgData(payload, sizeof(payload), &pstRecord->stData);
+
+        rc = fnMqttPublishMessage(pstRecord->achTopic, payload, (size_t)length, 0);
+        if (fnPublisherWindowFull(rc))
+            return false;
+        if (rc != 0)
+        {
+            fnPublisherJournal(pstRecord->achTopic, payload, (size_t)length);
+        }
+    }
+    else if (pstRecord->eKind == PUBLISH_ROLLUP)
+    {
+        char payload[ROLLUP_PAYLOAD_MAX];
+        int length = fnRollupFormat(payload, sizeof(payload), pstRecord->address, &pstRecord->stRollup);
+        rc = (length > 0) ? fnMqttPublishMessage(pstRecord->achTopic, payload, (size_t)length, 0) : -1;
+        if (fnPublisherWindowFull(rc))
+            return false;
+        if (rc != 0 && length > 0)
+        {
+            fnPublisherJournal(pstRecord->achTopic, payload, (size_t)length);
+        }
+    }
+    else if (pstRecord->eKind == PUBLISH_EVENT)
+    {
+        char payload[EVENT_PAYLOAD_MAX];
+        int length = fnEventFormat(payload, sizeof(payload), pstRecord->address, &pstRecord->stEvent);
+        rc = (length > 0) ? fnMqttPublishMessage(pstRecord->achTopic, payload, (size_t)length, 0) : -1;
+        if (fnPublisherWindowFull(rc))
+            return false;
+        if (rc != 0 && length > 0)
+        {
+            fnPublisherJournal(pstRecord->achTopic, payload, (size_t)length);
+        }
+    }
+    else
+    {
+        rc = fnMqttPublishProbeStatus(pstRecord->achTopic, pstRecord->address,
+                                      fnProbeCommStateName(pstRecord->eCommState), pstRecord->u32Failures,
+                                      pstRecord->u32PollIntervalMs, pstRecord->u32Suppressed);
+        if (fnPublisherWindowFull(rc))
+            return false;
+    }
+    fnPublisherCount(rc);
+    return true;
+}
+
+// Drain one record per lane per pass so a busy bus cannot starve the others.
+// Whatever met a full window goes first; until it is out the lanes wait
+static bool fnPublisherDrain()
+{
+    PublishRecord stRecord;
+    bool bAny = false;
+    bool bMore = true;
+
+    while (bMore)
+    {
+        fnPublisherDrainAlarms();
+        if (bBatchHeld && !fnPublisherFlushBatch())
+        {
+            break;
+        }
+        if (wHeldLane >= 0)
+        {
+            if (!fnPublisherSend(wHeldLane, &stHeld))
+            {
+                break;
+            }
+            wHeldLane = -1;
+            bAny = true;
+        }
+
+        bMore = false;
+        for (int i = 0; i < wLaneCount && wHeldLane < 0; i++)
+        {
+            if (fnRingPop(&pstLanes[i], &stRecord))
+            {
+                if (!fnPublisherSend(i, &stRecord))
+                {
+                    stHeld = stRecord;
+                    wHeldLane = i;
+                }
+                bMore = bAny = true;
+            }
+        }
+        bMore = bMore && !fnPublisherBlocked();
+    }
+    return bAny;
+}
+
+// Send journaled readings, oldest first, without exceeding the replay rate
+static void fnPublisherReplay(double dbNow)
+{
+    char achTopic[PROBE_TOPIC_LEN + 8];
+    size_t szLength;
+    double dbRate = stJournal.stConfig.dbReplayRate;
+
+    // Credit accrues at the replay rate; at most one second's worth is sent in a burst
+    dbReplayCredit += (dbNow - dbLastReplayAt) * dbRate / 1000.0;
+    dbLastReplayAt = dbNow;
+    if (dbReplayCredit > dbRate)
+        dbReplayCredit = dbRate;
+
+    while (dbReplayCredit >= 1 && fnMqttIsConnected() &&
+           fnJournalPeek(&stJournal, achTopic, sizeof(achTopic), achPayloadBuffer, sizeof(achPayloadBuffer), &szLength))
+    {
+        fnPublisherDrainAlarms();
+
+        // A refused replay stays at the head of the journal for the next tick
+        if (fnMqttPublishMessage(achTopic, achPayloadBuffer, szLength, 0) != 0)
+            break;
+        fnJournalConsume(&stJournal);
+        dbReplayCredit -= 1;
+    }
+}
+
+// Publish a snapshot of the runtime statistics on the stats topic
+static void fnPublisherStats(double dbNow)
+{
+    const StatsConfig *pstStats = fnStatsConfig();
+    char achPayload[STATS_PAYLOAD_MAX];
+
+    fnStatsCollect(&stStatsNow);
+    int wLength = fnStatsFormat(achPayload, sizeof(achPayload), &stStatsNow, &stStatsPrevious,
+                                (dbNow - dbStartedAt) / 1000.0);
+    if (wLength > 0)
+    {
+        fnPublisherCount(fnMqttPublishMessage(pstStats->achTopic, achPayload, (size_t)wLength, 1));
+    }
+    stStatsPrevious = stStatsNow;
+    dbNextStatsAt = dbNow + pstStats->u32IntervalS * 1000.0;
+}
+
+// How long the thread may sleep: with a journal open it also wakes for the
+// next replay slot and the periodic sync, with a batch open for its deadline,
+// and with statistics enabled for the next snapshot. Held behind a full
+// window, only the client's wakeup can move replay and the batch on
+static int fnPublisherWaitMs()
+{
+    int wTimeoutMs = -1;
+    if (stJournal.bOpen)
+    {
+        wTimeoutMs = JOURNAL_SYNC_MS;
+        if (fnJournalPending(&stJournal) > 0 && !fnPublisherBlocked())
+        {
+            int wReplayMs = (int)(1000.0 / stJournal.stConfig.dbReplayRate);
+            wTimeoutMs = (wReplayMs < 10) ? 10 : (wReplayMs < wTimeoutMs ? wReplayMs : wTimeoutMs);
+        }
+    }
+    if (u32BatchCount > 0 && !bBatchHeld)
+    {
+        double dbLeftMs = dbBatchOpenedAt + stConfig.u32WindowMs - getCurrentTimeMs();
+        int wBatchMs = (dbLeftMs > 0) ? (int)dbLeftMs + 1 : 0;
+        if (wTimeoutMs < 0 || wBatchMs < wTimeoutMs)
+            wTimeoutMs = wBatchMs;
+    }
+    if (fnStatsConfig()->bEnabled)
+    {
+        double dbLeftMs = dbNextStatsAt - getCurrentTimeMs();
+        int wStatsMs = (dbLeftMs > 0) ? (int)dbLeftMs + 1 : 0;
+        if (wTimeoutMs < 0 || wStatsMs < wTimeoutMs)
+            wTimeoutMs = wStatsMs;
+    }
+    return wTimeoutMs;
+}
+
+static void *fnPublisherThread(void *pvArg)
+{
+    (void)pvArg;
+    uint64_t u64Wakeups;
+
+    dbLastReplayAt = dbLastSyncAt = dbStartedAt = getCurrentTimeMs();
+    dbNextStatsAt = dbStartedAt + fnStatsConfig()->u32IntervalS * 1000.0;
+    while (true)
+    {
+        // Sleep until a worker queues something, a stop is requested or a timed task is due
+        struct pollfd stPoll = {wakeFd, POLLIN, 0};
+        int rc = poll(&stPoll, 1, fnPublisherWaitMs());
+        if (rc < 0 && errno != EINTR)
+        {
+            printf("[Publisher] Error waiting for records: %s\n", strerror(errno));
+            break;
+        }
+        if (rc > 0 && read(wakeFd, &u64Wakeups, sizeof(u64Wakeups)) != sizeof(u64Wakeups))
+        {
+            printf("[Publisher] Error reading wakeup: %s\n", strerror(errno));
+            break;
+        }
+
+        // Live readings first, then whatever the replay budget allows
+        fnPublisherDrain();
+        if (u32BatchCount > 0 && !bBatchHeld && getCurrentTimeMs() - dbBatchOpenedAt >= stConfig.u32WindowMs)
+        {
+            fnPublisherFlushBatch();
+        }
+        if (stJournal.bOpen)
+        {
+            double dbNow = getCurrentTimeMs();
+            if (!fnPublisherBlocked())
+                fnPublisherReplay(dbNow);
+            fnStatsSetGauge(STAT_JOURNAL_DEPTH, fnJournalPending(&stJournal));
+            if (dbNow - dbLastSyncAt >= JOURNAL_SYNC_MS)
+            {
+                fnJournalSync(&stJournal);
+                dbLastSyncAt = dbNow;
+            }
+        }
+        if (fnStatsConfig()->bEnabled && getCurrentTimeMs() >= dbNextStatsAt)
+        {
+            fnPublisherStats(getCurrentTimeMs());
+        }
+
+        // Workers are stopped before the publisher, so nothing arrives after the final drain
+        if (atomic_load(&bStopRequested))
+        {
+            fnPublisherDrain();
+            fnPublisherFlushBatch();
+            break;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Fill in the compiled-in batching defaults (batching off)
+ */
+void fnPublisherConfigDefaults(PublisherConfig *pstConfig)
+{
+    pstConfig->eMode = BATCH_OFF;
+    strcpy(pstConfig->achTopic, BATCH_TOPIC);
+    pstConfig->u32WindowMs = BATCH_WINDOW_MS;
+    pstConfig->u32MaxReadings = BATCH_MAX_READINGS;
+}
+
+static int fnPublisherConfigHandler(void *pvContext, const char *achSection, const char *achName,
+                                    const char *achKey, const char *achValue, int wLine)
+{
+    PublisherConfig *pstConfig = (PublisherConfig *)pvContext;
+    (void)achName;
+
+    if (strcmp(achSection, "batch") != 0 || achKey[0] == '\0')
+    {
+        return 0;
+    }
+
+    if (strcmp(achKey, "mode") == 0)
+    {
+        if (strcasecmp(achValue, "off") == 0)
+            pstConfig->eMode = BATCH_OFF;
+        else if (strcasecmp(achValue, "sweep") == 0)
+            pstConfig->eMode = BATCH_SWEEP;
+        else if (strcasecmp(achValue, "window") == 0)
+            pstConfig->eMode = BATCH_WINDOW;
+        else
+        {
+            printf("Config line %d: batch mode must be off, sweep or window\n", wLine);
+            return -1;
+        }
+    }
+    else if (strcmp(achKey, "topic") == 0)
+    {
+        if (achValue[0] == '\0' || strlen(achValue) >= sizeof(pstConfig->achTopic))
+        {
+            printf("Config line %d: invalid batch topic\n", wLine);
+            return -1;
+        }
+        strcpy(pstConfig->achTopic, achValue);
+    }
+    else if (strcmp(achKey, "window_ms") == 0)
+    {
+        pstConfig->u32WindowMs = (uint32_t)strtoul(achValue, NULL, 10);
+    }
+    else if (strcmp(achKey, "max_readings") == 0)
+    {
+        int wValue = atoi(achValue);
+        if (wValue < 1 || wValue > BATCH_READINGS_LIMIT)
+        {
+            printf("Config line %d: max_readings must be between 1 and %d\n", wLine, BATCH_READINGS_LIMIT);
+            return -1;
+        }
+        pstConfig->u32MaxReadings = (uint32_t)wValue;
+    }
+    else
+    {
+        printf("Config line %d: unknown batch key '%s' ignored\n", wLine, achKey);
+    }
+    return 0;
+}
+
+/**
+ * Read the [batch] section of the configuration file
+ * @return 0 on success or if the file does not exist, non-zero on a bad value
+ */
+int fnPublisherLoadConfig(PublisherConfig *pstConfig, const char *achPath)
+{
+    fnPublisherConfigDefaults(pstConfig);
+    int rc = fnConfigParse(achPath, fnPublisherConfigHandler, pstConfig);
+    if (pstConfig->u32WindowMs < 10)
+        pstConfig->u32WindowMs = 10;
+    return (rc == -1) ? 0 : rc;
+}
+
+/**
+ * Create one lane per bus worker and open the store-and-forward journal
+ * @param wLanes Number of producers (bus workers)
+ * @param u32Depth Records each lane can hold, rounded up to a power of two
+ * @param pstConfig Batching settings
+ * @param pstJournalConfig Journal settings; a journal that cannot be opened is skipped
+ * @return 0 on success, -1 on failure
+ */
+int fnPublisherInit(int wLanes, uint32_t u32Depth, const PublisherConfig *pstConfig,
+                    const JournalConfig *pstJournalConfig)
+{
+    atomic_init(&bStopRequested, false);
+    stConfig = *pstConfig;
+    eEncoding = fnMqttPayloadEncoding();
+    if (stConfig.eMode != BATCH_OFF)
+    {
+        printf("[Publisher] Batching readings per %s on %s (up to %u readings, %u ms, %s)\n",
+               (stConfig.eMode == BATCH_SWEEP) ? "sweep" : "window", stConfig.achTopic, stConfig.u32MaxReadings,
+               stConfig.u32WindowMs, fnPayloadEncodingName(eEncoding));
+    }
+
+    // Each ring is cache-line aligned so neighbouring lanes never share a line
+    void *pvLanes = NULL;
+    if (posix_memalign(&pvLanes, SPSC_CACHE_LINE, sizeof(SpscRing) * wLanes) != 0)
+    {
+        return -1;
+    }
+    pstLanes = (SpscRing *)pvLanes;
+    memset(pstLanes, 0, sizeof(SpscRing) * wLanes);
+    if (posix_memalign(&pvLanes, SPSC_CACHE_LINE, sizeof(SpscRing) * wLanes) != 0)
+    {
+        return -1;
+    }
+    pstAlarmLanes = (SpscRing *)pvLanes;
+    memset(pstAlarmLanes, 0, sizeof(SpscRing) * wLanes);
+
+    for (wLaneCount = 0; wLaneCount < wLanes; wLaneCount++)
+    {
+        if (fnRingInit(&pstLanes[wLaneCount], sizeof(PublishRecord), u32Depth) != 0 ||
+            fnRingInit(&pstAlarmLanes[wLaneCount], sizeof(AlarmRecord), ALARM_LANE_DEPTH) != 0)
+        {
+            return -1;
+        }
+    }
+
+    wakeFd = eventfd(0, EFD_CLOEXEC);
+    if (wakeFd < 0)
+    {
+        printf("[Publisher] Error creating eventfd: %s\n", strerror(errno));
+        return -1;
+    }
+
+    // A journal that failed to open stays closed and refuses appends
+    if (fnJournalOpen(&stJournal, pstJournalConfig) != 0)
+    {
+        printf("[Publisher] Warning: journal unavailable, readings are lost while the broker is unreachable\n");
+    }
+    fnMqttSetUndeliveredHandler(fnOnUndelivered);
+    fnMqttSetWindowHandler(fnPublisherWake);
+    return 0;
+}
+
+/**
+ * Start the publish thread
+ * @return 0 on success
+ */
+int fnPublisherStart()
+{
+    int rc = pthread_create(&publishThread, NULL, fnPublisherThread, NULL);
+    if (rc != 0)
+    {
+        printf("[Publisher] Error starting publish thread: %s\n", strerror(rc));
+        return -1;
+    }
+    bThreadStarted = true;
+    return 0;
+}
+
+/**
+ * Publish whatever is still queued, then stop the thread (after the bus workers)
+ */
+void fnPublisherStop()
+{
+    if (!bThreadStarted)
+    {
+        return;
+    }
+    atomic_store(&bStopRequested, true);
+    fnPublisherWake();
+    pthread_join(publishThread, NULL);
+    bThreadStarted = false;
+}
+
+/**
+ * Print the lane counters, close the journal and release the rings
+ * (after fnMqttCleanup, which journals whatever was still in flight)
+ */
+void fnPublisherFree()
+{
+    for (int i = 0; i < wLaneCount; i++)
+    {
+        printf("[Publisher] Lane %d: %u queued, %u dropped (queue full); %u alarm(s), %u dropped\n", i,
+               atomic_load(&pstLanes[i].u32Pushed), atomic_load(&pstLanes[i].u32Dropped),
+               atomic_load(&pstAlarmLanes[i].u32Pushed), atomic_load(&pstAlarmLanes[i].u32Dropped));
+        fnRingFree(&pstLanes[i]);
+        fnRingFree(&pstAlarmLanes[i]);
+    }
+    if (wLaneCount > 0)
+    {
+        printf("[Publisher] %u published, %u failed, %u journaled, %u lost\n", u32Published, u32Failed,
+               u32Journaled, u32Lost);
+    }
+    if (u32Batches > 0)
+    {
+        printf("[Publisher] %u batch(es) carrying %u reading(s)\n", u32Batches, u32Batched);
+    }
+    if (u32Alarms > 0)
+    {
+        printf("[Publisher] %u alarm(s), frame to MQTT client: mean %.2f ms, max %.2f ms\n", u32Alarms,
+               dbAlarmTotalMs / u32Alarms, dbAlarmMaxMs);
+    }
+    fnMqttSetUndeliveredHandler(NULL);
+    fnMqttSetWindowHandler(NULL);
+    fnJournalClose(&stJournal);
+
+    free(pstLanes);
+    free(pstAlarmLanes);
+    pstLanes = NULL;
+    pstAlarmLanes = NULL;
+    wLaneCount = 0;
+    if (wakeFd >= 0)
+    {
+        close(wakeFd);
+        wakeFd = -1;
+    }
+}
+
+/**
+ * Queue a reading for the probe's topic
+ * @return 0 if queued, -1 if the lane is full
+ */
+int fnPublisherPublishReading(int wLane, const AtgProbe *pstProbe, const AtgData *pstData)
+{
+    PublishRecord stRecord;
+    memset(&stRecord, 0, sizeof(stRecord));
+    stRecord.eKind = PUBLISH_READING;
+    strcpy(stRecord.achTopic, pstProbe->achTopic);
+    stRecord.stData = *pstData;
+    return fnPublisherEnqueue(wLane, &stRecord);
+}
+
+/**
+ * Queue a probe's communication state, effective poll interval and count of
+ * readings held back by the filter for <topic>/status
+ * @return 0 if queued, -1 if the lane is full
+ */
+int fnPublisherPublishStatus(int wLane, const AtgProbe *pstProbe)
+{
+    PublishRecord stRecord;
+    memset(&stRecord, 0, sizeof(stRecord));
+    stRecord.eKind = PUBLISH_STATUS;
+    snprintf(stRecord.achTopic, sizeof(stRecord.achTopic), "%s/status", pstProbe->achTopic);
+    stRecord.address = pstProbe->address;
+    stRecord.eCommState = pstProbe->eCommState;
+    stRecord.u32Failures = pstProbe->u8Failures;
+    stRecord.u32PollIntervalMs = (unsigned)pstProbe->dbPollIntervalMs;
+    stRecord.u32Suppressed = pstProbe->u32Suppressed;
+    return fnPublisherEnqueue(wLane, &stRecord);
+}
+
+/**
+ * Queue a closed rollup window for <topic>/summary
+ * @return 0 if queued, -1 if the lane is full
+ */
+int fnPublisherPublishRollup(int wLane, const AtgProbe *pstProbe, const RollupWindow *pstWindow)
+{
+    PublishRecord stRecord;
+    memset(&stRecord, 0, sizeof(stRecord));
+    stRecord.eKind = PUBLISH_ROLLUP;
+    snprintf(stRecord.achTopic, sizeof(stRecord.achTopic), "%s/summary", pstProbe->achTopic);
+    stRecord.address = pstProbe->address;
+    stRecord.stRollup = *pstWindow;
+    return fnPublisherEnqueue(wLane, &stRecord);
+}
+
+/**
+ * Queue a delivery, loss or water ingress event for <topic>/event
+ * @return 0 if queued, -1 if the lane is full
+ */
+int fnPublisherPublishEvent(int wLane, const AtgProbe *pstProbe, const TankEvent *pstEvent)
+{
+    PublishRecord stRecord;
+    memset(&stRecord, 0, sizeof(stRecord));
+    stRecord.eKind = PUBLISH_EVENT;
+    snprintf(stRecord.achTopic, sizeof(stRecord.achTopic), "%s/event", pstProbe->achTopic);
+    stRecord.address = pstProbe->address;
+    stRecord.stEvent = *pstEvent;
+    return fnPublisherEnqueue(wLane, &stRecord);
+}
+
+/**
+ * Queue an alarm raised or cleared on a probe for <topic>/alarm, ahead of
+ * the lane's telemetry
+ * @return 0 if queued, -1 if the alarm lane is full
+ */
+int fnPublisherPublishAlarm(int wLane, const AtgProbe *pstProbe, const AlarmChange *pstChange)
+{
+    AlarmRecord stRecord;
+    memset(&stRecord, 0, sizeof(stRecord));
+    snprintf(stRecord.achTopic, sizeof(stRecord.achTopic), "%s/alarm", pstProbe->achTopic);
+    stRecord.address = pstProbe->address;
+    stRecord.stChange = *pstChange;
+    if (!fnRingPush(&pstAlarmLanes[wLane], &stRecord))
+    {
+        return -1;
+    }
+    fnPublisherWake();
+    return 0;
+}
+
+/**
+ * Tell the publisher the bus behind wLane has gone idle, closing its part of
+ * the current sweep batch (only queued in sweep mode)
+ * @return 0 if queued or not needed, -1 if the lane is full
+ */
+int fnPublisherEndSweep(int wLane)
+{
+    if (stConfig.eMode != BATCH_SWEEP)
+    {
+        return 0;
+    }
+
+    PublishRecord stRecord;
+    memset(&stRecord, 0, sizeof(stRecord));
+    stRecord.eKind = PUBLISH_SWEEP_END;
+    return fnPublisherEnqueue(wLane, &stRecord);
+}
@@ -0,0 +1,74 @@
+/**
+ * Publish Stage
+ * Dedicated MQTT thread fed by one lock-free ring per bus worker
+ */
+
+#ifndef PUBLISHER_H
+#define PUBLISHER_H
+
+#include <stdint.h>
+#include "atg.h"
+#include "registry.h"
+#include "journal.h"
+#include "rollup.h"
+#include "events.h"
+#include "alarm.h"
+
+// Readings one batch payload can carry, and the largest payload the publish
+// thread builds or replays
+#define BATCH_READINGS_LIMIT 64
+#define PUBLISH_PAYLOAD_MAX (256 + BATCH_READINGS_LIMIT * 256)
+
+typedef enum {
+    BATCH_OFF,    // One message per reading on the probe's topic
+    BATCH_SWEEP,  // One message per polling sweep of every bus
+    BATCH_WINDOW  // One message per time window
+} BatchMode;
+
+typedef struct {
+    BatchMode eMode;
+    char achTopic[PROBE_TOPIC_LEN]; // Station topic the batches are published on
+    uint32_t u32WindowMs;           // Longest a reading waits in a batch
+    uint32_t u32MaxReadings;        // A full batch is published at once
+} PublisherConfig;
+
+typedef enum {
+    PUBLISH_READING,
+    PUBLISH_STATUS,
+    PUBLISH_ROLLUP,
+    PUBLISH_EVENT,
+    PUBLISH_SWEEP_END // The lane's bus has gone idle
+} PublishKind;
+
+// Self-contained copy of everything one MQTT message needs, so the publish
+// thread never touches probe state owned by a bus worker
+typedef struct {
+    PublishKind eKind;
+    char achTopic[PROBE_TOPIC_LEN + 8];
+    AtgData stData;             // PUBLISH_READING
+    int address;                // PUBLISH_STATUS, PUBLISH_ROLLUP, PUBLISH_EVENT
+    ProbeCommState eCommState;  // PUBLISH_STATUS
+    unsigned u32Failures;       // PUBLISH_STATUS
+    unsigned u32PollIntervalMs; // PUBLISH_STATUS
+    unsigned u32Suppressed;     // PUBLISH_STATUS
+    RollupWindow stRollup;      // PUBLISH_ROLLUP
+    TankEvent stEvent;          // PUBLISH_EVENT
+} PublishRecord;
+
+void fnPublisherConfigDefaults(PublisherConfig *pstConfig);
+int fnPublisherLoadConfig(PublisherConfig *pstConfig, const char *achPath);
+int fnPublisherInit(int wLanes, uint32_t u32Depth, const PublisherConfig *pstConfig,
+                    const JournalConfig *pstJournalConfig);
+int fnPublisherStart();
+void fnPublisherStop();
+void fnPublisherFree();
+
+// Called from the bus worker that owns wLane; never blocks on the broker
+int fnPublisherPublishReading(int wLane, const AtgProbe *pstProbe, const AtgData *pstData);
+int fnPublisherPublishStatus(int wLane, const AtgProbe *pstProbe);
+int fnPublisherPublishRollup(int wLane, const AtgProbe *pstProbe, const RollupWindow *pstWindow);
+int fnPublisherPublishEvent(int wLane, const AtgProbe *pstProbe, const TankEvent *pstEvent);
+int fnPublisherPublishAlarm(int wLane, const AtgProbe *pstProbe, const AlarmChange *pstChange);
+int fnPublisherEndSweep(int wLane);
+
+#endif
@@ -0,0 +1,397 @@
+/**
+ * ATG Probe Registry
+ *
+ * Probes are read from [probe <address>] sections of the configuration
+ * file. Each probe gets one preallocated slot holding its settings and
+ * runtime state; responses are matched to slots through an open-addressed
+ * hash on the numeric address instead of a linear scan.
+ */
+
+#include "registry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "config.h"
+#include "main_linux.h"
+
+/**
+ * Knuth multiplicative hash of a probe address
+ */
+static uint32_t fnHashAddress(int address)
+{
+    return (uint32_t)address * 2654435761u;
+}
+
+/**
+ * Check that an address is 1-6 decimal digits
+ */
+static bool fnIsValidAddress(const char *achAddress)
+{
+    size_t len = strlen(achAddress);
+    if (len == 0 || len >= PROBE_ADDRESS_LEN)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        if (!isdigit((unsigned char)achAddress[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Append a probe with default settings
+ * @return The new slot, or NULL on duplicate address / allocation failure
+ */
+static AtgProbe *fnRegistryAdd(ProbeRegistry *pstRegistry, const char *achAddress)
+{
+    int address = atoi(achAddress);
+
+    for (int i = 0; i < pstRegistry->wCount; i++)
+    {
+        if (pstRegistry->pstProbes[i].address == address)
+        {
+            printf("Registry: duplicate probe address %s ignored\n", achAddress);
+            return NULL;
+        }
+    }
+
+    if (pstRegistry->wCount >= REGISTRY_MAX_PROBES)
+    {
+        printf("Registry: more than %d probes, %s ignored\n", REGISTRY_MAX_PROBES, achAddress);
+        return NULL;
+    }
+
+    if (pstRegistry->wCount == pstRegistry->wCapacity)
+    {
+        int wCapacity = pstRegistry->wCapacity ? pstRegistry->wCapacity * 2 : 16;
+        AtgProbe *pstProbes = (AtgProbe *)realloc(pstRegistry->pstProbes, wCapacity * sizeof(AtgProbe));
+        if (pstProbes == NULL)
+        {
+            printf("Registry: out of memory, %s ignored\n", achAddress);
+            return NULL;
+        }
+        pstRegistry->pstProbes = pstProbes;
+        pstRegistry->wCapacity = wCapacity;
+    }
+
+    AtgProbe *pstProbe = &pstRegistry->pstProbes[pstRegistry->wCount++];
+    memset(pstProbe, 0, sizeof(AtgProbe));
+    snprintf(pstProbe->achAddress, sizeof(pstProbe->achAddress), "%s", achAddress);
+    pstProbe->address = address;
+    snprintf(pstProbe->achTopic, sizeof(pstProbe->achTopic), "ATG%d", address);
+    pstProbe->fTempThreshold = TEMP_CHANGE_THRESHOLD;
+    pstProbe->fProductThreshold = PRODUCT_CHANGE_THRESHOLD;
+    pstProbe->fWaterThreshold = WATER_CHANGE_THRESHOLD;
+    pstProbe->stVcf.wRow = -1;
+    return pstProbe;
+}
+
+/**
+ * Build the address hash once all probes are known
+ */
+static int fnRegistryBuildIndex(ProbeRegistry *pstRegistry)
+{
+    uint32_t u32Size = 16;
+    while (u32Size < (uint32_t)pstRegistry->wCount * 2)
+    {
+        u32Size <<= 1;
+    }
+
+    free(pstRegistry->ai32Index);
+    pstRegistry->ai32Index = (int32_t *)malloc(u32Size * sizeof(int32_t));
+    if (pstRegistry->ai32Index == NULL)
+    {
+        return -1;
+    }
+    memset(pstRegistry->ai32Index, 0xFF, u32Size * sizeof(int32_t));
+    pstRegistry->u32IndexMask = u32Size - 1;
+
+    for (int i = 0; i < pstRegistry->wCount; i++)
+    {
+        AtgProbe *pstProbe = &pstRegistry->pstProbes[i];
+        uint32_t u32Slot = fnHashAddress(pstProbe->address) & pstRegistry->u32IndexMask;
+        while (pstRegistry->ai32Index[u32Slot] >= 0)
+        {
+            u32Slot = (u32Slot + 1) & pstRegistry->u32IndexMask;
+        }
+        pstRegistry->ai32Index[u32Slot] = i;
+
+        // Preset runtime state so the first reading is always published
+        fnInitAtgData(&pstProbe->stLatest);
+        fnInitAtgData(&pstProbe->stPrevious);
+        pstProbe->stLatest.address = pstProbe->address;
+        pstProbe->stPrevious.address = pstProbe->address;
+        pstProbe->dbLastPublishTime = -(MQTT_PERIODIC_INTERVAL);
+    }
+    return 0;
+}
+
+static int fnRegistryConfigHandler(void *pvContext, const char *achSection, const char *achName,
+                                   const char *achKey, const char *achValue, int wLine)
+{
+    ProbeRegistry *pstRegistry = (ProbeRegistry *)pvContext;
+
+    if (strcmp(achSection, "probe") != 0)
+    {
+        return 0;
+    }
+
+    if (!fnIsValidAddress(achName))
+    {
+        printf("Config line %d: invalid probe address '%s'\n", wLine, achName);
+        return -1;
+    }
+
+    // Section header: create the slot so a probe with only defaults still exists
+    int address = atoi(achName);
+    if (achKey[0] == '\0')
+    {
+        for (int i = 0; i < pstRegistry->wCount; i++)
+        {
+            if (pstRegistry->pstProbes[i].address == address)
+            {
+                printf("Config line %d: probe %s defined twice\n", wLine, achName);
+                return -1;
+            }
+        }
+        // A probe beyond REGISTRY_MAX_PROBES is skipped; running out of memory fails the load
+        if (fnRegistryAdd(pstRegistry, achName) == NULL && pstRegistry->wCount < REGISTRY_MAX_PROBES)
+        {
+            return -1;
+        }
+        return 0;
+    }
+
+    // Keys belong to the probe whose section was opened last
+    if (pstRegistry->wCount == 0 || pstRegistry->pstProbes[pstRegistry->wCount - 1].address != address)
+    {
+        return 0;
+    }
+    AtgProbe *pstProbe = &pstRegistry->pstProbes[pstRegistry->wCount - 1];
+
+    if (strcmp(achKey, "topic") == 0)
+    {
+        snprintf(pstProbe->achTopic, sizeof(pstProbe->achTopic), "%s", achValue);
+    }
+    else if (strcmp(achKey, "bus") == 0)
+    {
+        snprintf(pstProbe->achBus, sizeof(pstProbe->achBus), "%s", achValue);
+    }
+    else if (strcmp(achKey, "chart") == 0)
+    {
+        snprintf(pstProbe->achChart, sizeof(pstProbe->achChart), "%s", achValue);
+    }
+    else if (strcmp(achKey, "product") == 0)
+    {
+        if (fnVcfParseProduct(achValue, &pstProbe->eProduct) != 0)
+        {
+            printf("Config line %d: product must be refined, crude or lube\n", wLine);
+            return -1;
+        }
+    }
+    else if (strcmp(achKey, "density") == 0)
+    {
+        pstProbe->fDensity = strtof(achValue, NULL);
+    }
+    else if (strcmp(achKey, "temp_threshold") == 0)
+    {
+        pstProbe->fTempThreshold = strtof(achValue, NULL);
+    }
+    else if (strcmp(achKey, "product_threshold") == 0)
+    {
+        pstProbe->fProductThreshold = strtof(achValue, NULL);
+    }
+    else if (strcmp(achKey, "water_threshold") == 0)
+    {
+        pstProbe->fWaterThreshold = strtof(achValue, NULL);
+    }
+    else if (strcmp(achKey, "min_interval_ms") == 0)
+    {
+        pstProbe->dbMinIntervalMs = strtod(achValue, NULL);
+    }
+    else if (strcmp(achKey, "max_interval_ms") == 0)
+    {
+        pstProbe->dbMaxIntervalMs = strtod(achValue, NULL);
+    }
+    else if (fnAlarmParseRule(&pstProbe->stAlarmRules, achKey, achValue) != 0)
+    {
+        printf("Config line %d: unknown probe key '%s' ignored\n", wLine, achKey);
+    }
+    return 0;
+}
+
+/**
+ * Load probes from a configuration file
+ * @return 0 on success, -1 if the file is missing, >0 on parse error
+ */
+int fnRegistryLoad(ProbeRegistry *pstRegistry, const char *achPath)
+{
+    memset(pstRegistry, 0, sizeof(ProbeRegistry));
+
+    int rc = fnConfigParse(achPath, fnRegistryConfigHandler, pstRegistry);
+    if (rc != 0)
+    {
+        fnRegistryFree(pstRegistry);
+        return rc;
+    }
+
+    if (pstRegistry->wCount == 0)
+    {
+        printf("Config %s: no [probe] sections found\n", achPath);
+        fnRegistryFree(pstRegistry);
+        return 1;
+    }
+
+    // The product and density keys may come in either order, so resolve them last
+    for (int i = 0; i < pstRegistry->wCount; i++)
+    {
+        AtgProbe *pstProbe = &pstRegistry->pstProbes[i];
+        if (pstProbe->fDensity > 0 && fnVcfCurve(&pstProbe->stVcf, pstProbe->eProduct, pstProbe->fDensity) != 0)
+        {
+            printf("Config %s: probe %s density %.1f is outside the %s table\n", achPath, pstProbe->achAddress,
+                   pstProbe->fDensity, fnVcfProductName(pstProbe->eProduct));
+            fnRegistryFree(pstRegistry);
+            return 1;
+        }
+    }
+
+    return fnRegistryBuildIndex(pstRegistry);
+}
+
+/**
+ * Load the compiled-in probe list from atg.c
+ */
+int fnRegistryLoadDefaults(ProbeRegistry *pstRegistry)
+{
+    memset(pstRegistry, 0, sizeof(ProbeRegistry));
+    for (int i = 0; i < NUMBER_OF_ATGS; i++)
+    {
+        fnRegistryAdd(pstRegistry, achAtgAddress[i]);
+    }
+    return fnRegistryBuildIndex(pstRegistry);
+}
+
+/**
+ * Build a registry holding the probes of one bus
+ * @param pstSource Registry loaded from the configuration file
+ * @param achBus Bus name to select
+ * @param bDefaultBus Also take probes that do not name a bus
+ */
+int fnRegistrySelect(ProbeRegistry *pstRegistry, const ProbeRegistry *pstSource, const char *achBus,
+                     bool bDefaultBus)
+{
+    memset(pstRegistry, 0, sizeof(ProbeRegistry));
+    for (int i = 0; i < pstSource->wCount; i++)
+    {
+        const AtgProbe *pstSourceProbe = &pstSource->pstProbes[i];
+        bool bMatch = (strcmp(pstSourceProbe->achBus, achBus) == 0) ||
+                      (bDefaultBus && pstSourceProbe->achBus[0] == '\0');
+        if (!bMatch)
+        {
+            continue;
+        }
+
+        AtgProbe *pstProbe = fnRegistryAdd(pstRegistry, pstSourceProbe->achAddress);
+        if (pstProbe == NULL)
+        {
+            fnRegistryFree(pstRegistry);
+            return -1;
+        }
+        *pstProbe = *pstSourceProbe;
+    }
+    return fnRegistryBuildIndex(pstRegistry);
+}
+
+/**
+ * Copy a probe's runtime state (readings, learned timing, counters) to its
+ * slot in a reloaded registry; the configured fields of pstTo are kept.
+ * A probe moved to another topic publishes its next reading at once.
+ */
+void fnRegistryCarryState(AtgProbe *pstTo, const AtgProbe *pstFrom)
+{
+    pstTo->stRaw = pstFrom->stRaw;
+    pstTo->stLatest = pstFrom->stLatest;
+    pstTo->stPrevious = pstFrom->stPrevious;
+    pstTo->dbLastPublishTime =
+        (strcmp(pstTo->achTopic, pstFrom->achTopic) == 0) ? pstFrom->dbLastPublishTime : -(MQTT_PERIODIC_INTERVAL);
+    pstTo->stFilter = pstFrom->stFilter;
+    pstTo->u32Suppressed = pstFrom->u32Suppressed;
+    pstTo->u32SuppressedReported = pstFrom->u32SuppressedReported;
+    pstTo->stRollup = pstFrom->stRollup;
+    pstTo->stEvents = pstFrom->stEvents;
+    pstTo->stAlarms = pstFrom->stAlarms;
+    pstTo->dbSrttMs = pstFrom->dbSrttMs;
+    pstTo->dbRttVarMs = pstFrom->dbRttVarMs;
+    pstTo->u32RttSamples = pstFrom->u32RttSamples;
+    pstTo->eCommState = pstFrom->eCommState;
+    pstTo->u8Failures = pstFrom->u8Failures;
+    pstTo->dbBackoffMs = pstFrom->dbBackoffMs;
+    pstTo->dbPollIntervalMs = pstFrom->dbPollIntervalMs;
+    pstTo->dbLastPollAt = pstFrom->dbLastPollAt;
+    pstTo->dbNextPollAt = pstFrom->dbNextPollAt;
+    pstTo->dbLastReadingAt = pstFrom->dbLastReadingAt;
+    pstTo->u32Polls = pstFrom->u32Polls;
+    pstTo->u32Responses = pstFrom->u32Responses;
+    pstTo->u32Timeouts = pstFrom->u32Timeouts;
+}
+
+void fnRegistryFree(ProbeRegistry *pstRegistry)
+{
+    free(pstRegistry->pstProbes);
+    free(pstRegistry->ai32Index);
+    memset(pstRegistry, 0, sizeof(ProbeRegistry));
+}
+
+/**
+ * Find the slot for a probe address
+ * @return The probe, or NULL if the address is not configured
+ */
+AtgProbe *fnRegistryFind(const ProbeRegistry *pstRegistry, int address)
+{
+    if (pstRegistry->ai32Index == NULL)
+    {
+        return NULL;
+    }
+
+    uint32_t u32Slot = fnHashAddress(address) & pstRegistry->u32IndexMask;
+    int32_t i32Index;
+    while ((i32Index = pstRegistry->ai32Index[u32Slot]) >= 0)
+    {
+        if (pstRegistry->pstProbes[i32Index].address == address)
+        {
+            return &pstRegistry->pstProbes[i32Index];
+        }
+        u32Slot = (u32Slot + 1) & pstRegistry->u32IndexMask;
+    }
+    return NULL;
+}
+
+const char *fnProbeCommStateName(ProbeCommState eState)
+{
+    switch (eState)
+    {
+    case PROBE_COMM_ONLINE:
+        return "online";
+    case PROBE_COMM_RETRYING:
+        return "retrying";
+    case PROBE_COMM_OFFLINE:
+        return "offline";
+    default:
+        return "unknown";
+    }
+}
+
+void fnRegistryPrint(const ProbeRegistry *pstRegistry)
+{
+    printf("Configured probes: %d\n", pstRegistry->wCount);
+    for (int i = 0; i < pstRegistry->wCount; i++)
+    {
+        const AtgProbe *pstProbe = &pstRegistry->pstProbes[i];
+        printf("  %-6s -> %s\n", pstProbe->achAddress, pstProbe->achTopic);
+    }
+}
@@ -0,0 +1,119 @@
+/**
+ * ATG Probe Registry
+ * Probe list loaded at startup with hashed address-to-slot lookup
+ */
+
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "atg.h"
+#include "vcf.h"
+#include "filter.h"
+#include "rollup.h"
+#include "events.h"
+#include "alarm.h"
+
+// Upper bound on probes per registry (sized for large multi-tank sites)
+#define REGISTRY_MAX_PROBES 1024
+
+#define PROBE_ADDRESS_LEN 7
+#define PROBE_TOPIC_LEN 64
+#define PROBE_BUS_LEN 32
+
+struct DipChart;
+
+// Communication state of a probe as seen by the poll scheduler
+typedef enum {
+    PROBE_COMM_UNKNOWN = 0, // Not polled yet
+    PROBE_COMM_ONLINE,      // Answered its last poll
+    PROBE_COMM_RETRYING,    // Missed a poll, retrying within the retry budget
+    PROBE_COMM_OFFLINE      // Retries exhausted, re-probed with exponential backoff
+} ProbeCommState;
+
+// One configured probe and its preallocated runtime state
+typedef struct {
+    char achAddress[PROBE_ADDRESS_LEN]; // Address as sent in the poll command
+    int address;                        // Numeric address as parsed from responses
+    char achTopic[PROBE_TOPIC_LEN];     // MQTT topic for this probe's readings
+    char achBus[PROBE_BUS_LEN];         // [bus] section the probe is wired to, empty = first bus
+    char achChart[PROBE_TOPIC_LEN];     // Dip chart name, empty = the topic
+    const struct DipChart *pstChart;    // Strapping table, NULL = no volume (see dipchart.c)
+
+    // Standard volume at 15 C (see vcf.c)
+    VcfProduct eProduct; // Product class
+    float fDensity;      // kg/m3 at 15 C, 0 = no correction
+    VcfCurve stVcf;      // Set from the two above when loaded
+
+    // Change thresholds for publishing
+    float fTempThreshold;    // degrees Celsius
+    float fProductThreshold; // mm
+    float fWaterThreshold;   // mm
+
+    // Local alarm limits (see alarm.c)
+    AlarmRules stAlarmRules;
+
+    // Poll interval bounds in ms, 0 = use the [scheduler] defaults
+    double dbMinIntervalMs;
+    double dbMaxIntervalMs;
+
+    // Runtime state
+    AtgData stRaw;            // Last reading as received
+    AtgData stLatest;         // Last reading received, after the filter
+    AtgData stPrevious;       // Last reading published
+    double dbLastPublishTime; // ms, monotonic
+
+    // Signal conditioning (see filter.c)
+    ProbeFilter stFilter;
+    uint32_t u32Suppressed;         // Readings the filter kept from being published
+    uint32_t u32SuppressedReported; // u32Suppressed in the last queued status
+
+    // Open summary windows (see rollup.c)
+    ProbeRollup stRollup;
+
+    // Delivery, loss and water ingress detection (see events.c)
+    ProbeEvents stEvents;
+
+    // Raised local alarms (see alarm.c)
+    ProbeAlarms stAlarms;
+
+    // Learned response time (see scheduler.c)
+    double dbSrttMs;        // Smoothed poll-to-frame time
+    double dbRttVarMs;      // Mean deviation of the above
+    uint32_t u32RttSamples; // Responses measured so far
+
+    // Request tracking and adaptive rate (see scheduler.c)
+    ProbeCommState eCommState;
+    uint8_t u8Failures;       // Consecutive unanswered polls
+    double dbBackoffMs;       // Current re-probe interval while offline
+    double dbPollIntervalMs;  // Current time between polls while online
+    double dbLastPollAt;      // When the last poll was sent (ms)
+    double dbNextPollAt;      // Due time of the next poll (ms)
+    double dbLastReadingAt;   // When stLatest was received (ms)
+    uint32_t u32Polls;
+    uint32_t u32Responses;
+    uint32_t u32Timeouts;
+} AtgProbe;
+
+typedef struct {
+    AtgProbe *pstProbes; // Slots, in configuration order
+    int wCount;
+    int wCapacity;
+
+    // Open-addressed hash: address -> slot index, -1 when empty
+    int32_t *ai32Index;
+    uint32_t u32IndexMask;
+} ProbeRegistry;
+
+int fnRegistryLoad(ProbeRegistry *pstRegistry, const char *achPath);
+int fnRegistryLoadDefaults(ProbeRegistry *pstRegistry);
+int fnRegistrySelect(ProbeRegistry *pstRegistry, const ProbeRegistry *pstSource, const char *achBus,
+                     bool bDefaultBus);
+void fnRegistryCarryState(AtgProbe *pstTo, const AtgProbe *pstFrom);
+void fnRegistryFree(ProbeRegistry *pstRegistry);
+AtgProbe *fnRegistryFind(const ProbeRegistry *pstRegistry, int address);
+void fnRegistryPrint(const ProbeRegistry *pstRegistry);
+const char *fnProbeCommStateName(ProbeCommState eState);
+
+#endif
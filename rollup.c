@@ -0,0 +1,226 @@
+/**
+ * Rollups
+ *
+ * The server otherwise builds its hourly statistics from every raw row,
+ * so every sample has to cross the WAN first. With [rollup] enabled each
+ * probe keeps running aggregates of its readings over up to four window
+ * lengths, e.g. a minute and an hour, and publishes one summary per window
+ * on <topic>/summary:
+ *
+ *   {"Address":"83731","Start":"2026-10-16T11:32:00.000Z","WindowS":60,
+ *    "Count":12,"Product":{"Min":..,"Max":..,"Mean":..,"Last":..,
+ *    "RatePerMin":..},"Water":{..},"Temp":{..},"Volume":{..},
+ *    "StdVolume":{..}}
+ *
+ * Volume and StdVolume appear when the probe has a dip chart and density.
+ * RatePerMin is the least-squares slope over the window, which a single
+ * rippled reading at either end cannot skew the way last - first would.
+ *
+ * Windows are aligned to multiples of their length in Unix time, so every
+ * gateway's minute and hour windows line up. A window is published with
+ * the first reading after it ends; an offline probe's last window goes out
+ * when it answers again. Each window is a fixed set of sums, so memory per
+ * probe is constant however many readings a window holds. The aggregated
+ * values are the filtered ones that are published (see filter.c).
+ */
+
+#include "rollup.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "config.h"
+#include "main_linux.h"
+
+static const char *const aachChannelNames[ROLLUP_CHANNELS] = {"Product", "Water", "Temp", "Volume", "StdVolume"};
+
+void fnRollupConfigDefaults(RollupConfig *pstConfig)
+{
+    memset(pstConfig, 0, sizeof(RollupConfig));
+    pstConfig->bEnabled = false;
+    pstConfig->wWindows = 1;
+    pstConfig->au32WindowS[0] = ROLLUP_WINDOW_S;
+    pstConfig->bThinRaw = false;
+}
+
+static int fnRollupConfigHandler(void *pvContext, const char *achSection, const char *achName,
+                                 const char *achKey, const char *achValue, int wLine)
+{
+    RollupConfig *pstConfig = (RollupConfig *)pvContext;
+    (void)achName;
+
+    if (strcmp(achSection, "rollup") != 0 || achKey[0] == '\0')
+    {
+        return 0;
+    }
+
+    if (strcmp(achKey, "enabled") == 0)
+    {
+        pstConfig->bEnabled = fnConfigParseBool(achValue);
+    }
+    else if (strcmp(achKey, "thin_raw") == 0)
+    {
+        pstConfig->bThinRaw = fnConfigParseBool(achValue);
+    }
+    else if (strcmp(achKey, "windows") == 0)
+    {
+        // Comma-separated lengths in seconds, e.g. 60, 3600
+        const char *pchNext = achValue;
+        pstConfig->wWindows = 0;
+        while (*pchNext != '\0')
+        {
+            char *pchEnd;
+            unsigned long u32Value = strtoul(pchNext, &pchEnd, 10);
+            if (pchEnd == pchNext || u32Value < ROLLUP_MIN_WINDOW_S || u32Value > ROLLUP_MAX_WINDOW_S ||
+                pstConfig->wWindows == ROLLUP_MAX_WINDOWS)
+            {
+                printf("Config line %d: windows must be up to %d lengths of %d to %d s\n", wLine,
+                       ROLLUP_MAX_WINDOWS, ROLLUP_MIN_WINDOW_S, ROLLUP_MAX_WINDOW_S);
+                return -1;
+            }
+            pstConfig->au32WindowS[pstConfig->wWindows++] = (uint32_t)u32Value;
+            pchNext = pchEnd + strspn(pchEnd, ", \t");
+        }
+    }
+    else
+    {
+        printf("Config line %d: unknown rollup key '%s' ignored\n", wLine, achKey);
+    }
+    return 0;
+}
+
+/**
+ * Read the [rollup] section on top of the defaults
+ * @return 0 on success (or missing file), >0 on parse error
+ */
+int fnRollupLoadConfig(RollupConfig *pstConfig, const char *achPath)
+{
+    fnRollupConfigDefaults(pstConfig);
+    int rc = fnConfigParse(achPath, fnRollupConfigHandler, pstConfig);
+    if (rc == 0 && pstConfig->bEnabled && pstConfig->wWindows == 0)
+    {
+        printf("Config %s: rollups enabled without windows\n", achPath);
+        return 1;
+    }
+    return (rc == -1) ? 0 : rc;
+}
+
+static void fnRollupChannelAdd(RollupChannel *pstChannel, double dbT, double dbValue)
+{
+    if (pstChannel->u32Count == 0)
+    {
+        pstChannel->dbOrigin = dbValue;
+        pstChannel->dbMin = pstChannel->dbMax = dbValue;
+    }
+    if (dbValue < pstChannel->dbMin)
+        pstChannel->dbMin = dbValue;
+    if (dbValue > pstChannel->dbMax)
+        pstChannel->dbMax = dbValue;
+    pstChannel->dbLast = dbValue;
+
+    double dbX = dbValue - pstChannel->dbOrigin;
+    pstChannel->u32Count++;
+    pstChannel->dbSumX += dbX;
+    pstChannel->dbSumT += dbT;
+    pstChannel->dbSumTT += dbT * dbT;
+    pstChannel->dbSumTX += dbT * dbX;
+}
+
+/**
+ * Add a reading to every configured window of a probe, handing each window
+ * that has ended to fnHandler first. Windows whose length was changed by a
+ * reload, or all of them when rollups are disabled, are dropped unpublished.
+ */
+void fnRollupAdd(ProbeRollup *pstRollup, const RollupConfig *pstConfig, const AtgData *pstData,
+                 RollupHandler fnHandler, void *pvContext)
+{
+    int64_t i64Now = pstData->timestamp;
+
+    for (int i = 0; i < ROLLUP_MAX_WINDOWS; i++)
+    {
+        RollupWindow *pstWindow = &pstRollup->astWindows[i];
+        uint32_t u32WindowS = (pstConfig->bEnabled && i < pstConfig->wWindows) ? pstConfig->au32WindowS[i] : 0;
+
+        if (pstWindow->i64StartMs != 0 && pstWindow->u32WindowS != u32WindowS)
+        {
+            memset(pstWindow, 0, sizeof(RollupWindow));
+        }
+        if (u32WindowS == 0 || i64Now <= 0)
+        {
+            continue;
+        }
+
+        int64_t i64LengthMs = (int64_t)u32WindowS * 1000;
+        int64_t i64StartMs = i64Now - i64Now % i64LengthMs;
+        if (pstWindow->i64StartMs != i64StartMs)
+        {
+            if (pstWindow->i64StartMs != 0)
+            {
+                fnHandler(pstWindow, pvContext);
+            }
+            memset(pstWindow, 0, sizeof(RollupWindow));
+            pstWindow->i64StartMs = i64StartMs;
+            pstWindow->u32WindowS = u32WindowS;
+        }
+
+        double dbT = (i64Now - i64StartMs) / 1000.0;
+        RollupChannel *pstChannels = pstWindow->astChannels;
+        fnRollupChannelAdd(&pstChannels[ROLLUP_PRODUCT], dbT, pstData->product);
+        fnRollupChannelAdd(&pstChannels[ROLLUP_WATER], dbT, pstData->water);
+        fnRollupChannelAdd(&pstChannels[ROLLUP_TEMP], dbT, pstData->temperature);
+        if (pstData->volume >= 0)
+            fnRollupChannelAdd(&pstChannels[ROLLUP_VOLUME], dbT, pstData->volume);
+        if (pstData->std_volume >= 0)
+            fnRollupChannelAdd(&pstChannels[ROLLUP_STD_VOLUME], dbT, pstData->std_volume);
+    }
+}
+
+// Least-squares slope in units per minute, 0 with fewer than two distinct times
+static double fnRollupRate(const RollupChannel *pstChannel)
+{
+    double dbCount = pstChannel->u32Count;
+    double dbDenominator = dbCount * pstChannel->dbSumTT - pstChannel->dbSumT * pstChannel->dbSumT;
+    if (pstChannel->u32Count < 2 || dbDenominator <= 1e-9 * dbCount * pstChannel->dbSumTT)
+    {
+        return 0;
+    }
+    return 60.0 * (dbCount * pstChannel->dbSumTX - pstChannel->dbSumT * pstChannel->dbSumX) / dbDenominator;
+}
+
+/**
+ * Format a closed window as the JSON summary payload
+ * @return Payload length, or -1 if it did not fit
+ */
+int fnRollupFormat(char *achPayload, size_t szSize, int address, const RollupWindow *pstWindow)
+{
+    time_t seconds = (time_t)(pstWindow->i64StartMs / 1000);
+    struct tm utc;
+    gmtime_r(&seconds, &utc);
+
+    int wLength = snprintf(achPayload, szSize,
+                           "{\"Address\":\"%d\",\"Start\":\"%04d-%02d-%02dT%02d:%02d:%02d.000Z\",\"WindowS\":%u,"
+                           "\"Count\":%u",
+                           address, utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday, utc.tm_hour, utc.tm_min,
+                           utc.tm_sec, pstWindow->u32WindowS, pstWindow->astChannels[ROLLUP_PRODUCT].u32Count);
+
+    for (int i = 0; i < ROLLUP_CHANNELS && wLength > 0 && (size_t)wLength < szSize; i++)
+    {
+        const RollupChannel *pstChannel = &pstWindow->astChannels[i];
+        if (pstChannel->u32Count == 0)
+        {
+            continue;
+        }
+        wLength += snprintf(achPayload + wLength, szSize - wLength,
+                            ",\"%s\":{\"Min\":%.2f,\"Max\":%.2f,\"Mean\":%.2f,\"Last\":%.2f,\"RatePerMin\":%.3f}",
+                            aachChannelNames[i], pstChannel->dbMin, pstChannel->dbMax,
+                            pstChannel->dbOrigin + pstChannel->dbSumX / pstChannel->u32Count, pstChannel->dbLast,
+                            fnRollupRate(pstChannel));
+    }
+    if (wLength > 0 && (size_t)wLength + 1 < szSize)
+    {
+        achPayload[wLength++] = '}';
+        achPayload[wLength] = '\0';
+        return wLength;
+    }
+    return -1;
+}
@@ -0,0 +1,69 @@
+/**
+ * Rollups
+ * Per-tank aggregates over fixed time windows, published on a summary topic
+ */
+
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "atg.h"
+
+#define ROLLUP_MAX_WINDOWS 4   // Window lengths aggregated at once
+#define ROLLUP_MIN_WINDOW_S 10
+#define ROLLUP_MAX_WINDOW_S 86400
+#define ROLLUP_PAYLOAD_MAX 640 // Largest formatted summary
+
+typedef struct {
+    bool bEnabled;
+    int wWindows;
+    uint32_t au32WindowS[ROLLUP_MAX_WINDOWS]; // Window lengths in seconds
+    bool bThinRaw; // Drop the periodic republish of unchanged readings
+} RollupConfig;
+
+typedef enum {
+    ROLLUP_PRODUCT = 0,
+    ROLLUP_WATER,
+    ROLLUP_TEMP,
+    ROLLUP_VOLUME,
+    ROLLUP_STD_VOLUME,
+    ROLLUP_CHANNELS
+} RollupChannelId;
+
+// Running statistics of one channel; values are kept relative to the first
+// sample and times relative to the window start to preserve precision
+typedef struct {
+    uint32_t u32Count;
+    double dbMin;
+    double dbMax;
+    double dbLast;
+    double dbOrigin; // First sample
+    double dbSumX;   // Sum of (sample - origin)
+    double dbSumT;   // Sum of seconds into the window
+    double dbSumTT;
+    double dbSumTX;
+} RollupChannel;
+
+// One open (or just closed) window of one probe
+typedef struct {
+    int64_t i64StartMs;  // Unix time in ms, a multiple of the window length; 0 = not started
+    uint32_t u32WindowS; // Length it was started with
+    RollupChannel astChannels[ROLLUP_CHANNELS];
+} RollupWindow;
+
+typedef struct {
+    RollupWindow astWindows[ROLLUP_MAX_WINDOWS];
+} ProbeRollup;
+
+// Called with each window that has ended
+typedef void (*RollupHandler)(const RollupWindow *pstWindow, void *pvContext);
+
+void fnRollupConfigDefaults(RollupConfig *pstConfig);
+int fnRollupLoadConfig(RollupConfig *pstConfig, const char *achPath);
+void fnRollupAdd(ProbeRollup *pstRollup, const RollupConfig *pstConfig, const AtgData *pstData,
+                 RollupHandler fnHandler, void *pvContext);
+int fnRollupFormat(char *achPayload, size_t szSize, int address, const RollupWindow *pstWindow);
+
+#endif
@@ -0,0 +1,621 @@
+/**
+ * ATG Poll Scheduler
+ *
+ * Only one poll is outstanding on the bus at a time. As soon as its
+ * response frame completes (or its timeout expires) the next due probe is
+ * polled after a short turnaround gap, so the bus is limited by how fast
+ * the probes answer rather than a fixed slot per probe.
+ *
+ * Every probe has its own poll interval. After each reading the interval
+ * is set to the time the fastest-moving channel (the same temperature,
+ * product and water fields fnHasDataChanged compares, before filtering)
+ * needs to cross its publish threshold, so a tank being filled is polled every second while
+ * a static tank drifts up to the maximum interval. Probes are kept in a
+ * min-heap on their due time and polled earliest-deadline-first.
+ *
+ * Each probe's response time is learned with the same smoothing TCP uses
+ * for its retransmission timer: timeout = srtt + 4 * rttvar + turnaround,
+ * clamped between the configured minimum and maximum.
+ *
+ * A missed response is retried immediately up to the retry budget. After
+ * that the probe is marked offline and re-probed once per backoff
+ * interval, which doubles after every silent re-probe up to the
+ * configured cap. One answer brings it back online.
+ */
+
+#include "scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "config.h"
+#include "stats.h"
+#include "main_linux.h"
+
+void fnSchedulerConfigDefaults(SchedulerConfig *pstConfig)
+{
+    pstConfig->dbTurnaroundMs = POLL_TURNAROUND_MS;
+    pstConfig->dbMinTimeoutMs = POLL_MIN_TIMEOUT_MS;
+    pstConfig->dbMaxTimeoutMs = POLL_MAX_TIMEOUT_MS;
+    pstConfig->dbMinIntervalMs = POLL_MIN_INTERVAL_MS;
+    pstConfig->dbMaxIntervalMs = POLL_MAX_INTERVAL_MS;
+    pstConfig->dbGrowth = POLL_INTERVAL_GROWTH;
+    pstConfig->wRetries = POLL_RETRIES;
+    pstConfig->dbBackoffMinMs = POLL_BACKOFF_MIN_MS;
+    pstConfig->dbBackoffMaxMs = POLL_BACKOFF_MAX_MS;
+}
+
+static int fnSchedulerConfigHandler(void *pvContext, const char *achSection, const char *achName,
+                                    const char *achKey, const char *achValue, int wLine)
+{
+    SchedulerConfig *pstConfig = (SchedulerConfig *)pvContext;
+    (void)achName;
+
+    if (strcmp(achSection, "scheduler") != 0 || achKey[0] == '\0')
+    {
+        return 0;
+    }
+
+    double dbValue = strtod(achValue, NULL);
+    if (dbValue < 0)
+    {
+        printf("Config line %d: %s must not be negative\n", wLine, achKey);
+        return -1;
+    }
+
+    if (strcmp(achKey, "turnaround_ms") == 0)
+        pstConfig->dbTurnaroundMs = dbValue;
+    else if (strcmp(achKey, "min_timeout_ms") == 0)
+        pstConfig->dbMinTimeoutMs = dbValue;
+    else if (strcmp(achKey, "max_timeout_ms") == 0)
+        pstConfig->dbMaxTimeoutMs = dbValue;
+    else if (strcmp(achKey, "min_interval_ms") == 0)
+        pstConfig->dbMinIntervalMs = dbValue;
+    else if (strcmp(achKey, "max_interval_ms") == 0)
+        pstConfig->dbMaxIntervalMs = dbValue;
+    else if (strcmp(achKey, "interval_growth") == 0)
+        pstConfig->dbGrowth = (dbValue < 1.0) ? 1.0 : dbValue;
+    else if (strcmp(achKey, "retries") == 0)
+        pstConfig->wRetries = (int)dbValue;
+    else if (strcmp(achKey, "backoff_min_ms") == 0)
+        pstConfig->dbBackoffMinMs = dbValue;
+    else if (strcmp(achKey, "backoff_max_ms") == 0)
+        pstConfig->dbBackoffMaxMs = dbValue;
+    else
+        printf("Config line %d: unknown scheduler key '%s' ignored\n", wLine, achKey);
+    return 0;
+}
+
+/**
+ * Read the [scheduler] section on top of the defaults
+ * @return 0 on success (or missing file), >0 on parse error
+ */
+int fnSchedulerLoadConfig(SchedulerConfig *pstConfig, const char *achPath)
+{
+    fnSchedulerConfigDefaults(pstConfig);
+    int rc = fnConfigParse(achPath, fnSchedulerConfigHandler, pstConfig);
+    if (rc == -1)
+    {
+        return 0;
+    }
+    if (pstConfig->dbMinTimeoutMs > pstConfig->dbMaxTimeoutMs)
+    {
+        pstConfig->dbMinTimeoutMs = pstConfig->dbMaxTimeoutMs;
+    }
+    if (pstConfig->dbBackoffMinMs > pstConfig->dbBackoffMaxMs)
+    {
+        pstConfig->dbBackoffMinMs = pstConfig->dbBackoffMaxMs;
+    }
+    if (pstConfig->dbMinIntervalMs > pstConfig->dbMaxIntervalMs)
+    {
+        pstConfig->dbMinIntervalMs = pstConfig->dbMaxIntervalMs;
+    }
+    return rc;
+}
+
+
+// ----------------------------------------
+// Due-time heap
+// ----------------------------------------
+
+static bool fnHeapLess(const PollScheduler *pstScheduler, int wA, int wB)
+{
+    const AtgProbe *pstProbes = pstScheduler->pstRegistry->pstProbes;
+    if (pstProbes[wA].dbNextPollAt != pstProbes[wB].dbNextPollAt)
+    {
+        return pstProbes[wA].dbNextPollAt < pstProbes[wB].dbNextPollAt;
+    }
+    return wA < wB; // Configuration order breaks ties
+}
+
+static void fnHeapSwap(PollScheduler *pstScheduler, int wI, int wJ)
+{
+    int wTmp = pstScheduler->pwHeap[wI];
+    pstScheduler->pwHeap[wI] = pstScheduler->pwHeap[wJ];
+    pstScheduler->pwHeap[wJ] = wTmp;
+    pstScheduler->pwHeapPos[pstScheduler->pwHeap[wI]] = wI;
+    pstScheduler->pwHeapPos[pstScheduler->pwHeap[wJ]] = wJ;
+}
+
+/**
+ * Restore heap order after a probe's dbNextPollAt changed
+ */
+static void fnHeapFix(PollScheduler *pstScheduler, int wProbe)
+{
+    int wCount = pstScheduler->pstRegistry->wCount;
+    int wPos = pstScheduler->pwHeapPos[wProbe];
+
+    while (wPos > 0)
+    {
+        int wParent = (wPos - 1) / 2;
+        if (!fnHeapLess(pstScheduler, pstScheduler->pwHeap[wPos], pstScheduler->pwHeap[wParent]))
+            break;
+        fnHeapSwap(pstScheduler, wPos, wParent);
+        wPos = wParent;
+    }
+
+    for (;;)
+    {
+        int wSmallest = wPos;
+        int wLeft = 2 * wPos + 1;
+        int wRight = wLeft + 1;
+        if (wLeft < wCount && fnHeapLess(pstScheduler, pstScheduler->pwHeap[wLeft], pstScheduler->pwHeap[wSmallest]))
+            wSmallest = wLeft;
+        if (wRight < wCount && fnHeapLess(pstScheduler, pstScheduler->pwHeap[wRight], pstScheduler->pwHeap[wSmallest]))
+            wSmallest = wRight;
+        if (wSmallest == wPos)
+            break;
+        fnHeapSwap(pstScheduler, wPos, wSmallest);
+        wPos = wSmallest;
+    }
+}
+
+static void fnSchedulerSetDue(PollScheduler *pstScheduler, AtgProbe *pstProbe, double dbDueAt)
+{
+    pstProbe->dbNextPollAt = dbDueAt;
+    fnHeapFix(pstScheduler, (int)(pstProbe - pstScheduler->pstRegistry->pstProbes));
+}
+
+// ----------------------------------------
+// Scheduler
+// ----------------------------------------
+
+static double fnProbeMinInterval(const PollScheduler *pstScheduler, const AtgProbe *pstProbe)
+{
+    return (pstProbe->dbMinIntervalMs > 0) ? pstProbe->dbMinIntervalMs : pstScheduler->stConfig.dbMinIntervalMs;
+}
+
+static double fnProbeMaxInterval(const PollScheduler *pstScheduler, const AtgProbe *pstProbe)
+{
+    double dbMax = (pstProbe->dbMaxIntervalMs > 0) ? pstProbe->dbMaxIntervalMs : pstScheduler->stConfig.dbMaxIntervalMs;
+    double dbMin = fnProbeMinInterval(pstScheduler, pstProbe);
+    return (dbMax < dbMin) ? dbMin : dbMax;
+}
+
+/**
+ * Prepare the scheduler for the probes in a registry
+ * @return 0 on success, -1 on allocation failure
+ */
+int fnSchedulerInit(PollScheduler *pstScheduler, const SchedulerConfig *pstConfig, ProbeRegistry *pstRegistry)
+{
+    memset(pstScheduler, 0, sizeof(PollScheduler));
+    pstScheduler->stConfig = *pstConfig;
+    pstScheduler->pstRegistry = pstRegistry;
+    pstScheduler->wCurrent = -1;
+    pstScheduler->wRetry = -1;
+
+    int wCount = pstRegistry->wCount;
+    pstScheduler->pwHeap = (int *)malloc((wCount + 1) * sizeof(int));
+    pstScheduler->pwHeapPos = (int *)malloc((wCount + 1) * sizeof(int));
+    if (pstScheduler->pwHeap == NULL || pstScheduler->pwHeapPos == NULL)
+    {
+        fnSchedulerFree(pstScheduler);
+        return -1;
+    }
+
+    // Everything is due at once, in configuration order; start at the fastest rate
+    for (int i = 0; i < wCount; i++)
+    {
+        AtgProbe *pstProbe = &pstRegistry->pstProbes[i];
+        pstProbe->dbPollIntervalMs = fnProbeMinInterval(pstScheduler, pstProbe);
+        pstProbe->dbNextPollAt = 0;
+        pstScheduler->pwHeap[i] = i;
+        pstScheduler->pwHeapPos[i] = i;
+    }
+    return 0;
+}
+
+/**
+ * Take over a registry rebuilt by a configuration reload. Probes carried
+ * over keep their learned interval (clamped to the new bounds) and due
+ * time; probes new to the bus are due at once. Only valid while nothing is
+ * in flight, since the slot numbers change.
+ * @return 0 on success, -1 on allocation failure (the scheduler is unchanged)
+ */
+int fnSchedulerRebuild(PollScheduler *pstScheduler, const SchedulerConfig *pstConfig, ProbeRegistry *pstRegistry)
+{
+    int wCount = pstRegistry->wCount;
+    int *pwHeap = (int *)malloc((wCount + 1) * sizeof(int));
+    int *pwHeapPos = (int *)malloc((wCount + 1) * sizeof(int));
+    if (pwHeap == NULL || pwHeapPos == NULL)
+    {
+        free(pwHeap);
+        free(pwHeapPos);
+        return -1;
+    }
+
+    fnSchedulerFree(pstScheduler);
+    pstScheduler->stConfig = *pstConfig;
+    pstScheduler->pstRegistry = pstRegistry;
+    pstScheduler->pwHeap = pwHeap;
+    pstScheduler->pwHeapPos = pwHeapPos;
+
+    for (int i = 0; i < wCount; i++)
+    {
+        AtgProbe *pstProbe = &pstRegistry->pstProbes[i];
+        if (pstProbe->dbPollIntervalMs <= 0)
+        {
+            pstProbe->dbPollIntervalMs = fnProbeMinInterval(pstScheduler, pstProbe);
+            pstProbe->dbNextPollAt = 0;
+        }
+        else
+        {
+            pstProbe->dbPollIntervalMs = fmax(pstProbe->dbPollIntervalMs, fnProbeMinInterval(pstScheduler, pstProbe));
+            pstProbe->dbPollIntervalMs = fmin(pstProbe->dbPollIntervalMs, fnProbeMaxInterval(pstScheduler, pstProbe));
+        }
+
+        // Insert at the bottom and sift up
+        int wPos = i;
+        pwHeap[i] = i;
+        pwHeapPos[i] = i;
+        while (wPos > 0 && fnHeapLess(pstScheduler, pwHeap[wPos], pwHeap[(wPos - 1) / 2]))
+        {
+            fnHeapSwap(pstScheduler, wPos, (wPos - 1) / 2);
+            wPos = (wPos - 1) / 2;
+        }
+    }
+    return 0;
+}
+
+void fnSchedulerFree(PollScheduler *pstScheduler)
+{
+    free(pstScheduler->pwHeap);
+    free(pstScheduler->pwHeapPos);
+    pstScheduler->pwHeap = NULL;
+    pstScheduler->pwHeapPos = NULL;
+}
+
+void fnSchedulerSetStatusHandler(PollScheduler *pstScheduler, ProbeStatusHandler fnHandler, void *pvContext)
+{
+    pstScheduler->fnOnStatus = fnHandler;
+    pstScheduler->pvStatusContext = pvContext;
+}
+
+static void fnSchedulerNotify(PollScheduler *pstScheduler, AtgProbe *pstProbe)
+{
+    if (pstScheduler->fnOnStatus != NULL)
+    {
+        pstScheduler->fnOnStatus(pstProbe, pstScheduler->pvStatusContext);
+    }
+}
+
+static void fnSchedulerSetCommState(PollScheduler *pstScheduler, AtgProbe *pstProbe, ProbeCommState eState)
+{
+    if (pstProbe->eCommState == eState)
+    {
+        return;
+    }
+    pstProbe->eCommState = eState;
+    fnStatsProbeOnline(pstProbe->address, eState == PROBE_COMM_ONLINE);
+    fnSchedulerNotify(pstScheduler, pstProbe);
+}
+
+/**
+ * The outstanding poll went unanswered: retry, take offline or back off further
+ */
+static void fnSchedulerOnTimeout(PollScheduler *pstScheduler, double dbNow)
+{
+    const SchedulerConfig *pstConfig = &pstScheduler->stConfig;
+    int wIndex = pstScheduler->wCurrent;
+    AtgProbe *pstProbe = &pstScheduler->pstRegistry->pstProbes[wIndex];
+
+    printf("No response from %s within %.0f ms\n", pstProbe->achAddress,
+           fnSchedulerTimeoutMs(pstScheduler, pstProbe));
+    pstScheduler->u32Timeouts++;
+    pstProbe->u32Timeouts++;
+    fnStatsCount(STAT_TIMEOUTS);
+    fnStatsProbeTimeout(pstProbe->address);
+    if (pstProbe->u8Failures < UINT8_MAX)
+    {
+        pstProbe->u8Failures++;
+    }
+
+    pstScheduler->wCurrent = -1;
+    pstScheduler->dbBusFreeAt = dbNow + pstConfig->dbTurnaroundMs;
+
+    if (pstProbe->eCommState == PROBE_COMM_OFFLINE)
+    {
+        // Silent re-probe: wait twice as long before the next one
+        pstProbe->dbBackoffMs *= 2.0;
+        if (pstProbe->dbBackoffMs > pstConfig->dbBackoffMaxMs)
+            pstProbe->dbBackoffMs = pstConfig->dbBackoffMaxMs;
+        fnSchedulerSetDue(pstScheduler, pstProbe, dbNow + pstProbe->dbBackoffMs);
+    }
+    else if (pstProbe->u8Failures <= pstConfig->wRetries)
+    {
+        pstScheduler->wRetry = wIndex;
+        fnSchedulerSetCommState(pstScheduler, pstProbe, PROBE_COMM_RETRYING);
+    }
+    else
+    {
+        pstProbe->dbBackoffMs = pstConfig->dbBackoffMinMs;
+        fnSchedulerSetDue(pstScheduler, pstProbe, dbNow + pstProbe->dbBackoffMs);
+        printf("Probe %s offline after %d missed polls, re-probing every %.0f s\n",
+               pstProbe->achAddress, pstProbe->u8Failures, pstProbe->dbBackoffMs / 1000.0);
+        fnSchedulerSetCommState(pstScheduler, pstProbe, PROBE_COMM_OFFLINE);
+    }
+}
+
+/**
+ * How long to wait for this probe before giving up on the poll
+ */
+double fnSchedulerTimeoutMs(const PollScheduler *pstScheduler, const AtgProbe *pstProbe)
+{
+    const SchedulerConfig *pstConfig = &pstScheduler->stConfig;
+
+    if (pstProbe->u32RttSamples == 0)
+    {
+        return pstConfig->dbMaxTimeoutMs;
+    }
+
+    double dbTimeout = pstProbe->dbSrttMs + 4.0 * pstProbe->dbRttVarMs + pstConfig->dbTurnaroundMs;
+    if (dbTimeout < pstConfig->dbMinTimeoutMs)
+        dbTimeout = pstConfig->dbMinTimeoutMs;
+    if (dbTimeout > pstConfig->dbMaxTimeoutMs)
+        dbTimeout = pstConfig->dbMaxTimeoutMs;
+    return dbTimeout;
+}
+
+/**
+ * Absolute time (ms) at which fnSchedulerPoll next has something to do
+ * @return INFINITY while the bus has no probes
+ */
+double fnSchedulerNextDeadline(const PollScheduler *pstScheduler)
+{
+    const ProbeRegistry *pstRegistry = pstScheduler->pstRegistry;
+
+    if (pstScheduler->wCurrent >= 0)
+    {
+        const AtgProbe *pstProbe = &pstRegistry->pstProbes[pstScheduler->wCurrent];
+        return pstScheduler->dbSentAt + fnSchedulerTimeoutMs(pstScheduler, pstProbe);
+    }
+
+    if (pstRegistry->wCount == 0)
+    {
+        return INFINITY;
+    }
+
+    if (pstScheduler->wRetry >= 0)
+    {
+        return pstScheduler->dbBusFreeAt;
+    }
+
+    double dbDueAt = pstRegistry->pstProbes[pstScheduler->pwHeap[0]].dbNextPollAt;
+    return (dbDueAt > pstScheduler->dbBusFreeAt) ? dbDueAt : pstScheduler->dbBusFreeAt;
+}
+
+/**
+ * Whether the current run of back-to-back polls is over: nothing outstanding
+ * and no probe due before the bus is free again
+ */
+bool fnSchedulerIdle(const PollScheduler *pstScheduler)
+{
+    const ProbeRegistry *pstRegistry = pstScheduler->pstRegistry;
+
+    if (pstScheduler->wCurrent >= 0 || pstScheduler->wRetry >= 0)
+    {
+        return false;
+    }
+    return pstRegistry->wCount == 0 ||
+           pstRegistry->pstProbes[pstScheduler->pwHeap[0]].dbNextPollAt > pstScheduler->dbBusFreeAt;
+}
+
+/**
+ * Whether a poll awaits its response or a retry is pending
+ */
+bool fnSchedulerInFlight(const PollScheduler *pstScheduler)
+{
+    return pstScheduler->wCurrent >= 0 || pstScheduler->wRetry >= 0;
+}
+
+/**
+ * Forget the outstanding poll and any pending retry without holding it
+ * against the probe, e.g. when the port it went out on is gone
+ */
+void fnSchedulerAbort(PollScheduler *pstScheduler)
+{
+    pstScheduler->wCurrent = -1;
+    pstScheduler->wRetry = -1;
+}
+
+/**
+ * Advance the schedule
+ * @return The probe to poll now, or NULL if nothing is due yet
+ */
+AtgProbe *fnSchedulerPoll(PollScheduler *pstScheduler, double dbNow)
+{
+    ProbeRegistry *pstRegistry = pstScheduler->pstRegistry;
+
+    if (pstRegistry->wCount == 0)
+    {
+        return NULL;
+    }
+
+    // Outstanding poll: give up once its timeout has passed
+    if (pstScheduler->wCurrent >= 0)
+    {
+        if (dbNow < fnSchedulerNextDeadline(pstScheduler))
+        {
+            return NULL;
+        }
+        fnSchedulerOnTimeout(pstScheduler, dbNow);
+    }
+
+    if (dbNow < fnSchedulerNextDeadline(pstScheduler))
+    {
+        return NULL;
+    }
+
+    // A pending retry goes first, otherwise the probe that has been due longest
+    int wIndex = pstScheduler->wRetry;
+    pstScheduler->wRetry = -1;
+    if (wIndex < 0)
+    {
+        wIndex = pstScheduler->pwHeap[0];
+    }
+
+    AtgProbe *pstProbe = &pstRegistry->pstProbes[wIndex];
+    pstScheduler->wCurrent = wIndex;
+    pstScheduler->dbSentAt = dbNow;
+    pstScheduler->u32Polls++;
+    pstProbe->u32Polls++;
+    fnStatsProbePoll(pstProbe->address);
+    pstProbe->dbLastPollAt = dbNow;
+    fnSchedulerSetDue(pstScheduler, pstProbe, dbNow + pstProbe->dbPollIntervalMs);
+    return pstProbe;
+}
+
+/**
+ * Record when the poll command finished transmitting (start of the response wait)
+ */
+void fnSchedulerOnSent(PollScheduler *pstScheduler, double dbNow)
+{
+    pstScheduler->dbSentAt = dbNow;
+}
+
+/**
+ * A complete frame arrived on the bus
+ * @param pstProbe Probe the frame came from, NULL if it could not be attributed
+ */
+void fnSchedulerOnFrame(PollScheduler *pstScheduler, AtgProbe *pstProbe, double dbNow)
+{
+    if (pstScheduler->wCurrent < 0)
+    {
+        return;
+    }
+
+    // A late answer from a probe that already timed out; keep waiting for ours
+    AtgProbe *pstExpected = &pstScheduler->pstRegistry->pstProbes[pstScheduler->wCurrent];
+    if (pstProbe != NULL && pstProbe != pstExpected)
+    {
+        return;
+    }
+
+    if (pstProbe == pstExpected)
+    {
+        double dbRtt = dbNow - pstScheduler->dbSentAt;
+        if (pstProbe->u32RttSamples == 0)
+        {
+            pstProbe->dbSrttMs = dbRtt;
+            pstProbe->dbRttVarMs = dbRtt / 2.0;
+        }
+        else
+        {
+            double dbError = dbRtt - pstProbe->dbSrttMs;
+            pstProbe->dbSrttMs += dbError / 8.0;
+            pstProbe->dbRttVarMs += (fabs(dbError) - pstProbe->dbRttVarMs) / 4.0;
+        }
+        pstProbe->u32RttSamples++;
+        pstProbe->u32Responses++;
+        pstScheduler->u32Responses++;
+        fnStatsProbeResponse(pstProbe->address, dbRtt);
+
+        // Any answer clears the failure history and returns to the normal rate
+        if (pstProbe->eCommState == PROBE_COMM_OFFLINE)
+        {
+            printf("Probe %s back online\n", pstProbe->achAddress);
+            fnSchedulerSetDue(pstScheduler, pstProbe, pstProbe->dbLastPollAt + pstProbe->dbPollIntervalMs);
+        }
+        pstProbe->u8Failures = 0;
+        pstProbe->dbBackoffMs = 0;
+        fnSchedulerSetCommState(pstScheduler, pstProbe, PROBE_COMM_ONLINE);
+    }
+
+    // Ours (or unreadable, which is most likely ours): the bus is quiet again
+    pstScheduler->wCurrent = -1;
+    pstScheduler->dbBusFreeAt = dbNow + pstScheduler->stConfig.dbTurnaroundMs;
+}
+
+/**
+ * Adapt a probe's poll interval to how fast its raw readings are moving
+ * Call before pstProbe->stRaw is overwritten with the new reading.
+ */
+void fnSchedulerOnReading(PollScheduler *pstScheduler, AtgProbe *pstProbe, const AtgData *pstReading, double dbNow)
+{
+    double dbMin = fnProbeMinInterval(pstScheduler, pstProbe);
+    double dbMax = fnProbeMaxInterval(pstScheduler, pstProbe);
+    double dbSince = dbNow - pstProbe->dbLastReadingAt;
+    bool bFirst = (pstProbe->dbLastReadingAt <= 0);
+
+    pstProbe->dbLastReadingAt = dbNow;
+    if (bFirst || dbSince <= 0)
+    {
+        return;
+    }
+
+    const AtgData *pstPrevious = &pstProbe->stRaw;
+    double dbTarget = dbMax;
+
+    if (pstReading->status != pstPrevious->status)
+    {
+        dbTarget = dbMin;
+    }
+    else
+    {
+        // Time for each channel to move by its publish threshold at the current rate
+        double adbDelta[3] = {
+            fabs(pstReading->temperature - pstPrevious->temperature),
+            fabs(pstReading->product - pstPrevious->product),
+            fabs((double)(pstReading->water - pstPrevious->water))};
+        double adbThreshold[3] = {pstProbe->fTempThreshold, pstProbe->fProductThreshold, pstProbe->fWaterThreshold};
+
+        for (int i = 0; i < 3; i++)
+        {
+            if (adbDelta[i] > 0)
+            {
+                double dbCross = adbThreshold[i] * dbSince / adbDelta[i];
+                if (dbCross < dbTarget)
+                    dbTarget = dbCross;
+            }
+        }
+    }
+
+    if (dbTarget < dbMin)
+        dbTarget = dbMin;
+
+    // Speed up at once, slow down gradually
+    double dbInterval = pstProbe->dbPollIntervalMs;
+    if (dbTarget < dbInterval)
+    {
+        dbInterval = dbTarget;
+    }
+    else
+    {
+        dbInterval *= pstScheduler->stConfig.dbGrowth;
+        if (dbInterval > dbTarget)
+            dbInterval = dbTarget;
+    }
+    if (dbInterval < dbMin)
+        dbInterval = dbMin;
+    if (dbInterval > dbMax)
+        dbInterval = dbMax;
+
+    // Only report moves of 10% or more
+    bool bReport = fabs(dbInterval - pstProbe->dbPollIntervalMs) >= 0.1 * pstProbe->dbPollIntervalMs;
+    pstProbe->dbPollIntervalMs = dbInterval;
+    fnSchedulerSetDue(pstScheduler, pstProbe, pstProbe->dbLastPollAt + dbInterval);
+    if (bReport)
+    {
+        fnSchedulerNotify(pstScheduler, pstProbe);
+    }
+}
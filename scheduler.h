@@ -0,0 +1,68 @@
+/**
+ * ATG Poll Scheduler
+ * Response-driven, adaptive-rate polling of the probes on one bus
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "atg.h"
+#include "registry.h"
+
+typedef struct {
+    double dbTurnaroundMs;  // Idle gap between a response and the next poll
+    double dbMinTimeoutMs;  // Lower bound of the learned response timeout
+    double dbMaxTimeoutMs;  // Timeout before a probe has answered at all
+    double dbMinIntervalMs; // Fastest per-probe poll interval
+    double dbMaxIntervalMs; // Slowest per-probe poll interval
+    double dbGrowth;        // Interval multiplier per unchanged reading
+    int wRetries;           // Immediate retries before a probe is marked offline
+    double dbBackoffMinMs;  // First re-probe interval once offline
+    double dbBackoffMaxMs;  // Cap for the doubling re-probe interval
+} SchedulerConfig;
+
+// Called whenever a probe's communication state or poll interval changes
+typedef void (*ProbeStatusHandler)(AtgProbe *pstProbe, void *pvContext);
+
+typedef struct {
+    SchedulerConfig stConfig;
+    ProbeRegistry *pstRegistry;
+
+    int wCurrent;       // Probe awaiting a response, -1 when the bus is idle
+    int wRetry;         // Probe to retry before anything else, -1 if none
+    double dbSentAt;    // When the outstanding poll finished transmitting
+    double dbBusFreeAt; // Earliest time the next poll may go out
+
+    // Min-heap of probe slots ordered by dbNextPollAt
+    int *pwHeap;
+    int *pwHeapPos;
+
+    ProbeStatusHandler fnOnStatus;
+    void *pvStatusContext;
+
+    // Counters
+    uint32_t u32Polls;
+    uint32_t u32Responses;
+    uint32_t u32Timeouts;
+} PollScheduler;
+
+void fnSchedulerConfigDefaults(SchedulerConfig *pstConfig);
+int fnSchedulerLoadConfig(SchedulerConfig *pstConfig, const char *achPath);
+int fnSchedulerInit(PollScheduler *pstScheduler, const SchedulerConfig *pstConfig, ProbeRegistry *pstRegistry);
+int fnSchedulerRebuild(PollScheduler *pstScheduler, const SchedulerConfig *pstConfig, ProbeRegistry *pstRegistry);
+void fnSchedulerFree(PollScheduler *pstScheduler);
+void fnSchedulerSetStatusHandler(PollScheduler *pstScheduler, ProbeStatusHandler fnHandler, void *pvContext);
+
+AtgProbe *fnSchedulerPoll(PollScheduler *pstScheduler, double dbNow);
+void fnSchedulerOnSent(PollScheduler *pstScheduler, double dbNow);
+void fnSchedulerOnFrame(PollScheduler *pstScheduler, AtgProbe *pstProbe, double dbNow);
+void fnSchedulerOnReading(PollScheduler *pstScheduler, AtgProbe *pstProbe, const AtgData *pstReading, double dbNow);
+double fnSchedulerNextDeadline(const PollScheduler *pstScheduler);
+bool fnSchedulerIdle(const PollScheduler *pstScheduler);
+bool fnSchedulerInFlight(const PollScheduler *pstScheduler);
+void fnSchedulerAbort(PollScheduler *pstScheduler);
+double fnSchedulerTimeoutMs(const PollScheduler *pstScheduler, const AtgProbe *pstProbe);
+
+#endif
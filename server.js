@@ -7,6 +7,7 @@ const multer = require('multer')
 const mqtt = require('mqtt')
 const { Pool } = require('pg')
 const { parseDipChart } = require('./dip_parser')
+const { PACKED_MAGIC, decodePackedPayload } = require('./packed_payload')
 
 // Configuration
 const MQTT_BROKER_URL = 'mqtt://localhost:1883'
@@ -109,6 +110,56 @@ async function initDB() {
         console.log('Alarms table check:', e.message);
       }
 
+      // Create tank_rollups table: per-window summaries computed by the poller
+      // (<topic>/summary), one row per tank, window length and window start
+      try {
+        await client.query(`
+          CREATE TABLE IF NOT EXISTS tank_rollups (
+            bucket TIMESTAMPTZ NOT NULL,
+            tank_id TEXT NOT NULL,
+            window_s INTEGER NOT NULL,
+            sample_count INTEGER,
+            avg_product DOUBLE PRECISION,
+            min_product DOUBLE PRECISION,
+            max_product DOUBLE PRECISION,
+            avg_water DOUBLE PRECISION,
+            avg_temp DOUBLE PRECISION,
+            avg_volume DOUBLE PRECISION,
+            min_volume DOUBLE PRECISION,
+            max_volume DOUBLE PRECISION,
+            volume_rate_per_min DOUBLE PRECISION,
+            summary JSONB,
+            PRIMARY KEY (tank_id, window_s, bucket)
+          );
+        `);
+        console.log('Rollups table configured');
+      } catch (e) {
+        console.log('Rollups table check:', e.message);
+      }
+
+      // Create tank_events table: deliveries, losses and water ingress
+      // detected by the poller (<topic>/event)
+      try {
+        await client.query(`
+          CREATE TABLE IF NOT EXISTS tank_events (
+            start_time TIMESTAMPTZ NOT NULL,
+            tank_id TEXT NOT NULL,
+            event_type TEXT NOT NULL,
+            detected_at TIMESTAMPTZ,
+            end_time TIMESTAMPTZ,
+            start_level DOUBLE PRECISION,
+            end_level DOUBLE PRECISION,
+            start_volume DOUBLE PRECISION,
+            end_volume DOUBLE PRECISION,
+            volume DOUBLE PRECISION,
+            PRIMARY KEY (tank_id, event_type, start_time)
+          );
+        `);
+        console.log('Events table configured');
+      } catch (e) {
+        console.log('Events table check:', e.message);
+      }
+
       // Create tank_config table for storing tank settings
       try {
         await client.query(`
@@ -816,6 +867,12 @@ app.get('/api/calibrations/cache', (req, res) => {
   res.json({ success: true, cache: calibrationCache });
 });
 
+// Latest runtime statistics published by each poller, keyed by station
+const pollerStats = {};
+app.get('/api/poller-stats', (req, res) => {
+  res.json({ success: true, stats: pollerStats });
+});
+
 io.on('connection', (socket) => {
   console.log('Web Client connected', socket.id, 'clients:', io.sockets.sockets.size);
   socket.on('disconnect', () => {
@@ -914,76 +971,226 @@ if (ENABLE_MQTT) {
       if (!err) console.log('Subscribed to + (Root Single Level)');
       else console.error('Subscription error:', err);
     });
+    // Per-window summaries from pollers with [rollup] enabled
+    mqttClient.subscribe('+/summary', (err) => {
+      if (err) console.error('Subscription error:', err);
+    });
+    // Deliveries, losses and water ingress detected by the pollers
+    mqttClient.subscribe('+/event', (err) => {
+      if (err) console.error('Subscription error:', err);
+    });
+    // Alarms raised and cleared by the pollers' own limits
+    mqttClient.subscribe('+/alarm', (err) => {
+      if (err) console.error('Subscription error:', err);
+    });
+    // Retained runtime statistics of each poller ([stats] section)
+    mqttClient.subscribe('+/stats', (err) => {
+      if (err) console.error('Subscription error:', err);
+    });
   });
 
-  mqttClient.on('message', async (topic, message) => {
-    const payloadStr = message.toString();
-    // Debug log
-    console.log(`Received message on ${topic}: ${payloadStr.substring(0, 50)}...`);
+  // Store one window summary; a journal replay may deliver it twice
+  async function handleSummary(topic, data) {
+    const tankId = topic.slice(0, -'/summary'.length);
+    const product = data.Product || {};
+    const volume = data.Volume || {};
+    try {
+      await pool.query(
+        `INSERT INTO tank_rollups (bucket, tank_id, window_s, sample_count, avg_product, min_product, max_product,
+                                   avg_water, avg_temp, avg_volume, min_volume, max_volume, volume_rate_per_min, summary)
+                   VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9, $10, $11, $12, $13, $14)
+                   ON CONFLICT (tank_id, window_s, bucket) DO NOTHING`,
+        [
+          new Date(data.Start),
+          tankId,
+          data.WindowS,
+          data.Count,
+          product.Mean,
+          product.Min,
+          product.Max,
+          data.Water ? data.Water.Mean : null,
+          data.Temp ? data.Temp.Mean : null,
+          volume.Mean,
+          volume.Min,
+          volume.Max,
+          volume.RatePerMin,
+          data
+        ]
+      );
+    } catch (dbErr) {
+      console.error('Rollup Insert Error:', dbErr.message);
+    }
+    io.emit('mqtt_summary', { topic: tankId, payload: data });
+  }
 
+  // Store one tank event; a journal replay may deliver it twice
+  async function handleEvent(topic, data) {
+    const tankId = topic.slice(0, -'/event'.length);
     try {
-      let data = JSON.parse(payloadStr);
+      await pool.query(
+        `INSERT INTO tank_events (start_time, tank_id, event_type, detected_at, end_time, start_level, end_level,
+                                  start_volume, end_volume, volume)
+                   VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9, $10)
+                   ON CONFLICT (tank_id, event_type, start_time) DO NOTHING`,
+        [
+          new Date(data.Start),
+          tankId,
+          data.Event,
+          new Date(data.Timestamp),
+          data.End ? new Date(data.End) : null,
+          data.StartLevel,
+          data.EndLevel !== undefined ? data.EndLevel : null,
+          data.StartVolume !== undefined ? data.StartVolume : null,
+          data.EndVolume !== undefined ? data.EndVolume : null,
+          data.Volume !== undefined ? data.Volume : null
+        ]
+      );
+    } catch (dbErr) {
+      console.error('Event Insert Error:', dbErr.message);
+    }
+    console.log(`[EVENT] ${tankId} ${data.Event}`);
+    io.emit('mqtt_event', { topic: tankId, payload: data });
+  }
 
-      // Process Data
-      if (data.Product !== undefined) {
-        // FIX: Use MQTT Topic as the unique ID to prevent overlap
-        const tankId = topic;
+  // Open or resolve the alarm a poller raised or cleared
+  async function handleAlarm(topic, data) {
+    const tankId = topic.slice(0, -'/alarm'.length);
+    const latencyMs = Date.now() - new Date(data.Timestamp).getTime();
+    console.log(`[ALARM] ${tankId} ${data.Alarm} ${data.Active ? 'raised' : 'cleared'} (${latencyMs} ms after the reading)`);
+    try {
+      if (data.Active) {
+        const existing = await pool.query(
+          'SELECT 1 FROM alarms WHERE tank_id = $1 AND alarm_type = $2 AND resolved = FALSE',
+          [tankId, data.Alarm]
+        );
+        if (existing.rows.length === 0) {
+          const alarmId = `ALM-${Date.now()}-${Math.random().toString(36).substr(2, 9)}`;
+          const message = `${data.Alarm.replace('_', ' ')} on Tank ${tankId}: Value ${data.Value} exceeded threshold ${data.Limit}`;
+          await pool.query(
+            `INSERT INTO alarms (alarm_id, tank_id, alarm_type, severity, current_value, threshold_value, message, created_at)
+             VALUES ($1, $2, $3, $4, $5, $6, $7, $8)`,
+            [alarmId, tankId, data.Alarm, data.Severity, data.Value, data.Limit, message, new Date(data.Timestamp)]
+          );
+        }
+      } else {
+        await pool.query(
+          `UPDATE alarms SET resolved = TRUE, resolved_at = $3
+           WHERE tank_id = $1 AND alarm_type = $2 AND resolved = FALSE`,
+          [tankId, data.Alarm, new Date(data.Timestamp)]
+        );
+      }
+    } catch (dbErr) {
+      console.error('Alarm Update Error:', dbErr.message);
+    }
+    io.emit('mqtt_alarm', { topic: tankId, payload: data });
+  }
 
-        // Get calibration offsets
-        const offsets = calibrationCache[tankId] || { product: 0, water: 0 };
+  // Store one reading and forward it to the UI; topic identifies the tank
+  async function handleReading(topic, data) {
+    // Process Data
+    if (data.Product !== undefined) {
+      // FIX: Use MQTT Topic as the unique ID to prevent overlap
+      const tankId = topic;
 
-        // Store RAW values in database (before calibration)
-        const rawProduct = parseFloat(data.Product) || 0;
-        const rawWater = parseFloat(data.Water) || 0;
+      // Get calibration offsets
+      const offsets = calibrationCache[tankId] || { product: 0, water: 0 };
 
-        // Apply calibration offsets for display
-        const calibratedProduct = Math.max(0, rawProduct - offsets.product);
-        const calibratedWater = Math.max(0, rawWater - offsets.water);
+      // Store RAW values in database (before calibration)
+      const rawProduct = parseFloat(data.Product) || 0;
+      const rawWater = parseFloat(data.Water) || 0;
 
-        // Debug: log calibration being applied
-        if (offsets.product !== 0 || offsets.water !== 0) {
-          console.log(`[CALIBRATION] Tank ${tankId}: Raw P=${rawProduct}, W=${rawWater} | Offset P=${offsets.product}, W=${offsets.water} | Calibrated P=${calibratedProduct}, W=${calibratedWater}`);
-        }
+      // Apply calibration offsets for display
+      const calibratedProduct = Math.max(0, rawProduct - offsets.product);
+      const calibratedWater = Math.max(0, rawWater - offsets.water);
 
-        // Calculate volume using calibrated product level
-        const volume = getVolume(tankId, rawProduct); // getVolume already applies offset internally
+      // Debug: log calibration being applied
+      if (offsets.product !== 0 || offsets.water !== 0) {
+        console.log(`[CALIBRATION] Tank ${tankId}: Raw P=${rawProduct}, W=${rawWater} | Offset P=${offsets.product}, W=${offsets.water} | Calibrated P=${calibratedProduct}, W=${calibratedWater}`);
+      }
 
-        // Store in DB (store RAW values for historical accuracy)
-        try {
-          const timestamp = data.Timestamp ? new Date(data.Timestamp) : new Date();
-          const productType = data.ProductType || 'Diesel';
+      // The poller computes Volume from the Product it publishes (after its
+      // [filter], when that is on) when it has the tank's dip chart; a
+      // calibration offset needs the server's lookup
+      const volume = (data.Volume !== undefined && offsets.product === 0)
+        ? data.Volume
+        : getVolume(tankId, rawProduct); // getVolume already applies offset internally
 
-          await pool.query(
-            `INSERT INTO sensor_data (time, tank_id, product_mm, water_mm, volume_l, temp_c, status, product_type)
-                       VALUES ($1, $2, $3, $4, $5, $6, $7, $8)`,
-            [
-              timestamp,
-              tankId,
-              rawProduct,      // Store raw value
-              rawWater,        // Store raw value
-              volume,          // Store calibrated volume
-              data.Temp || 0,
-              data.Status || '0',
-              productType
-            ]
-          );
-        } catch (dbErr) {
-          console.error('DB Insert Error:', dbErr.message);
-        }
+      // Store in DB (store RAW values for historical accuracy)
+      try {
+        const timestamp = data.Timestamp ? new Date(data.Timestamp) : new Date();
+        const productType = data.ProductType || 'Diesel';
+
+        await pool.query(
+          `INSERT INTO sensor_data (time, tank_id, product_mm, water_mm, volume_l, temp_c, status, product_type)
+                     VALUES ($1, $2, $3, $4, $5, $6, $7, $8)`,
+          [
+            timestamp,
+            tankId,
+            rawProduct,      // Store raw value
+            rawWater,        // Store raw value
+            volume,          // Store calibrated volume
+            data.Temp || 0,
+            data.Status || '0',
+            productType
+          ]
+        );
+      } catch (dbErr) {
+        console.error('DB Insert Error:', dbErr.message);
+      }
 
-        // Send CALIBRATED values to UI
-        data.Product = calibratedProduct;  // Calibrated product level
-        data.Water = calibratedWater;      // Calibrated water level
-        data.Volume = volume;              // Volume (already calibrated)
+      // Send CALIBRATED values to UI
+      data.Product = calibratedProduct;  // Calibrated product level
+      data.Water = calibratedWater;      // Calibrated water level
+      // StdVolume (15 C) keeps the poller's correction factor for a recalibrated volume
+      if (data.StdVolume !== undefined && data.Volume > 0 && volume !== data.Volume) {
+        data.StdVolume = Math.round(volume * (data.StdVolume / data.Volume) * 100) / 100;
+      }
+      data.Volume = volume;              // Volume (already calibrated)
 
-        // Broadcast to Web UI
-        io.emit('mqtt_message', {
-          topic: topic,
-          payload: data,
-          timestamp: new Date().toISOString()
-        });
+      // Broadcast to Web UI
+      io.emit('mqtt_message', {
+        topic: topic,
+        payload: data,
+        timestamp: new Date().toISOString()
+      });
+    }
+  }
+
+  mqttClient.on('message', async (topic, message) => {
+    const packed = message.length > 0 && message[0] === PACKED_MAGIC;
+    const payloadStr = packed ? `<${message.length} bytes packed>` : message.toString();
+    // Debug log
+    console.log(`Received message on ${topic}: ${payloadStr.substring(0, 50)}...`);
+
+    try {
+      let data = packed ? decodePackedPayload(message) : JSON.parse(payloadStr);
+
+      if (topic.endsWith('/summary')) {
+        await handleSummary(topic, data);
+        return;
+      }
+      if (topic.endsWith('/event')) {
+        await handleEvent(topic, data);
+        return;
+      }
+      if (topic.endsWith('/alarm')) {
+        await handleAlarm(topic, data);
+        return;
+      }
+      if (topic.endsWith('/stats')) {
+        pollerStats[topic.slice(0, -'/stats'.length)] = { ...data, ReceivedAt: new Date().toISOString() };
+        io.emit('mqtt_stats', { topic, payload: data });
+        return;
       }
 
+      // Batched station payload: one entry per reading, each naming its probe's topic
+      if (Array.isArray(data.Readings)) {
+        for (const reading of data.Readings) {
+          if (reading.Topic) await handleReading(reading.Topic, reading);
+        }
+      } else {
+        await handleReading(topic, data);
+      }
     } catch (e) {
       // Not JSON or error processing
     }
@@ -0,0 +1,137 @@
+/**
+ * Runtime Settings
+ *
+ * The probe list, per-probe thresholds and intervals, the [scheduler],
+ * [filter], [rollup], [events] and [alarms] sections and the dip charts can
+ * be reloaded without a restart (SIGHUP).
+ * They are loaded into one Settings snapshot that is never modified after
+ * it is published, and the current snapshot is a single atomic pointer:
+ *
+ *   1. The main thread loads and validates a complete new snapshot. On any
+ *      error the running configuration is kept.
+ *   2. It swaps the pointer and wakes the bus workers.
+ *   3. Each worker, at a point where no poll is outstanding, builds its own
+ *      probe list from the new snapshot, carrying over the runtime state of
+ *      probes that still exist, then records the generation it now uses.
+ *   4. Once every worker has moved on, nothing refers to the old snapshot
+ *      (the probes' chart pointers included) and the main thread frees it.
+ *
+ * Readers never take a lock and never see a partly loaded snapshot. The
+ * publish thread does not read the settings at all: queued readings carry
+ * their topic. Port, MQTT, batching and journal settings still need a
+ * restart.
+ */
+
+#include "settings.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+static _Atomic(Settings *) pstCurrent;
+static uint32_t u32LastGeneration; // Written by the main thread only
+
+/**
+ * Load the reloadable settings
+ * @param bInitial Startup: a missing file falls back to the compiled-in probe list
+ * @return New snapshot, or NULL on error (reported)
+ */
+Settings *fnSettingsLoad(const char *achPath, bool bInitial)
+{
+    Settings *pstSettings = (Settings *)calloc(1, sizeof(Settings));
+    if (pstSettings == NULL)
+    {
+        printf("ERROR: Out of memory loading the configuration\n");
+        return NULL;
+    }
+
+    int rc = fnRegistryLoad(&pstSettings->stRegistry, achPath);
+    if (rc == -1 && bInitial)
+    {
+        printf("Config %s not found, using compiled-in probe list\n", achPath);
+        rc = fnRegistryLoadDefaults(&pstSettings->stRegistry);
+    }
+    if (rc != 0)
+    {
+        printf("ERROR: Could not load probe configuration from %s\n", achPath);
+        free(pstSettings);
+        return NULL;
+    }
+    fnRegistryPrint(&pstSettings->stRegistry);
+    printf("\n");
+
+    if (fnSchedulerLoadConfig(&pstSettings->stScheduler, achPath) != 0)
+    {
+        printf("ERROR: Invalid [scheduler] section in %s\n", achPath);
+        fnSettingsFree(pstSettings);
+        return NULL;
+    }
+
+    if (fnFilterLoadConfig(&pstSettings->stFilter, achPath) != 0)
+    {
+        printf("ERROR: Invalid [filter] section in %s\n", achPath);
+        fnSettingsFree(pstSettings);
+        return NULL;
+    }
+
+    if (fnRollupLoadConfig(&pstSettings->stRollup, achPath) != 0)
+    {
+        printf("ERROR: Invalid [rollup] section in %s\n", achPath);
+        fnSettingsFree(pstSettings);
+        return NULL;
+    }
+
+    if (fnEventLoadConfig(&pstSettings->stEvents, achPath) != 0)
+    {
+        printf("ERROR: Invalid [events] section in %s\n", achPath);
+        fnSettingsFree(pstSettings);
+        return NULL;
+    }
+
+    if (fnAlarmLoadConfig(&pstSettings->stAlarms, achPath) != 0)
+    {
+        printf("ERROR: Invalid [alarms] section in %s\n", achPath);
+        fnSettingsFree(pstSettings);
+        return NULL;
+    }
+
+    DipChartConfig stChartConfig;
+    if (fnDipChartLoadConfig(&stChartConfig, achPath) != 0)
+    {
+        printf("ERROR: Invalid [charts] section in %s\n", achPath);
+        fnSettingsFree(pstSettings);
+        return NULL;
+    }
+    fnDipChartLoad(&pstSettings->stCharts, &stChartConfig);
+    fnDipChartAttach(&pstSettings->stCharts, &pstSettings->stRegistry);
+    return pstSettings;
+}
+
+void fnSettingsFree(Settings *pstSettings)
+{
+    if (pstSettings == NULL)
+    {
+        return;
+    }
+    fnRegistryFree(&pstSettings->stRegistry);
+    fnDipChartFree(&pstSettings->stCharts);
+    free(pstSettings);
+}
+
+/**
+ * Make a snapshot current and give it the next generation number
+ * @return The previous snapshot; free it only after every bus has
+ *         reached the new generation (see fnBusGeneration)
+ */
+Settings *fnSettingsPublish(Settings *pstSettings)
+{
+    pstSettings->u32Generation = ++u32LastGeneration;
+    return atomic_exchange_explicit(&pstCurrent, pstSettings, memory_order_acq_rel);
+}
+
+/**
+ * The current snapshot; valid until the caller reports a newer generation
+ */
+const Settings *fnSettingsCurrent(void)
+{
+    return atomic_load_explicit(&pstCurrent, memory_order_acquire);
+}
@@ -0,0 +1,36 @@
+/**
+ * Runtime Settings
+ * The reloadable part of the configuration, swapped as one snapshot
+ */
+
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "registry.h"
+#include "scheduler.h"
+#include "dipchart.h"
+#include "filter.h"
+#include "rollup.h"
+#include "events.h"
+#include "alarm.h"
+
+// Read-only once published; replaced as a whole by a reload
+typedef struct {
+    uint32_t u32Generation;     // 1 for the startup configuration, +1 per reload
+    ProbeRegistry stRegistry;   // Every configured probe (runtime fields unused)
+    SchedulerConfig stScheduler;
+    FilterConfig stFilter;
+    RollupConfig stRollup;
+    EventConfig stEvents;
+    AlarmConfig stAlarms;
+    DipChartSet stCharts;       // Referenced by the probes' pstChart
+} Settings;
+
+Settings *fnSettingsLoad(const char *achPath, bool bInitial);
+void fnSettingsFree(Settings *pstSettings);
+Settings *fnSettingsPublish(Settings *pstSettings);
+const Settings *fnSettingsCurrent(void);
+
+#endif
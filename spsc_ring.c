@@ -0,0 +1,110 @@
+/**
+ * Single-Producer/Single-Consumer Ring
+ *
+ * Exactly one thread may push and exactly one other thread may pop. Each
+ * side owns one free-running index and publishes it with release ordering;
+ * the other side reads it with acquire ordering. Each side also keeps a
+ * cached copy of the opposite index, so the shared cache line is only
+ * touched when the ring looks full (producer) or empty (consumer).
+ *
+ * Overflow policy: a push into a full ring is rejected and counted in
+ * u32Dropped. Records already queued are never overwritten, because the
+ * producer cannot safely reclaim a slot the consumer may be reading.
+ */
+
+#include "spsc_ring.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Allocate the slots of a ring
+ * @param pstRing Ring to initialize
+ * @param szRecord Size of one record in bytes
+ * @param u32Capacity Minimum number of records, rounded up to a power of two
+ * @return 0 on success, -1 if out of memory
+ */
+int fnRingInit(SpscRing *pstRing, size_t szRecord, uint32_t u32Capacity)
+{
+    uint32_t u32Slots = 1;
+    while (u32Slots < u32Capacity)
+    {
+        u32Slots <<= 1;
+    }
+
+    memset(pstRing, 0, sizeof(SpscRing));
+    pstRing->pu8Slots = (uint8_t *)malloc(szRecord * u32Slots);
+    if (pstRing->pu8Slots == NULL)
+    {
+        return -1;
+    }
+    pstRing->szRecord = szRecord;
+    pstRing->u32Mask = u32Slots - 1;
+    atomic_init(&pstRing->u32Head, 0);
+    atomic_init(&pstRing->u32Tail, 0);
+    atomic_init(&pstRing->u32Pushed, 0);
+    atomic_init(&pstRing->u32Dropped, 0);
+    return 0;
+}
+
+void fnRingFree(SpscRing *pstRing)
+{
+    free(pstRing->pu8Slots);
+    pstRing->pu8Slots = NULL;
+}
+
+/**
+ * Copy a record into the ring (producer thread only)
+ * @return true if queued, false if the ring was full and the record was dropped
+ */
+bool fnRingPush(SpscRing *pstRing, const void *pvRecord)
+{
+    uint32_t u32Head = atomic_load_explicit(&pstRing->u32Head, memory_order_relaxed);
+
+    if (u32Head - pstRing->u32CachedTail > pstRing->u32Mask)
+    {
+        pstRing->u32CachedTail = atomic_load_explicit(&pstRing->u32Tail, memory_order_acquire);
+        if (u32Head - pstRing->u32CachedTail > pstRing->u32Mask)
+        {
+            atomic_fetch_add_explicit(&pstRing->u32Dropped, 1, memory_order_relaxed);
+            return false;
+        }
+    }
+
+    memcpy(pstRing->pu8Slots + (size_t)(u32Head & pstRing->u32Mask) * pstRing->szRecord, pvRecord,
+           pstRing->szRecord);
+    atomic_store_explicit(&pstRing->u32Head, u32Head + 1, memory_order_release);
+    atomic_fetch_add_explicit(&pstRing->u32Pushed, 1, memory_order_relaxed);
+    return true;
+}
+
+/**
+ * Copy the oldest record out of the ring (consumer thread only)
+ * @return true if a record was returned, false if the ring was empty
+ */
+bool fnRingPop(SpscRing *pstRing, void *pvRecord)
+{
+    uint32_t u32Tail = atomic_load_explicit(&pstRing->u32Tail, memory_order_relaxed);
+
+    if (u32Tail == pstRing->u32CachedHead)
+    {
+        pstRing->u32CachedHead = atomic_load_explicit(&pstRing->u32Head, memory_order_acquire);
+        if (u32Tail == pstRing->u32CachedHead)
+        {
+            return false;
+        }
+    }
+
+    memcpy(pvRecord, pstRing->pu8Slots + (size_t)(u32Tail & pstRing->u32Mask) * pstRing->szRecord,
+           pstRing->szRecord);
+    atomic_store_explicit(&pstRing->u32Tail, u32Tail + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * Number of queued records; only a snapshot when called from a third thread
+ */
+uint32_t fnRingCount(SpscRing *pstRing)
+{
+    return atomic_load_explicit(&pstRing->u32Head, memory_order_acquire) -
+           atomic_load_explicit(&pstRing->u32Tail, memory_order_acquire);
+}
@@ -0,0 +1,40 @@
+/**
+ * Single-Producer/Single-Consumer Ring
+ * Bounded lock-free queue of fixed-size records between two threads
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Producer and consumer indices live on separate cache lines
+#define SPSC_CACHE_LINE 64
+
+typedef struct {
+    // Written by the producer only
+    _Alignas(SPSC_CACHE_LINE) atomic_uint u32Head; // Next slot to fill (free running)
+    uint32_t u32CachedTail;                       // Producer's last view of u32Tail
+    atomic_uint u32Pushed;                        // Records accepted
+    atomic_uint u32Dropped;                       // Records rejected because the ring was full
+
+    // Written by the consumer only
+    _Alignas(SPSC_CACHE_LINE) atomic_uint u32Tail; // Next slot to drain (free running)
+    uint32_t u32CachedHead;                       // Consumer's last view of u32Head
+
+    // Read-only after fnRingInit
+    _Alignas(SPSC_CACHE_LINE) uint8_t *pu8Slots;
+    size_t szRecord;
+    uint32_t u32Mask;
+} SpscRing;
+
+int fnRingInit(SpscRing *pstRing, size_t szRecord, uint32_t u32Capacity);
+void fnRingFree(SpscRing *pstRing);
+bool fnRingPush(SpscRing *pstRing, const void *pvRecord);
+bool fnRingPop(SpscRing *pstRing, void *pvRecord);
+uint32_t fnRingCount(SpscRing *pstRing);
+
+#endif
@@ -0,0 +1,426 @@
+/**
+ * Runtime Statistics
+ *
+ * Counters and latency histograms for every stage of the hot path: the
+ * poll write, first byte and complete frame after a poll, parsing, queueing
+ * the reading, and the broker's PUBACK. They are snapshotted every
+ * interval_s seconds by the publish thread and published retained on the
+ * [stats] topic, so poll intervals, baud rates and fleet capacity can be
+ * sized from measurements instead of guesses.
+ *
+ * Each thread that records gets a block of its own on first use, so every
+ * counter has a single writer and an update is a relaxed load and store on
+ * the thread's own cache lines: no lock, no atomic read-modify-write. The
+ * snapshot sums the blocks with relaxed loads; a snapshot may miss an
+ * update in flight, never double counts one. Threads beyond
+ * STATS_MAX_THREADS share a last block with atomic adds.
+ *
+ * Latencies go into log-linear histograms: exact below 8 us, then eight
+ * linear buckets per power of two, so any value up to 71 minutes lands in
+ * one of 240 buckets within 12.5%. Percentiles are read off the buckets of
+ * the last interval (the difference of two snapshots); counters are totals
+ * since start.
+ *
+ * Each probe also has poll, response and timeout counters, its summed
+ * response time and whether it is online, in a fixed open-addressed table
+ * keyed by address. A probe can move to another bus on a reload, so these
+ * use atomic adds; they change a few times per poll, not per byte. Gauges
+ * (journal depth, broker connection) are set by their owner. The metrics
+ * endpoint (metrics.c) reads all of it without stopping anyone.
+ */
+
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "main_linux.h"
+
+typedef struct {
+    _Alignas(64) atomic_uint au32Counters[STAT_COUNTERS];
+    atomic_uint aau32Buckets[STAT_STAGES][STATS_BUCKETS];
+    atomic_ullong au64SumUs[STAT_STAGES];
+} StatsBlock;
+
+// Counters of one probe; iKey is its address + 1, 0 while the slot is free
+typedef struct {
+    atomic_int iKey;
+    atomic_bool bOnline;
+    atomic_uint u32Polls;
+    atomic_uint u32Responses;
+    atomic_uint u32Timeouts;
+    atomic_ullong u64RttSumUs;
+} StatsProbe;
+
+static StatsBlock astBlocks[STATS_MAX_THREADS + 1]; // The last is shared
+static atomic_uint u32Threads;
+static _Thread_local StatsBlock *pstLocal = NULL;
+static atomic_ullong au64Gauges[STAT_GAUGES];
+static StatsProbe astProbes[STATS_MAX_PROBES];
+
+static StatsConfig stConfig = {true, STATS_INTERVAL_S, STATS_TOPIC};
+
+static const char *const aachCounterNames[STAT_COUNTERS] = {
+    "Polls", "Frames", "Rejected", "ChecksumMismatches", "Timeouts", "Queued", "QueueFull",
+    "Sent", "Acked", "PublishFailed", "Journaled", "Connects", "ConnectionsLost"};
+static const char *const aachStageNames[STAT_STAGES] = {"Tx", "FirstByte", "Frame", "Parse", "Enqueue", "Puback"};
+
+static int fnStatsConfigHandler(void *pvContext, const char *achSection, const char *achName,
+                                const char *achKey, const char *achValue, int wLine)
+{
+    StatsConfig *pstConfig = (StatsConfig *)pvContext;
+    (void)achName;
+
+    if (strcmp(achSection, "stats") != 0 || achKey[0] == '\0')
+    {
+        return 0;
+    }
+
+    if (strcmp(achKey, "enabled") == 0)
+    {
+        pstConfig->bEnabled = fnConfigParseBool(achValue);
+    }
+    else if (strcmp(achKey, "interval_s") == 0)
+    {
+        long lValue = strtol(achValue, NULL, 10);
+        if (lValue < 10 || lValue > 86400)
+        {
+            printf("Config line %d: interval_s must be 10 to 86400\n", wLine);
+            return -1;
+        }
+        pstConfig->u32IntervalS = (uint32_t)lValue;
+    }
+    else if (strcmp(achKey, "topic") == 0)
+    {
+        if (achValue[0] == '\0' || strlen(achValue) >= sizeof(pstConfig->achTopic))
+        {
+            printf("Config line %d: invalid stats topic\n", wLine);
+            return -1;
+        }
+        strcpy(pstConfig->achTopic, achValue);
+    }
+    else
+    {
+        printf("Config line %d: unknown stats key '%s' ignored\n", wLine, achKey);
+    }
+    return 0;
+}
+
+/**
+ * Read the [stats] section of the configuration file
+ * @return 0 on success or if the file does not exist, non-zero on a bad value
+ */
+int fnStatsLoadConfig(const char *achPath)
+{
+    StatsConfig stNew = {true, STATS_INTERVAL_S, STATS_TOPIC};
+    int rc = fnConfigParse(achPath, fnStatsConfigHandler, &stNew);
+    if (rc > 0)
+    {
+        return rc;
+    }
+    stConfig = stNew;
+    return 0;
+}
+
+const StatsConfig *fnStatsConfig(void)
+{
+    return &stConfig;
+}
+
+const char *fnStatsCounterName(StatCounter eCounter)
+{
+    return aachCounterNames[eCounter];
+}
+
+const char *fnStatsStageName(StatStage eStage)
+{
+    return aachStageNames[eStage];
+}
+
+// The calling thread's block, claimed on its first update
+static inline StatsBlock *fnStatsBlock(void)
+{
+    if (pstLocal == NULL)
+    {
+        unsigned u32Index = atomic_fetch_add_explicit(&u32Threads, 1, memory_order_relaxed);
+        pstLocal = &astBlocks[(u32Index < STATS_MAX_THREADS) ? u32Index : STATS_MAX_THREADS];
+    }
+    return pstLocal;
+}
+
+static inline void fnStatsBump(StatsBlock *pstBlock, atomic_uint *pu32Value)
+{
+    if (pstBlock == &astBlocks[STATS_MAX_THREADS])
+        atomic_fetch_add_explicit(pu32Value, 1, memory_order_relaxed);
+    else
+        atomic_store_explicit(pu32Value, atomic_load_explicit(pu32Value, memory_order_relaxed) + 1,
+                              memory_order_relaxed);
+}
+
+// Histogram bucket of a value in microseconds
+static inline int fnStatsBucket(uint32_t u32Us)
+{
+    if (u32Us < STATS_SUB_BUCKETS)
+    {
+        return (int)u32Us;
+    }
+    int wExponent = 31 - __builtin_clz(u32Us); // 3..31
+    return (wExponent - 2) * STATS_SUB_BUCKETS + (int)((u32Us >> (wExponent - 3)) & (STATS_SUB_BUCKETS - 1));
+}
+
+// Smallest value in a bucket, and the bucket's width
+static double fnStatsBucketLow(int wBucket, double *pdbWidth)
+{
+    if (wBucket < STATS_SUB_BUCKETS)
+    {
+        *pdbWidth = 1;
+        return wBucket;
+    }
+    int wExponent = wBucket / STATS_SUB_BUCKETS + 2;
+    double dbStep = (double)(1u << (wExponent - 3));
+    *pdbWidth = dbStep;
+    return (STATS_SUB_BUCKETS + wBucket % STATS_SUB_BUCKETS) * dbStep;
+}
+
+/**
+ * First value above a histogram bucket, in microseconds
+ */
+double fnStatsBucketUpperUs(int wBucket)
+{
+    double dbWidth;
+    double dbLow = fnStatsBucketLow(wBucket, &dbWidth);
+    return dbLow + dbWidth;
+}
+
+/**
+ * Count one occurrence
+ */
+void fnStatsCount(StatCounter eCounter)
+{
+    StatsBlock *pstBlock = fnStatsBlock();
+    fnStatsBump(pstBlock, &pstBlock->au32Counters[eCounter]);
+}
+
+/**
+ * Record one latency of a stage
+ * @param dbMs Duration in milliseconds
+ */
+void fnStatsRecord(StatStage eStage, double dbMs)
+{
+    double dbUs = dbMs * 1000.0;
+    uint32_t u32Us = (dbUs <= 0) ? 0 : (dbUs >= 4294967295.0) ? UINT32_MAX : (uint32_t)dbUs;
+    StatsBlock *pstBlock = fnStatsBlock();
+
+    fnStatsBump(pstBlock, &pstBlock->aau32Buckets[eStage][fnStatsBucket(u32Us)]);
+    if (pstBlock == &astBlocks[STATS_MAX_THREADS])
+        atomic_fetch_add_explicit(&pstBlock->au64SumUs[eStage], u32Us, memory_order_relaxed);
+    else
+        atomic_store_explicit(&pstBlock->au64SumUs[eStage],
+                              atomic_load_explicit(&pstBlock->au64SumUs[eStage], memory_order_relaxed) + u32Us,
+                              memory_order_relaxed);
+}
+
+void fnStatsSetGauge(StatGauge eGauge, uint64_t u64Value)
+{
+    atomic_store_explicit(&au64Gauges[eGauge], u64Value, memory_order_relaxed);
+}
+
+uint64_t fnStatsGauge(StatGauge eGauge)
+{
+    return atomic_load_explicit(&au64Gauges[eGauge], memory_order_relaxed);
+}
+
+// The probe's slot, claimed on first use; NULL once the table is full
+static StatsProbe *fnStatsProbe(int address)
+{
+    int iKey = address + 1;
+    uint32_t u32Slot = ((uint32_t)address * 2654435761u) % STATS_MAX_PROBES;
+
+    for (int i = 0; i < STATS_MAX_PROBES; i++)
+    {
+        StatsProbe *pstProbe = &astProbes[(u32Slot + i) % STATS_MAX_PROBES];
+        int iSeen = atomic_load_explicit(&pstProbe->iKey, memory_order_acquire);
+        if (iSeen == 0)
+        {
+            int iFree = 0;
+            if (atomic_compare_exchange_strong(&pstProbe->iKey, &iFree, iKey))
+                return pstProbe;
+            iSeen = iFree; // Claimed meanwhile, possibly for this address
+        }
+        if (iSeen == iKey)
+            return pstProbe;
+    }
+    return NULL;
+}
+
+void fnStatsProbePoll(int address)
+{
+    StatsProbe *pstProbe = fnStatsProbe(address);
+    if (pstProbe != NULL)
+        atomic_fetch_add_explicit(&pstProbe->u32Polls, 1, memory_order_relaxed);
+}
+
+void fnStatsProbeResponse(int address, double dbRttMs)
+{
+    StatsProbe *pstProbe = fnStatsProbe(address);
+    if (pstProbe != NULL)
+    {
+        atomic_fetch_add_explicit(&pstProbe->u32Responses, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&pstProbe->u64RttSumUs, (dbRttMs > 0) ? (uint64_t)(dbRttMs * 1000.0) : 0,
+                                  memory_order_relaxed);
+    }
+}
+
+void fnStatsProbeTimeout(int address)
+{
+    StatsProbe *pstProbe = fnStatsProbe(address);
+    if (pstProbe != NULL)
+        atomic_fetch_add_explicit(&pstProbe->u32Timeouts, 1, memory_order_relaxed);
+}
+
+void fnStatsProbeOnline(int address, bool bOnline)
+{
+    StatsProbe *pstProbe = fnStatsProbe(address);
+    if (pstProbe != NULL)
+        atomic_store_explicit(&pstProbe->bOnline, bOnline, memory_order_relaxed);
+}
+
+/**
+ * Copy the counters of every probe seen so far
+ * @return Number of probes copied, at most wMax
+ */
+int fnStatsCollectProbes(StatsProbeCounts *pstCounts, int wMax)
+{
+    int wCount = 0;
+    for (int i = 0; i < STATS_MAX_PROBES && wCount < wMax; i++)
+    {
+        const StatsProbe *pstProbe = &astProbes[i];
+        int iKey = atomic_load_explicit(&pstProbe->iKey, memory_order_acquire);
+        if (iKey == 0)
+        {
+            continue;
+        }
+        StatsProbeCounts *pstOut = &pstCounts[wCount++];
+        pstOut->address = iKey - 1;
+        pstOut->bOnline = atomic_load_explicit(&pstProbe->bOnline, memory_order_relaxed);
+        pstOut->u32Polls = atomic_load_explicit(&pstProbe->u32Polls, memory_order_relaxed);
+        pstOut->u32Responses = atomic_load_explicit(&pstProbe->u32Responses, memory_order_relaxed);
+        pstOut->u32Timeouts = atomic_load_explicit(&pstProbe->u32Timeouts, memory_order_relaxed);
+        pstOut->u64RttSumUs = atomic_load_explicit(&pstProbe->u64RttSumUs, memory_order_relaxed);
+    }
+    return wCount;
+}
+
+/**
+ * Add up every thread's counters and histograms
+ */
+void fnStatsCollect(StatsSnapshot *pstSnapshot)
+{
+    memset(pstSnapshot, 0, sizeof(StatsSnapshot));
+    unsigned u32Used = atomic_load_explicit(&u32Threads, memory_order_relaxed);
+    int wBlocks = (u32Used < STATS_MAX_THREADS) ? (int)u32Used : STATS_MAX_THREADS + 1;
+
+    for (int b = 0; b < wBlocks; b++)
+    {
+        StatsBlock *pstBlock = &astBlocks[b];
+        for (int i = 0; i < STAT_COUNTERS; i++)
+        {
+            pstSnapshot->au64Counters[i] += atomic_load_explicit(&pstBlock->au32Counters[i], memory_order_relaxed);
+        }
+        for (int s = 0; s < STAT_STAGES; s++)
+        {
+            for (int i = 0; i < STATS_BUCKETS; i++)
+            {
+                pstSnapshot->aau64Buckets[s][i] +=
+                    atomic_load_explicit(&pstBlock->aau32Buckets[s][i], memory_order_relaxed);
+            }
+            pstSnapshot->au64SumUs[s] += atomic_load_explicit(&pstBlock->au64SumUs[s], memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * Value below which dbFraction of the recorded latencies fall
+ * @return Microseconds (middle of the bucket), 0 if nothing was recorded
+ */
+double fnStatsPercentileUs(const uint64_t *pu64Buckets, uint64_t u64Count, double dbFraction)
+{
+    uint64_t u64Rank = (uint64_t)(dbFraction * u64Count + 0.999999);
+    uint64_t u64Seen = 0;
+    double dbWidth;
+
+    if (u64Count == 0)
+    {
+        return 0;
+    }
+    if (u64Rank < 1)
+    {
+        u64Rank = 1;
+    }
+    for (int i = 0; i < STATS_BUCKETS; i++)
+    {
+        u64Seen += pu64Buckets[i];
+        if (u64Seen >= u64Rank)
+        {
+            double dbLow = fnStatsBucketLow(i, &dbWidth);
+            return (dbWidth > 1) ? dbLow + dbWidth / 2 : dbLow;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Format a snapshot: counters since start, latencies since pstPrevious
+ * @return Payload length, or -1 if it did not fit
+ */
+int fnStatsFormat(char *achPayload, size_t szSize, const StatsSnapshot *pstNow, const StatsSnapshot *pstPrevious,
+                  double dbUptimeS)
+{
+    int wLength = snprintf(achPayload, szSize, "{\"UptimeS\":%.0f,\"IntervalS\":%u,\"Counters\":{", dbUptimeS,
+                           stConfig.u32IntervalS);
+
+    for (int i = 0; i < STAT_COUNTERS && wLength > 0 && (size_t)wLength < szSize; i++)
+    {
+        wLength += snprintf(achPayload + wLength, szSize - wLength, "%s\"%s\":%llu", (i > 0) ? "," : "",
+                            aachCounterNames[i], (unsigned long long)pstNow->au64Counters[i]);
+    }
+    if (wLength > 0 && (size_t)wLength < szSize)
+    {
+        wLength += snprintf(achPayload + wLength, szSize - wLength, "},\"Latency\":{");
+    }
+
+    for (int s = 0; s < STAT_STAGES && wLength > 0 && (size_t)wLength < szSize; s++)
+    {
+        uint64_t au64Buckets[STATS_BUCKETS];
+        uint64_t u64Count = 0;
+        int wHighest = -1;
+        for (int i = 0; i < STATS_BUCKETS; i++)
+        {
+            au64Buckets[i] = pstNow->aau64Buckets[s][i] - pstPrevious->aau64Buckets[s][i];
+            u64Count += au64Buckets[i];
+            if (au64Buckets[i] > 0)
+                wHighest = i;
+        }
+        uint64_t u64SumUs = pstNow->au64SumUs[s] - pstPrevious->au64SumUs[s];
+
+        // The largest value is known to its bucket; report the bucket's top
+        double dbWidth = 0;
+        double dbMaxUs = (wHighest >= 0) ? fnStatsBucketLow(wHighest, &dbWidth) + dbWidth - 1 : 0;
+
+        wLength += snprintf(achPayload + wLength, szSize - wLength,
+                            "%s\"%s\":{\"Count\":%llu,\"MeanUs\":%.0f,\"P50Us\":%.0f,\"P90Us\":%.0f,\"P99Us\":%.0f,"
+                            "\"MaxUs\":%.0f}",
+                            (s > 0) ? "," : "", aachStageNames[s], (unsigned long long)u64Count,
+                            u64Count ? (double)u64SumUs / u64Count : 0.0,
+                            fnStatsPercentileUs(au64Buckets, u64Count, 0.50),
+                            fnStatsPercentileUs(au64Buckets, u64Count, 0.90),
+                            fnStatsPercentileUs(au64Buckets, u64Count, 0.99), dbMaxUs);
+    }
+
+    if (wLength > 0 && (size_t)wLength + 2 < szSize)
+    {
+        wLength += snprintf(achPayload + wLength, szSize - wLength, "}}");
+        return wLength;
+    }
+    return -1;
+}
@@ -0,0 +1,99 @@
+/**
+ * Runtime Statistics
+ * Lock-free per-thread counters and latency histograms, snapshotted as JSON
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define STATS_MAX_THREADS 16    // Threads with a block of their own; more share one
+#define STATS_SUB_BUCKETS 8     // Linear steps per power of two (12.5% resolution)
+#define STATS_BUCKETS 240       // Covers 0 us to 2^32 us
+#define STATS_PAYLOAD_MAX 2048  // Largest formatted snapshot
+#define STATS_MAX_PROBES 1024   // Probes with counters of their own (REGISTRY_MAX_PROBES)
+
+typedef enum {
+    STAT_POLLS = 0,      // Poll commands sent
+    STAT_FRAMES,         // Responses parsed
+    STAT_REJECTED,       // Responses that failed to parse
+    STAT_MISMATCHED,     // Responses accepted although their checksum did not match
+    STAT_TIMEOUTS,       // Polls left unanswered
+    STAT_QUEUED,         // Readings queued for publishing
+    STAT_QUEUE_FULL,     // Readings deferred because their lane was full
+    STAT_SENT,           // Messages handed to the MQTT client
+    STAT_ACKED,          // PUBACKs received
+    STAT_PUBLISH_FAILED, // Messages refused or failed
+    STAT_JOURNALED,      // Messages written to the journal
+    STAT_CONNECTS,       // Broker connections established
+    STAT_CONNECTIONS_LOST,
+    STAT_COUNTERS
+} StatCounter;
+
+typedef enum {
+    STAT_TX = 0,     // Writing a poll command to the port
+    STAT_FIRST_BYTE, // Poll sent to first response byte
+    STAT_FRAME,      // Poll sent to complete response frame
+    STAT_PARSE,      // Parsing a response frame
+    STAT_ENQUEUE,    // Frame complete to reading queued for publishing
+    STAT_PUBACK,     // Message handed to the MQTT client to its PUBACK
+    STAT_STAGES
+} StatStage;
+
+// Current values, set by their owner
+typedef enum {
+    STAT_JOURNAL_DEPTH = 0, // Messages waiting in the journal
+    STAT_MQTT_CONNECTED,    // 1 while the broker connection is up
+    STAT_GAUGES
+} StatGauge;
+
+// Poll counters of one probe
+typedef struct {
+    int address;
+    bool bOnline;
+    uint32_t u32Polls;
+    uint32_t u32Responses;
+    uint32_t u32Timeouts;
+    uint64_t u64RttSumUs; // Poll to frame, over u32Responses
+} StatsProbeCounts;
+
+typedef struct {
+    bool bEnabled;
+    uint32_t u32IntervalS; // Between snapshots
+    char achTopic[96];     // Retained snapshot topic
+} StatsConfig;
+
+// Sum of every thread's block at one moment
+typedef struct {
+    uint64_t au64Counters[STAT_COUNTERS];
+    uint64_t aau64Buckets[STAT_STAGES][STATS_BUCKETS];
+    uint64_t au64SumUs[STAT_STAGES];
+} StatsSnapshot;
+
+int fnStatsLoadConfig(const char *achPath);
+const StatsConfig *fnStatsConfig(void);
+
+// Called from any thread; never blocks
+void fnStatsCount(StatCounter eCounter);
+void fnStatsRecord(StatStage eStage, double dbMs);
+void fnStatsSetGauge(StatGauge eGauge, uint64_t u64Value);
+void fnStatsProbePoll(int address);
+void fnStatsProbeResponse(int address, double dbRttMs);
+void fnStatsProbeTimeout(int address);
+void fnStatsProbeOnline(int address, bool bOnline);
+
+void fnStatsCollect(StatsSnapshot *pstSnapshot);
+uint64_t fnStatsGauge(StatGauge eGauge);
+int fnStatsCollectProbes(StatsProbeCounts *pstCounts, int wMax);
+double fnStatsBucketUpperUs(int wBucket);
+double fnStatsPercentileUs(const uint64_t *pu64Buckets, uint64_t u64Count, double dbFraction);
+const char *fnStatsCounterName(StatCounter eCounter);
+const char *fnStatsStageName(StatStage eStage);
+int fnStatsFormat(char *achPayload, size_t szSize, const StatsSnapshot *pstNow, const StatsSnapshot *pstPrevious,
+                  double dbUptimeS);
+
+#endif
@@ -0,0 +1,91 @@
+/**
+ * Probe Response Parser Benchmark
+ *
+ * Times fnParseAtgResponse over a mix of typical frames, next to the
+ * strstr/sscanf/strtof parser it replaced (kept below for comparison), and
+ * prints nanoseconds per frame. Build with the target's CFLAGS ("make
+ * bench") and run on the gateway itself for numbers that matter.
+ *
+ * Usage: atg_bench [frames]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "atg.h"
+
+static const char *const aachFrames[] = {
+    "83731N0=+253=1500.0=12.0=1314\r\n",
+    "R:83727N0=+187=812.3=0.0=1234\r\n",
+    "83728N0=+310=2400.125=5.5=1377\r\n",
+    "83729N0=+199=35.0=0.0=1185\r\n",
+};
+#define FRAME_COUNT ((int)(sizeof(aachFrames) / sizeof(aachFrames[0])))
+
+// The parser fnParseAtgResponse replaced, for comparison only
+static int fnParseSscanf(const char *achBuffer, AtgData *data)
+{
+    const char *start = strstr(achBuffer, "R:");
+    start = start ? start + 2 : achBuffer;
+
+    char waterStr[16];
+    int tempRaw;
+    int parsed = sscanf(start, "%5dN%d=+%d=%f=%[^=]=%d", &data->address, &data->status, &tempRaw, &data->product,
+                        waterStr, &data->checksum);
+    if (parsed != 6)
+        return 1;
+    data->temperature = tempRaw / 10.0f;
+    data->water = (int)strtof(waterStr, NULL);
+    return 0;
+}
+
+static double fnNowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Parse lFrames frames round-robin; returns ns per frame
+static double fnTime(int (*fnParse)(const char *, AtgData *), long lFrames, long *plAddressSum)
+{
+    AtgData stData;
+    long lSum = 0;
+    double dbStart = fnNowNs();
+    for (long n = 0; n < lFrames; n++)
+    {
+        if (fnParse(aachFrames[n % FRAME_COUNT], &stData) == 0)
+            lSum += stData.address;
+    }
+    *plAddressSum = lSum; // Keeps the loop from being optimized away
+    return (fnNowNs() - dbStart) / lFrames;
+}
+
+int main(int argc, char *argv[])
+{
+    long lFrames = (argc > 1) ? strtol(argv[1], NULL, 10) : 4000000;
+    long lSumOnePass, lSumSscanf;
+
+    // Every frame must parse cleanly, or the timing is of the error path
+    for (int i = 0; i < FRAME_COUNT; i++)
+    {
+        AtgData stData;
+        if (fnParseAtgResponse(aachFrames[i], &stData) != ATG_PARSE_OK || stData.checksum_mismatch)
+        {
+            printf("Benchmark frame %d does not parse\n", i);
+            return 1;
+        }
+    }
+    if (lFrames < FRAME_COUNT)
+        lFrames = FRAME_COUNT;
+
+    fnTime(fnParseAtgResponse, lFrames / 10, &lSumOnePass); // Warm up
+    double dbOnePass = fnTime(fnParseAtgResponse, lFrames, &lSumOnePass);
+    double dbSscanf = fnTime(fnParseSscanf, lFrames, &lSumSscanf);
+
+    printf("atg_bench: %ld frames\n", lFrames);
+    printf("  fnParseAtgResponse  %7.1f ns/frame\n", dbOnePass);
+    printf("  sscanf (replaced)   %7.1f ns/frame\n", dbSscanf);
+    return (lSumOnePass == lSumSscanf) ? 0 : 1;
+}
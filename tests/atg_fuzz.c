@@ -0,0 +1,284 @@
+/**
+ * Probe Response Fuzzer
+ *
+ * Mutates the frames in a seed corpus (tests/corpus/atg, one response per
+ * file) and feeds them to fnParseAtgResponse, built with AddressSanitizer
+ * and UndefinedBehaviorSanitizer by "make fuzz". Every input must:
+ *
+ *   - return an AtgParseResult with a name
+ *   - leave the output untouched unless the result is ATG_PARSE_OK
+ *   - when accepted, flag a checksum mismatch exactly when the byte sum from
+ *     the address through the last '=' differs from the checksum field
+ *
+ * Mutations are bit flips, protocol characters written, inserted or
+ * deleted, truncation and duplicated runs, from a fixed seed so a failure
+ * reproduces. The first violation is printed in hex and fails the run.
+ * Accepted mutants whose checksum still matched are only counted: an
+ * additive checksum cannot see every corruption.
+ *
+ * Usage: atg_fuzz <corpus dir> [iterations] [seed]
+ * With ATG_LIBFUZZER defined only LLVMFuzzerTestOneInput is built, for
+ * clang -fsanitize=fuzzer over the same corpus.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <dirent.h>
+#include "atg.h"
+
+#define FUZZ_MAX_FRAME 128
+#define FUZZ_MAX_SEEDS 256
+
+static const char achProtocolChars[] = "0123456789=+-.NR:\r\n";
+
+// Byte sum from the address through the last '=', as the parser should see it
+static uint32_t fnReferenceSum(const char *achFrame, int32_t *pi32Field)
+{
+    const char *pch = (achFrame[0] == 'R' && achFrame[1] == ':') ? achFrame + 2 : achFrame;
+    const char *pchLast = strrchr(pch, '=');
+    uint32_t u32Sum = 0;
+    for (const char *p = pch; p <= pchLast; p++)
+        u32Sum += (uint8_t)*p;
+    *pi32Field = atoi(pchLast + 1);
+    return u32Sum % 65536u;
+}
+
+/**
+ * Parse one input and check the invariants
+ * @param pstData Receives the reading when the frame is accepted
+ * @return The parse result, or -1 on a violation (already reported)
+ */
+static int fnFuzzOne(const uint8_t *pu8Data, size_t szLength, AtgData *pstData)
+{
+    char achFrame[FUZZ_MAX_FRAME + 1];
+    AtgData stData, stUntouched;
+
+    if (szLength > FUZZ_MAX_FRAME)
+        szLength = FUZZ_MAX_FRAME;
+    memcpy(achFrame, pu8Data, szLength);
+    achFrame[szLength] = '\0';
+
+    memset(&stUntouched, 0xA5, sizeof(stUntouched));
+    stData = stUntouched;
+    int wResult = fnParseAtgResponse(achFrame, &stData);
+
+    const char *achViolation = NULL;
+    if (wResult < ATG_PARSE_OK || wResult > ATG_PARSE_E_TRAILING ||
+        strcmp(fnAtgParseResultName(wResult), "unknown error") == 0)
+    {
+        achViolation = "result out of range";
+    }
+    else if (wResult != ATG_PARSE_OK && memcmp(&stData, &stUntouched, sizeof(AtgData)) != 0)
+    {
+        achViolation = "output written for a rejected frame";
+    }
+    else if (wResult == ATG_PARSE_OK)
+    {
+        int32_t i32Field;
+        bool bMismatch = (fnReferenceSum(achFrame, &i32Field) != (uint32_t)i32Field);
+        if (stData.checksum != i32Field || stData.checksum_mismatch != bMismatch)
+            achViolation = "checksum not checked as specified";
+        else if (stData.address < 0 || stData.status < 0 || stData.product < 0 || stData.water < 0)
+            achViolation = "negative field accepted";
+    }
+
+    if (achViolation != NULL)
+    {
+        printf("FAIL %s (result %d) on:", achViolation, wResult);
+        for (size_t i = 0; i < szLength; i++)
+            printf(" %02x", (uint8_t)achFrame[i]);
+        printf("\n");
+        return -1;
+    }
+    *pstData = stData;
+    return wResult;
+}
+
+#ifdef ATG_LIBFUZZER
+
+int LLVMFuzzerTestOneInput(const uint8_t *pu8Data, size_t szLength)
+{
+    AtgData stData;
+    if (fnFuzzOne(pu8Data, szLength, &stData) < 0)
+        abort();
+    return 0;
+}
+
+#else
+
+typedef struct {
+    char achName[256];
+    uint8_t au8Frame[FUZZ_MAX_FRAME];
+    size_t szLength;
+    bool bValid; // Accepted with a matching checksum
+    AtgData stData;
+} Seed;
+
+static Seed astSeeds[FUZZ_MAX_SEEDS];
+static int wSeeds = 0;
+static uint64_t u64State;
+
+static uint32_t fnRandom(uint32_t u32Below)
+{
+    // xorshift64*
+    u64State ^= u64State >> 12;
+    u64State ^= u64State << 25;
+    u64State ^= u64State >> 27;
+    return (uint32_t)((u64State * 2685821657736338717ULL) >> 32) % u32Below;
+}
+
+static uint8_t fnRandomChar(void)
+{
+    return fnRandom(4) ? (uint8_t)achProtocolChars[fnRandom(sizeof(achProtocolChars) - 1)] : (uint8_t)fnRandom(256);
+}
+
+static void fnMutate(uint8_t *pu8Frame, size_t *pszLength)
+{
+    size_t szLength = *pszLength;
+    size_t szAt = szLength ? fnRandom((uint32_t)szLength) : 0;
+
+    switch (fnRandom(6))
+    {
+    case 0: // Flip a bit
+        if (szLength)
+            pu8Frame[szAt] ^= (uint8_t)(1u << fnRandom(8));
+        break;
+    case 1: // Overwrite a byte
+        if (szLength)
+            pu8Frame[szAt] = fnRandomChar();
+        break;
+    case 2: // Insert a byte
+        if (szLength < FUZZ_MAX_FRAME)
+        {
+            memmove(pu8Frame + szAt + 1, pu8Frame + szAt, szLength - szAt);
+            pu8Frame[szAt] = fnRandomChar();
+            szLength++;
+        }
+        break;
+    case 3: // Delete a byte
+        if (szLength)
+        {
+            memmove(pu8Frame + szAt, pu8Frame + szAt + 1, szLength - szAt - 1);
+            szLength--;
+        }
+        break;
+    case 4: // Truncate
+        szLength = szAt;
+        break;
+    default: // Duplicate a run
+    {
+        size_t szRun = 1 + fnRandom(8);
+        if (szAt + szRun <= szLength && szLength + szRun <= FUZZ_MAX_FRAME)
+        {
+            memmove(pu8Frame + szAt + szRun, pu8Frame + szAt, szLength - szAt);
+            szLength += szRun;
+        }
+        break;
+    }
+    }
+    *pszLength = szLength;
+}
+
+// Seeds in name order, so a run with the same seed replays the same mutants
+static int fnLoadCorpus(const char *achDir)
+{
+    struct dirent **ppstEntries;
+    int wEntries = scandir(achDir, &ppstEntries, NULL, alphasort);
+    if (wEntries < 0)
+    {
+        printf("Cannot open corpus %s\n", achDir);
+        return -1;
+    }
+    for (int i = 0; i < wEntries; i++)
+    {
+        const char *achName = ppstEntries[i]->d_name;
+        char achPath[512];
+        snprintf(achPath, sizeof(achPath), "%s/%s", achDir, achName);
+        FILE *pFile = (achName[0] != '.' && wSeeds < FUZZ_MAX_SEEDS) ? fopen(achPath, "rb") : NULL;
+        if (pFile != NULL)
+        {
+            Seed *pstSeed = &astSeeds[wSeeds++];
+            snprintf(pstSeed->achName, sizeof(pstSeed->achName), "%s", achName);
+            pstSeed->szLength = fread(pstSeed->au8Frame, 1, sizeof(pstSeed->au8Frame), pFile);
+            fclose(pFile);
+        }
+        free(ppstEntries[i]);
+    }
+    free(ppstEntries);
+    return wSeeds > 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <corpus dir> [iterations] [seed]\n", argv[0]);
+        return 2;
+    }
+    long lIterations = (argc > 2) ? strtol(argv[2], NULL, 10) : 1000000;
+    u64State = (argc > 3) ? strtoull(argv[3], NULL, 10) : 0x41544746555A5AULL;
+    if (u64State == 0)
+        u64State = 1;
+    if (fnLoadCorpus(argv[1]) != 0)
+    {
+        return 2;
+    }
+
+    long alResults[ATG_PARSE_E_TRAILING + 1] = {0};
+    long lMismatched = 0, lUnnoticed = 0;
+
+    // The seeds themselves, then mutants of them
+    for (int i = 0; i < wSeeds; i++)
+    {
+        Seed *pstSeed = &astSeeds[i];
+        int wResult = fnFuzzOne(pstSeed->au8Frame, pstSeed->szLength, &pstSeed->stData);
+        if (wResult < 0)
+            return 1;
+        pstSeed->bValid = (wResult == ATG_PARSE_OK && !pstSeed->stData.checksum_mismatch);
+        printf("  %-16s %s\n", pstSeed->achName, fnAtgParseResultName(wResult));
+    }
+
+    for (long n = 0; n < lIterations; n++)
+    {
+        const Seed *pstSeed = &astSeeds[fnRandom((uint32_t)wSeeds)];
+        uint8_t au8Frame[FUZZ_MAX_FRAME];
+        size_t szLength = pstSeed->szLength;
+        memcpy(au8Frame, pstSeed->au8Frame, szLength);
+
+        int wMutations = 1 + (int)fnRandom(4);
+        for (int m = 0; m < wMutations; m++)
+            fnMutate(au8Frame, &szLength);
+
+        AtgData stData;
+        int wResult = fnFuzzOne(au8Frame, szLength, &stData);
+        if (wResult < 0)
+            return 1;
+        alResults[wResult]++;
+
+        if (wResult == ATG_PARSE_OK)
+        {
+            const AtgData *pstSeedData = &pstSeed->stData;
+            if (stData.checksum_mismatch)
+                lMismatched++;
+            else if (pstSeed->bValid &&
+                     (stData.address != pstSeedData->address || stData.status != pstSeedData->status ||
+                      stData.temperature != pstSeedData->temperature || stData.product != pstSeedData->product ||
+                      stData.water != pstSeedData->water))
+                lUnnoticed++;
+        }
+    }
+
+    printf("atg_fuzz: %d seed(s), %ld mutant(s), no violations\n", wSeeds, lIterations);
+    for (int r = 0; r <= ATG_PARSE_E_TRAILING; r++)
+    {
+        if (alResults[r])
+            printf("  %-20s %ld\n", fnAtgParseResultName(r), alResults[r]);
+    }
+    printf("  accepted with a checksum mismatch %ld, changed readings the checksum did not catch %ld\n", lMismatched,
+           lUnnoticed);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,118 @@
+/**
+ * Serial Framer
+ *
+ * Pushes response streams through the framer the way the bus worker does,
+ * in one burst and split byte by byte, and checks the frames that come out
+ * and the resync counter: noise ahead of a response (the RS-485 turnaround
+ * glitch) must cost only the noise, noise inside a response only that
+ * response, and back-to-back responses must all arrive.
+ *
+ * Usage: framer_test
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "framer.h"
+
+#define FRAME_A "83731N0=+253=1500.0=12.0=1314"
+#define FRAME_B "83727N0=+187=812.3=0.0=1234"
+
+typedef struct {
+    const char *achName;
+    const char *achStream;
+    uint16_t u16Length; // Stream length, the NULs included
+    const char *aachFrames[4];
+    uint32_t u32Resyncs;
+} FramerCase;
+
+#define STREAM(s) s, (uint16_t)(sizeof(s) - 1)
+
+static const FramerCase astCases[] = {
+    {"clean", STREAM(FRAME_A "\r\n"), {FRAME_A}, 0},
+    {"nul before", STREAM("\x00" FRAME_A "\r\n"), {FRAME_A}, 1},
+    {"0xff before", STREAM("\xff" FRAME_A "\r\n"), {FRAME_A}, 1},
+    {"burst before", STREAM("\x00\xff\x00\x80" FRAME_A "\r\n"), {FRAME_A}, 4},
+    {"noise inside", STREAM("83731N0=+253\xff=1500.0=12.0=1314\r\n" FRAME_B "\r\n"), {FRAME_B}, 1},
+    {"noise before \\r", STREAM(FRAME_A "\x00\r\n" FRAME_B "\r\n"), {FRAME_B}, 1},
+    {"back to back", STREAM(FRAME_A "\r\n" FRAME_B "\r\n" FRAME_A "\r\n"), {FRAME_A, FRAME_B, FRAME_A}, 0},
+    {"noise between", STREAM(FRAME_A "\r\n\x00\xff" FRAME_B "\r\n"), {FRAME_A, FRAME_B}, 2},
+    {"bare \\n", STREAM(FRAME_A "\n" FRAME_B "\n"), {FRAME_A, FRAME_B}, 0},
+    {"garbage before \\r", STREAM("??\r" FRAME_A "\r\n"), {FRAME_A}, 1},
+};
+#define CASE_COUNT ((int)(sizeof(astCases) / sizeof(astCases[0])))
+
+static int wFailures = 0;
+
+static void fnCheck(bool bOk, const char *achWhat, const char *achCase, const char *achSplit)
+{
+    if (!bOk)
+    {
+        printf("FAIL %s (%s): %s\n", achCase, achSplit, achWhat);
+        wFailures++;
+    }
+}
+
+// Feed a case in bursts of u16Burst bytes and compare what comes out
+static void fnRunCase(const FramerCase *pstCase, uint16_t u16Burst, const char *achSplit)
+{
+    Framer stFramer;
+    uint8_t au8Frame[FRAMER_MAX_FRAME + 1];
+    int wFrames = 0;
+
+    fnFramerInit(&stFramer);
+    for (uint16_t u16At = 0; u16At < pstCase->u16Length; u16At += u16Burst)
+    {
+        uint16_t u16Length = pstCase->u16Length - u16At;
+        if (u16Length > u16Burst)
+            u16Length = u16Burst;
+        fnFramerPush(&stFramer, (const uint8_t *)pstCase->achStream + u16At, u16Length);
+
+        uint16_t u16FrameLength;
+        while ((u16FrameLength = fnFramerNext(&stFramer, au8Frame, sizeof(au8Frame))) > 0)
+        {
+            const char *achExpected = (wFrames < 4) ? pstCase->aachFrames[wFrames] : NULL;
+            fnCheck(achExpected != NULL, "unexpected frame", pstCase->achName, achSplit);
+            if (achExpected != NULL)
+                fnCheck(strcmp((const char *)au8Frame, achExpected) == 0 && u16FrameLength == strlen(achExpected),
+                        "wrong frame", pstCase->achName, achSplit);
+            wFrames++;
+        }
+    }
+
+    int wExpected = 0;
+    while (wExpected < 4 && pstCase->aachFrames[wExpected] != NULL)
+        wExpected++;
+    fnCheck(wFrames == wExpected, "frame missing", pstCase->achName, achSplit);
+    fnCheck(stFramer.u32Frames == (uint32_t)wExpected, "frame count", pstCase->achName, achSplit);
+    fnCheck(stFramer.u32Resyncs == pstCase->u32Resyncs, "resync count", pstCase->achName, achSplit);
+    fnCheck(fnFramerPending(&stFramer) == 0, "bytes left pending", pstCase->achName, achSplit);
+}
+
+// A new poll drops an unanswered partial frame, not a glitch that went before it
+static void fnTestDropPartial(void)
+{
+    Framer stFramer;
+    uint8_t au8Frame[FRAMER_MAX_FRAME + 1];
+
+    fnFramerInit(&stFramer);
+    fnFramerPush(&stFramer, (const uint8_t *)"\xff" "83731N0=+2", 11);
+    fnCheck(fnFramerPending(&stFramer) == 10, "partial frame not kept", "drop partial", "burst");
+    fnFramerDropPartial(&stFramer);
+    fnFramerPush(&stFramer, (const uint8_t *)FRAME_B "\r\n", sizeof(FRAME_B "\r\n") - 1);
+    fnCheck(fnFramerNext(&stFramer, au8Frame, sizeof(au8Frame)) > 0 && strcmp((const char *)au8Frame, FRAME_B) == 0,
+            "next response lost", "drop partial", "burst");
+    fnCheck(stFramer.u32Resyncs == 2, "resync count", "drop partial", "burst");
+}
+
+int main(void)
+{
+    for (int i = 0; i < CASE_COUNT; i++)
+    {
+        fnRunCase(&astCases[i], astCases[i].u16Length, "burst");
+        fnRunCase(&astCases[i], 1, "bytewise");
+    }
+    fnTestDropPartial();
+    printf("framer_test: %d case(s), %d failure(s)\n", CASE_COUNT + 1, wFailures);
+    return wFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,377 @@
+/**
+ * Packed Payload Round Trip
+ *
+ * Encodes readings and batches with payload.c, decodes them again and
+ * compares every field against the expected fixed-point value, including
+ * saturation at the field limits, the "no volume" marker, older record
+ * versions and malformed payloads. With a file argument the same buffers
+ * and their expected readings are written as JSON for tests/payload_test.js,
+ * which runs the server's decoder (packed_payload.js) over them.
+ *
+ * Usage: payload_test [vectors.json]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include "payload.h"
+
+#define BATCH_MAX 64
+#define VECTORS_MAX 64
+
+typedef struct {
+    const char *achName;
+    AtgData stIn;
+    // Expected after the round trip
+    double dbProduct;
+    int water;
+    double dbTemp;
+    bool bVolume;
+    double dbVolume;
+    double dbUllage;
+    bool bStdVolume;
+    double dbStdVolume;
+} ReadingCase;
+
+typedef struct {
+    const char *achName;
+    uint8_t au8Buffer[1024];
+    size_t szLength;
+    int wCases; // Readings from astCases in the payload, -1 for a buffer that must be rejected
+    int awCases[BATCH_MAX];
+    const char *achStation;
+} Vector;
+
+static ReadingCase astCases[] = {
+    {"typical", {83731, 0, 25.30f, 1500.00f, 12, 0, false, 1760000000123LL, 20250.55, 4749.45, 20118.02},
+     1500.00, 12, 25.30, true, 20250.55, 4749.45, true, 20118.02},
+    {"no chart", {83727, 3, 18.75f, 812.34f, 0, 0, false, 1760000000000LL, -1, -1, -1},
+     812.34, 0, 18.75, false, 0, 0, false, 0},
+    {"no density", {83728, 0, 31.00f, 2400.10f, 5, 0, false, 1760000000999LL, 41000.00, 0.00, -1},
+     2400.10, 5, 31.00, true, 41000.00, 0.00, false, 0},
+    {"not timestamped", {1, 65535, 0.00f, 0.00f, 0, 0, false, 0, 0.00, 0.00, 0.00},
+     0.00, 0, 0.00, true, 0.00, 0.00, true, 0.00},
+    {"cold", {99999, 1, -40.25f, 3.50f, 0, 0, false, 1, 0.49, 55000.00, 0.50},
+     3.50, 0, -40.25, true, 0.49, 55000.00, true, 0.50},
+    {"rounding", {12345, 0, 20.004f, 1234.566f, 7, 0, false, 1760000000000LL, 100.004, 200.006, 99.996},
+     1234.57, 7, 20.00, true, 100.00, 200.01, true, 100.00},
+    {"saturated high", {54321, 0, 400.0f, 3.0e8f, 30000000, 0, false, 253402300799999LL, 3.0e7, 3.0e7, 3.0e7},
+     INT32_MAX / 100.0, (int)lround(INT32_MAX / 100.0), INT16_MAX / 100.0, true, INT32_MAX / 100.0,
+     INT32_MAX / 100.0, true, INT32_MAX / 100.0},
+    {"saturated low", {54322, 0, -400.0f, -3.0e8f, -30000000, 0, false, 1760000000000LL, 0.00, -3.0e7, 0.00},
+     INT32_MIN / 100.0, (int)lround(INT32_MIN / 100.0), INT16_MIN / 100.0, true, 0.00, (INT32_MIN + 1) / 100.0,
+     true, 0.00},
+};
+#define CASE_COUNT ((int)(sizeof(astCases) / sizeof(astCases[0])))
+
+static Vector astVectors[VECTORS_MAX];
+static int wVectors = 0;
+static int wFailures = 0;
+
+// Readings delivered by the decoder
+static AtgData astDecoded[BATCH_MAX];
+static char aachTopics[BATCH_MAX][256];
+static int wDecoded = 0;
+
+static void fnCheck(bool bOk, const char *achWhat, const char *achCase)
+{
+    if (!bOk)
+    {
+        printf("FAIL %s: %s\n", achCase, achWhat);
+        wFailures++;
+    }
+}
+
+// Within the 0.01 resolution, or float precision for values beyond it
+static bool fnNear(double dbA, double dbB)
+{
+    return fabs(dbA - dbB) < 0.006 || fabs(dbA - dbB) < 1e-6 * fabs(dbB);
+}
+
+static void fnCollect(const char *achTopic, const AtgData *pstData, void *pvContext)
+{
+    (void)pvContext;
+    if (wDecoded < BATCH_MAX)
+    {
+        snprintf(aachTopics[wDecoded], sizeof(aachTopics[wDecoded]), "%s", achTopic);
+        astDecoded[wDecoded++] = *pstData;
+    }
+}
+
+static void fnCheckReading(const ReadingCase *pstCase, const AtgData *pstOut)
+{
+    const char *achName = pstCase->achName;
+    fnCheck(pstOut->address == pstCase->stIn.address, "address", achName);
+    fnCheck(pstOut->status == pstCase->stIn.status, "status", achName);
+    fnCheck(fnNear(pstOut->product, pstCase->dbProduct), "product", achName);
+    fnCheck(pstOut->water == pstCase->water, "water", achName);
+    fnCheck(fnNear(pstOut->temperature, pstCase->dbTemp), "temperature", achName);
+    fnCheck(pstOut->timestamp == pstCase->stIn.timestamp, "timestamp", achName);
+    fnCheck((pstOut->volume >= 0) == pstCase->bVolume, "volume present", achName);
+    if (pstCase->bVolume)
+    {
+        fnCheck(fnNear(pstOut->volume, pstCase->dbVolume), "volume", achName);
+        fnCheck(fnNear(pstOut->ullage, pstCase->dbUllage), "ullage", achName);
+    }
+    fnCheck((pstOut->std_volume >= 0) == pstCase->bStdVolume, "std volume present", achName);
+    if (pstCase->bStdVolume)
+    {
+        fnCheck(fnNear(pstOut->std_volume, pstCase->dbStdVolume), "std volume", achName);
+    }
+}
+
+static Vector *fnAddVector(const char *achName, const uint8_t *pu8Buffer, size_t szLength)
+{
+    Vector *pstVector = &astVectors[wVectors++];
+    memset(pstVector, 0, sizeof(Vector));
+    pstVector->achName = achName;
+    memcpy(pstVector->au8Buffer, pu8Buffer, szLength);
+    pstVector->szLength = szLength;
+    pstVector->wCases = -1;
+    pstVector->achStation = "";
+    return pstVector;
+}
+
+// Decode a payload that must be rejected with wError
+static void fnExpectError(const char *achName, const uint8_t *pu8Buffer, size_t szLength, int wError)
+{
+    wDecoded = 0;
+    int rc = fnPayloadUnpack(pu8Buffer, szLength, NULL, 0, fnCollect, NULL);
+    if (rc != wError)
+    {
+        printf("FAIL %s: returned %d, expected %d\n", achName, rc, wError);
+        wFailures++;
+    }
+    if (wVectors < VECTORS_MAX)
+        fnAddVector(achName, pu8Buffer, szLength);
+}
+
+static void fnTestSingle(void)
+{
+    uint8_t au8Buffer[64];
+
+    for (int i = 0; i < CASE_COUNT; i++)
+    {
+        int wLength = fnPayloadPackReading(au8Buffer, sizeof(au8Buffer), &astCases[i].stIn);
+        fnCheck(wLength == PAYLOAD_HEADER_SIZE + PAYLOAD_READING_SIZE, "single length", astCases[i].achName);
+        fnCheck(au8Buffer[0] == PAYLOAD_MAGIC && au8Buffer[1] == PAYLOAD_VERSION, "header", astCases[i].achName);
+
+        wDecoded = 0;
+        int rc = fnPayloadUnpack(au8Buffer, (size_t)wLength, NULL, 0, fnCollect, NULL);
+        fnCheck(rc == 1 && wDecoded == 1 && aachTopics[0][0] == '\0', "single decode", astCases[i].achName);
+        fnCheckReading(&astCases[i], &astDecoded[0]);
+
+        Vector *pstVector = fnAddVector(astCases[i].achName, au8Buffer, (size_t)wLength);
+        pstVector->wCases = 1;
+        pstVector->awCases[0] = i;
+    }
+
+    fnCheck(fnPayloadPackReading(au8Buffer, PAYLOAD_HEADER_SIZE + PAYLOAD_READING_SIZE - 1, &astCases[0].stIn) == -1,
+            "reading into a short buffer", "single");
+}
+
+static void fnTestBatch(void)
+{
+    static const char *aachBatchTopics[] = {"ATG83731", "", "tank/with/a/long/topic/name"};
+    uint8_t au8Buffer[1024];
+    char achStation[64];
+
+    int wUsed = fnPayloadPackBatchBegin(au8Buffer, sizeof(au8Buffer), "ATGSTATION");
+    fnCheck(wUsed == PAYLOAD_HEADER_SIZE + 1 + 10, "batch begin", "batch");
+    for (int i = 0; i < CASE_COUNT; i++)
+    {
+        wUsed = fnPayloadPackBatchAdd(au8Buffer, sizeof(au8Buffer), (size_t)wUsed, aachBatchTopics[i % 3],
+                                      &astCases[i].stIn);
+        fnCheck(wUsed > 0, "batch add", astCases[i].achName);
+    }
+    fnCheck(au8Buffer[3] == CASE_COUNT, "batch count", "batch");
+
+    wDecoded = 0;
+    int rc = fnPayloadUnpack(au8Buffer, (size_t)wUsed, achStation, sizeof(achStation), fnCollect, NULL);
+    fnCheck(rc == CASE_COUNT && wDecoded == CASE_COUNT, "batch decode", "batch");
+    fnCheck(strcmp(achStation, "ATGSTATION") == 0, "station", "batch");
+    for (int i = 0; i < wDecoded; i++)
+    {
+        fnCheck(strcmp(aachTopics[i], aachBatchTopics[i % 3]) == 0, "topic", astCases[i].achName);
+        fnCheckReading(&astCases[i], &astDecoded[i]);
+    }
+
+    Vector *pstVector = fnAddVector("batch", au8Buffer, (size_t)wUsed);
+    pstVector->wCases = CASE_COUNT;
+    pstVector->achStation = "ATGSTATION";
+    for (int i = 0; i < CASE_COUNT; i++)
+        pstVector->awCases[i] = i;
+
+    // A reading that does not fit leaves the batch as it was
+    int wFull = fnPayloadPackBatchAdd(au8Buffer, (size_t)wUsed + PAYLOAD_READING_SIZE, (size_t)wUsed, "ATG1",
+                                      &astCases[0].stIn);
+    fnCheck(wFull == -1 && au8Buffer[3] == CASE_COUNT, "batch overflow", "batch");
+
+    // An empty batch is valid
+    wUsed = fnPayloadPackBatchBegin(au8Buffer, sizeof(au8Buffer), "S");
+    rc = fnPayloadUnpack(au8Buffer, (size_t)wUsed, achStation, sizeof(achStation), fnCollect, NULL);
+    fnCheck(rc == 0 && strcmp(achStation, "S") == 0, "empty batch", "batch");
+    pstVector = fnAddVector("empty batch", au8Buffer, (size_t)wUsed);
+    pstVector->wCases = 0;
+    pstVector->achStation = "S";
+
+    // At most 255 readings
+    static uint8_t au8Large[PAYLOAD_HEADER_SIZE + 2 + 256 * (1 + PAYLOAD_READING_SIZE)];
+    wUsed = fnPayloadPackBatchBegin(au8Large, sizeof(au8Large), "S");
+    for (int i = 0; i < 255; i++)
+        wUsed = fnPayloadPackBatchAdd(au8Large, sizeof(au8Large), (size_t)wUsed, "", &astCases[0].stIn);
+    fnCheck(wUsed > 0 && fnPayloadPackBatchAdd(au8Large, sizeof(au8Large), (size_t)wUsed, "", &astCases[0].stIn) == -1,
+            "256th reading", "batch");
+}
+
+// Records of versions 1 and 2 are prefixes of the current record
+static void fnTestVersions(void)
+{
+    uint8_t au8Buffer[64];
+    const ReadingCase *pstCase = &astCases[0];
+
+    fnPayloadPackReading(au8Buffer, sizeof(au8Buffer), &pstCase->stIn);
+    for (int wVersion = 1; wVersion <= 2; wVersion++)
+    {
+        size_t szLength = PAYLOAD_HEADER_SIZE + ((wVersion == 1) ? PAYLOAD_READING_SIZE_V1 : PAYLOAD_READING_SIZE_V2);
+        au8Buffer[1] = (uint8_t)wVersion;
+        wDecoded = 0;
+        int rc = fnPayloadUnpack(au8Buffer, szLength, NULL, 0, fnCollect, NULL);
+        fnCheck(rc == 1 && wDecoded == 1, "old version decode", wVersion == 1 ? "version 1" : "version 2");
+        fnCheck(astDecoded[0].address == pstCase->stIn.address && fnNear(astDecoded[0].product, pstCase->dbProduct),
+                "old version fields", wVersion == 1 ? "version 1" : "version 2");
+        fnCheck((astDecoded[0].volume >= 0) == (wVersion == 2), "old version volume",
+                wVersion == 1 ? "version 1" : "version 2");
+        fnCheck(astDecoded[0].std_volume < 0, "old version std volume", wVersion == 1 ? "version 1" : "version 2");
+
+        Vector *pstVector = fnAddVector(wVersion == 1 ? "version 1" : "version 2", au8Buffer, szLength);
+        pstVector->wCases = 1;
+        pstVector->awCases[0] = 0;
+    }
+}
+
+static void fnTestMalformed(void)
+{
+    uint8_t au8Good[64], au8Bad[128];
+    int wLength = fnPayloadPackReading(au8Good, sizeof(au8Good), &astCases[0].stIn);
+
+    memcpy(au8Bad, au8Good, (size_t)wLength);
+    au8Bad[1] = 0;
+    fnExpectError("version 0", au8Bad, (size_t)wLength, PAYLOAD_E_VERSION);
+    au8Bad[1] = PAYLOAD_VERSION + 1;
+    fnExpectError("next version", au8Bad, (size_t)wLength, PAYLOAD_E_VERSION);
+
+    memcpy(au8Bad, au8Good, (size_t)wLength);
+    au8Bad[0] = '{';
+    fnExpectError("JSON", au8Bad, (size_t)wLength, PAYLOAD_E_MAGIC);
+
+    memcpy(au8Bad, au8Good, (size_t)wLength);
+    au8Bad[2] = 3;
+    fnExpectError("unknown kind", au8Bad, (size_t)wLength, PAYLOAD_E_KIND);
+
+    memcpy(au8Bad, au8Good, (size_t)wLength);
+    au8Bad[3] = 2;
+    fnExpectError("single with count 2", au8Bad, (size_t)wLength, PAYLOAD_E_SHORT);
+
+    memcpy(au8Bad, au8Good, (size_t)wLength);
+    au8Bad[wLength] = 0;
+    fnExpectError("trailing byte", au8Bad, (size_t)wLength + 1, PAYLOAD_E_TRAILING);
+
+    fnExpectError("empty", au8Good, 0, PAYLOAD_E_SHORT);
+    fnExpectError("header only", au8Good, PAYLOAD_HEADER_SIZE, PAYLOAD_E_SHORT);
+
+    // Every truncation of a batch is rejected
+    int wUsed = fnPayloadPackBatchBegin(au8Bad, sizeof(au8Bad), "ATGSTATION");
+    wUsed = fnPayloadPackBatchAdd(au8Bad, sizeof(au8Bad), (size_t)wUsed, "ATG83731", &astCases[0].stIn);
+    for (int i = 0; i < wUsed; i++)
+    {
+        wDecoded = 0;
+        int rc = fnPayloadUnpack(au8Bad, (size_t)i, NULL, 0, fnCollect, NULL);
+        if (rc >= 0)
+        {
+            printf("FAIL batch cut to %d bytes: accepted\n", i);
+            wFailures++;
+        }
+    }
+    fnExpectError("batch cut in its record", au8Bad, (size_t)wUsed - 1, PAYLOAD_E_SHORT);
+    fnExpectError("batch cut in its topic", au8Bad, PAYLOAD_HEADER_SIZE + 1 + 10 + 4, PAYLOAD_E_SHORT);
+}
+
+static void fnWriteReading(FILE *pFile, const ReadingCase *pstCase, int wVersion)
+{
+    fprintf(pFile, "{\"Address\": \"%d\", \"Status\": \"%d\", \"Temp\": %.2f, \"Product\": %.2f, \"Water\": %d",
+            pstCase->stIn.address, pstCase->stIn.status, pstCase->dbTemp, pstCase->dbProduct, pstCase->water);
+    if (pstCase->stIn.timestamp > 0)
+        fprintf(pFile, ", \"TimestampMs\": %lld", (long long)pstCase->stIn.timestamp);
+    if (pstCase->bVolume && wVersion >= 2)
+        fprintf(pFile, ", \"Volume\": %.2f, \"Ullage\": %.2f", pstCase->dbVolume, pstCase->dbUllage);
+    if (pstCase->bStdVolume && wVersion >= 3)
+        fprintf(pFile, ", \"StdVolume\": %.2f", pstCase->dbStdVolume);
+    fprintf(pFile, "}");
+}
+
+// The buffers and what they hold, for the server's decoder
+static int fnWriteVectors(const char *achPath)
+{
+    static const char *aachBatchTopics[] = {"ATG83731", "", "tank/with/a/long/topic/name"};
+    FILE *pFile = fopen(achPath, "w");
+    if (pFile == NULL)
+    {
+        printf("Cannot write %s\n", achPath);
+        return -1;
+    }
+
+    fprintf(pFile, "[\n");
+    for (int v = 0; v < wVectors; v++)
+    {
+        const Vector *pstVector = &astVectors[v];
+        fprintf(pFile, "  {\"name\": \"%s\", \"hex\": \"", pstVector->achName);
+        for (size_t i = 0; i < pstVector->szLength; i++)
+            fprintf(pFile, "%02x", pstVector->au8Buffer[i]);
+        fprintf(pFile, "\", ");
+
+        int wVersion = (pstVector->szLength > 1) ? pstVector->au8Buffer[1] : 0;
+        if (pstVector->wCases < 0)
+        {
+            fprintf(pFile, "\"error\": true");
+        }
+        else if (pstVector->au8Buffer[2] == PAYLOAD_KIND_READING)
+        {
+            fprintf(pFile, "\"reading\": ");
+            fnWriteReading(pFile, &astCases[pstVector->awCases[0]], wVersion);
+        }
+        else
+        {
+            fprintf(pFile, "\"station\": \"%s\", \"readings\": [", pstVector->achStation);
+            for (int i = 0; i < pstVector->wCases; i++)
+            {
+                fprintf(pFile, "%s{\"Topic\": \"%s\", \"Reading\": ", i ? ", " : "", aachBatchTopics[i % 3]);
+                fnWriteReading(pFile, &astCases[pstVector->awCases[i]], wVersion);
+                fprintf(pFile, "}");
+            }
+            fprintf(pFile, "]");
+        }
+        fprintf(pFile, "}%s\n", (v + 1 < wVectors) ? "," : "");
+    }
+    fprintf(pFile, "]\n");
+    fclose(pFile);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    fnTestSingle();
+    fnTestBatch();
+    fnTestVersions();
+    fnTestMalformed();
+
+    if (argc > 1 && fnWriteVectors(argv[1]) != 0)
+    {
+        return 1;
+    }
+
+    printf("payload_test: %d vector(s), %d failure(s)\n", wVectors, wFailures);
+    return wFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,61 @@
+/**
+ * Packed Payload Decoder Test
+ * Runs the server's decoder (packed_payload.js) over the buffers written by
+ * tests/payload_test.c and compares every field with what the C encoder was
+ * given. Usage: node tests/payload_test.js vectors.json
+ */
+
+const fs = require('fs');
+const path = require('path');
+const { decodePackedPayload } = require(path.join(__dirname, '..', 'packed_payload'));
+
+const vectors = JSON.parse(fs.readFileSync(process.argv[2] || 'payload_vectors.json', 'utf8'));
+let failures = 0;
+
+function fail(name, what) {
+  console.log(`FAIL ${name}: ${what}`);
+  failures++;
+}
+
+function checkReading(name, got, expected) {
+  for (const key of ['Address', 'Status']) {
+    if (got[key] !== expected[key]) fail(name, `${key} ${got[key]} != ${expected[key]}`);
+  }
+  for (const key of ['Temp', 'Product', 'Volume', 'Ullage', 'StdVolume']) {
+    if ((key in got) !== (key in expected)) fail(name, `${key} ${key in got ? 'unexpected' : 'missing'}`);
+    else if (key in got && Math.abs(got[key] - expected[key]) > 0.006) fail(name, `${key} ${got[key]} != ${expected[key]}`);
+  }
+  // Water is whole millimetres on the device
+  if (Math.round(got.Water) !== expected.Water) fail(name, `Water ${got.Water} != ${expected.Water}`);
+  const timestamp = expected.TimestampMs ? new Date(expected.TimestampMs).toISOString() : undefined;
+  if (got.Timestamp !== timestamp) fail(name, `Timestamp ${got.Timestamp} != ${timestamp}`);
+}
+
+for (const vector of vectors) {
+  const buf = Buffer.from(vector.hex, 'hex');
+  let decoded;
+  try {
+    decoded = decodePackedPayload(buf);
+  } catch (e) {
+    if (!vector.error) fail(vector.name, e.message);
+    continue;
+  }
+  if (vector.error) {
+    fail(vector.name, 'accepted');
+  } else if (vector.reading) {
+    checkReading(vector.name, decoded, vector.reading);
+  } else {
+    if (decoded.Station !== vector.station) fail(vector.name, `Station ${decoded.Station}`);
+    if (decoded.Readings.length !== vector.readings.length) {
+      fail(vector.name, `${decoded.Readings.length} readings`);
+      continue;
+    }
+    vector.readings.forEach((entry, i) => {
+      if (decoded.Readings[i].Topic !== entry.Topic) fail(vector.name, `Topic ${decoded.Readings[i].Topic}`);
+      checkReading(`${vector.name}[${i}]`, decoded.Readings[i], entry.Reading);
+    });
+  }
+}
+
+console.log(`payload_test.js: ${vectors.length} vector(s), ${failures} failure(s)`);
+process.exit(failures === 0 ? 0 : 1);
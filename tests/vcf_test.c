@@ -0,0 +1,194 @@
+/**
+ * Volume Correction Accuracy
+ *
+ * Checks fnVcfFactor against Table 54A, 54B and 54D reference factors at
+ * the four decimals the printed tables carry, covering every 54B density
+ * band (its transition zone included), both density edges of each class
+ * and both temperature edges of the table. The references are the
+ * tables' defining equation evaluated with each class's constants, as in
+ * vcf.c's header, and rounded to four decimals.
+ *
+ * It then sweeps every class over its density range (0.5 kg/m3 steps) and
+ * the whole temperature range (0.1 C steps) and checks the interpolated
+ * factor against the exact equation, which vcf.c promises to within 1e-6.
+ * Densities and temperatures outside the table must give no correction,
+ * and each 54B band boundary must belong to the band above it.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+#include "vcf.h"
+
+#define VCF_PRINTED_HALF_UNIT 0.00005 // Half the last printed decimal
+#define VCF_INTERPOLATION_MAX 1e-6
+
+typedef struct {
+    VcfProduct eProduct;
+    double dbDensity;     // kg/m3 at 15 C
+    double dbTemperature; // C
+    double dbVcf;         // Table value, four decimals
+} VcfReference;
+
+static const VcfReference astReferences[] = {
+    // 54A crude oil
+    {VCF_PRODUCT_CRUDE, 610.5, -30, 1.0722},
+    {VCF_PRODUCT_CRUDE, 610.5, 80, 0.8903},
+    {VCF_PRODUCT_CRUDE, 700.0, 40, 0.9684},
+    {VCF_PRODUCT_CRUDE, 850.0, 0, 1.0127},
+    {VCF_PRODUCT_CRUDE, 850.0, 30, 0.9872},
+    {VCF_PRODUCT_CRUDE, 1075.0, -30, 1.0237},
+    {VCF_PRODUCT_CRUDE, 1075.0, 80, 0.9651},
+    // 54B gasolines
+    {VCF_PRODUCT_REFINED, 653.0, -30, 1.0653},
+    {VCF_PRODUCT_REFINED, 653.0, 40, 0.9625},
+    {VCF_PRODUCT_REFINED, 720.0, 25, 0.9872},
+    {VCF_PRODUCT_REFINED, 750.0, 30, 0.9819},
+    {VCF_PRODUCT_REFINED, 770.0, 15, 1.0000},
+    // 54B transition zone
+    {VCF_PRODUCT_REFINED, 770.5, 30, 0.9826},
+    {VCF_PRODUCT_REFINED, 775.0, -10, 1.0272},
+    {VCF_PRODUCT_REFINED, 780.0, 35, 0.9790},
+    {VCF_PRODUCT_REFINED, 787.0, 50, 0.9659},
+    // 54B jet fuels and kerosene
+    {VCF_PRODUCT_REFINED, 787.5, 30, 0.9856},
+    {VCF_PRODUCT_REFINED, 800.0, 40, 0.9766},
+    {VCF_PRODUCT_REFINED, 838.0, 25, 0.9915},
+    // 54B fuel oils
+    {VCF_PRODUCT_REFINED, 838.5, 30, 0.9873},
+    {VCF_PRODUCT_REFINED, 850.0, 30, 0.9875},
+    {VCF_PRODUCT_REFINED, 900.0, 50, 0.9728},
+    {VCF_PRODUCT_REFINED, 1075.0, -30, 1.0274},
+    {VCF_PRODUCT_REFINED, 1075.0, 80, 0.9596},
+    // 54D lubricating oils
+    {VCF_PRODUCT_LUBE, 800.0, -30, 1.0349},
+    {VCF_PRODUCT_LUBE, 800.0, 40, 0.9803},
+    {VCF_PRODUCT_LUBE, 900.0, 60, 0.9683},
+    {VCF_PRODUCT_LUBE, 1164.0, -30, 1.0241},
+    {VCF_PRODUCT_LUBE, 1164.0, 80, 0.9646},
+};
+#define REFERENCE_COUNT ((int)(sizeof(astReferences) / sizeof(astReferences[0])))
+
+// Density range of each class's table
+static const double aadbDensityRange[3][2] = {{653.0, 1075.0}, {610.5, 1075.0}, {800.0, 1164.0}};
+
+static int wFailures = 0;
+
+static double fnExactVcf(VcfProduct eProduct, double dbDensity, double dbTemperature)
+{
+    double dbAlpha = fnVcfAlpha(eProduct, dbDensity);
+    double dbDelta = dbTemperature - 15.0;
+    return exp(-dbAlpha * dbDelta * (1.0 + 0.8 * dbAlpha * dbDelta));
+}
+
+static void fnTestReferences(void)
+{
+    for (int i = 0; i < REFERENCE_COUNT; i++)
+    {
+        const VcfReference *pstRef = &astReferences[i];
+        VcfCurve stCurve;
+        double dbVcf = -1;
+        if (fnVcfCurve(&stCurve, pstRef->eProduct, pstRef->dbDensity) == 0)
+            dbVcf = fnVcfFactor(&stCurve, pstRef->dbTemperature);
+        if (fabs(dbVcf - pstRef->dbVcf) > VCF_PRINTED_HALF_UNIT + VCF_INTERPOLATION_MAX)
+        {
+            printf("FAIL %s %.1f kg/m3 at %.1f C: %.6f, table %.4f\n", fnVcfProductName(pstRef->eProduct),
+                   pstRef->dbDensity, pstRef->dbTemperature, dbVcf, pstRef->dbVcf);
+            wFailures++;
+        }
+    }
+}
+
+static void fnTestInterpolation(void)
+{
+    for (int p = 0; p < 3; p++)
+    {
+        VcfProduct eProduct = (VcfProduct)p;
+        double dbWorst = 0, dbWorstDensity = 0, dbWorstTemperature = 0;
+
+        for (double dbDensity = aadbDensityRange[p][0]; dbDensity <= aadbDensityRange[p][1]; dbDensity += 0.5)
+        {
+            VcfCurve stCurve;
+            if (fnVcfCurve(&stCurve, eProduct, dbDensity) != 0)
+            {
+                printf("FAIL %s %.1f kg/m3: inside the class but not in the table\n", fnVcfProductName(eProduct),
+                       dbDensity);
+                wFailures++;
+                continue;
+            }
+            for (int t = 0; t <= (VCF_TEMP_STEPS - 1) * 10; t++)
+            {
+                double dbTemperature = VCF_TEMP_MIN + t / 10.0;
+                double dbError = fabs(fnVcfFactor(&stCurve, dbTemperature) -
+                                      fnExactVcf(eProduct, dbDensity, dbTemperature));
+                if (dbError > dbWorst)
+                {
+                    dbWorst = dbError;
+                    dbWorstDensity = dbDensity;
+                    dbWorstTemperature = dbTemperature;
+                }
+            }
+        }
+
+        printf("  %-8s worst interpolation error %.2e at %.1f kg/m3, %.1f C\n", fnVcfProductName(eProduct), dbWorst,
+               dbWorstDensity, dbWorstTemperature);
+        if (dbWorst > VCF_INTERPOLATION_MAX)
+        {
+            printf("FAIL %s: interpolation error above %.0e\n", fnVcfProductName(eProduct), VCF_INTERPOLATION_MAX);
+            wFailures++;
+        }
+    }
+}
+
+static void fnTestEdges(void)
+{
+    VcfCurve stCurve;
+
+    for (int p = 0; p < 3; p++)
+    {
+        VcfProduct eProduct = (VcfProduct)p;
+        if (fnVcfCurve(&stCurve, eProduct, aadbDensityRange[p][0] - 0.1) == 0 ||
+            fnVcfCurve(&stCurve, eProduct, aadbDensityRange[p][1] + 0.1) == 0 || fnVcfCurve(&stCurve, eProduct, 0) == 0)
+        {
+            printf("FAIL %s: density outside the table accepted\n", fnVcfProductName(eProduct));
+            wFailures++;
+        }
+        if (stCurve.wRow != -1 || fnVcfFactor(&stCurve, 20.0) != -1.0)
+        {
+            printf("FAIL %s: rejected density still corrects\n", fnVcfProductName(eProduct));
+            wFailures++;
+        }
+    }
+
+    // The 54B bands meet almost continuously, so the tables' four decimals cannot tell which applies
+    const double adbBoundaryAlpha[3][2] = {{770.5, -0.00336312 + 2680.3206 / (770.5 * 770.5)},
+                                           {787.5, 594.5418 / (787.5 * 787.5)},
+                                           {838.5, 186.9696 / (838.5 * 838.5) + 0.4862 / 838.5}};
+    for (int b = 0; b < 3; b++)
+    {
+        if (fabs(fnVcfAlpha(VCF_PRODUCT_REFINED, adbBoundaryAlpha[b][0]) - adbBoundaryAlpha[b][1]) > 1e-12)
+        {
+            printf("FAIL 54B boundary %.1f kg/m3 in the wrong band\n", adbBoundaryAlpha[b][0]);
+            wFailures++;
+        }
+    }
+
+    fnVcfCurve(&stCurve, VCF_PRODUCT_REFINED, 850.0);
+    double dbLast = VCF_TEMP_MIN + VCF_TEMP_STEPS - 1;
+    if (fnVcfFactor(&stCurve, VCF_TEMP_MIN) < 0 || fnVcfFactor(&stCurve, dbLast) < 0 ||
+        fnVcfFactor(&stCurve, VCF_TEMP_MIN - 0.01) != -1.0 || fnVcfFactor(&stCurve, dbLast + 0.01) != -1.0 ||
+        fnVcfFactor(&stCurve, NAN) != -1.0)
+    {
+        printf("FAIL temperature edges of the table\n");
+        wFailures++;
+    }
+}
+
+int main(void)
+{
+    fnTestReferences();
+    fnTestInterpolation();
+    fnTestEdges();
+    printf("vcf_test: %d reference factor(s), %d failure(s)\n", REFERENCE_COUNT, wFailures);
+    return wFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,277 @@
+/**
+ * Serial Trace
+ *
+ * With enabled = true in the [capture] section every byte written to or
+ * read from a serial port is appended to a binary trace file, with the time
+ * it was seen. atg_replay (atg_replay.c) feeds a trace back through the
+ * framer, parser, filters and publisher, so field behaviour can be
+ * reproduced and the hot path benchmarked offline. Every multi-byte field
+ * is little-endian.
+ *
+ *   File header (16 bytes)
+ *     char magic[4]  "ATGT"
+ *     u8   version   1
+ *     u8   reserved[3]
+ *     i64  start     Wall clock of the capture start, Unix time in ms
+ *   Record header (8 bytes), then length data bytes
+ *     u32  delta     Microseconds since the previous record (saturating)
+ *     u8   kind      1 = TX, 2 = RX, 3 = port opened (data = device path)
+ *     u8   channel   Port file descriptor, which tells the buses apart
+ *     u16  length
+ *
+ * A poll and its response cost about 60 bytes of trace. Records go through
+ * a 64 KB stdio buffer under one mutex, so a bus worker only waits for the
+ * disk when that buffer fills; the tail is flushed when the poller stops.
+ * Capture stops once the file reaches max_mb. While capture is off the
+ * serial calls pay one atomic load.
+ */
+
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "config.h"
+#include "main_linux.h"
+
+#define TRACE_BUFFER_SIZE (64 * 1024)
+
+static const char achMagic[4] = {'A', 'T', 'G', 'T'};
+
+static atomic_bool bTracing;
+static pthread_mutex_t traceMutex = PTHREAD_MUTEX_INITIALIZER;
+static FILE *pTraceFile = NULL;
+static uint64_t u64TraceBytes = 0;
+static uint64_t u64TraceLimit = 0;
+static double dbLastRecordAt = 0;
+static uint32_t u32Records = 0;
+
+static void fnPutU16(uint8_t *pu8Out, uint16_t u16Value)
+{
+    pu8Out[0] = (uint8_t)u16Value;
+    pu8Out[1] = (uint8_t)(u16Value >> 8);
+}
+
+static void fnPutU32(uint8_t *pu8Out, uint32_t u32Value)
+{
+    for (int i = 0; i < 4; i++)
+        pu8Out[i] = (uint8_t)(u32Value >> (8 * i));
+}
+
+static uint16_t fnGetU16(const uint8_t *pu8In)
+{
+    return (uint16_t)(pu8In[0] | (pu8In[1] << 8));
+}
+
+static uint32_t fnGetU32(const uint8_t *pu8In)
+{
+    uint32_t u32Value = 0;
+    for (int i = 3; i >= 0; i--)
+        u32Value = (u32Value << 8) | pu8In[i];
+    return u32Value;
+}
+
+static int fnTraceConfigHandler(void *pvContext, const char *achSection, const char *achName,
+                                const char *achKey, const char *achValue, int wLine)
+{
+    TraceConfig *pstConfig = (TraceConfig *)pvContext;
+    (void)achName;
+
+    if (strcmp(achSection, "capture") != 0 || achKey[0] == '\0')
+    {
+        return 0;
+    }
+
+    if (strcmp(achKey, "enabled") == 0)
+    {
+        pstConfig->bEnabled = fnConfigParseBool(achValue);
+    }
+    else if (strcmp(achKey, "file") == 0)
+    {
+        if (achValue[0] == '\0' || strlen(achValue) >= sizeof(pstConfig->achFile))
+        {
+            printf("Config line %d: invalid capture file\n", wLine);
+            return -1;
+        }
+        strcpy(pstConfig->achFile, achValue);
+    }
+    else if (strcmp(achKey, "max_mb") == 0)
+    {
+        long lValue = strtol(achValue, NULL, 10);
+        if (lValue < 1 || lValue > 65536)
+        {
+            printf("Config line %d: max_mb must be 1 to 65536\n", wLine);
+            return -1;
+        }
+        pstConfig->u32MaxMb = (uint32_t)lValue;
+    }
+    else
+    {
+        printf("Config line %d: unknown capture key '%s' ignored\n", wLine, achKey);
+    }
+    return 0;
+}
+
+/**
+ * Read the [capture] section on top of the defaults (capture off)
+ * @return 0 on success (or missing file), >0 on parse error
+ */
+int fnTraceLoadConfig(TraceConfig *pstConfig, const char *achPath)
+{
+    pstConfig->bEnabled = false;
+    strcpy(pstConfig->achFile, TRACE_FILE);
+    pstConfig->u32MaxMb = TRACE_MAX_MB;
+    int rc = fnConfigParse(achPath, fnTraceConfigHandler, pstConfig);
+    return (rc == -1) ? 0 : rc;
+}
+
+/**
+ * Create the trace file and start capturing, if enabled
+ * @return 0 on success or when disabled, -1 if the file could not be created
+ */
+int fnTraceStart(const TraceConfig *pstConfig)
+{
+    if (!pstConfig->bEnabled)
+    {
+        return 0;
+    }
+
+    pTraceFile = fopen(pstConfig->achFile, "wb");
+    if (pTraceFile == NULL)
+    {
+        printf("[Capture] Error creating %s: %s\n", pstConfig->achFile, strerror(errno));
+        return -1;
+    }
+    setvbuf(pTraceFile, NULL, _IOFBF, TRACE_BUFFER_SIZE);
+
+    uint8_t au8Header[TRACE_HEADER_SIZE] = {0};
+    uint64_t u64Start = (uint64_t)getWallClockMs();
+    memcpy(au8Header, achMagic, sizeof(achMagic));
+    au8Header[4] = TRACE_VERSION;
+    fnPutU32(au8Header + 8, (uint32_t)u64Start);
+    fnPutU32(au8Header + 12, (uint32_t)(u64Start >> 32));
+    fwrite(au8Header, 1, sizeof(au8Header), pTraceFile);
+
+    u64TraceBytes = sizeof(au8Header);
+    u64TraceLimit = (uint64_t)pstConfig->u32MaxMb * 1024 * 1024;
+    dbLastRecordAt = getCurrentTimeMs();
+    u32Records = 0;
+    atomic_store(&bTracing, true);
+    printf("[Capture] Recording serial traffic to %s\n", pstConfig->achFile);
+    return 0;
+}
+
+/**
+ * Stop capturing and flush the trace (after the bus workers stopped)
+ */
+void fnTraceStop(void)
+{
+    atomic_store(&bTracing, false);
+    pthread_mutex_lock(&traceMutex);
+    if (pTraceFile != NULL)
+    {
+        fclose(pTraceFile);
+        pTraceFile = NULL;
+        printf("[Capture] %u record(s), %llu bytes\n", u32Records, (unsigned long long)u64TraceBytes);
+    }
+    pthread_mutex_unlock(&traceMutex);
+}
+
+/**
+ * Append one record to the trace; does nothing while capture is off
+ * @param channel Port file descriptor
+ */
+void fnTraceRecord(TraceKind eKind, int channel, const void *pvData, uint16_t u16Length)
+{
+    if (!atomic_load_explicit(&bTracing, memory_order_relaxed))
+    {
+        return;
+    }
+
+    double dbNow = getCurrentTimeMs();
+    uint8_t au8Header[TRACE_RECORD_SIZE];
+
+    pthread_mutex_lock(&traceMutex);
+    if (pTraceFile != NULL)
+    {
+        if (u64TraceBytes + sizeof(au8Header) + u16Length > u64TraceLimit)
+        {
+            printf("[Capture] Trace reached its size limit, capture stopped\n");
+            atomic_store(&bTracing, false);
+        }
+        else
+        {
+            double dbDeltaUs = (dbNow - dbLastRecordAt) * 1000.0;
+            fnPutU32(au8Header, (dbDeltaUs <= 0) ? 0 : (dbDeltaUs >= 4294967295.0) ? UINT32_MAX : (uint32_t)dbDeltaUs);
+            au8Header[4] = (uint8_t)eKind;
+            au8Header[5] = (uint8_t)channel;
+            fnPutU16(au8Header + 6, u16Length);
+            fwrite(au8Header, 1, sizeof(au8Header), pTraceFile);
+            fwrite(pvData, 1, u16Length, pTraceFile);
+            u64TraceBytes += sizeof(au8Header) + u16Length;
+            u32Records++;
+            dbLastRecordAt = dbNow;
+        }
+    }
+    pthread_mutex_unlock(&traceMutex);
+}
+
+/**
+ * Open a trace for reading and check its header
+ * @return 0 on success, -1 if it cannot be read or is not a trace
+ */
+int fnTraceReaderOpen(TraceReader *pstReader, const char *achPath)
+{
+    uint8_t au8Header[TRACE_HEADER_SIZE];
+
+    memset(pstReader, 0, sizeof(TraceReader));
+    pstReader->pFile = fopen(achPath, "rb");
+    if (pstReader->pFile == NULL)
+    {
+        printf("Error opening %s: %s\n", achPath, strerror(errno));
+        return -1;
+    }
+    if (fread(au8Header, 1, sizeof(au8Header), pstReader->pFile) != sizeof(au8Header) ||
+        memcmp(au8Header, achMagic, sizeof(achMagic)) != 0 || au8Header[4] != TRACE_VERSION)
+    {
+        printf("%s is not a version %d serial trace\n", achPath, TRACE_VERSION);
+        fnTraceReaderClose(pstReader);
+        return -1;
+    }
+    pstReader->i64StartMs = (int64_t)((uint64_t)fnGetU32(au8Header + 8) | ((uint64_t)fnGetU32(au8Header + 12) << 32));
+    return 0;
+}
+
+/**
+ * Read the next record
+ * @return 1 if a record was read, 0 at the end of the trace (a torn last record ends it too)
+ */
+int fnTraceReaderNext(TraceReader *pstReader, TraceRecord *pstRecord)
+{
+    uint8_t au8Header[TRACE_RECORD_SIZE];
+
+    if (pstReader->pFile == NULL || fread(au8Header, 1, sizeof(au8Header), pstReader->pFile) != sizeof(au8Header))
+    {
+        return 0;
+    }
+    pstReader->dbAtMs += fnGetU32(au8Header) / 1000.0;
+    pstRecord->eKind = (TraceKind)au8Header[4];
+    pstRecord->u8Channel = au8Header[5];
+    pstRecord->dbAtMs = pstReader->dbAtMs;
+    pstRecord->u16Length = fnGetU16(au8Header + 6);
+    if (fread(pstRecord->au8Data, 1, pstRecord->u16Length, pstReader->pFile) != pstRecord->u16Length)
+    {
+        return 0;
+    }
+    return 1;
+}
+
+void fnTraceReaderClose(TraceReader *pstReader)
+{
+    if (pstReader->pFile != NULL)
+    {
+        fclose(pstReader->pFile);
+        pstReader->pFile = NULL;
+    }
+}
@@ -0,0 +1,53 @@
+/**
+ * Serial Trace
+ * Timestamped capture of the raw serial traffic, and its reader for replay
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 16 // File header
+#define TRACE_RECORD_SIZE 8  // Record header, before the data
+
+typedef enum {
+    TRACE_TX = 1,  // Bytes written to a port
+    TRACE_RX = 2,  // Bytes read from a port
+    TRACE_OPEN = 3 // A port was opened; the data is its device path
+} TraceKind;
+
+typedef struct {
+    bool bEnabled;
+    char achFile[128];
+    uint32_t u32MaxMb; // Capture stops at this size
+} TraceConfig;
+
+// One record as read back
+typedef struct {
+    TraceKind eKind;
+    uint8_t u8Channel;    // Port descriptor at capture time; tells the buses apart
+    double dbAtMs;        // Since the start of the capture
+    uint16_t u16Length;
+    uint8_t au8Data[65535];
+} TraceRecord;
+
+typedef struct {
+    FILE *pFile;
+    int64_t i64StartMs; // Wall clock when the capture started (ms since epoch)
+    double dbAtMs;      // Time of the last record read
+} TraceReader;
+
+int fnTraceLoadConfig(TraceConfig *pstConfig, const char *achPath);
+int fnTraceStart(const TraceConfig *pstConfig);
+void fnTraceStop(void);
+void fnTraceRecord(TraceKind eKind, int channel, const void *pvData, uint16_t u16Length);
+
+int fnTraceReaderOpen(TraceReader *pstReader, const char *achPath);
+int fnTraceReaderNext(TraceReader *pstReader, TraceRecord *pstRecord);
+void fnTraceReaderClose(TraceReader *pstReader);
+
+#endif
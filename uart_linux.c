@@ -3,7 +3,7 @@
  * Replaces Windows-specific uart.c for ARM Linux systems
  */
 
-#include "uart.h"
+#include "uart_linux.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,8 +11,8 @@
 #include <fcntl.h>
 #include <termios.h>
 #include <errno.h>
+#include "trace.h"
 
-static int serialFd = -1;
 static char chComPort[64] = "/dev/ttyS0";
 static unsigned long chBaudRate = 9600;
 
@@ -111,7 +111,8 @@ bool fnInitComPort(int *fd, const char *portName, unsigned long baudRate)
     // Flush any pending data
     tcflush(*fd, TCIOFLUSH);
 
-    serialFd = *fd;
+    // Lets a replay tell the buses of a capture apart
+    fnTraceRecord(TRACE_OPEN, *fd, portName, (uint16_t)strlen(portName));
     return true;
 }
 
@@ -124,7 +125,6 @@ void fnCloseComPort(int fd)
     {
         close(fd);
     }
-    serialFd = -1;
 }
 
 /**
@@ -152,6 +152,7 @@ uint16_t fnUartTransmit(int *fd, uint8_t *buffer, uint16_t length)
 
     // Ensure data is transmitted
     tcdrain(*fd);
+    fnTraceRecord(TRACE_TX, *fd, buffer, (uint16_t)bytesWritten);
 
     printf("S:%s\n", buffer);
     return (uint16_t)bytesWritten;
@@ -181,9 +182,50 @@ uint16_t fnUartReceive(int *fd, uint8_t *buffer)
         return 0;
     }
 
+    if (bytesRead > 0)
+    {
+        fnTraceRecord(TRACE_RX, *fd, buffer, (uint16_t)bytesRead);
+    }
     return (uint16_t)bytesRead;
 }
 
+/**
+ * Receive everything the driver has buffered in a single read
+ * @param fd Pointer to file descriptor
+ * @param buffer Buffer to store received data
+ * @param maxLength Size of the buffer
+ * @return Number of bytes received (0 if nothing is pending), -1 if the port
+ *         is gone (e.g. an unplugged USB adapter) and must be reopened
+ */
+int fnUartReceiveBulk(int *fd, uint8_t *buffer, uint16_t maxLength)
+{
+    if (*fd < 0)
+    {
+        return 0;
+    }
+
+    ssize_t bytesRead = read(*fd, buffer, maxLength);
+
+    if (bytesRead < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        {
+            return 0;
+        }
+        printf("Error reading from serial port: %s\n", strerror(errno));
+        return -1;
+    }
+
+    // A non-blocking tty with nothing pending fails with EAGAIN; end of file means it hung up
+    if (bytesRead == 0)
+    {
+        return -1;
+    }
+
+    fnTraceRecord(TRACE_RX, *fd, buffer, (uint16_t)bytesRead);
+    return (int)bytesRead;
+}
+
 /**
  * Set COM port name
  */
@@ -12,15 +12,12 @@
 #include <stdint.h>
 
 // Linux uses int file descriptor instead of Windows HANDLE
-extern int serialFd;
-extern char chComPort[64];
-extern unsigned long chBaudRate;
-
 // Function prototypes (using int instead of HANDLE for Linux)
 bool fnInitComPort(int *fd, const char *portName, unsigned long baudRate);
 void fnCloseComPort(int fd);
 uint16_t fnUartTransmit(int *fd, uint8_t *buffer, uint16_t length);
 uint16_t fnUartReceive(int *fd, uint8_t *buffer);
+int fnUartReceiveBulk(int *fd, uint8_t *buffer, uint16_t maxLength);
 void setComPort(const char *comPort);
 void setBaudRate(unsigned long baudRate);
 void getComPort(char *comPort);
@@ -0,0 +1,143 @@
+/**
+ * Volume Correction
+ *
+ * Turns a tank's gross observed volume into standard volume at 15 C with
+ * the volume correction factors of ASTM D1250-80 / API 2540 Table 54
+ * (metric, density at 15 C in kg/m3):
+ *
+ *   a15 = K0 / rho15^2 + K1 / rho15
+ *   VCF = exp(-a15 * dT * (1 + 0.8 * a15 * dT)),  dT = t - 15
+ *
+ *   Class            Density       K0          K1
+ *   54A crude        610.5-1075    613.9723    0
+ *   54B gasoline     653-770.5     346.4228    0.4388
+ *   54B transition   770.5-787.5   a15 = -0.00336312 + 2680.3206 / rho15^2
+ *   54B jet/kerosene 787.5-838.5   594.5418    0
+ *   54B fuel oil     838.5-1075    186.9696    0.4862
+ *   54D lube         800-1164      0           0.6278
+ *
+ * A probe's density does not change between readings, so a15 and the two
+ * table rows around it are found once when the configuration is loaded
+ * (fnVcfCurve). The factors come from a table over (a15, t) written by
+ * vcf_gen at build time; a reading costs four loads and three multiply-adds
+ * instead of an exp(). Interpolation error is below 1e-6 over the whole
+ * table, well inside the four decimals the printed tables carry;
+ * tests/vcf_test.c checks both ("make test").
+ */
+
+#include "vcf.h"
+#include <string.h>
+#include <strings.h>
+#include "vcf_table.h"
+
+const char *fnVcfProductName(VcfProduct eProduct)
+{
+    switch (eProduct)
+    {
+    case VCF_PRODUCT_CRUDE:
+        return "crude";
+    case VCF_PRODUCT_LUBE:
+        return "lube";
+    default:
+        return "refined";
+    }
+}
+
+/**
+ * Parse a "product" configuration value
+ * @return 0 on success, -1 if the value names no product class
+ */
+int fnVcfParseProduct(const char *achValue, VcfProduct *peProduct)
+{
+    if (strcasecmp(achValue, "refined") == 0)
+        *peProduct = VCF_PRODUCT_REFINED;
+    else if (strcasecmp(achValue, "crude") == 0)
+        *peProduct = VCF_PRODUCT_CRUDE;
+    else if (strcasecmp(achValue, "lube") == 0)
+        *peProduct = VCF_PRODUCT_LUBE;
+    else
+        return -1;
+    return 0;
+}
+
+/**
+ * Thermal expansion coefficient at 15 C of a product
+ * @param dbDensity Density at 15 C in kg/m3
+ * @return a15 in 1/C, or 0 if the density is outside the class's table
+ */
+double fnVcfAlpha(VcfProduct eProduct, double dbDensity)
+{
+    double dbSquare = dbDensity * dbDensity;
+
+    switch (eProduct)
+    {
+    case VCF_PRODUCT_CRUDE:
+        if (dbDensity < 610.5 || dbDensity > 1075.0)
+            return 0;
+        return 613.9723 / dbSquare;
+    case VCF_PRODUCT_LUBE:
+        if (dbDensity < 800.0 || dbDensity > 1164.0)
+            return 0;
+        return 0.6278 / dbDensity;
+    default:
+        if (dbDensity < 653.0 || dbDensity > 1075.0)
+            return 0;
+        if (dbDensity < 770.5)
+            return 346.4228 / dbSquare + 0.4388 / dbDensity;
+        if (dbDensity < 787.5)
+            return -0.00336312 + 2680.3206 / dbSquare;
+        if (dbDensity < 838.5)
+            return 594.5418 / dbSquare;
+        return 186.9696 / dbSquare + 0.4862 / dbDensity;
+    }
+}
+
+/**
+ * Locate a product in the correction table
+ * @param dbDensity Density at 15 C in kg/m3
+ * @return 0 on success, -1 if the density is outside the class's table
+ *         (pstCurve then disables correction)
+ */
+int fnVcfCurve(VcfCurve *pstCurve, VcfProduct eProduct, double dbDensity)
+{
+    double dbRow = (fnVcfAlpha(eProduct, dbDensity) - VCF_ALPHA_MIN) / VCF_ALPHA_STEP;
+
+    pstCurve->wRow = -1;
+    pstCurve->fWeight = 0;
+    if (!(dbRow >= 0 && dbRow <= VCF_ALPHA_STEPS - 1))
+    {
+        return -1;
+    }
+
+    // The last row gets weight 0 towards a next row it does not have
+    pstCurve->wRow = (dbRow < VCF_ALPHA_STEPS - 1) ? (int)dbRow : VCF_ALPHA_STEPS - 2;
+    pstCurve->fWeight = (float)(dbRow - pstCurve->wRow);
+    return 0;
+}
+
+/**
+ * Volume correction factor to 15 C
+ * @param pstCurve The product, from fnVcfCurve
+ * @param dbTemperature Observed product temperature in C
+ * @return Factor to multiply observed volume by, or -1 if the product has
+ *         no correction or the temperature is outside the table
+ */
+double fnVcfFactor(const VcfCurve *pstCurve, double dbTemperature)
+{
+    double dbColumn = dbTemperature - VCF_TEMP_MIN;
+
+    // Also rejects NaN
+    if (pstCurve->wRow < 0 || !(dbColumn >= 0 && dbColumn <= VCF_TEMP_STEPS - 1))
+    {
+        return -1.0;
+    }
+
+    int j = (dbColumn < VCF_TEMP_STEPS - 1) ? (int)dbColumn : VCF_TEMP_STEPS - 2;
+    double dbV = dbColumn - j;
+    const float *pfLow = afVcfTable[pstCurve->wRow];
+    const float *pfHigh = afVcfTable[pstCurve->wRow + 1];
+
+    double dbLow = pfLow[j] + (pfLow[j + 1] - pfLow[j]) * dbV;
+    double dbHigh = pfHigh[j] + (pfHigh[j + 1] - pfHigh[j]) * dbV;
+    return dbLow + (dbHigh - dbLow) * pstCurve->fWeight;
+}
@@ -0,0 +1,35 @@
+/**
+ * Volume Correction
+ * Observed volume to standard volume at 15 C for petroleum products
+ */
+
+#ifndef VCF_H
+#define VCF_H
+
+// Correction table written by vcf_gen at build time (vcf_table.h)
+#define VCF_ALPHA_MIN 0.00050  // Lowest expansion coefficient (1/C)
+#define VCF_ALPHA_STEP 0.00002 // Coefficient step between rows
+#define VCF_ALPHA_STEPS 61     // Rows, up to 0.00170
+#define VCF_TEMP_MIN -30       // Lowest product temperature (C)
+#define VCF_TEMP_STEPS 111     // Columns 1 C apart, up to 80 C
+
+// Product classes of ASTM D1250-80 (API 2540) Table 54
+typedef enum {
+    VCF_PRODUCT_REFINED = 0, // 54B generalized products: gasoline, jet, kerosene, diesel, fuel oil
+    VCF_PRODUCT_CRUDE,       // 54A crude oil
+    VCF_PRODUCT_LUBE         // 54D lubricating oil
+} VcfProduct;
+
+// One product's place in the table, fixed by its class and density
+typedef struct {
+    int wRow;       // Table row at or below the product's a15, -1 = no correction
+    float fWeight;  // Share of the next row, 0..1
+} VcfCurve;
+
+const char *fnVcfProductName(VcfProduct eProduct);
+int fnVcfParseProduct(const char *achValue, VcfProduct *peProduct);
+double fnVcfAlpha(VcfProduct eProduct, double dbDensity);
+int fnVcfCurve(VcfCurve *pstCurve, VcfProduct eProduct, double dbDensity);
+double fnVcfFactor(const VcfCurve *pstCurve, double dbTemperature);
+
+#endif
@@ -0,0 +1,42 @@
+/**
+ * Volume Correction Table Generator
+ * Run at build time (see Makefile.orangepi) to write vcf_table.h
+ *
+ * Usage: vcf_gen > vcf_table.h
+ *
+ * The correction factor of ASTM D1250-80 / API 2540 Tables 54A, 54B and
+ * 54D depends on the product only through its thermal expansion
+ * coefficient at 15 C:
+ *
+ *   VCF = exp(-a15 * dT * (1 + 0.8 * a15 * dT)),  dT = t - 15
+ *
+ * so one table over (a15, t) serves every product class. vcf.c computes a
+ * probe's a15 once from its configured class and density, and interpolates
+ * this table per reading.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include "vcf.h"
+
+int main(void)
+{
+    printf("// Generated by vcf_gen; do not edit\n");
+    printf("// VCF to 15 C for alpha15 = %.5f + i * %.5f, t = %d + j C\n\n", VCF_ALPHA_MIN, VCF_ALPHA_STEP,
+           VCF_TEMP_MIN);
+    printf("static const float afVcfTable[VCF_ALPHA_STEPS][VCF_TEMP_STEPS] = {\n");
+    for (int i = 0; i < VCF_ALPHA_STEPS; i++)
+    {
+        double dbAlpha = VCF_ALPHA_MIN + i * VCF_ALPHA_STEP;
+        printf("    {");
+        for (int j = 0; j < VCF_TEMP_STEPS; j++)
+        {
+            double dbDelta = (VCF_TEMP_MIN + j) - 15.0;
+            double dbVcf = exp(-dbAlpha * dbDelta * (1.0 + 0.8 * dbAlpha * dbDelta));
+            printf("%s%.8ff", (j % 8 == 0) ? (j ? ",\n     " : "") : ", ", dbVcf);
+        }
+        printf("},\n");
+    }
+    printf("};\n");
+    return 0;
+}